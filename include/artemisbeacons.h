@@ -22,7 +22,161 @@ namespace Artemis {
       MagnetometerBeacon,
       GPSBeacon,
       SwitchBeacon,
+      QueueBeacon,
+      /** @brief Several beacons packed together by route_beacon_to_rfm23(). */
+      AggregateBeacon,
+      /**
+       * @brief A beacon compressed by beacon_encoder, followed by the output
+       * of BeaconEncoder::encode(). BeaconDecoder rebuilds the original.
+       */
+      CompressedBeacon,
+      AirtimeBeacon,
+      LinkBeacon,
     };
+
+    static_assert((uint8_t)BeaconType::AggregateBeacon ==
+                      BEACON_AGGREGATE_TYPE,
+                  "Aggregates must start with the AggregateBeacon type");
+    static_assert((uint8_t)BeaconType::CompressedBeacon == BEACON_CODEC_TYPE,
+                  "Compressed beacons must start with CompressedBeacon");
+
+    /** @brief The queue telemetry beacon structure. */
+    struct __attribute__((packed)) queuebeacon {
+      /** @brief The type of the beacon. */
+      BeaconType type = BeaconType::QueueBeacon;
+      /** @brief A decimal identifier for the beacon. */
+      uint32_t   deci = 0;
+      /**
+       * @brief The queue being reported.
+       *
+       * This is the Channel_ID of the channel consuming the queue, or 0 for the
+       * main channel's queue.
+       */
+      uint8_t    queue = 0;
+      /** @brief The number of packets accepted, modulo 2^16. */
+      uint16_t   enqueued = 0;
+      /** @brief The number of packets pulled, modulo 2^16. */
+      uint16_t   dequeued = 0;
+      /** @brief The number of packets lost to a full queue, modulo 2^16. */
+      uint16_t   dropped = 0;
+      /** @brief The largest number of packets held at once. */
+      uint8_t    high_water = 0;
+      /** @brief The dwell-time histogram, modulo 2^16 per bucket. */
+      uint16_t   dwell[QUEUE_DWELL_BUCKETS];
+    };
+    /**<  A diagram of the struct is included below.
+     *
+     * @verbatim
+1 byte 4 bytes 1 byte  2 bytes    2 bytes    2 bytes   1 byte       2*X bytes
++------+-------+-------+----------+----------+---------+------------+---------+
+| type | deci  | queue | enqueued | dequeued | dropped | high_water | dwell[] |
++------+-------+-------+----------+----------+---------+------------+---------+
+(Note: X = QUEUE_DWELL_BUCKETS)
+       @endverbatim
+     */
+
+    /**
+     * @brief Pack a queue's telemetry into a queue beacon.
+     *
+     * The counters wrap modulo 2^16, as documented on each field. A high-water
+     * mark too large for its field reads 255.
+     *
+     * @param stats The telemetry of the queue.
+     * @param queue_id The Channel_ID of the channel consuming the queue, or 0
+     * for the main queue.
+     * @param deci The decimal identifier of the beacon.
+     * @return queuebeacon The packed beacon.
+     */
+    inline queuebeacon pack_queuebeacon(const queue_stats &stats,
+                                        uint8_t queue_id, uint32_t deci) {
+      queuebeacon beacon;
+      beacon.deci       = deci;
+      beacon.queue      = queue_id;
+      beacon.enqueued   = (uint16_t)stats.enqueued;
+      beacon.dequeued   = (uint16_t)stats.dequeued;
+      beacon.dropped    = (uint16_t)stats.dropped;
+      beacon.high_water = stats.high_water > UINT8_MAX
+                              ? UINT8_MAX
+                              : (uint8_t)stats.high_water;
+      for (size_t i = 0; i < QUEUE_DWELL_BUCKETS; i++) {
+        beacon.dwell[i] = (uint16_t)stats.dwell[i];
+      }
+      return beacon;
+    }
+
+    /** @brief The radio airtime telemetry beacon structure. */
+    struct __attribute__((packed)) airtimebeacon {
+      /** @brief The type of the beacon. */
+      BeaconType type = BeaconType::AirtimeBeacon;
+      /** @brief A decimal identifier for the beacon. */
+      uint32_t   deci = 0;
+      /** @brief The airtime, in milliseconds, allowed in each window. */
+      uint16_t   budget = 0;
+      /** @brief The length of the window, in seconds. */
+      uint16_t   window = 0;
+      /** @brief The total airtime spent, in milliseconds, modulo 2^32. */
+      uint32_t   consumed = 0;
+      /** @brief The airtime left, in milliseconds. Negative means debt. */
+      int16_t    remaining = 0;
+    };
+    /**<  A diagram of the struct is included below.
+     *
+     * @verbatim
+1 byte 4 bytes 2 bytes  2 bytes  4 bytes    2 bytes
++------+-------+--------+--------+----------+-----------+
+| type | deci  | budget | window | consumed | remaining |
++------+-------+--------+--------+----------+-----------+
+       @endverbatim
+     */
+
+    /** @brief The radio link health beacon structure. */
+    struct __attribute__((packed)) linkbeacon {
+      /** @brief The type of the beacon. */
+      BeaconType type = BeaconType::LinkBeacon;
+      /** @brief A decimal identifier for the beacon. */
+      uint32_t   deci = 0;
+      /** @brief The length of the period reported, in milliseconds. */
+      uint32_t   period = 0;
+      /** @brief The rung of RFM23::MODEM_LADDER in use. */
+      uint8_t    rung = 0;
+      /** @brief The number of frames sent. */
+      uint16_t   tx_frames = 0;
+      /** @brief The number of frames the radio refused to send. */
+      uint16_t   tx_refused = 0;
+      /** @brief The number of sent frames aborted for taking too long. */
+      uint16_t   tx_timeouts = 0;
+      /** @brief The number of bulk frames sent again by the ARQ transport. */
+      uint16_t   retransmissions = 0;
+      /** @brief The number of frames received and read. */
+      uint16_t   rx_frames = 0;
+      /** @brief The number of received frames that could not be read. */
+      uint16_t   rx_failed = 0;
+      /** @brief The number of frames read that FEC could not repair. */
+      uint16_t   rx_corrupted = 0;
+      /** @brief The bytes sent per second. */
+      uint16_t   tx_rate = 0;
+      /** @brief The bytes received per second. */
+      uint16_t   rx_rate = 0;
+      /** @brief The share of the period spent transmitting, per mille. */
+      uint16_t   duty = 0;
+      /** @brief The mean RSSI, in dBm, of the frames read. */
+      int8_t     rssi = 0;
+      /** @brief The weakest RSSI, in dBm, of the frames read. */
+      int8_t     rssi_min = 0;
+      /** @brief The strongest RSSI, in dBm, of the frames read. */
+      int8_t     rssi_max = 0;
+      /** @brief The mean wait, in microseconds, for the SPI mutex. */
+      uint16_t   lock_wait = 0;
+      /** @brief The longest wait, in microseconds, for the SPI mutex. */
+      uint16_t   lock_wait_max = 0;
+      /** @brief The mean wait, in milliseconds, for a frame to send. */
+      uint16_t   sent_wait = 0;
+      /** @brief The longest wait, in milliseconds, for a frame to send. */
+      uint16_t   sent_wait_max = 0;
+    };
+    /**<  Every count covers the period reported. Waits too long for their
+     * field read 65535.
+     */
   } // namespace Devices
 } // namespace Artemis
 
@@ -31,7 +31,16 @@ namespace Channels {
     void setup();
     void loop();
     void handle_queue();
+    PacketPriority lowest_allowed();
+    void handle_packet();
     void receive_from_radio();
+    bool transmit(PacketComm &outgoing);
+    Devices::RFM23::FecMode fec_mode(const PacketComm &packet);
+    void handle_bulk();
+    void update_modem();
+    void beacon_link();
+    void request_modem(uint8_t rung);
+    void switch_modem(uint8_t rung);
   } // namespace RFM23
 
   namespace PDU {
@@ -42,6 +51,7 @@ namespace Channels {
     void deploy_burn_wire();
     void loop();
     void handle_queue();
+    void handle_packet();
     void test_communicating_with_pdu();
     void set_switch_on_pdu();
     void report_pdu_switch_status();
@@ -50,13 +60,30 @@ namespace Channels {
   } // namespace PDU
 
   namespace RPI {
-    void rpi_channel();
-    void setup();
-    void loop();
-    void handle_queue();
-    void shut_down_pi();
-    void send_to_pi();
-    void receive_from_pi();
+    void    rpi_channel();
+    void    setup();
+    void    loop();
+    void    update_session();
+    void    hold_queue();
+    void    handle_queue();
+    void    handle_packet();
+    bool    switches_pi_off(const PacketComm &command);
+    void    shut_down_pi();
+    void    send_to_pi();
+    uint8_t stream_of(PacketComm::TypeId type);
+    void    flush_to_pi();
+    bool    drain_to_pi();
+    bool    send_baud_request(uint32_t baud);
+    bool    ping_pi();
+    void    restart_link();
+    bool    send_control(PacketComm::TypeId type, const void *data,
+                         size_t size);
+    bool    handle_link_reply();
+    void    start_downlink();
+    void    handle_downlink();
+    bool    receive_from_pi();
+    void    deliver_from_pi();
+    void    route_from_pi();
   } // namespace RPI
 
   namespace TEST {
@@ -73,6 +100,7 @@ namespace Channels {
     void report_threads_status();
     void report_memory_usage();
     void report_queue_size();
+    void report_queue(const char *name, PacketQueue &queue);
   } // namespace TEST
 
 } // namespace Channels
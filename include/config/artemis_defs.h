@@ -8,6 +8,15 @@
 #define _ARTEMIS_DEFS_H
 
 #include <TeensyThreads.h>
+#include <airtime.h>
+#include <arq.h>
+#include <beacon_aggregate.h>
+#include <beacon_codec.h>
+#include <beacon_packer.h>
+#include <packet_pool.h>
+#include <packet_queue.h>
+#include <priority_queue.h>
+#include <rfm23.h>
 #include <support/configCosmosKernel.h>
 #include <support/packetcomm.h>
 
@@ -44,9 +53,218 @@ const float MV_PER_ADC_UNIT  = 3300.0 / 1024.0;
 /** @brief The activation temperature, in Celsius, of the heater. */
 const float heater_threshold = -10.0;
 
-/** @brief The maximum number of packets that a queue can hold. */
+/**
+ * @brief The maximum number of packets that each priority class of a queue can
+ * hold.
+ *
+ * Queues are ring buffers, so this must be a power of two.
+ */
 #define MAXQUEUESIZE 8
 
+/** @brief The most packets a channel pulls from its queue at once. */
+#define QUEUE_BATCH_SIZE MAXQUEUESIZE
+
+/**
+ * @brief The packet type the RFM23 channel uses to ask ground for a modem
+ * switch.
+ *
+ * Its data is the requested rung of RFM23::MODEM_LADDER.
+ */
+#define RADIO_MODEM_REQUEST (PacketComm::TypeId)0x8A0
+/**
+ * @brief The packet type ground uses to order a modem switch.
+ *
+ * Its data is the rung of RFM23::MODEM_LADDER to switch to. Ground switches
+ * as soon as it has sent this, and the satellite as soon as it receives it.
+ */
+#define RADIO_MODEM_SWITCH  (PacketComm::TypeId)0x8A1
+/**
+ * @brief The packet type of an ARQ data frame carrying bulk data to ground.
+ *
+ * Its layout is described by ArqSender.
+ */
+#define RADIO_BULK_DATA     (PacketComm::TypeId)0x8A2
+/**
+ * @brief The packet type of ground's acknowledgement of ARQ data frames.
+ *
+ * Its layout is described by ArqReceiver.
+ */
+#define RADIO_BULK_ACK      (PacketComm::TypeId)0x8A3
+/**
+ * @brief The packet type the RPi channel uses to ask the RPi for a new baud
+ * rate.
+ *
+ * Its data is the requested baud rate, as a little-endian uint32_t. The RPi
+ * replies with the same type and the rate it agrees to, or 0 to refuse, at
+ * the old rate, and then switches. If no ping arrives within
+ * RPI_BAUD_PROBATION of a switch, the RPi falls back to RPI_BASE_BAUD.
+ */
+#define RPI_BAUD_REQUEST    (PacketComm::TypeId)0x8A4
+/**
+ * @brief The packet type ground uses to ask for a file from the RPi.
+ *
+ * Its data is the file's ID and the offset of the first byte wanted,
+ * little-endian, 2 and 4 bytes. An unfinished transfer is resumed by asking
+ * again from the first byte ground is missing.
+ */
+#define FILE_DOWNLINK       (PacketComm::TypeId)0x8A5
+/**
+ * @brief The packet type the RPi channel uses to read part of a file from
+ * the RPi.
+ *
+ * Its layout is described by FileDownlink.
+ */
+#define FILE_READ_REQUEST   (PacketComm::TypeId)0x8A6
+/**
+ * @brief The packet type of a chunk of a file, from the RPi to the Teensy and
+ * from the Teensy to ground.
+ *
+ * Its layout is described by FileDownlink.
+ */
+#define FILE_CHUNK          (PacketComm::TypeId)0x8A7
+/**
+ * @brief The packet type the RPi sends the Teensy every second while its
+ * flight software runs, starting as soon as it boots.
+ */
+#define RPI_HEARTBEAT       (PacketComm::TypeId)0x8A8
+/**
+ * @brief The packet type the RPi answers a halt with, once its file systems
+ * are synced and read-only, so its power can be cut.
+ */
+#define RPI_HALT_ACK        (PacketComm::TypeId)0x8A9
+
+/** @brief The most bytes the RPi channel reads from its serial port at once. */
+#define RPI_RX_CHUNK        64
+/**
+ * @brief The size, in bytes, of the RPi channel's SLIP transmit ring. Must be
+ * a power of two, and hold RPI_TX_LOW_WATER bytes and a whole escaped frame.
+ */
+#define RPI_TX_RING         1024
+/**
+ * @brief The bytes the RPi channel keeps in its transmit ring, topping it up
+ * from the multiplexer's streams.
+ *
+ * Every byte here is ahead of the next control frame, so the ring is kept
+ * short and the streams decide what goes out next.
+ */
+#define RPI_TX_LOW_WATER    256
+/**
+ * @brief The size, in bytes, of the memory added to Serial2's receive buffer.
+ *
+ * This holds over 100 ms of bytes at the highest baud rate, so nothing is lost
+ * while the RPi channel sleeps.
+ */
+#define RPI_SERIAL_RX_BUFFER 16384
+/**
+ * @brief The size, in bytes, of the memory added to Serial2's TX buffer.
+ *
+ * Like the transmit ring, this sits ahead of control frames, so it only holds
+ * a few milliseconds of bytes at the highest baud rate.
+ */
+#define RPI_SERIAL_TX_BUFFER 512
+
+/**
+ * @brief The SLIP multiplexer stream of the link's own packets: pings and
+ * pongs, baud requests, file reads and halts.
+ */
+#define RPI_STREAM_CONTROL   0
+/** @brief The SLIP multiplexer stream of packets to and from the satellite. */
+#define RPI_STREAM_PACKETS   1
+/** @brief The SLIP multiplexer stream of file chunks from the RPi. */
+#define RPI_STREAM_FILES     2
+/** @brief The segments the control stream may send for each file segment. */
+#define RPI_CONTROL_WEIGHT   4
+/** @brief The segments the packet stream may send for each file segment. */
+#define RPI_PACKETS_WEIGHT   2
+/**
+ * @brief The time, in milliseconds, between resends of every stream's credit
+ * to the RPi.
+ */
+#define RPI_CREDIT_INTERVAL  (1 * SECONDS)
+
+/**
+ * @brief The most file bytes in each chunk sent to ground.
+ *
+ * Once the chunk header, the PacketComm headers and CRCs of the chunk and of
+ * the ARQ frame carrying it, and the ARQ sequence number are added, this
+ * fills exactly three FEC-protected radio frames.
+ */
+#define FILE_DOWNLINK_CHUNK  58
+
+/** @brief The number of bulk packets the RFM23 keeps in flight at once. */
+#define ARQ_WINDOW          16
+
+/**
+ * @brief The airtime, in milliseconds, the RFM23 may transmit for in each
+ * RFM23_AIRTIME_WINDOW.
+ *
+ * This holds the radio to a 10% duty cycle, which keeps the power amplifier
+ * within its thermal and power budget.
+ */
+#define RFM23_AIRTIME_BUDGET           (6 * SECONDS)
+/** @brief The window, in milliseconds, the airtime budget applies to. */
+#define RFM23_AIRTIME_WINDOW           (60 * SECONDS)
+/**
+ * @brief The airtime, in microseconds, responses leave for link control.
+ *
+ * Modem requests keep the link itself alive, so they may spend the last of
+ * the budget. This leaves them three full frames at the slowest rung however
+ * many responses are waiting.
+ */
+#define RFM23_AIRTIME_RESPONSE_RESERVE (RFM23_AIRTIME_BUDGET * 1000 / 8)
+/** @brief The airtime, in microseconds, beacons leave for responses. */
+#define RFM23_AIRTIME_BEACON_RESERVE   (RFM23_AIRTIME_BUDGET * 1000 / 4)
+/** @brief The airtime, in microseconds, bulk data leaves for beacons. */
+#define RFM23_AIRTIME_BULK_RESERVE     (RFM23_AIRTIME_BUDGET * 1000 / 2)
+
+/** @brief The time, in milliseconds, covered by each link health beacon. */
+#define RFM23_LINK_BEACON_INTERVAL     (60 * SECONDS)
+
+/** @brief The number of radio frames an aggregated beacon packet may fill. */
+#define BEACON_AGGREGATE_FRAMES   3
+/**
+ * @brief The most data bytes in an aggregated beacon packet.
+ *
+ * This fills BEACON_AGGREGATE_FRAMES radio frames once the PacketComm header
+ * and its 2-byte CRC are added.
+ */
+#define BEACON_AGGREGATE_SIZE                                                  \
+  (BEACON_AGGREGATE_FRAMES * RFM23_FRAGMENT_PAYLOAD -                          \
+   sizeof(PacketComm::header) - 2)
+/** @brief The longest time, in milliseconds, a beacon waits to be sent. */
+#define BEACON_AGGREGATE_DEADLINE (1 * SECONDS)
+/**
+ * @brief The number of beacons of each type between keyframes.
+ *
+ * A lost beacon leaves ground unable to decode up to this many beacons of its
+ * type.
+ */
+#define BEACON_KEYFRAME_INTERVAL  10
+
+/**
+ * @brief The capacity and drop policy of each priority class in a queue.
+ *
+ * Commands are never evicted; a full command class rejects new commands.
+ * Responses and beacons keep the newest packets by evicting the oldest.
+ */
+const priority_class_config QUEUE_CLASS_CONFIG[PACKET_PRIORITY_COUNT] = {
+    {MAXQUEUESIZE,     DropPolicy::Reject},
+    {MAXQUEUESIZE, DropPolicy::DropOldest},
+    {MAXQUEUESIZE, DropPolicy::DropOldest},
+};
+
+/**
+ * @brief The capacity and drop policy of each priority class in a bulk queue.
+ *
+ * Bulk data must arrive whole, so no class ever drops a packet. Producers are
+ * expected to hold on to rejected packets and try again.
+ */
+const priority_class_config BULK_QUEUE_CLASS_CONFIG[PACKET_PRIORITY_COUNT] = {
+    {MAXQUEUESIZE, DropPolicy::Reject},
+    {MAXQUEUESIZE, DropPolicy::Reject},
+    {MAXQUEUESIZE, DropPolicy::Reject},
+};
+
 /** @brief Enumeration of Node ID. */
 enum class NODES : uint8_t {
   GROUND_NODE_ID = 1,
@@ -115,30 +333,44 @@ extern vector<struct thread_struct> thread_list;
 
 extern std::map<string, NODES>      NodeType;
 
-extern std::deque<PacketComm>       main_queue;
-extern std::deque<PacketComm>       rfm23_queue;
-extern std::deque<PacketComm>       pdu_queue;
-extern std::deque<PacketComm>       rpi_queue;
+/** @brief The lock-free queue of packet handles passed between channels. */
+typedef PriorityPacketQueue<MAXQUEUESIZE> PacketQueue;
 
-extern Threads::Mutex               main_queue_mtx;
-extern Threads::Mutex               rfm23_queue_mtx;
-extern Threads::Mutex               pdu_queue_mtx;
-extern Threads::Mutex               rpi_queue_mtx;
+extern PacketPool                   packet_pool;
+
+extern PacketQueue                  main_queue;
+extern PacketQueue                  rfm23_queue;
+extern PacketQueue                  rfm23_bulk_queue;
+extern PacketQueue                  pdu_queue;
+extern PacketQueue                  rpi_queue;
 
 extern Threads::Mutex               spi1_mtx;
 extern Threads::Mutex               i2c1_mtx;
 
 extern bool                         deploymentmode;
 
+extern BeaconEncoder                beacon_encoder;
+
+extern AirtimeBudget                rfm23_airtime;
+
 bool                                kill_thread(uint8_t channel_id);
-void PushQueue(PacketComm &packet, std::deque<PacketComm> &queue,
-               Threads::Mutex &mtx);
-bool PullQueue(PacketComm &packet, std::deque<PacketComm> &queue,
-               Threads::Mutex &mtx);
-
-void route_packet_to_main(PacketComm packet);
-void route_packet_to_rfm23(PacketComm packet);
-void route_packet_to_pdu(PacketComm packet);
-void route_packet_to_rpi(PacketComm packet);
+PacketPriority                      packet_priority(const PacketComm &packet);
+PushResult PushQueue(PacketHandle &packet, PacketQueue &queue);
+bool       PullQueue(PacketHandle &packet, PacketQueue &queue,
+                     PacketPriority lowest = PacketPriority::Beacon);
+size_t PullQueue(PacketHandle *packets, size_t max, PacketQueue &queue);
+bool WaitQueue(PacketQueue &queue, uint32_t timeout,
+               PacketPriority lowest = PacketPriority::Beacon);
+
+PushResult route_packet_to_main(PacketHandle packet);
+PushResult route_packet_to_rfm23(PacketHandle packet);
+PushResult route_packet_to_rfm23_bulk(PacketHandle &packet);
+PushResult route_packet_to_pdu(PacketHandle packet);
+PushResult route_packet_to_rpi(PacketHandle packet);
+
+PacketHandle acquire_beacon_packet();
+PushResult   route_beacon_to_rfm23(const void *beacon, size_t size);
+PushResult   flush_beacons();
+void         flush_beacons_if_due();
 
 #endif // _ARTEMIS_DEFS_H
@@ -0,0 +1,220 @@
+/**
+ * @file packet_router.h
+ * @brief The table-driven packet router.
+ *
+ * This file defines the route table used by the main channel to dispatch
+ * packets to their handlers.
+ */
+#ifndef _PACKET_ROUTER_H
+#define _PACKET_ROUTER_H
+
+#include "config/artemis_defs.h"
+
+/**
+ * @brief The bit of a route key set when the route names a packet type.
+ *
+ * Routes that match every type or every sub-key leave the type or sub-key
+ * bits clear, so no value of either field doubles as a wildcard.
+ */
+#define ROUTE_TYPE_BIT   ((uint64_t)1 << 25)
+/** @brief The bit of a route key set when the route names a sub-key. */
+#define ROUTE_SUBKEY_BIT ((uint64_t)1 << 8)
+/** @brief The bits of a route key holding the destination node. */
+#define ROUTE_NODE_MASK  ((uint64_t)0xFF << 26)
+/** @brief The bits of a route key holding the destination node and type. */
+#define ROUTE_TYPE_MASK                                                        \
+  (ROUTE_NODE_MASK | ROUTE_TYPE_BIT | ((uint64_t)0xFFFF << 9))
+
+namespace Artemis {
+/**
+ * @brief The packet router.
+ *
+ * Routes are keyed on the packet's destination node, its type, and an optional
+ * sub-key taken from the first byte of its data (such as a PDU switch ID). A
+ * route table is sorted at compile time, and every route is given the
+ * handlers of the less specific routes above it. Finding a packet's handler
+ * is then a single binary search over a flat array.
+ */
+namespace Router {
+  /** @brief A function that handles a routed packet. */
+  typedef void (*route_handler)();
+
+  /** @brief A single entry in a route table. */
+  struct route_entry {
+    /** @brief The packed destination, type and sub-key of the route. */
+    uint64_t      key;
+    /** @brief The function called for packets matching the route. */
+    route_handler handler;
+    /**
+     * @brief The handler for packets of the route's node and type whose
+     * sub-key has no route of its own. Filled in by sort_routes().
+     */
+    route_handler type_handler;
+    /**
+     * @brief The handler for packets to the route's node whose type has no
+     * route of its own. Filled in by sort_routes().
+     */
+    route_handler node_handler;
+  };
+
+  /** @brief The route key of every packet sent to a node. */
+  constexpr uint64_t route_key(uint8_t node) { return (uint64_t)node << 26; }
+
+  /** @brief The route key of a packet type sent to a node. */
+  constexpr uint64_t route_key(uint8_t node, uint16_t type) {
+    return route_key(node) | ROUTE_TYPE_BIT | ((uint64_t)type << 9);
+  }
+
+  /** @brief The route key of a packet type and sub-key sent to a node. */
+  constexpr uint64_t route_key(uint8_t node, uint16_t type, uint8_t subkey) {
+    return route_key(node, type) | ROUTE_SUBKEY_BIT | subkey;
+  }
+
+  /** @brief Register a handler for every packet sent to a node. */
+  constexpr route_entry route(NODES node, route_handler handler) {
+    return {route_key((uint8_t)node), handler, nullptr, nullptr};
+  }
+
+  /** @brief Register a handler for a packet type sent to a node. */
+  constexpr route_entry route(NODES node, PacketComm::TypeId type,
+                              route_handler handler) {
+    return {route_key((uint8_t)node, (uint16_t)type), handler, nullptr,
+            nullptr};
+  }
+
+  /** @brief Register a handler for a packet type and sub-key. */
+  constexpr route_entry route(NODES node, PacketComm::TypeId type,
+                              uint8_t subkey, route_handler handler) {
+    return {route_key((uint8_t)node, (uint16_t)type, subkey), handler,
+            nullptr, nullptr};
+  }
+
+  /**
+   * @brief A route table of a fixed number of entries.
+   *
+   * @tparam N The number of routes in the table.
+   */
+  template <size_t N> struct route_table {
+    /** @brief The routes, sorted by key once passed through sort_routes(). */
+    route_entry entries[N];
+
+    /**
+     * @brief Find the handler for a packet.
+     *
+     * The most specific route wins: an exact match on destination, type and
+     * sub-key, then destination and type, then destination alone. Keys sort
+     * less specific routes just before the more specific ones below them, so
+     * the last route at or before the packet's key is either its match, or a
+     * route of the same node, or the same node and type, that carries the
+     * handler to fall back to.
+     *
+     * @param node The packet's destination node ID.
+     * @param type The packet's type.
+     * @param subkey The packet's sub-key, or a negative value if it has none.
+     * @return route_handler The matching handler, or nullptr if there is none.
+     */
+    route_handler find(uint8_t node, uint16_t type, int16_t subkey) const {
+      uint64_t key  = subkey >= 0 ? route_key(node, type, (uint8_t)subkey)
+                                  : route_key(node, type);
+      size_t   low  = 0;
+      size_t   high = N;
+      while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (entries[mid].key <= key) {
+          low = mid + 1;
+        } else {
+          high = mid;
+        }
+      }
+      if (low == 0) {
+        return nullptr;
+      }
+      const route_entry &entry = entries[low - 1];
+      if (entry.key == key) {
+        return entry.handler;
+      }
+      if ((entry.key & ROUTE_TYPE_MASK) == (key & ROUTE_TYPE_MASK)) {
+        return entry.type_handler;
+      }
+      if ((entry.key & ROUTE_NODE_MASK) == (key & ROUTE_NODE_MASK)) {
+        return entry.node_handler;
+      }
+      return nullptr;
+    }
+  };
+
+  /**
+   * @brief Find the handler of a route in a table, at compile time.
+   *
+   * @tparam N The number of routes in the table.
+   * @param table The table.
+   * @param key The key of the route.
+   * @return route_handler The route's handler, or nullptr if there is none.
+   */
+  template <size_t N>
+  constexpr route_handler route_handler_of(const route_table<N> &table,
+                                           uint64_t              key) {
+    for (size_t i = 0; i < N; i++) {
+      if (table.entries[i].key == key) {
+        return table.entries[i].handler;
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief Sort a route table by key, and give every route the handlers to
+   * fall back to, at compile time.
+   *
+   * @tparam N The number of routes in the table.
+   * @param table The unsorted table.
+   * @return route_table<N> The sorted table.
+   */
+  template <size_t N>
+  constexpr route_table<N> sort_routes(route_table<N> table) {
+    for (size_t i = 1; i < N; i++) {
+      route_entry entry = table.entries[i];
+      size_t      j     = i;
+      while (j > 0 && table.entries[j - 1].key > entry.key) {
+        table.entries[j] = table.entries[j - 1];
+        j--;
+      }
+      table.entries[j] = entry;
+    }
+    for (size_t i = 0; i < N; i++) {
+      route_entry &entry = table.entries[i];
+      entry.node_handler =
+          route_handler_of(table, entry.key & ROUTE_NODE_MASK);
+      entry.type_handler = entry.node_handler;
+      if (entry.key & ROUTE_TYPE_BIT) {
+        route_handler type_handler =
+            route_handler_of(table, entry.key & ROUTE_TYPE_MASK);
+        if (type_handler != nullptr) {
+          entry.type_handler = type_handler;
+        }
+      }
+    }
+    return table;
+  }
+
+  /**
+   * @brief Check that no two routes in a sorted table share a key.
+   *
+   * @tparam N The number of routes in the table.
+   * @param table The sorted table.
+   * @return true Every key is unique.
+   * @return false At least two routes share a key.
+   */
+  template <size_t N>
+  constexpr bool unique_routes(const route_table<N> &table) {
+    for (size_t i = 1; i < N; i++) {
+      if (table.entries[i - 1].key == table.entries[i].key) {
+        return false;
+      }
+    }
+    return true;
+  }
+} // namespace Router
+} // namespace Artemis
+
+#endif // _PACKET_ROUTER_H
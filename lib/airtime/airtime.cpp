@@ -0,0 +1,59 @@
+/**
+ * @file airtime.cpp
+ * @brief The radio airtime budget.
+ *
+ * This file contains definitions for the token bucket that limits how long
+ * the radio may transmit in any window of time.
+ */
+#include "airtime.h"
+
+/**
+ * @brief Construct a new AirtimeBudget, starting with a full bucket.
+ *
+ * @param budget The airtime, in milliseconds, allowed in each window.
+ * @param window The length of the window, in milliseconds.
+ */
+AirtimeBudget::AirtimeBudget(uint32_t budget, uint32_t window)
+    : bucket_size(budget * 1000), window(window == 0 ? 1 : window),
+      tokens(bucket_size), refilled_at(millis()) {}
+
+/**
+ * @brief Check whether a sender may start a transmission.
+ *
+ * @param reserve The airtime the sender must leave for more important
+ * traffic. Pass 0 for the most important traffic.
+ * @return true More than reserve airtime is left in the bucket.
+ * @return false The sender should wait for the bucket to refill.
+ */
+bool AirtimeBudget::allows(uint32_t reserve) {
+  refill();
+  return tokens > (int32_t)reserve;
+}
+
+/**
+ * @brief Take the airtime of a finished transmission out of the bucket.
+ *
+ * @param airtime The airtime the transmission took.
+ */
+void AirtimeBudget::spend(uint32_t airtime) {
+  refill();
+  tokens   -= airtime;
+  spent_us += airtime;
+  spent_ms += spent_us / 1000;
+  spent_us %= 1000;
+}
+
+/** @brief Add the airtime earned since the last refill. */
+void AirtimeBudget::refill() {
+  uint32_t now      = millis();
+  carry            += (uint64_t)(now - refilled_at) * bucket_size;
+  refilled_at       = now;
+  uint64_t earned   = carry / window;
+  carry            %= window;
+  if (tokens + (int64_t)earned > (int64_t)bucket_size) {
+    tokens = bucket_size;
+    carry  = 0;
+  } else {
+    tokens += earned;
+  }
+}
@@ -0,0 +1,63 @@
+/**
+ * @file airtime.h
+ * @brief The header file for the radio airtime budget.
+ *
+ * This file contains declarations for the token bucket that limits how long
+ * the radio may transmit in any window of time.
+ */
+#ifndef _AIRTIME_H
+#define _AIRTIME_H
+
+#include <Arduino.h>
+
+/**
+ * @brief A token bucket of transmit airtime.
+ *
+ * The bucket holds up to budget milliseconds of airtime, and refills at
+ * budget milliseconds per window. Senders check allows() before transmitting
+ * and spend() the airtime the transmission actually took. A transmission that
+ * starts with too little airtime left still runs to the end, and leaves the
+ * bucket in debt, so the radio may overshoot the budget by at most one
+ * transmission, which later transmissions then have to wait out.
+ *
+ * Each sender passes a reserve to allows(), which is the airtime it must
+ * leave in the bucket for more important traffic. With lower reserves for
+ * higher priorities, the budget is spent in priority order as it runs out.
+ *
+ * Airtime is counted in microseconds, except for the total reported by
+ * consumed(), which would otherwise wrap after 71 minutes.
+ */
+class AirtimeBudget {
+public:
+  AirtimeBudget(uint32_t budget, uint32_t window);
+
+  bool     allows(uint32_t reserve);
+  void     spend(uint32_t airtime);
+
+  /** @brief The most airtime the bucket holds, a whole window's budget. */
+  uint32_t capacity() const { return bucket_size; }
+  /** @brief The airtime left, as of the last check. Negative means debt. */
+  int32_t  remaining() const { return tokens; }
+  /** @brief The total airtime spent, in milliseconds, modulo 2^32. */
+  uint32_t consumed() const { return spent_ms; }
+
+private:
+  void     refill();
+
+  /** @brief The most airtime the bucket holds. */
+  uint32_t bucket_size;
+  /** @brief The length of the window, in milliseconds. */
+  uint32_t window;
+  /** @brief The airtime in the bucket. */
+  int32_t  tokens;
+  /** @brief The refill owed for time too short to earn a whole microsecond. */
+  uint64_t carry       = 0;
+  /** @brief The time, in milliseconds, the bucket was last refilled. */
+  uint32_t refilled_at = 0;
+  /** @brief The total airtime spent, in milliseconds. */
+  uint32_t spent_ms    = 0;
+  /** @brief The airtime spent that does not yet make a whole millisecond. */
+  uint32_t spent_us    = 0;
+};
+
+#endif // _AIRTIME_H
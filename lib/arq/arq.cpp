@@ -0,0 +1,373 @@
+/**
+ * @file arq.cpp
+ * @brief The selective-repeat ARQ transport.
+ *
+ * This file contains definitions for the sending and receiving ends of the
+ * ARQ transport.
+ */
+#include "arq.h"
+
+/**
+ * @brief Construct a new ArqSender.
+ *
+ * @param window The number of packets allowed in flight at once, clamped to
+ * ARQ_MAX_WINDOW.
+ */
+ArqSender::ArqSender(uint8_t window)
+    : window(window > ARQ_MAX_WINDOW ? ARQ_MAX_WINDOW : window) {}
+
+/**
+ * @brief Add a packet to the send window.
+ *
+ * The packet is wrapped once here, so retransmissions reuse its bytes. The
+ * first packet after construction or a reset opens a new session.
+ *
+ * @param packet The packet to be sent reliably. The sender takes ownership of
+ * it unless the window is full.
+ * @return true The packet has been given the next sequence number.
+ * @return false The window is full, or the packet could not be wrapped.
+ */
+bool ArqSender::push(PacketHandle &packet) {
+  if (!ready() || !packet) {
+    return false;
+  }
+  packet->wrapped.resize(0);
+  if (!packet->Wrap()) {
+    print_debug(Helpers::RFM23, "Failed to wrap packet for ARQ transport");
+    return false;
+  }
+  if (!started) {
+    open_session();
+    started = true;
+  }
+  if (base == next_seq) {
+    heard_at = millis();
+  }
+  arq_slot &slot     = slots[next_seq % ARQ_MAX_WINDOW];
+  slot.packet        = std::move(packet);
+  slot.transmissions = 0;
+  slot.acked         = false;
+  slot.lost          = false;
+  next_seq++;
+  return true;
+}
+
+/**
+ * @brief Get the next frame that needs to be transmitted.
+ *
+ * New packets, packets found lost, and packets whose retransmit timer has
+ * expired are sent oldest first. An expired timer doubles the timeout, but a
+ * burst of frames lost together only doubles it once. A packet found lost
+ * leaves the timeout as it is, since the link is still delivering. While the
+ * link is silent(), only the oldest packet is sent, once every
+ * ARQ_MAX_TIMEOUT.
+ *
+ * @param frame The packet whose data will be set to the frame. Its header is
+ * left to the caller.
+ * @return true frame holds a data frame to transmit.
+ * @return false Nothing needs to be transmitted right now.
+ */
+bool ArqSender::poll(PacketComm &frame) {
+  uint32_t now     = millis();
+  bool     probing = silent();
+  for (uint16_t seq = base; seq != next_seq; seq++) {
+    arq_slot &slot = slots[seq % ARQ_MAX_WINDOW];
+    if (probing && (seq != base || (slot.transmissions > 0 &&
+                                    now - slot.sent_at < ARQ_MAX_TIMEOUT))) {
+      return false;
+    }
+    if (slot.acked || (!slot.lost && slot.transmissions > 0 &&
+                       now - slot.sent_at < rto)) {
+      continue;
+    }
+    if (!slot.lost && slot.transmissions > 0 && now - backoff_at >= rto) {
+      rto        = rto * 2 > ARQ_MAX_TIMEOUT ? ARQ_MAX_TIMEOUT : rto * 2;
+      backoff_at = now;
+    }
+    if (slot.transmissions > 0) {
+      resent++;
+    }
+    frame.data.resize(0);
+    frame.data.push_back(opening ? session_id | ARQ_SESSION_OPEN : session_id);
+    frame.data.push_back(seq & 0xFF);
+    frame.data.push_back(seq >> 8);
+    frame.data.insert(frame.data.end(), slot.packet->wrapped.begin(),
+                      slot.packet->wrapped.end());
+    slot.sent_at = now;
+    slot.order   = sent++;
+    slot.lost    = false;
+    if (slot.transmissions < UINT8_MAX) {
+      slot.transmissions++;
+    }
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Process an acknowledgement from the receiver.
+ *
+ * Every packet covered by the cumulative ack or the SACK bitmap is marked as
+ * acknowledged, and the window slides past the acknowledged packets at its
+ * start, returning them to the packet pool. A packet still unacknowledged
+ * once ARQ_REORDER_THRESHOLD packets sent after it are acknowledged is marked
+ * lost, for poll() to send again straight away.
+ *
+ * An acknowledgement of another session is left over from before the
+ * current one opened, or, once the receiver has acknowledged the current
+ * one, means the receiver restarted. The packets not yet acknowledged are
+ * then sent again in a new session.
+ *
+ * @param ack The acknowledgement packet.
+ */
+void ArqSender::acknowledge(const PacketComm &ack) {
+  if (ack.data.size() < ARQ_ACK_SIZE) {
+    return;
+  }
+  if (!started) {
+    return;
+  }
+  if (ack.data[0] != session_id) {
+    if (!opening) {
+      print_debug(Helpers::RFM23, "ARQ receiver restarted, resending window");
+      resync();
+    }
+    return;
+  }
+  uint16_t cumulative = ack.data[1] | (ack.data[2] << 8);
+  uint32_t bitmap     = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    bitmap |= (uint32_t)ack.data[3 + i] << (8 * i);
+  }
+  if ((uint16_t)(cumulative - base) > in_flight()) {
+    return;
+  }
+
+  uint32_t now = millis();
+  opening      = false;
+  heard_at     = now;
+  for (uint16_t seq = base; seq != next_seq; seq++) {
+    arq_slot &slot   = slots[seq % ARQ_MAX_WINDOW];
+    uint16_t  offset = seq - cumulative;
+    bool      acked  = (uint16_t)(seq - base) < (uint16_t)(cumulative - base);
+    if (offset >= 1 && offset <= 32) {
+      acked = acked || ((bitmap >> (offset - 1)) & 1);
+    }
+    if (!acked || slot.acked) {
+      continue;
+    }
+    slot.acked = true;
+    if (slot.transmissions == 1) {
+      sample_rtt(now - slot.sent_at);
+    }
+  }
+
+  for (uint16_t seq = base; seq != next_seq; seq++) {
+    arq_slot &slot = slots[seq % ARQ_MAX_WINDOW];
+    if (slot.acked || slot.lost || slot.transmissions == 0) {
+      continue;
+    }
+    uint8_t later = 0;
+    for (uint16_t other = base; other != next_seq; other++) {
+      const arq_slot &sent_after = slots[other % ARQ_MAX_WINDOW];
+      if (sent_after.acked && (int32_t)(sent_after.order - slot.order) > 0) {
+        later++;
+      }
+    }
+    slot.lost = later >= ARQ_REORDER_THRESHOLD;
+  }
+
+  while (base != next_seq && slots[base % ARQ_MAX_WINDOW].acked) {
+    slots[base % ARQ_MAX_WINDOW].packet.release();
+    base++;
+  }
+}
+
+/**
+ * @brief Drop every packet in the window and start again from sequence 0.
+ *
+ * The next packet pushed opens a new session.
+ */
+void ArqSender::reset() {
+  for (auto &slot : slots) {
+    slot.packet.release();
+  }
+  base       = 0;
+  next_seq   = 0;
+  srtt       = 0;
+  rttvar     = 0;
+  rto        = ARQ_INITIAL_TIMEOUT;
+  backoff_at = 0;
+  started    = false;
+  opening    = false;
+}
+
+/**
+ * @brief Open a new session, numbered differently from the last.
+ *
+ * The step from the last number comes from the microsecond clock, so a
+ * sender that restarted is unlikely to reopen the session it was in.
+ */
+void ArqSender::open_session() {
+  session_id = (session_id + 1 + micros() % (ARQ_SESSION_OPEN - 1)) &
+               (ARQ_SESSION_OPEN - 1);
+  opening    = true;
+}
+
+/**
+ * @brief Renumber the packets not yet acknowledged from 0, oldest first, in
+ * a new session.
+ *
+ * Packets only covered by the SACK bitmap are kept, since the receiver lost
+ * them when it restarted.
+ */
+void ArqSender::resync() {
+  PacketHandle held[ARQ_MAX_WINDOW];
+  uint16_t     count = 0;
+  for (uint16_t seq = base; seq != next_seq; seq++) {
+    held[count++] = std::move(slots[seq % ARQ_MAX_WINDOW].packet);
+  }
+  for (uint16_t seq = 0; seq < count; seq++) {
+    slots[seq].packet        = std::move(held[seq]);
+    slots[seq].transmissions = 0;
+    slots[seq].acked         = false;
+    slots[seq].lost          = false;
+  }
+  base     = 0;
+  next_seq = count;
+  open_session();
+}
+
+/**
+ * @brief Update the retransmit timeout with a round-trip time sample.
+ *
+ * @param rtt The round-trip time, in milliseconds, of a packet acknowledged
+ * on its first transmission.
+ */
+void ArqSender::sample_rtt(uint32_t rtt) {
+  if (srtt == 0) {
+    srtt   = rtt;
+    rttvar = rtt / 2;
+  } else {
+    uint32_t delta = srtt > rtt ? srtt - rtt : rtt - srtt;
+    rttvar         = (3 * rttvar + delta) / 4;
+    srtt           = (7 * srtt + rtt) / 8;
+  }
+  rto = srtt + (4 * rttvar > ARQ_TIMER_GRANULARITY ? 4 * rttvar
+                                                   : ARQ_TIMER_GRANULARITY);
+  if (rto < ARQ_MIN_TIMEOUT) {
+    rto = ARQ_MIN_TIMEOUT;
+  } else if (rto > ARQ_MAX_TIMEOUT) {
+    rto = ARQ_MAX_TIMEOUT;
+  }
+}
+
+/**
+ * @brief Construct a new ArqReceiver.
+ *
+ * @param pool The pool received packets are stored in.
+ * @param window The number of packets buffered at once, clamped to
+ * ARQ_MAX_WINDOW. This must match the sender's window.
+ */
+ArqReceiver::ArqReceiver(PacketPool &pool, uint8_t window)
+    : pool(pool), window(window > ARQ_MAX_WINDOW ? ARQ_MAX_WINDOW : window) {}
+
+/**
+ * @brief Process a data frame from the sender.
+ *
+ * @param frame The data frame.
+ * @return true The frame carried a new packet, which has been buffered.
+ * @return false The frame was a duplicate, outside the window, of another
+ * session, malformed, or the packet pool is exhausted. An acknowledgement
+ * should be sent anyway.
+ */
+bool ArqReceiver::receive(const PacketComm &frame) {
+  if (frame.data.size() <= ARQ_DATA_HEADER) {
+    return false;
+  }
+  uint8_t  id  = frame.data[0] & ~ARQ_SESSION_OPEN;
+  uint16_t seq = frame.data[1] | (frame.data[2] << 8);
+  if (frame.data[0] & ARQ_SESSION_OPEN) {
+    if (id != session || confirmed) {
+      reset();
+      session = id;
+    }
+  } else if (id != session) {
+    return false;
+  } else {
+    confirmed = true;
+  }
+  if ((uint16_t)(seq - delivered) >= window ||
+      slots[seq % ARQ_MAX_WINDOW]) {
+    return false;
+  }
+
+  PacketHandle packet = pool.acquire();
+  if (!packet) {
+    return false;
+  }
+  packet->wrapped.assign(frame.data.begin() + ARQ_DATA_HEADER,
+                         frame.data.end());
+  if (packet->Unwrap() < 0) {
+    print_debug(Helpers::RFM23, "ARQ frame does not hold a packetcomm packet");
+    return false;
+  }
+  slots[seq % ARQ_MAX_WINDOW] = std::move(packet);
+  while ((uint16_t)(expected - delivered) < window &&
+         slots[expected % ARQ_MAX_WINDOW]) {
+    expected++;
+  }
+  return true;
+}
+
+/**
+ * @brief Pull the next packet in sequence order.
+ *
+ * @param packet The handle that will own the packet, if there is one.
+ * @return true A packet has been pulled.
+ * @return false The next packet in sequence has not been received yet.
+ */
+bool ArqReceiver::pop(PacketHandle &packet) {
+  if (delivered == expected) {
+    return false;
+  }
+  packet = std::move(slots[delivered % ARQ_MAX_WINDOW]);
+  delivered++;
+  return true;
+}
+
+/**
+ * @brief Describe the packets received so far.
+ *
+ * @param ack The packet whose data will be set to the acknowledgement. Its
+ * header is left to the caller.
+ */
+void ArqReceiver::acknowledgement(PacketComm &ack) const {
+  uint32_t bitmap = 0;
+  for (uint8_t i = 0; i < 32; i++) {
+    uint16_t seq = expected + 1 + i;
+    if ((uint16_t)(seq - delivered) < window && slots[seq % ARQ_MAX_WINDOW]) {
+      bitmap |= (uint32_t)1 << i;
+    }
+  }
+  ack.data.resize(0);
+  ack.data.push_back(session);
+  ack.data.push_back(expected & 0xFF);
+  ack.data.push_back(expected >> 8);
+  for (uint8_t i = 0; i < 4; i++) {
+    ack.data.push_back((bitmap >> (8 * i)) & 0xFF);
+  }
+}
+
+/**
+ * @brief Drop every buffered packet and wait for a sender to open a session.
+ */
+void ArqReceiver::reset() {
+  for (auto &slot : slots) {
+    slot.release();
+  }
+  delivered = 0;
+  expected  = 0;
+  session   = ARQ_NO_SESSION;
+  confirmed = false;
+}
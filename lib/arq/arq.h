@@ -0,0 +1,221 @@
+/**
+ * @file arq.h
+ * @brief The header file for the selective-repeat ARQ transport.
+ *
+ * This file contains declarations for the sending and receiving ends of the
+ * sliding-window transport used to carry bulk data reliably over the radio.
+ */
+#ifndef _ARQ_H
+#define _ARQ_H
+
+#include "helpers.h"
+#include "packet_pool.h"
+#include <Arduino.h>
+#include <support/packetcomm.h>
+
+/**
+ * @brief The largest window, in packets, either end of the transport supports.
+ *
+ * This is also the number of packets covered by an acknowledgement's SACK
+ * bitmap, so it cannot exceed 32.
+ */
+#define ARQ_MAX_WINDOW        32
+/** @brief The size of the session and sequence number of each data frame. */
+#define ARQ_DATA_HEADER       3
+/** @brief The size of an acknowledgement's session, cumulative ack and SACK. */
+#define ARQ_ACK_SIZE          7
+/** @brief The flag in a data frame's session byte while the session opens. */
+#define ARQ_SESSION_OPEN      0x80
+/** @brief The session byte of an acknowledgement from a receiver with none. */
+#define ARQ_NO_SESSION        0x80
+/** @brief The retransmit timeout, in milliseconds, before any RTT sample. */
+#define ARQ_INITIAL_TIMEOUT   (3 * SECONDS)
+/** @brief The shortest retransmit timeout, in milliseconds. */
+#define ARQ_MIN_TIMEOUT       500
+/**
+ * @brief The smallest margin, in milliseconds, kept between the smoothed
+ * round-trip time and the retransmit timeout.
+ *
+ * An acknowledgement can wait behind a whole frame on a slow link, so the
+ * timeout must not collapse onto the round-trip time when it barely varies.
+ */
+#define ARQ_TIMER_GRANULARITY 200
+/** @brief The longest retransmit timeout, in milliseconds. */
+#define ARQ_MAX_TIMEOUT       (20 * SECONDS)
+/**
+ * @brief The number of packets sent after a packet that must be acknowledged
+ * before it is taken to be lost, and sent again without waiting for its
+ * timer.
+ */
+#define ARQ_REORDER_THRESHOLD 3
+/**
+ * @brief The time, in milliseconds, without an acknowledgement after which
+ * the link is taken to be down.
+ */
+#define ARQ_SILENCE_TIMEOUT   (60 * SECONDS)
+
+/**
+ * @brief The sending end of the selective-repeat ARQ transport.
+ *
+ * Packets pushed into the sender are numbered and held until the receiver
+ * acknowledges them. poll() hands out the next frame to transmit: a packet
+ * that has not been sent yet, or one whose retransmit timer has expired.
+ * Acknowledgements carry a cumulative ack and a SACK bitmap, so only the
+ * frames that were actually lost are sent again. A packet is sent again
+ * without waiting for its timer once ARQ_REORDER_THRESHOLD packets sent after
+ * it have been acknowledged, since a whole window sent back to back otherwise
+ * waits out a timeout that covers its own airtime for each loss.
+ *
+ * The retransmit timeout follows the smoothed round-trip time and its
+ * variance (RFC 6298). Only frames acknowledged on their first transmission
+ * are sampled, and the timeout doubles, at most once per timeout period,
+ * while frames have to be resent. Once nothing has been acknowledged for
+ * ARQ_SILENCE_TIMEOUT, as between passes, only the oldest packet is sent,
+ * once every ARQ_MAX_TIMEOUT, until the receiver answers.
+ *
+ * Packets are numbered from 0 in a session, so a sender that restarts cannot
+ * be confused with the one before it. The session is numbered from the
+ * microsecond clock when the first packet is pushed, and its frames carry
+ * ARQ_SESSION_OPEN until the receiver acknowledges one, which tells the
+ * receiver to start over. If the receiver later acknowledges another
+ * session, it has restarted, and the sender renumbers the packets it holds
+ * into a new session.
+ *
+ * A data frame's data is its session, its sequence number, little-endian,
+ * and the wrapped packet it carries:
+ *
+ * @verbatim
+1 byte    2 bytes    N bytes
++---------+----------+----------------+
+| session | sequence | wrapped packet |
++---------+----------+----------------+
+   @endverbatim
+ */
+class ArqSender {
+public:
+  ArqSender(uint8_t window = ARQ_MAX_WINDOW);
+
+  bool     push(PacketHandle &packet);
+  bool     poll(PacketComm &frame);
+  void     acknowledge(const PacketComm &ack);
+  void     reset();
+
+  /** @brief Whether the window has room for another packet. */
+  bool     ready() const { return (uint16_t)(next_seq - base) < window; }
+  /** @brief The number of packets not yet acknowledged. */
+  uint16_t in_flight() const { return next_seq - base; }
+  /** @brief The current retransmit timeout, in milliseconds. */
+  uint32_t timeout() const { return rto; }
+  /** @brief The total number of frames sent again, modulo 2^32. */
+  uint32_t retransmissions() const { return resent; }
+  /** @brief The number of the current session. */
+  uint8_t  session() const { return session_id; }
+  /** @brief Whether packets wait on a link silent for ARQ_SILENCE_TIMEOUT. */
+  bool     silent() const {
+    return base != next_seq && millis() - heard_at >= ARQ_SILENCE_TIMEOUT;
+  }
+
+private:
+  /** @brief A packet in the send window. */
+  struct arq_slot {
+    /** @brief The packet, already wrapped, or empty if the slot is unused. */
+    PacketHandle packet;
+    /** @brief The time, in milliseconds, the packet was last transmitted. */
+    uint32_t     sent_at       = 0;
+    /** @brief The order of the packet's last transmission among all sent. */
+    uint32_t     order         = 0;
+    /** @brief The number of times the packet has been transmitted. */
+    uint8_t      transmissions = 0;
+    /** @brief Whether the receiver has acknowledged the packet. */
+    bool         acked         = false;
+    /** @brief Whether packets sent after it show it to have been lost. */
+    bool         lost          = false;
+  };
+
+  void     sample_rtt(uint32_t rtt);
+  void     open_session();
+  void     resync();
+
+  /** @brief The packets in the send window, indexed by sequence number. */
+  arq_slot slots[ARQ_MAX_WINDOW];
+  /** @brief The number of packets allowed in flight at once. */
+  uint8_t  window;
+  /** @brief The sequence number of the oldest unacknowledged packet. */
+  uint16_t base       = 0;
+  /** @brief The sequence number given to the next packet pushed. */
+  uint16_t next_seq   = 0;
+  /** @brief The smoothed round-trip time, in milliseconds, or 0 if unknown. */
+  uint32_t srtt       = 0;
+  /** @brief The round-trip time variation, in milliseconds. */
+  uint32_t rttvar     = 0;
+  /** @brief The retransmit timeout, in milliseconds. */
+  uint32_t rto        = ARQ_INITIAL_TIMEOUT;
+  /** @brief The time, in milliseconds, the timeout was last doubled. */
+  uint32_t backoff_at = 0;
+  /** @brief The total number of frames sent again. */
+  uint32_t resent     = 0;
+  /** @brief The total number of frames sent, modulo 2^32. */
+  uint32_t sent       = 0;
+  /** @brief The number of the current session. */
+  uint8_t  session_id = 0;
+  /** @brief Whether a session has been opened since the last reset. */
+  bool     started    = false;
+  /** @brief Whether the receiver has yet to acknowledge the session. */
+  bool     opening    = false;
+  /**
+   * @brief The time, in milliseconds, of the last acknowledgement, or of the
+   * push that found the window empty.
+   */
+  uint32_t heard_at   = 0;
+};
+
+/**
+ * @brief The receiving end of the selective-repeat ARQ transport.
+ *
+ * Frames may arrive out of order or more than once. The receiver buffers up to
+ * a window of packets, hands them out in order through pop(), and describes
+ * what it holds in each acknowledgement.
+ *
+ * A frame opening a session the receiver is not in, or opening its own
+ * session again after the sender has confirmed it, starts the receiver over
+ * in that session. Frames of any other session are ignored.
+ *
+ * An acknowledgement's data is the receiver's session, or ARQ_NO_SESSION,
+ * the next sequence number it is missing, then a bitmap in which bit i is
+ * set if the packet numbered cumulative + 1 + i has been received, both
+ * little-endian:
+ *
+ * @verbatim
+1 byte    2 bytes      4 bytes
++---------+------------+-------------+
+| session | cumulative | SACK bitmap |
++---------+------------+-------------+
+   @endverbatim
+ */
+class ArqReceiver {
+public:
+  ArqReceiver(PacketPool &pool, uint8_t window = ARQ_MAX_WINDOW);
+
+  bool receive(const PacketComm &frame);
+  bool pop(PacketHandle &packet);
+  void acknowledgement(PacketComm &ack) const;
+  void reset();
+
+private:
+  /** @brief The pool received packets are stored in. */
+  PacketPool  &pool;
+  /** @brief The packets received but not yet popped, by sequence number. */
+  PacketHandle slots[ARQ_MAX_WINDOW];
+  /** @brief The number of packets buffered at once. */
+  uint8_t      window;
+  /** @brief The sequence number of the next packet to pop. */
+  uint16_t     delivered = 0;
+  /** @brief The sequence number of the first packet not yet received. */
+  uint16_t     expected  = 0;
+  /** @brief The session being received, or ARQ_NO_SESSION. */
+  uint8_t      session   = ARQ_NO_SESSION;
+  /** @brief Whether a frame has shown the sender saw the session open. */
+  bool         confirmed = false;
+};
+
+#endif // _ARQ_H
@@ -0,0 +1,73 @@
+/**
+ * @file beacon_aggregate.cpp
+ * @brief Aggregated beacon packing.
+ *
+ * This file contains definitions for packing beacons into an aggregate and
+ * unpacking them again.
+ */
+#include "beacon_aggregate.h"
+#include <string.h>
+
+/**
+ * @brief Get the length an aggregate would have with one more beacon.
+ *
+ * @param length The length of the aggregate so far, or 0 if it is empty.
+ * @param size The size of the beacon to be added.
+ * @return size_t The length of the aggregate holding the beacon.
+ */
+size_t beacon_aggregate_size(size_t length, size_t size) {
+  return (length == 0 ? 1 : length) + 1 + size;
+}
+
+/**
+ * @brief Add a beacon to an aggregate.
+ *
+ * @param aggregate The aggregate, with room for beacon_aggregate_size(length,
+ * size) bytes.
+ * @param length The length of the aggregate so far, or 0 to start a new one.
+ * @param beacon The beacon, starting with its type.
+ * @param size The size of the beacon, at most BEACON_AGGREGATE_MAX.
+ * @return size_t The new length of the aggregate, or 0 if the beacon is empty
+ * or too large.
+ */
+size_t pack_beacon_aggregate(uint8_t *aggregate, size_t length,
+                             const uint8_t *beacon, size_t size) {
+  if (size == 0 || size > BEACON_AGGREGATE_MAX) {
+    return 0;
+  }
+  if (length == 0) {
+    aggregate[length++] = BEACON_AGGREGATE_TYPE;
+  }
+  aggregate[length++] = (uint8_t)size;
+  memcpy(&aggregate[length], beacon, size);
+  return length + size;
+}
+
+/**
+ * @brief Find the beacons in an aggregate.
+ *
+ * @param aggregate The aggregate.
+ * @param length The length of the aggregate.
+ * @param beacons The array that will point into the aggregate at each beacon.
+ * @param max The most beacons to find.
+ * @return int16_t The number of beacons found, or -1 if the aggregate does
+ * not start with BEACON_AGGREGATE_TYPE, a beacon runs past its end, or it
+ * holds more than max beacons.
+ */
+int16_t unpack_beacon_aggregate(const uint8_t *aggregate, size_t length,
+                                beacon_span *beacons, size_t max) {
+  if (length == 0 || aggregate[0] != BEACON_AGGREGATE_TYPE) {
+    return -1;
+  }
+  size_t count  = 0;
+  size_t offset = 1;
+  while (offset < length) {
+    uint8_t size = aggregate[offset++];
+    if (size == 0 || size > length - offset || count == max) {
+      return -1;
+    }
+    beacons[count++] = {&aggregate[offset], size};
+    offset          += size;
+  }
+  return count;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file beacon_aggregate.h
+ * @brief The header file for aggregated beacon packing.
+ *
+ * This file contains declarations for packing several beacons into the data
+ * of a single packet, and unpacking them again. Like the beacon codec, it does
+ * not depend on the Teensy, so ground software can build it.
+ *
+ * After its type byte, an aggregate stores each beacon whole, preceded by its
+ * size.
+ *
+ * @verbatim
+1 byte 1 byte  N1 bytes  1 byte  N2 bytes
++------+------+----------+------+----------+-----
+| type | N1   | beacon 1 | N2   | beacon 2 | ...
++------+------+----------+------+----------+-----
+   @endverbatim
+ */
+#ifndef _BEACON_AGGREGATE_H
+#define _BEACON_AGGREGATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief The type byte at the start of an aggregate, BeaconType's value. */
+#define BEACON_AGGREGATE_TYPE 9
+/** @brief The largest beacon, in bytes, an aggregate can hold. */
+#define BEACON_AGGREGATE_MAX  UINT8_MAX
+
+/** @brief A beacon inside an aggregate. */
+struct beacon_span {
+  /** @brief The beacon, starting with its type. */
+  const uint8_t *data;
+  /** @brief The size of the beacon. */
+  uint8_t        size;
+};
+
+size_t  beacon_aggregate_size(size_t length, size_t size);
+size_t  pack_beacon_aggregate(uint8_t *aggregate, size_t length,
+                              const uint8_t *beacon, size_t size);
+int16_t unpack_beacon_aggregate(const uint8_t *aggregate, size_t length,
+                                beacon_span *beacons, size_t max);
+
+#endif // _BEACON_AGGREGATE_H
@@ -0,0 +1,304 @@
+/**
+ * @file beacon_codec.cpp
+ * @brief The beacon codec.
+ *
+ * This file contains definitions for the satellite and ground ends of the
+ * beacon codec.
+ */
+#include "beacon_codec.h"
+#include <math.h>
+#include <string.h>
+
+/** @brief The largest magnitude of a quantized reading. */
+#define BEACON_CODEC_MAX_VALUE (1L << 30)
+
+namespace {
+  /** @brief The powers of ten from 10^-8 to 10^7, for each exponent. */
+  const double POW10[16] = {
+      1e-8, 1e-7, 1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1,
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+  };
+
+  /** @brief Read a little-endian 32-bit word. */
+  uint32_t get_u32(const uint8_t *bytes) {
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+           ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+  }
+
+  /** @brief Write a little-endian 32-bit word. */
+  void put_u32(uint8_t *bytes, uint32_t word) {
+    for (uint8_t i = 0; i < 4; i++) {
+      bytes[i] = (word >> (8 * i)) & 0xFF;
+    }
+  }
+
+  /** @brief Write a variable-length integer, 7 bits per byte. */
+  size_t put_varint(uint8_t *out, uint32_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+      out[length++]   = (value & 0x7F) | 0x80;
+      value         >>= 7;
+    }
+    out[length++] = value;
+    return length;
+  }
+
+  /**
+   * @brief Read a variable-length integer.
+   *
+   * @return size_t The number of bytes read, or 0 if the integer runs past the
+   * end of the input or does not fit in 32 bits.
+   */
+  size_t get_varint(const uint8_t *in, size_t size, uint32_t &value) {
+    value = 0;
+    for (size_t i = 0; i < size && i < 5; i++) {
+      value |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+      if ((in[i] & 0x80) == 0) {
+        return i + 1;
+      }
+    }
+    return 0;
+  }
+
+  /** @brief Map a signed integer to an unsigned one, small magnitudes first. */
+  uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+  }
+
+  /** @brief Undo zigzag(). */
+  int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+  }
+
+  /** @brief Find the stream of a beacon type. */
+  beacon_stream *find_stream(beacon_stream *streams, uint8_t type) {
+    for (size_t i = 0; i < BEACON_CODEC_STREAMS; i++) {
+      if (streams[i].type == type) {
+        return &streams[i];
+      }
+    }
+    return nullptr;
+  }
+} // namespace
+
+/**
+ * @brief Construct a new BeaconEncoder.
+ *
+ * @param keyframe_interval The number of beacons of each type between
+ * keyframes, including the keyframe. A lost beacon can cost up to this many
+ * beacons of its type on the ground.
+ */
+BeaconEncoder::BeaconEncoder(uint8_t keyframe_interval)
+    : keyframe_interval(keyframe_interval == 0 ? 1 : keyframe_interval) {}
+
+/**
+ * @brief Register a beacon type for compression.
+ *
+ * @param type The beacon's type byte. It must not be 0.
+ * @param exponents The power of ten each reading is quantized to, from -8 to
+ * 7. This should be finer than the sensor's resolution.
+ * @param fields The number of float readings after the beacon's deci.
+ * @return true The beacon type will be compressed.
+ * @return false There are too many fields or streams, or an exponent is out of
+ * range.
+ */
+bool BeaconEncoder::add_stream(uint8_t type, const int8_t *exponents,
+                               uint8_t fields) {
+  if (type == 0 || fields == 0 || fields > BEACON_CODEC_MAX_FIELDS) {
+    return false;
+  }
+  for (uint8_t i = 0; i < fields; i++) {
+    if (exponents[i] < -8 || exponents[i] > 7) {
+      return false;
+    }
+  }
+  beacon_stream *stream = find_stream(streams, type);
+  if (stream == nullptr) {
+    stream = find_stream(streams, 0);
+  }
+  if (stream == nullptr) {
+    return false;
+  }
+  *stream        = {};
+  stream->type   = type;
+  stream->fields = fields;
+  memcpy(stream->exponent, exponents, fields);
+  return true;
+}
+
+/**
+ * @brief Compress a beacon.
+ *
+ * @param beacon The beacon structure, starting with its type.
+ * @param size The size of the beacon structure.
+ * @param out The buffer that will hold the compressed beacon, at least
+ * BEACON_CODEC_MAX_ENCODED bytes long.
+ * @return size_t The size of the compressed beacon, or 0 if the beacon should
+ * be sent as it is: its type has no stream, its size does not match, or a
+ * reading is not a finite number the quantization can hold.
+ */
+size_t BeaconEncoder::encode(const uint8_t *beacon, size_t size,
+                             uint8_t *out) {
+  if (size < BEACON_CODEC_HEADER) {
+    return 0;
+  }
+  beacon_stream *stream = find_stream(streams, beacon[0]);
+  if (stream == nullptr ||
+      size != BEACON_CODEC_HEADER + 4 * (size_t)stream->fields) {
+    return 0;
+  }
+
+  int32_t value[BEACON_CODEC_MAX_FIELDS];
+  for (uint8_t i = 0; i < stream->fields; i++) {
+    uint32_t word = get_u32(&beacon[BEACON_CODEC_HEADER + 4 * i]);
+    float    reading;
+    memcpy(&reading, &word, sizeof(reading));
+    double scaled = reading / POW10[stream->exponent[i] + 8];
+    if (!isfinite(scaled) || fabs(scaled) >= BEACON_CODEC_MAX_VALUE) {
+      return 0;
+    }
+    value[i] = (int32_t)lround(scaled);
+  }
+
+  uint32_t deci     = get_u32(&beacon[1]);
+  bool     keyframe = !stream->synced ||
+                  stream->since_keyframe + 1 >= keyframe_interval;
+  size_t   length   = 0;
+  stream->seq       = (stream->seq + 1) & 0x7F;
+  out[length++]     = stream->type;
+  out[length++]     = stream->seq | (keyframe ? BEACON_CODEC_KEYFRAME : 0);
+  if (keyframe) {
+    length += put_varint(&out[length], deci);
+    out[length++] = stream->fields;
+    for (uint8_t i = 0; i < stream->fields; i += 2) {
+      uint8_t low    = stream->exponent[i] & 0x0F;
+      uint8_t high   = i + 1 < stream->fields ? stream->exponent[i + 1] : 0;
+      out[length++]  = low | (high << 4);
+    }
+    for (uint8_t i = 0; i < stream->fields; i++) {
+      length += put_varint(&out[length], zigzag(value[i]));
+    }
+    stream->since_keyframe = 0;
+  } else {
+    length += put_varint(&out[length], deci - stream->deci);
+    for (uint8_t i = 0; i < stream->fields; i++) {
+      length += put_varint(&out[length], zigzag(value[i] - stream->value[i]));
+    }
+    stream->since_keyframe++;
+  }
+
+  stream->synced = true;
+  stream->deci   = deci;
+  memcpy(stream->value, value, sizeof(stream->value));
+  return length;
+}
+
+/**
+ * @brief Send a keyframe for the next beacon of every type.
+ *
+ * This should be called whenever compressed beacons may have been lost in
+ * bulk, such as after the radio link drops.
+ */
+void BeaconEncoder::reset() {
+  for (auto &stream : streams) {
+    stream.synced = false;
+  }
+}
+
+/**
+ * @brief Rebuild a beacon from its compressed form.
+ *
+ * @param in The compressed beacon.
+ * @param size The size of the compressed beacon.
+ * @param beacon The buffer that will hold the rebuilt beacon structure, at
+ * least BEACON_CODEC_MAX_DECODED bytes long.
+ * @return size_t The size of the rebuilt beacon, or 0 if the compressed beacon
+ * is malformed, or is a delta that does not follow the last beacon of its
+ * type.
+ */
+size_t BeaconDecoder::decode(const uint8_t *in, size_t size,
+                             uint8_t *beacon) {
+  if (size < 2 || in[0] == 0) {
+    return 0;
+  }
+  uint8_t type     = in[0];
+  uint8_t seq      = in[1] & 0x7F;
+  bool    keyframe = in[1] & BEACON_CODEC_KEYFRAME;
+  size_t  offset   = 2;
+  size_t  read;
+
+  beacon_stream *stream = find_stream(streams, type);
+  if (stream == nullptr) {
+    if (!keyframe || (stream = find_stream(streams, 0)) == nullptr) {
+      return 0;
+    }
+  }
+
+  beacon_stream next = *stream;
+  uint32_t      word;
+  if (keyframe) {
+    if ((read = get_varint(&in[offset], size - offset, next.deci)) == 0 ||
+        offset + read >= size) {
+      return 0;
+    }
+    offset      += read;
+    next.fields  = in[offset++];
+    if (next.fields == 0 || next.fields > BEACON_CODEC_MAX_FIELDS ||
+        offset + (next.fields + 1) / 2 > size) {
+      return 0;
+    }
+    for (uint8_t i = 0; i < next.fields; i++) {
+      uint8_t nibble   = (in[offset + i / 2] >> (4 * (i % 2))) & 0x0F;
+      next.exponent[i] = nibble >= 8 ? nibble - 16 : nibble;
+    }
+    offset += (next.fields + 1) / 2;
+    for (uint8_t i = 0; i < next.fields; i++) {
+      if ((read = get_varint(&in[offset], size - offset, word)) == 0) {
+        return 0;
+      }
+      offset        += read;
+      next.value[i]  = unzigzag(word);
+    }
+  } else {
+    if (!stream->synced || stream->type != type ||
+        seq != ((stream->seq + 1) & 0x7F)) {
+      return 0;
+    }
+    if ((read = get_varint(&in[offset], size - offset, word)) == 0) {
+      return 0;
+    }
+    offset    += read;
+    next.deci += word;
+    for (uint8_t i = 0; i < next.fields; i++) {
+      if ((read = get_varint(&in[offset], size - offset, word)) == 0) {
+        return 0;
+      }
+      offset         += read;
+      next.value[i]  += unzigzag(word);
+    }
+  }
+  if (offset != size) {
+    return 0;
+  }
+
+  next.type   = type;
+  next.seq    = seq;
+  next.synced = true;
+  *stream     = next;
+
+  beacon[0] = type;
+  put_u32(&beacon[1], stream->deci);
+  for (uint8_t i = 0; i < stream->fields; i++) {
+    float reading = stream->value[i] * POW10[stream->exponent[i] + 8];
+    memcpy(&word, &reading, sizeof(word));
+    put_u32(&beacon[BEACON_CODEC_HEADER + 4 * i], word);
+  }
+  return BEACON_CODEC_HEADER + 4 * (size_t)stream->fields;
+}
+
+/** @brief Forget every stream, and wait for the next keyframe of each. */
+void BeaconDecoder::reset() {
+  for (auto &stream : streams) {
+    stream = {};
+  }
+}
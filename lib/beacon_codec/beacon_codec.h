@@ -0,0 +1,120 @@
+/**
+ * @file beacon_codec.h
+ * @brief The header file for the beacon codec.
+ *
+ * This file contains declarations for the stateful codec that compresses
+ * sensor beacons into keyframes and deltas. It does not depend on the Teensy,
+ * so ground software can build it to decode what the satellite sends.
+ */
+#ifndef _BEACON_CODEC_H
+#define _BEACON_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief The size of a beacon's type and deci, ahead of its readings. */
+#define BEACON_CODEC_HEADER      5
+/** @brief The most readings a compressed beacon can hold. */
+#define BEACON_CODEC_MAX_FIELDS  16
+/** @brief The number of beacon types either end of the codec can track. */
+#define BEACON_CODEC_STREAMS     8
+/** @brief The flag set in a compressed beacon's control byte on keyframes. */
+#define BEACON_CODEC_KEYFRAME    0x80
+/**
+ * @brief The type byte ahead of a compressed beacon sent on its own or in an
+ * aggregate, BeaconType's value.
+ */
+#define BEACON_CODEC_TYPE        10
+/** @brief The largest beacon, in bytes, the codec can produce. */
+#define BEACON_CODEC_MAX_ENCODED                                               \
+  (2 + 5 + 1 + BEACON_CODEC_MAX_FIELDS / 2 + 5 * BEACON_CODEC_MAX_FIELDS)
+/** @brief The largest beacon, in bytes, the decoder can rebuild. */
+#define BEACON_CODEC_MAX_DECODED                                               \
+  (BEACON_CODEC_HEADER + 4 * BEACON_CODEC_MAX_FIELDS)
+
+/** @brief The state of the beacons of one type, on either end of the codec. */
+struct beacon_stream {
+  /** @brief The beacon type, or 0 if the stream is unused. */
+  uint8_t  type;
+  /** @brief The number of float readings in each beacon. */
+  uint8_t  fields;
+  /** @brief The power of ten each reading is quantized to. */
+  int8_t   exponent[BEACON_CODEC_MAX_FIELDS];
+  /** @brief The sequence number of the last beacon, modulo 128. */
+  uint8_t  seq;
+  /** @brief The number of deltas since the last keyframe. */
+  uint8_t  since_keyframe;
+  /** @brief Whether a keyframe has been sent or received. */
+  bool     synced;
+  /** @brief The deci of the last beacon. */
+  uint32_t deci;
+  /** @brief The quantized readings of the last beacon. */
+  int32_t  value[BEACON_CODEC_MAX_FIELDS];
+};
+
+/**
+ * @brief The satellite end of the beacon codec.
+ *
+ * Beacons made of a type byte, a 32-bit deci and a run of floats, such as the
+ * IMU, magnetometer, current and temperature beacons, are compressed once a
+ * stream has been registered for their type. Each reading is quantized to a
+ * power of ten chosen below its sensor's resolution. The first beacon, and
+ * every keyframe_interval-th one after it, is sent whole as a keyframe. The
+ * others only carry the change from the beacon before, which is usually a
+ * single byte per reading.
+ *
+ * A compressed beacon starts with the beacon type and a control byte holding
+ * the keyframe flag and a 7-bit sequence number. Every number after that is a
+ * variable-length integer, 7 bits per byte, and signed numbers are zigzag
+ * encoded.
+ *
+ * @verbatim
+Keyframe:
+1 byte 1 byte      varint 1 byte  N/2 bytes     varint x N
++------+----------+------+-------+-------------+-------------------+
+| type | 0x80|seq | deci | N     | exponents[] | quantized value[] |
++------+----------+------+-------+-------------+-------------------+
+Delta:
+1 byte 1 byte      varint        varint x N
++------+----------+-------------+------------------------------+
+| type | seq      | deci change | change in quantized value[]  |
++------+----------+-------------+------------------------------+
+   @endverbatim
+ *
+ * Exponents are packed two to a byte, four bits each, low nibble first.
+ */
+class BeaconEncoder {
+public:
+  BeaconEncoder(uint8_t keyframe_interval);
+
+  bool   add_stream(uint8_t type, const int8_t *exponents, uint8_t fields);
+  size_t encode(const uint8_t *beacon, size_t size, uint8_t *out);
+  void   reset();
+
+private:
+  /** @brief The registered streams. */
+  beacon_stream streams[BEACON_CODEC_STREAMS] = {};
+  /** @brief The number of beacons between keyframes. */
+  uint8_t       keyframe_interval;
+};
+
+/**
+ * @brief The ground end of the beacon codec.
+ *
+ * The decoder rebuilds the original beacon structure from each compressed
+ * beacon, to within the quantization of its readings. It needs no knowledge
+ * of the beacon types, as keyframes describe their own layout. A delta that
+ * does not follow the last beacon of its type cannot be decoded, and neither
+ * can any later delta until the next keyframe.
+ */
+class BeaconDecoder {
+public:
+  size_t decode(const uint8_t *in, size_t size, uint8_t *beacon);
+  void   reset();
+
+private:
+  /** @brief The streams seen so far. */
+  beacon_stream streams[BEACON_CODEC_STREAMS] = {};
+};
+
+#endif // _BEACON_CODEC_H
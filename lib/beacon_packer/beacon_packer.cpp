@@ -0,0 +1,93 @@
+/**
+ * @file beacon_packer.cpp
+ * @brief The beacon packer.
+ *
+ * This file contains definitions for the packer that compresses beacons and
+ * collects the small ones into shared packets for the radio.
+ */
+#include "beacon_packer.h"
+
+/**
+ * @brief Construct a new beacon packer.
+ *
+ * @param encoder The codec compressing registered beacon types.
+ * @param capacity The most data bytes in an aggregate packet. A packer with
+ * no room for any beacon sends each one on its own.
+ * @param deadline The longest time, in milliseconds, a beacon waits in the
+ * aggregate before flush_if_due() sends it.
+ * @param acquire The function acquiring each packet, addressed as a beacon.
+ * @param route The function sending each finished packet.
+ */
+BeaconPacker::BeaconPacker(BeaconEncoder &encoder, size_t capacity,
+                           uint32_t deadline, beacon_acquirer acquire,
+                           beacon_router route)
+    : encoder(encoder), capacity(capacity), deadline(deadline),
+      acquire(acquire), route(route) {}
+
+/**
+ * @brief Send a beacon, packed together with other beacons.
+ *
+ * @param beacon The beacon structure, starting with its BeaconType.
+ * @param size The size of the beacon structure.
+ * @return PushResult The result of routing any packet this sent, or Accepted
+ * if the beacon is still waiting in the aggregate.
+ */
+PushResult BeaconPacker::add(const void *beacon, size_t size) {
+  const uint8_t *bytes = (const uint8_t *)beacon;
+  uint8_t        compressed[1 + BEACON_CODEC_MAX_ENCODED];
+  Threads::Scope lock(pending_mtx);
+  size_t         encoded = encoder.encode(bytes, size, &compressed[1]);
+  if (encoded > 0) {
+    compressed[0] = BEACON_CODEC_TYPE;
+    bytes         = compressed;
+    size          = 1 + encoded;
+  }
+
+  if (beacon_aggregate_size(0, size) > capacity) {
+    PacketHandle packet = acquire();
+    if (!packet) {
+      return PushResult::Rejected;
+    }
+    packet->data.assign(bytes, bytes + size);
+    return route(std::move(packet));
+  }
+
+  PushResult result = PushResult::Accepted;
+  if (pending && beacon_aggregate_size(pending->data.size(), size) > capacity) {
+    result = route(std::move(pending));
+  }
+  if (!pending) {
+    pending = acquire();
+    if (!pending) {
+      return PushResult::Rejected;
+    }
+    pending_age = 0;
+  }
+  vector<uint8_t> &data   = pending->data;
+  size_t           length = data.size();
+  data.resize(beacon_aggregate_size(length, size));
+  pack_beacon_aggregate(data.data(), length, bytes, size);
+  return result;
+}
+
+/**
+ * @brief Send the aggregate packet now, however full it is.
+ *
+ * @return PushResult The result of routing the aggregate, or Accepted if there
+ * was nothing to send.
+ */
+PushResult BeaconPacker::flush() {
+  Threads::Scope lock(pending_mtx);
+  if (!pending) {
+    return PushResult::Accepted;
+  }
+  return route(std::move(pending));
+}
+
+/** @brief Send the aggregate packet if it has waited past the deadline. */
+void BeaconPacker::flush_if_due() {
+  Threads::Scope lock(pending_mtx);
+  if (pending && pending_age >= deadline) {
+    route(std::move(pending));
+  }
+}
@@ -0,0 +1,64 @@
+/**
+ * @file beacon_packer.h
+ * @brief The header file for the beacon packer.
+ *
+ * This file contains declarations for the packer that compresses beacons and
+ * collects the small ones into shared packets for the radio.
+ */
+#ifndef _BEACON_PACKER_H
+#define _BEACON_PACKER_H
+
+#include <Arduino.h>
+#include <TeensyThreads.h>
+#include <beacon_aggregate.h>
+#include <beacon_codec.h>
+#include <packet_pool.h>
+#include <priority_queue.h>
+
+/**
+ * @brief Packs beacons into packets for the radio.
+ *
+ * Small beacons are collected into a single aggregate packet, so they share
+ * one PacketComm header and CRC and fill whole radio frames. The aggregate is
+ * sent once the next beacon would not fit in capacity bytes, or by
+ * flush_if_due() once its first beacon has waited deadline milliseconds. A
+ * beacon too large to share a packet is sent on its own.
+ *
+ * Beacon types registered with the encoder are first compressed into a
+ * BEACON_CODEC_TYPE beacon. The aggregate layout is described in
+ * beacon_aggregate.h.
+ */
+class BeaconPacker {
+public:
+  /** @brief A function that acquires an empty beacon packet. */
+  typedef PacketHandle (*beacon_acquirer)();
+  /** @brief A function that sends a finished beacon packet. */
+  typedef PushResult (*beacon_router)(PacketHandle packet);
+
+  BeaconPacker(BeaconEncoder &encoder, size_t capacity, uint32_t deadline,
+               beacon_acquirer acquire, beacon_router route);
+
+  PushResult add(const void *beacon, size_t size);
+  PushResult flush();
+  void       flush_if_due();
+
+private:
+  /** @brief The codec compressing registered beacon types. */
+  BeaconEncoder  &encoder;
+  /** @brief The most data bytes in an aggregate packet. */
+  size_t          capacity;
+  /** @brief The longest time, in milliseconds, a beacon waits to be sent. */
+  uint32_t        deadline;
+  /** @brief The function acquiring each packet. */
+  beacon_acquirer acquire;
+  /** @brief The function sending each finished packet. */
+  beacon_router   route;
+  /** @brief The aggregate packet being filled, if any. */
+  PacketHandle    pending;
+  /** @brief The time since the first beacon was added to pending. */
+  elapsedMillis   pending_age;
+  /** @brief The mutex for pending and the encoder. */
+  Threads::Mutex  pending_mtx;
+};
+
+#endif // _BEACON_PACKER_H
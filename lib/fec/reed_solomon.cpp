@@ -0,0 +1,255 @@
+/**
+ * @file reed_solomon.cpp
+ * @brief The Reed-Solomon codec.
+ *
+ * This file contains definitions for the table-driven Reed-Solomon encoder
+ * and decoder. The decoder finds the error locator with Berlekamp-Massey, its
+ * roots with a Chien search, and the error values with Forney's algorithm.
+ */
+#include "reed_solomon.h"
+#include <string.h>
+
+/** @brief The field's primitive polynomial, x^8 + x^4 + x^3 + x^2 + 1. */
+#define RS_GFPOLY 0x11D
+/** @brief The log of zero, which has no logarithm. */
+#define RS_A0     RS_NN
+
+uint8_t ReedSolomon::alpha_to[RS_NN + 1];
+uint8_t ReedSolomon::index_of[RS_NN + 1];
+bool    ReedSolomon::tables_ready = false;
+
+/**
+ * @brief Construct a new ReedSolomon codec.
+ *
+ * @param nroots The number of parity symbols added to each codeword, clamped
+ * to between 1 and RS_MAX_ROOTS.
+ */
+ReedSolomon::ReedSolomon(uint8_t nroots)
+    : nroots(nroots > RS_MAX_ROOTS ? RS_MAX_ROOTS
+             : nroots == 0         ? 1
+                                   : nroots) {
+  init_tables();
+
+  // Multiply out (x - alpha^0)(x - alpha^1)...(x - alpha^(nroots - 1)).
+  uint8_t poly[RS_MAX_ROOTS + 1] = {1};
+  for (uint8_t i = 0; i < this->nroots; i++) {
+    poly[i + 1] = 1;
+    for (uint8_t j = i; j > 0; j--) {
+      if (poly[j] != 0) {
+        poly[j] = poly[j - 1] ^ alpha_to[modnn(index_of[poly[j]] + i)];
+      } else {
+        poly[j] = poly[j - 1];
+      }
+    }
+    poly[0] = alpha_to[modnn(index_of[poly[0]] + i)];
+  }
+  for (uint8_t i = 0; i <= this->nroots; i++) {
+    genpoly[i] = index_of[poly[i]];
+  }
+}
+
+/** @brief Build the log and antilog tables shared by every codec. */
+void ReedSolomon::init_tables() {
+  if (tables_ready) {
+    return;
+  }
+  uint16_t sr = 1;
+  for (uint16_t i = 0; i < RS_NN; i++) {
+    index_of[sr] = i;
+    alpha_to[i]  = sr;
+    sr         <<= 1;
+    if (sr & 0x100) {
+      sr ^= RS_GFPOLY;
+    }
+  }
+  index_of[0]     = RS_A0;
+  alpha_to[RS_A0] = 0;
+  tables_ready    = true;
+}
+
+/**
+ * @brief Compute the parity symbols of a message.
+ *
+ * @param data The message.
+ * @param length The length of the message, at most RS_NN - roots().
+ * @param parity The buffer that will hold the roots() parity symbols.
+ */
+void ReedSolomon::encode(const uint8_t *data, size_t length,
+                         uint8_t *parity) const {
+  memset(parity, 0, nroots);
+  for (size_t i = 0; i < length; i++) {
+    uint8_t feedback = index_of[data[i] ^ parity[0]];
+    if (feedback == RS_A0) {
+      for (uint8_t j = 1; j < nroots; j++) {
+        parity[j - 1] = parity[j];
+      }
+      parity[nroots - 1] = 0;
+      continue;
+    }
+    // Shift the register one place as the feedback is added in.
+    for (uint8_t j = 1; j < nroots; j++) {
+      parity[j - 1] =
+          parity[j] ^ alpha_to[modnn(feedback + genpoly[nroots - j])];
+    }
+    parity[nroots - 1] = alpha_to[modnn(feedback + genpoly[0])];
+  }
+}
+
+/**
+ * @brief Correct the errors in a received codeword.
+ *
+ * @param codeword The message followed by its parity symbols. Errors are
+ * corrected in place.
+ * @param length The length of the codeword, including the parity symbols.
+ * @return int16_t The number of symbols corrected, or -1 if the codeword has
+ * more errors than the code can correct. An uncorrectable codeword is left
+ * untouched.
+ */
+int16_t ReedSolomon::decode(uint8_t *codeword, size_t length) const {
+  if (length <= nroots || length > RS_NN) {
+    return -1;
+  }
+  uint8_t pad = RS_NN - length;
+
+  // The syndromes are the codeword evaluated at each root of the generator.
+  uint8_t syndromes[RS_MAX_ROOTS];
+  uint8_t any_error = 0;
+  for (uint8_t i = 0; i < nroots; i++) {
+    uint8_t s = codeword[0];
+    for (size_t j = 1; j < length; j++) {
+      s = s == 0 ? codeword[j]
+                 : codeword[j] ^ alpha_to[modnn(index_of[s] + i)];
+    }
+    any_error    |= s;
+    syndromes[i]  = index_of[s];
+  }
+  if (any_error == 0) {
+    return 0;
+  }
+
+  // Berlekamp-Massey: find the shortest error locator polynomial lambda.
+  uint8_t lambda[RS_MAX_ROOTS + 1] = {1};
+  uint8_t b[RS_MAX_ROOTS + 1];
+  uint8_t t[RS_MAX_ROOTS + 1];
+  for (uint8_t i = 0; i <= nroots; i++) {
+    b[i] = index_of[lambda[i]];
+  }
+  uint8_t el = 0;
+  for (uint8_t r = 1; r <= nroots; r++) {
+    uint8_t discrepancy = 0;
+    for (uint8_t i = 0; i < r; i++) {
+      if (lambda[i] != 0 && syndromes[r - i - 1] != RS_A0) {
+        discrepancy ^=
+            alpha_to[modnn(index_of[lambda[i]] + syndromes[r - i - 1])];
+      }
+    }
+    discrepancy = index_of[discrepancy];
+    if (discrepancy == RS_A0) {
+      memmove(&b[1], b, nroots);
+      b[0] = RS_A0;
+      continue;
+    }
+    t[0] = lambda[0];
+    for (uint8_t i = 0; i < nroots; i++) {
+      t[i + 1] = b[i] != RS_A0
+                     ? lambda[i + 1] ^ alpha_to[modnn(discrepancy + b[i])]
+                     : lambda[i + 1];
+    }
+    if (2 * el <= r - 1) {
+      el = r - el;
+      for (uint8_t i = 0; i <= nroots; i++) {
+        b[i] = lambda[i] == 0
+                   ? RS_A0
+                   : modnn(index_of[lambda[i]] - discrepancy + RS_NN);
+      }
+    } else {
+      memmove(&b[1], b, nroots);
+      b[0] = RS_A0;
+    }
+    memcpy(lambda, t, nroots + 1);
+  }
+
+  uint8_t degree = 0;
+  for (uint8_t i = 0; i <= nroots; i++) {
+    lambda[i] = index_of[lambda[i]];
+    if (lambda[i] != RS_A0) {
+      degree = i;
+    }
+  }
+  if (degree == 0) {
+    return -1;
+  }
+
+  // Chien search: the roots of lambda are the inverses of the error locations.
+  uint8_t reg[RS_MAX_ROOTS + 1];
+  uint8_t roots[RS_MAX_ROOTS];
+  uint8_t locations[RS_MAX_ROOTS];
+  uint8_t count = 0;
+  memcpy(&reg[1], &lambda[1], nroots);
+  for (uint16_t i = 1, k = 0; i <= RS_NN; i++, k = modnn(k + 1)) {
+    uint8_t q = 1;
+    for (uint8_t j = degree; j > 0; j--) {
+      if (reg[j] != RS_A0) {
+        reg[j]  = modnn(reg[j] + j);
+        q      ^= alpha_to[reg[j]];
+      }
+    }
+    if (q != 0) {
+      continue;
+    }
+    roots[count]     = i;
+    locations[count] = k;
+    if (++count == degree) {
+      break;
+    }
+  }
+  if (count != degree) {
+    return -1;
+  }
+
+  // The error evaluator omega = syndromes * lambda mod x^nroots.
+  uint8_t omega[RS_MAX_ROOTS + 1];
+  for (uint8_t i = 0; i < degree; i++) {
+    uint8_t tmp = 0;
+    for (int16_t j = i; j >= 0; j--) {
+      if (syndromes[i - j] != RS_A0 && lambda[j] != RS_A0) {
+        tmp ^= alpha_to[modnn(syndromes[i - j] + lambda[j])];
+      }
+    }
+    omega[i] = index_of[tmp];
+  }
+
+  // Forney: find every error value before applying any of them, so an error
+  // located in the padding leaves the codeword untouched.
+  uint8_t values[RS_MAX_ROOTS];
+  for (uint8_t j = 0; j < count; j++) {
+    if (locations[j] < pad) {
+      return -1;
+    }
+    uint8_t num = 0;
+    for (int16_t i = degree - 1; i >= 0; i--) {
+      if (omega[i] != RS_A0) {
+        num ^= alpha_to[modnn(omega[i] + i * roots[j])];
+      }
+    }
+    // With the first root at alpha^0, X^(1 - fcr) is the error locator itself.
+    uint8_t scale = modnn(RS_NN - roots[j] + RS_NN);
+    uint8_t den   = 0;
+    for (int16_t i = (degree < nroots ? degree : nroots - 1) & ~1; i >= 0;
+         i -= 2) {
+      if (lambda[i + 1] != RS_A0) {
+        den ^= alpha_to[modnn(lambda[i + 1] + i * roots[j])];
+      }
+    }
+    if (den == 0) {
+      return -1;
+    }
+    values[j] = num == 0 ? 0
+                         : alpha_to[modnn(index_of[num] + scale + RS_NN -
+                                          index_of[den])];
+  }
+  for (uint8_t j = 0; j < count; j++) {
+    codeword[locations[j] - pad] ^= values[j];
+  }
+  return count;
+}
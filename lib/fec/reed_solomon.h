@@ -0,0 +1,65 @@
+/**
+ * @file reed_solomon.h
+ * @brief The header file for the Reed-Solomon codec.
+ *
+ * This file contains declarations for the table-driven Reed-Solomon encoder
+ * and decoder used to protect radio frames.
+ */
+#ifndef _REED_SOLOMON_H
+#define _REED_SOLOMON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief The most parity symbols a ReedSolomon codec can use. */
+#define RS_MAX_ROOTS 32
+/** @brief The length of a full codeword, in symbols. */
+#define RS_NN        255
+
+/**
+ * @brief A Reed-Solomon codec over GF(256).
+ *
+ * The field uses the primitive polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D),
+ * and the generator polynomial has the consecutive roots alpha^0 to
+ * alpha^(nroots - 1). Codewords are shortened: any message up to
+ * RS_NN - nroots bytes long is encoded as if padded with leading zeros.
+ *
+ * The codec corrects up to nroots / 2 byte errors anywhere in a codeword.
+ * Every multiplication is a lookup in the shared log and antilog tables, which
+ * are built once, the first time a codec is constructed.
+ */
+class ReedSolomon {
+public:
+  ReedSolomon(uint8_t nroots);
+
+  void    encode(const uint8_t *data, size_t length, uint8_t *parity) const;
+  int16_t decode(uint8_t *codeword, size_t length) const;
+
+  /** @brief The number of parity symbols added to each codeword. */
+  uint8_t roots() const { return nroots; }
+
+private:
+  static void    init_tables();
+  /** @brief Reduce a sum of logarithms modulo RS_NN. */
+  static uint8_t modnn(int x) {
+    while (x >= RS_NN) {
+      x -= RS_NN;
+      x  = (x >> 8) + (x & RS_NN);
+    }
+    return x;
+  }
+
+  /** @brief The antilog table: alpha_to[i] is alpha^i. */
+  static uint8_t alpha_to[RS_NN + 1];
+  /** @brief The log table, with index_of[0] set to RS_NN to stand for -inf. */
+  static uint8_t index_of[RS_NN + 1];
+  /** @brief Whether the log and antilog tables have been built. */
+  static bool    tables_ready;
+
+  /** @brief The number of parity symbols. */
+  uint8_t        nroots;
+  /** @brief The generator polynomial's coefficients, in log form. */
+  uint8_t        genpoly[RS_MAX_ROOTS + 1];
+};
+
+#endif // _REED_SOLOMON_H
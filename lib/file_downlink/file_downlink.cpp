@@ -0,0 +1,207 @@
+/**
+ * @file file_downlink.cpp
+ * @brief The chunked file downlink.
+ *
+ * This file contains definitions for the Teensy's end of a file downlink.
+ */
+#include "file_downlink.h"
+
+namespace {
+  /** @brief Append a little-endian integer of the given size to a packet. */
+  void put_le(PacketComm &packet, uint32_t value, uint8_t size) {
+    for (uint8_t i = 0; i < size; i++) {
+      packet.data.push_back(value >> (8 * i));
+    }
+  }
+
+  /** @brief Read a little-endian integer of the given size from a packet. */
+  uint32_t get_le(const PacketComm &packet, size_t at, uint8_t size) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < size; i++) {
+      value |= (uint32_t)packet.data[at + i] << (8 * i);
+    }
+    return value;
+  }
+} // namespace
+
+/**
+ * @brief Construct a new FileDownlink, with no transfer under way.
+ *
+ * @param chunk_size The most file bytes in each chunk sent to ground.
+ */
+FileDownlink::FileDownlink(uint16_t chunk_size) : chunk_size(chunk_size) {}
+
+/**
+ * @brief Start sending a file to ground.
+ *
+ * If the same file is already being sent and the offset falls within the
+ * bytes still in the staging buffer, sent or not, those bytes are kept, so
+ * chunks ground missed at the end of a pass are sent again without asking
+ * the RPi. Otherwise the transfer starts over.
+ *
+ * @param file The ID of the file on the RPi.
+ * @param offset The offset of the first byte ground wants.
+ */
+void FileDownlink::start(uint16_t file, uint32_t offset) {
+  // Staging a byte overwrites the one FILE_STAGE_SIZE before it.
+  uint32_t kept = staged_to - started_at > FILE_STAGE_SIZE
+                      ? staged_to - FILE_STAGE_SIZE
+                      : started_at;
+  if (running && file == file_id && offset >= kept && offset <= staged_to) {
+    sent_to    = offset;
+    unanswered = 0;
+    return;
+  }
+  running    = true;
+  ending     = false;
+  file_id    = file;
+  file_size  = 0;
+  started_at = offset;
+  sent_to    = offset;
+  staged_to  = offset;
+  reading    = false;
+  unanswered = 0;
+}
+
+/** @brief Stop the transfer, dropping any staged bytes. */
+void FileDownlink::cancel() {
+  running = false;
+  ending  = false;
+  reading = false;
+}
+
+/**
+ * @brief Get the next read request for the RPi, if one is due.
+ *
+ * A read is requested when none is outstanding and the staging buffer has
+ * room for a whole read, or for the rest of the file. An unanswered request
+ * is repeated after FILE_READ_TIMEOUT, and the transfer fails after
+ * FILE_READ_ATTEMPTS of them.
+ *
+ * @param request The packet whose data will be set to the read request. Its
+ * header is left to the caller.
+ * @return true request holds a read request to send to the RPi.
+ * @return false No read is due.
+ */
+bool FileDownlink::read_request(PacketComm &request) {
+  if (!running || ending || (file_size != 0 && staged_to >= file_size)) {
+    return false;
+  }
+  uint32_t now = millis();
+  if (reading) {
+    if (now - read_at < FILE_READ_TIMEOUT) {
+      return false;
+    }
+    if (++unanswered >= FILE_READ_ATTEMPTS) {
+      print_debug(Helpers::RPI, "RPi did not answer reads of file ", file_id);
+      cancel();
+      return false;
+    }
+  }
+
+  uint32_t wanted = FILE_READ_SIZE;
+  if (file_size != 0 && file_size - staged_to < wanted) {
+    wanted = file_size - staged_to;
+  }
+  if (FILE_STAGE_SIZE - staged() < wanted) {
+    return false;
+  }
+  request.data.resize(0);
+  put_le(request, file_id, 2);
+  put_le(request, staged_to, 4);
+  put_le(request, wanted, 2);
+  reading = true;
+  read_at = now;
+  return true;
+}
+
+/**
+ * @brief Stage the RPi's answer to a read request.
+ *
+ * @param chunk The chunk from the RPi.
+ * @return true The chunk answered the outstanding read, and has been staged.
+ * @return false The chunk was malformed, late, or for another file.
+ */
+bool FileDownlink::receive(const PacketComm &chunk) {
+  if (!running || !reading || chunk.data.size() < FILE_CHUNK_HEADER) {
+    return false;
+  }
+  uint16_t file   = get_le(chunk, 0, 2);
+  uint32_t offset = get_le(chunk, 2, 4);
+  uint32_t size   = get_le(chunk, 6, 4);
+  size_t   length = chunk.data.size() - FILE_CHUNK_HEADER;
+  if (file != file_id || offset != staged_to ||
+      length > FILE_STAGE_SIZE - staged()) {
+    return false;
+  }
+  reading    = false;
+  unanswered = 0;
+  file_size  = size;
+  if (length == 0 || size == FILE_SIZE_MISSING) {
+    ending = true;
+    return true;
+  }
+
+  const uint8_t *bytes = &chunk.data[FILE_CHUNK_HEADER];
+  size_t         start = staged_to & (FILE_STAGE_SIZE - 1);
+  size_t         first = length < FILE_STAGE_SIZE - start
+                             ? length
+                             : FILE_STAGE_SIZE - start;
+  memcpy(&stage[start], bytes, first);
+  memcpy(stage, bytes + first, length - first);
+  staged_to += length;
+  return true;
+}
+
+/**
+ * @brief Get the next chunk of the file for ground.
+ *
+ * Chunks are full, apart from the last one of the file, so a partly staged
+ * chunk waits for the next read. Once the transfer has ended, ground gets a
+ * chunk with no bytes if the last chunk did not already reach the end of the
+ * file.
+ *
+ * @param chunk The packet whose data will be set to the chunk. Its header is
+ * left to the caller.
+ * @return true chunk holds the next chunk to send.
+ * @return false Nothing is ready to send.
+ */
+bool FileDownlink::next_chunk(PacketComm &chunk) {
+  if (!running) {
+    return false;
+  }
+  bool     complete = file_size != 0 && staged_to >= file_size;
+  uint32_t length   = staged() < chunk_size ? staged() : chunk_size;
+  if (length == 0 && !ending) {
+    return false;
+  }
+  if (length < chunk_size && !complete && !ending) {
+    return false;
+  }
+
+  put_header(chunk, sent_to);
+  size_t start = sent_to & (FILE_STAGE_SIZE - 1);
+  size_t first =
+      length < FILE_STAGE_SIZE - start ? length : FILE_STAGE_SIZE - start;
+  chunk.data.insert(chunk.data.end(), &stage[start], &stage[start] + first);
+  chunk.data.insert(chunk.data.end(), stage, stage + (length - first));
+  sent_to += length;
+  if (staged() == 0 && (complete || ending)) {
+    running = false;
+    ending  = false;
+  }
+  return true;
+}
+
+/**
+ * @brief Set a packet's data to the header of a chunk.
+ *
+ * @param packet The packet.
+ * @param offset The offset of the chunk's first byte.
+ */
+void FileDownlink::put_header(PacketComm &packet, uint32_t offset) const {
+  packet.data.resize(0);
+  put_le(packet, file_id, 2);
+  put_le(packet, offset, 4);
+  put_le(packet, file_size, 4);
+}
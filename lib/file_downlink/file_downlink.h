@@ -0,0 +1,117 @@
+/**
+ * @file file_downlink.h
+ * @brief The header file for the chunked file downlink.
+ *
+ * This file contains declarations for the transfer that pulls a file from the
+ * Raspberry Pi in chunks, stages it, and cuts it into packets for the radio.
+ */
+#ifndef _FILE_DOWNLINK_H
+#define _FILE_DOWNLINK_H
+
+#include "helpers.h"
+#include <Arduino.h>
+#include <support/packetcomm.h>
+
+/**
+ * @brief The size, in bytes, of the buffer file data is staged in between the
+ * RPi and the radio. Must be a power of two.
+ */
+#define FILE_STAGE_SIZE     8192
+/** @brief The size of a read request: file ID, offset and length. */
+#define FILE_READ_HEADER    8
+/** @brief The size of the header of a chunk: file ID, offset and file size. */
+#define FILE_CHUNK_HEADER   10
+/** @brief The most file bytes asked of the RPi at once. */
+#define FILE_READ_SIZE      1024
+/** @brief The time, in milliseconds, the RPi has to answer a read request. */
+#define FILE_READ_TIMEOUT   (1 * SECONDS)
+/** @brief The number of unanswered read requests before a transfer fails. */
+#define FILE_READ_ATTEMPTS  5
+/** @brief The file size the RPi reports for a file it does not have. */
+#define FILE_SIZE_MISSING   0xFFFFFFFF
+
+/**
+ * @brief The Teensy's end of a file downlink.
+ *
+ * Ground starts a transfer by naming a file and the offset to start from.
+ * read_request() then asks the RPi for the bytes after those already staged,
+ * one read at a time, whenever the staging buffer has room. receive() stages
+ * the RPi's answer, and next_chunk() cuts the staged bytes into chunks for
+ * the radio, in order.
+ *
+ * Every chunk says where it belongs in the file, so ground can write it
+ * straight to disk, and a transfer cut short by the end of a pass is resumed
+ * by starting it again from the first byte ground is missing.
+ *
+ * A read request's data is the file ID, the offset and the number of bytes
+ * wanted. The RPi answers with a chunk of at most that many bytes. Chunks
+ * from the RPi and to ground share a layout: the file ID, the offset of the
+ * first byte, and the size of the whole file, or FILE_SIZE_MISSING, all
+ * little-endian, followed by the bytes.
+ *
+ * @verbatim
+2 bytes   4 bytes   2 bytes
++---------+---------+--------+
+| file ID | offset  | length |
++---------+---------+--------+
+
+2 bytes   4 bytes   4 bytes     N bytes
++---------+---------+-----------+-------+
+| file ID | offset  | file size | bytes |
++---------+---------+-----------+-------+
+   @endverbatim
+ *
+ * A chunk with no bytes means the transfer has ended: the file is missing,
+ * or the offset is at or past its end.
+ */
+class FileDownlink {
+public:
+  FileDownlink(uint16_t chunk_size);
+
+  void     start(uint16_t file, uint32_t offset);
+  void     cancel();
+  bool     read_request(PacketComm &request);
+  bool     receive(const PacketComm &chunk);
+  bool     next_chunk(PacketComm &chunk);
+
+  /** @brief Whether a transfer is under way. */
+  bool     active() const { return running; }
+  /** @brief The ID of the file being sent. */
+  uint16_t file() const { return file_id; }
+  /** @brief The offset of the next byte to be sent to ground. */
+  uint32_t offset() const { return sent_to; }
+  /** @brief The size of the file, or 0 if the RPi has not reported it. */
+  uint32_t size() const { return file_size; }
+  /** @brief The number of bytes staged but not yet sent to ground. */
+  uint32_t staged() const { return staged_to - sent_to; }
+
+private:
+  void     put_header(PacketComm &packet, uint32_t offset) const;
+
+  /** @brief The most file bytes in each chunk sent to ground. */
+  uint16_t chunk_size;
+  /** @brief The staged file bytes, at their offset modulo the buffer size. */
+  uint8_t  stage[FILE_STAGE_SIZE];
+  /** @brief Whether a transfer is under way. */
+  bool     running    = false;
+  /** @brief Whether ground is still to be told the transfer has ended. */
+  bool     ending     = false;
+  /** @brief The ID of the file being sent. */
+  uint16_t file_id    = 0;
+  /** @brief The size of the file, or 0 if the RPi has not reported it. */
+  uint32_t file_size  = 0;
+  /** @brief The offset the transfer started over from. */
+  uint32_t started_at = 0;
+  /** @brief The offset of the next byte to be sent to ground. */
+  uint32_t sent_to    = 0;
+  /** @brief The offset just past the last byte staged. */
+  uint32_t staged_to  = 0;
+  /** @brief Whether a read request is waiting for the RPi's answer. */
+  bool     reading    = false;
+  /** @brief The time, in milliseconds, the last read request was made. */
+  uint32_t read_at    = 0;
+  /** @brief The number of read requests in a row the RPi has not answered. */
+  uint8_t  unanswered = 0;
+};
+
+#endif // _FILE_DOWNLINK_H
@@ -0,0 +1,88 @@
+/**
+ * @file packet_pool.cpp
+ * @brief The static packet pool.
+ *
+ * This file contains definitions for the packet pool and its handles.
+ */
+#include "packet_pool.h"
+
+/**
+ * @brief Construct a new PacketHandle by taking ownership from another.
+ *
+ * @param other The handle to take ownership from. It is left empty.
+ */
+PacketHandle::PacketHandle(PacketHandle &&other)
+    : pool(other.pool), index(other.index) {
+  other.pool = nullptr;
+}
+
+/**
+ * @brief Take ownership of another handle's buffer.
+ *
+ * Any buffer already owned by this handle is returned to its pool first.
+ *
+ * @param other The handle to take ownership from. It is left empty.
+ * @return PacketHandle& This handle.
+ */
+PacketHandle &PacketHandle::operator=(PacketHandle &&other) {
+  if (this != &other) {
+    release();
+    pool       = other.pool;
+    index      = other.index;
+    other.pool = nullptr;
+  }
+  return *this;
+}
+
+/** @brief Return the owned buffer, if any, to its pool. */
+void PacketHandle::release() {
+  if (pool != nullptr) {
+    pool->release(index);
+    pool = nullptr;
+  }
+}
+
+/** @brief Access the owned packet. The handle must not be empty. */
+PacketComm *PacketHandle::operator->() const { return &pool->packets[index]; }
+
+/** @brief Access the owned packet. The handle must not be empty. */
+PacketComm &PacketHandle::operator*() const { return pool->packets[index]; }
+
+/** @brief Construct a new PacketPool with every buffer available. */
+PacketPool::PacketPool() {
+  for (size_t i = 0; i < PACKET_POOL_SIZE; i++) {
+    free_list.push((uint8_t)i);
+  }
+}
+
+/**
+ * @brief Acquire an empty packet buffer from the pool.
+ *
+ * The returned packet has a cleared header and empty data, wrapped and
+ * packetized vectors. The vectors keep the capacity left by their last use.
+ *
+ * @return PacketHandle A handle owning the buffer, or an empty handle if the
+ * pool is exhausted.
+ */
+PacketHandle PacketPool::acquire() {
+  uint8_t index;
+  if (!free_list.pop(index)) {
+    return PacketHandle();
+  }
+  PacketComm &packet = packets[index];
+  packet.header      = decltype(packet.header)();
+  packet.data.clear();
+  packet.wrapped.clear();
+  packet.packetized.clear();
+  return PacketHandle(this, index);
+}
+
+/** @brief The number of buffers that are not currently in use. */
+size_t PacketPool::available() const { return free_list.size(); }
+
+/**
+ * @brief Return a buffer to the pool.
+ *
+ * @param index The index of the buffer being returned.
+ */
+void PacketPool::release(uint8_t index) { free_list.push(index); }
@@ -0,0 +1,82 @@
+/**
+ * @file packet_pool.h
+ * @brief The header file for the static packet pool.
+ *
+ * This file contains declarations for the pool of packet buffers shared by
+ * every channel, and the move-only handles used to pass those buffers around.
+ */
+#ifndef _PACKET_POOL_H
+#define _PACKET_POOL_H
+
+#include "packet_queue.h"
+#include <support/packetcomm.h>
+
+/**
+ * @brief The number of packet buffers in the pool.
+ *
+ * This must cover every queue slot plus the packets held by producers and
+ * channels at any one time. It must be a power of two.
+ */
+#define PACKET_POOL_SIZE 128
+
+class PacketPool;
+
+/**
+ * @brief A move-only handle to a packet buffer in a PacketPool.
+ *
+ * A handle owns exactly one buffer in the pool. Moving the handle transfers
+ * ownership without copying the packet, and the buffer is returned to the pool
+ * when the owning handle is destroyed, released, or assigned another buffer.
+ */
+class PacketHandle {
+public:
+  PacketHandle() : pool(nullptr), index(0) {}
+  PacketHandle(PacketHandle &&other);
+  PacketHandle &operator=(PacketHandle &&other);
+  PacketHandle(const PacketHandle &)            = delete;
+  PacketHandle &operator=(const PacketHandle &) = delete;
+  ~PacketHandle() { release(); }
+
+  void        release();
+
+  /** @brief Whether the handle currently owns a packet buffer. */
+  explicit    operator bool() const { return pool != nullptr; }
+  PacketComm *operator->() const;
+  PacketComm &operator*() const;
+
+private:
+  friend class PacketPool;
+  PacketHandle(PacketPool *owner, uint8_t slot) : pool(owner), index(slot) {}
+
+  /** @brief The pool owning the buffer, or nullptr if the handle is empty. */
+  PacketPool *pool;
+  /** @brief The index of the buffer within the pool. */
+  uint8_t     index;
+};
+
+/**
+ * @brief A fixed pool of preallocated packet buffers.
+ *
+ * Producers acquire a buffer once, fill it in place, and hand it through the
+ * channel queues as a PacketHandle. The buffers' vectors keep their capacity
+ * between uses, so a packet that has circulated once is reused without any
+ * further heap allocation.
+ */
+class PacketPool {
+public:
+  PacketPool();
+
+  PacketHandle acquire();
+  size_t       available() const;
+
+private:
+  friend class PacketHandle;
+  void       release(uint8_t index);
+
+  /** @brief The statically allocated packet buffers. */
+  PacketComm packets[PACKET_POOL_SIZE];
+  /** @brief The indices of the buffers that are not currently in use. */
+  RingQueue<uint8_t, PACKET_POOL_SIZE> free_list;
+};
+
+#endif // _PACKET_POOL_H
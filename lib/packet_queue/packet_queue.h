@@ -0,0 +1,260 @@
+/**
+ * @file packet_queue.h
+ * @brief The header file for the lock-free packet queue.
+ *
+ * This file contains the definition of the fixed-capacity ring buffer used to
+ * pass packets between channels.
+ */
+#ifndef _PACKET_QUEUE_H
+#define _PACKET_QUEUE_H
+
+#include <atomic>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A fixed-capacity, lock-free ring buffer queue.
+ *
+ * The queue is a bounded multi-producer queue based on per-slot sequence
+ * numbers. Every slot is allocated statically with the queue, so pushing and
+ * pulling never allocates memory or takes a mutex. Any number of channels may
+ * push into the queue, and the consuming channel may pull from it at the same
+ * time.
+ *
+ * A producer claims a slot by advancing the enqueue position, fills it, then
+ * publishes it by updating the slot's sequence number. A consumer does the
+ * same with the dequeue position. A slot that has been claimed but not yet
+ * published (because its owner was switched out mid-copy) makes the queue
+ * appear full or empty until its owner runs again.
+ *
+ * Elements are moved into and out of the slots, so the queue can carry
+ * move-only types such as packet handles.
+ *
+ * @tparam T The type of the element held in each slot.
+ * @tparam Size The number of slots. Must be a power of two.
+ */
+template <typename T, size_t Size> class RingQueue {
+  static_assert(Size >= 2 && (Size & (Size - 1)) == 0,
+                "RingQueue size must be a power of two");
+
+public:
+  RingQueue() {
+    for (size_t i = 0; i < Size; i++) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    enqueue_pos.store(0, std::memory_order_relaxed);
+    dequeue_pos.store(0, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Push an element into the queue.
+   *
+   * @param item The element to be moved into the queue. It is left untouched
+   * if the queue is full.
+   * @return true The element was pushed into the queue.
+   * @return false The queue is full.
+   */
+  bool push(T &&item) {
+    size_t pos;
+    Slot  *slot = claim_enqueue(pos);
+    if (slot == nullptr) {
+      return false;
+    }
+    slot->item = std::move(item);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Push a copy of an element into the queue.
+   *
+   * @param item The element to be copied into the queue.
+   * @return true The element was pushed into the queue.
+   * @return false The queue is full.
+   */
+  bool push(const T &item) {
+    T copy(item);
+    return push(std::move(copy));
+  }
+
+  /**
+   * @brief Push an element, evicting the oldest element if the queue is full.
+   *
+   * @param item The element to be moved into the queue.
+   * @return true An older element was evicted to make room.
+   * @return false The element was pushed without evicting anything.
+   */
+  bool push_overwrite(T &&item) {
+    bool evicted = false;
+    while (!push(std::move(item))) {
+      evicted |= drop();
+    }
+    return evicted;
+  }
+
+  /**
+   * @brief Pull the oldest element from the queue.
+   *
+   * @param item The element that will hold the pulled element, if there is
+   * one.
+   * @return true An element has been pulled from the queue.
+   * @return false The queue is empty.
+   */
+  bool pop(T &item) {
+    size_t pos;
+    Slot  *slot = claim_dequeue(pos);
+    if (slot == nullptr) {
+      return false;
+    }
+    item = std::move(slot->item);
+    slot->sequence.store(pos + Size, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Pull up to max of the oldest elements from the queue at once.
+   *
+   * The elements are reserved with a single update of the dequeue position, so
+   * a batch costs one atomic reservation instead of one per element.
+   *
+   * @param items The array that will hold the pulled elements, oldest first.
+   * @param max The maximum number of elements to pull.
+   * @return size_t The number of elements pulled.
+   */
+  size_t pop_batch(T *items, size_t max) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    size_t count;
+    while (true) {
+      count = 0;
+      while (count < max &&
+             slots[(pos + count) & (Size - 1)].sequence.load(
+                 std::memory_order_acquire) == pos + count + 1) {
+        count++;
+      }
+      if (count == 0) {
+        return 0;
+      }
+      if (dequeue_pos.compare_exchange_weak(pos, pos + count,
+                                            std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    for (size_t i = 0; i < count; i++) {
+      Slot *slot = &slots[(pos + i) & (Size - 1)];
+      items[i]   = std::move(slot->item);
+      slot->sequence.store(pos + i + Size, std::memory_order_release);
+    }
+    return count;
+  }
+
+  /**
+   * @brief Discard the oldest element in the queue.
+   *
+   * The element is moved out of its slot and destroyed, so any resource it
+   * owns is released.
+   *
+   * @return true An element has been discarded.
+   * @return false The queue is empty.
+   */
+  bool drop() {
+    T discarded;
+    return pop(discarded);
+  }
+
+  /** @brief Discard every element in the queue. */
+  void clear() {
+    while (drop()) {
+    }
+  }
+
+  /**
+   * @brief The number of elements currently in the queue.
+   *
+   * The dequeue position is read first, so consumers advancing it between
+   * the two reads cannot put it past the enqueue position that was read.
+   */
+  size_t size() const {
+    size_t   head = dequeue_pos.load(std::memory_order_acquire);
+    size_t   tail = enqueue_pos.load(std::memory_order_acquire);
+    intptr_t used = (intptr_t)(tail - head);
+    if (used < 0) {
+      return 0;
+    }
+    return (size_t)used > Size ? Size : (size_t)used;
+  }
+
+  /** @brief Whether the queue is empty. */
+  bool empty() const { return size() == 0; }
+
+  /** @brief The maximum number of elements the queue can hold. */
+  static constexpr size_t capacity() { return Size; }
+
+private:
+  /** @brief A single slot in the ring buffer. */
+  struct Slot {
+    /** @brief The position this slot will next be written or read at. */
+    std::atomic<size_t> sequence;
+    /** @brief The element held in this slot. */
+    T                   item;
+  };
+
+  /**
+   * @brief Claim the next slot to be written.
+   *
+   * @param pos The claimed position.
+   * @return Slot* The claimed slot, or nullptr if the queue is full.
+   */
+  Slot *claim_enqueue(size_t &pos) {
+    pos = enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      Slot    *slot = &slots[pos & (Size - 1)];
+      size_t   seq  = slot->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          return slot;
+        }
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief Claim the next slot to be read.
+   *
+   * @param pos The claimed position.
+   * @return Slot* The claimed slot, or nullptr if the queue is empty.
+   */
+  Slot *claim_dequeue(size_t &pos) {
+    pos = dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      Slot    *slot = &slots[pos & (Size - 1)];
+      size_t   seq  = slot->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          return slot;
+        }
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /** @brief The statically allocated slots of the ring buffer. */
+  Slot                slots[Size];
+  /** @brief The position of the next slot to be written. */
+  std::atomic<size_t> enqueue_pos;
+  /** @brief The position of the next slot to be read. */
+  std::atomic<size_t> dequeue_pos;
+};
+
+#endif // _PACKET_QUEUE_H
@@ -0,0 +1,407 @@
+/**
+ * @file priority_queue.h
+ * @brief The header file for the multi-priority packet queue.
+ *
+ * This file contains the definition of the packet queue that separates packets
+ * into priority classes, each with its own capacity and drop policy.
+ */
+#ifndef _PRIORITY_QUEUE_H
+#define _PRIORITY_QUEUE_H
+
+#include "packet_pool.h"
+#include "packet_queue.h"
+#include <Arduino.h>
+#include <TeensyThreads.h>
+
+/** @brief Enumeration of packet priority classes, from highest to lowest. */
+enum class PacketPriority : uint8_t {
+  Command,
+  Response,
+  Beacon,
+};
+
+/** @brief The number of packet priority classes. */
+#define PACKET_PRIORITY_COUNT 3
+
+/**
+ * @brief The number of buckets in a queue's dwell-time histogram.
+ *
+ * Bucket 0 counts packets that spent less than 1 ms in the queue. Each later
+ * bucket i counts dwell times in [4^(i-1), 4^i) ms, and the last bucket counts
+ * everything longer.
+ */
+#define QUEUE_DWELL_BUCKETS 8
+
+/** @brief Enumeration of what to do with a packet pushed into a full class. */
+enum class DropPolicy : uint8_t {
+  /** @brief Evict the oldest packet in the class to make room. */
+  DropOldest,
+  /** @brief Discard the incoming packet. */
+  DropNewest,
+  /** @brief Refuse the incoming packet and leave it with the producer. */
+  Reject,
+};
+
+/** @brief Enumeration of the outcomes of pushing a packet into a queue. */
+enum class PushResult : uint8_t {
+  /** @brief The packet was queued without disturbing any other packet. */
+  Accepted,
+  /** @brief The packet was queued, but evicted an older packet to fit. */
+  EvictedOther,
+  /** @brief The packet was not queued, because its class is full. */
+  Rejected,
+};
+
+/** @brief The configuration of a single priority class. */
+struct priority_class_config {
+  /** @brief The maximum number of packets held by the class. */
+  uint8_t    capacity;
+  /** @brief What to do when a packet is pushed into a full class. */
+  DropPolicy policy;
+};
+
+/** @brief The drop counters of a single priority class. */
+struct priority_class_stats {
+  /** @brief The number of queued packets evicted by newer packets. */
+  uint32_t evicted;
+  /** @brief The number of incoming packets discarded because of DropNewest. */
+  uint32_t dropped;
+  /** @brief The number of incoming packets refused because of Reject. */
+  uint32_t rejected;
+};
+
+/** @brief The traffic counters of a whole queue. */
+struct queue_stats {
+  /** @brief The number of packets accepted into the queue. */
+  uint32_t enqueued;
+  /** @brief The number of packets pulled from the queue. */
+  uint32_t dequeued;
+  /** @brief The number of packets evicted, discarded or rejected. */
+  uint32_t dropped;
+  /** @brief The largest number of packets held at once. */
+  uint32_t high_water;
+  /** @brief The log-scale histogram of time spent in the queue. */
+  uint32_t dwell[QUEUE_DWELL_BUCKETS];
+};
+
+/**
+ * @brief A lock-free packet queue with separate priority classes.
+ *
+ * Each priority class is its own RingQueue, so a burst of low-priority packets
+ * can never evict a higher-priority one. Packets are always pulled from the
+ * highest-priority class that is not empty.
+ *
+ * The queue also keeps traffic counters: packets in and out, drops, the
+ * high-water mark, and a histogram of how long each packet waited.
+ *
+ * @tparam Slots The number of slots in each class's ring buffer. This bounds
+ * the capacity of any one class, and must be a power of two.
+ */
+template <size_t Slots> class PriorityPacketQueue {
+public:
+  /**
+   * @brief Construct a new PriorityPacketQueue.
+   *
+   * @param config The capacity and drop policy of each class, indexed by
+   * PacketPriority.
+   */
+  PriorityPacketQueue(
+      const priority_class_config (&config)[PACKET_PRIORITY_COUNT]) {
+    for (size_t i = 0; i < PACKET_PRIORITY_COUNT; i++) {
+      configure((PacketPriority)i, config[i]);
+      classes[i].evicted.store(0);
+      classes[i].dropped.store(0);
+      classes[i].rejected.store(0);
+    }
+    enqueued.store(0);
+    dequeued.store(0);
+    high_water.store(0);
+    for (size_t i = 0; i < QUEUE_DWELL_BUCKETS; i++) {
+      dwell[i].store(0);
+    }
+  }
+
+  /**
+   * @brief Push a packet into its priority class.
+   *
+   * If the class is full, its drop policy decides what happens. DropOldest
+   * evicts queued packets until the new one fits. DropNewest discards the new
+   * packet, returning it to the pool. Reject leaves the new packet with the
+   * caller.
+   *
+   * @param packet The packet to be pushed. The queue takes ownership of it
+   * unless it is rejected.
+   * @param priority The priority class the packet belongs to.
+   * @return PushResult Whether the packet was queued, and whether it cost an
+   * older packet its place. A packet dropped by DropNewest is reported as
+   * Rejected.
+   */
+  PushResult push(PacketHandle &packet, PacketPriority priority) {
+    priority_class &cls = classes[(uint8_t)priority];
+    queued_packet   entry;
+    bool            evicted = false;
+    entry.packet            = std::move(packet);
+    entry.enqueued_at       = millis();
+    while (true) {
+      if (cls.ring.size() < cls.config.capacity &&
+          cls.ring.push(std::move(entry))) {
+        enqueued++;
+        update_high_water();
+        return evicted ? PushResult::EvictedOther : PushResult::Accepted;
+      }
+      switch (cls.config.policy) {
+        case DropPolicy::DropOldest: {
+          if (cls.ring.drop()) {
+            cls.evicted++;
+            evicted = true;
+          }
+          break;
+        }
+        case DropPolicy::DropNewest: {
+          cls.dropped++;
+          return PushResult::Rejected;
+        }
+        case DropPolicy::Reject:
+        default: {
+          packet = std::move(entry.packet);
+          cls.rejected++;
+          return PushResult::Rejected;
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Pull the oldest packet from the highest-priority non-empty class.
+   *
+   * @param packet The handle that will own the pulled packet, if there is one.
+   * @param lowest The lowest-priority class that may be pulled from. Packets in
+   * lower classes are left in the queue.
+   * @return true A packet has been pulled from the queue.
+   * @return false The queue does not contain any packets of priority lowest
+   * or higher.
+   */
+  bool pop(PacketHandle  &packet,
+           PacketPriority lowest = PacketPriority::Beacon) {
+    queued_packet entry;
+    for (size_t i = 0; i <= (size_t)lowest; i++) {
+      if (classes[i].ring.pop(entry)) {
+        packet = std::move(entry.packet);
+        dequeued++;
+        dwell[dwell_bucket(millis() - entry.enqueued_at)]++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Pull up to max packets, highest-priority classes first.
+   *
+   * Each class is drained with a single reservation, so a full queue is
+   * emptied with one atomic operation per class instead of one per packet.
+   *
+   * @param packets The array of handles that will own the pulled packets, in
+   * the order they should be handled.
+   * @param max The maximum number of packets to pull.
+   * @param lowest The lowest-priority class that may be pulled from.
+   * @return size_t The number of packets pulled.
+   */
+  size_t pop_batch(PacketHandle *packets, size_t max,
+                   PacketPriority lowest = PacketPriority::Beacon) {
+    queued_packet entries[Slots];
+    size_t        count = 0;
+    uint32_t      now   = millis();
+    for (size_t i = 0; i <= (size_t)lowest && count < max; i++) {
+      size_t limit  = (max - count) < Slots ? (max - count) : Slots;
+      size_t pulled = classes[i].ring.pop_batch(entries, limit);
+      for (size_t j = 0; j < pulled; j++) {
+        packets[count++] = std::move(entries[j].packet);
+        dwell[dwell_bucket(now - entries[j].enqueued_at)]++;
+      }
+      dequeued += pulled;
+    }
+    return count;
+  }
+
+  /** @brief Discard every packet in every class. */
+  void clear() {
+    for (size_t i = 0; i < PACKET_PRIORITY_COUNT; i++) {
+      classes[i].ring.clear();
+    }
+  }
+
+  /** @brief The number of packets in every class. */
+  size_t size() const {
+    size_t total = 0;
+    for (size_t i = 0; i < PACKET_PRIORITY_COUNT; i++) {
+      total += classes[i].ring.size();
+    }
+    return total;
+  }
+
+  /** @brief The number of packets in a single class. */
+  size_t size(PacketPriority priority) const {
+    return classes[(uint8_t)priority].ring.size();
+  }
+
+  /**
+   * @brief The number of packets a class can take before its drop policy
+   * applies.
+   *
+   * This is cheap enough for producers to call before building a packet, so
+   * they can skip or coalesce work while the consumer is saturated.
+   */
+  size_t headroom(PacketPriority priority) const {
+    const priority_class &cls  = classes[(uint8_t)priority];
+    size_t                used = cls.ring.size();
+    return used < cls.config.capacity ? cls.config.capacity - used : 0;
+  }
+
+  /** @brief Whether every class is empty. */
+  bool empty() const { return size() == 0; }
+
+  /**
+   * @brief Whether a pop() down to a class would find a packet.
+   *
+   * @param lowest The lowest-priority class that may be pulled from.
+   * @return true A class of priority lowest or higher holds a packet.
+   * @return false Every class that may be pulled from is empty, though lower
+   * classes may not be.
+   */
+  bool pending(PacketPriority lowest = PacketPriority::Beacon) const {
+    for (size_t i = 0; i <= (size_t)lowest; i++) {
+      if (classes[i].ring.size() > 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Wait for a packet a pop() down to a class would find.
+   *
+   * The calling thread gives up its time slice on every check, as it would
+   * during threads.delay(), and returns as soon as such a packet is pushed.
+   *
+   * @param timeout The maximum time to wait, in milliseconds.
+   * @param lowest The lowest-priority class that may be pulled from.
+   * @return true A class of priority lowest or higher holds a packet.
+   * @return false The timeout expired with no such packet in the queue.
+   */
+  bool wait(uint32_t       timeout,
+            PacketPriority lowest = PacketPriority::Beacon) const {
+    elapsedMillis elapsed;
+    while (!pending(lowest)) {
+      if (elapsed >= timeout) {
+        return false;
+      }
+      threads.yield();
+    }
+    return true;
+  }
+
+  /**
+   * @brief Change the capacity and drop policy of a class.
+   *
+   * @param priority The class to be configured.
+   * @param config The new configuration. The capacity is clamped to Slots.
+   */
+  void configure(PacketPriority priority, priority_class_config config) {
+    if (config.capacity > Slots) {
+      config.capacity = Slots;
+    }
+    classes[(uint8_t)priority].config = config;
+  }
+
+  /**
+   * @brief Get the drop counters of a class.
+   *
+   * @param priority The class to be reported.
+   * @return priority_class_stats A snapshot of the class's counters.
+   */
+  priority_class_stats stats(PacketPriority priority) const {
+    const priority_class &cls = classes[(uint8_t)priority];
+    return {cls.evicted.load(), cls.dropped.load(), cls.rejected.load()};
+  }
+
+  /**
+   * @brief Get the traffic counters of the whole queue.
+   *
+   * @return queue_stats A snapshot of the queue's counters.
+   */
+  queue_stats telemetry() const {
+    queue_stats stats = {};
+    stats.enqueued    = enqueued.load();
+    stats.dequeued    = dequeued.load();
+    stats.high_water  = high_water.load();
+    for (size_t i = 0; i < PACKET_PRIORITY_COUNT; i++) {
+      stats.dropped += classes[i].evicted.load() +
+                       classes[i].dropped.load() + classes[i].rejected.load();
+    }
+    for (size_t i = 0; i < QUEUE_DWELL_BUCKETS; i++) {
+      stats.dwell[i] = dwell[i].load();
+    }
+    return stats;
+  }
+
+private:
+  /** @brief A packet held in the queue, stamped with its arrival time. */
+  struct queued_packet {
+    /** @brief The queued packet. */
+    PacketHandle packet;
+    /** @brief The time, in milliseconds, the packet entered the queue. */
+    uint32_t     enqueued_at = 0;
+  };
+
+  /** @brief Raise the high-water mark to the current size, if larger. */
+  void update_high_water() {
+    uint32_t current = size();
+    uint32_t highest = high_water.load();
+    while (current > highest &&
+           !high_water.compare_exchange_weak(highest, current)) {
+    }
+  }
+
+  /**
+   * @brief Find the histogram bucket for a dwell time.
+   *
+   * @param elapsed The time, in milliseconds, the packet spent in the queue.
+   * @return size_t The index of the bucket counting that dwell time.
+   */
+  static size_t dwell_bucket(uint32_t elapsed) {
+    size_t bucket = 0;
+    while (elapsed > 0 && bucket < QUEUE_DWELL_BUCKETS - 1) {
+      elapsed >>= 2;
+      bucket++;
+    }
+    return bucket;
+  }
+
+  /** @brief A single priority class. */
+  struct priority_class {
+    /** @brief The packets held by the class. */
+    RingQueue<queued_packet, Slots> ring;
+    /** @brief The capacity and drop policy of the class. */
+    priority_class_config           config;
+    /** @brief The number of queued packets evicted by newer packets. */
+    std::atomic<uint32_t>           evicted;
+    /** @brief The number of incoming packets discarded. */
+    std::atomic<uint32_t>           dropped;
+    /** @brief The number of incoming packets refused. */
+    std::atomic<uint32_t>           rejected;
+  };
+
+  /** @brief The priority classes, indexed by PacketPriority. */
+  priority_class        classes[PACKET_PRIORITY_COUNT];
+  /** @brief The number of packets accepted into the queue. */
+  std::atomic<uint32_t> enqueued;
+  /** @brief The number of packets pulled from the queue. */
+  std::atomic<uint32_t> dequeued;
+  /** @brief The largest number of packets held at once. */
+  std::atomic<uint32_t> high_water;
+  /** @brief The log-scale histogram of time spent in the queue. */
+  std::atomic<uint32_t> dwell[QUEUE_DWELL_BUCKETS];
+};
+
+#endif // _PRIORITY_QUEUE_H
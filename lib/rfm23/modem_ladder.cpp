@@ -0,0 +1,71 @@
+/**
+ * @file modem_ladder.cpp
+ * @brief The RFM23 modem ladder controller.
+ *
+ * This file contains definitions for the controller that decides when the
+ * radio should move up or down RFM23::MODEM_LADDER.
+ */
+#include "modem_ladder.h"
+
+namespace Artemis {
+namespace Devices {
+  /**
+   * @brief Decide the next step on the ladder from the link quality.
+   *
+   * A switch still on probation with no frame since is reverted, and a silent
+   * link falls back to rung 0. Otherwise, once RFM23_MODEM_MIN_FRAMES have
+   * been received at the rung and no request was made in the last
+   * RFM23_MODEM_REQUEST_INTERVAL, a step down is requested below 50% success
+   * or the rung's minimum RSSI, and a step up at 90% success and
+   * RFM23_MODEM_HYSTERESIS above the next rung's minimum RSSI.
+   *
+   * @param link The quality of the link at the current rung.
+   * @param rung The rung of RFM23::MODEM_LADDER the radio is using.
+   * @return step The step to take.
+   */
+  ModemLadder::step ModemLadder::update(const RFM23::link_quality &link,
+                                        uint8_t                    rung) {
+    if (on_probation && link.since_rx >= RFM23_MODEM_PROBATION) {
+      print_debug(Helpers::RFM23, "Modem switch not confirmed, reverting");
+      on_probation = false;
+      return {Action::Switch, previous_rung};
+    }
+    if (rung > 0 && link.since_rx >= RFM23_MODEM_SILENCE) {
+      print_debug(Helpers::RFM23, "Link lost, falling back to modem rung 0");
+      return {Action::Switch, 0};
+    }
+    if (link.good > 0) {
+      on_probation = false;
+    }
+    if (link.good + link.bad < RFM23_MODEM_MIN_FRAMES ||
+        since_request < RFM23_MODEM_REQUEST_INTERVAL) {
+      return {Action::None, rung};
+    }
+
+    uint32_t success = 100 * link.good / (link.good + link.bad);
+    if (rung > 0 &&
+        (success < 50 || link.rssi < RFM23::MODEM_MIN_RSSI[rung])) {
+      since_request = 0;
+      return {Action::Request, (uint8_t)(rung - 1)};
+    }
+    if (rung + 1 < RFM23_MODEM_RUNGS && success >= 90 &&
+        link.rssi >=
+            RFM23::MODEM_MIN_RSSI[rung + 1] + RFM23_MODEM_HYSTERESIS) {
+      since_request = 0;
+      return {Action::Request, (uint8_t)(rung + 1)};
+    }
+    return {Action::None, rung};
+  }
+
+  /**
+   * @brief Put a switch ground asked for on probation until a frame is
+   * received at the new rung.
+   *
+   * @param previous The rung the radio switched from.
+   */
+  void ModemLadder::switched(uint8_t previous) {
+    previous_rung = previous;
+    on_probation  = true;
+  }
+} // namespace Devices
+} // namespace Artemis
@@ -0,0 +1,59 @@
+/**
+ * @file modem_ladder.h
+ * @brief The header file for the RFM23 modem ladder controller.
+ *
+ * This file contains declarations for the controller that decides when the
+ * radio should move up or down RFM23::MODEM_LADDER.
+ */
+#ifndef _MODEM_LADDER_H
+#define _MODEM_LADDER_H
+
+#include "rfm23.h"
+
+namespace Artemis {
+namespace Devices {
+  /**
+   * @brief The controller walking the radio up and down RFM23::MODEM_LADDER.
+   *
+   * Once enough frames have been received at the current rung, a strong and
+   * clean link asks ground to step up, and a weak or lossy one asks ground to
+   * step down. Ground decides, and the radio switches when ground says so. If
+   * nothing is heard from ground after a switch, the radio reverts to the
+   * previous rung, and if the link goes silent, it falls back to rung 0,
+   * where ground will look for it too.
+   */
+  class ModemLadder {
+  public:
+    /** @brief Enumeration of the steps the controller can ask for. */
+    enum class Action : uint8_t {
+      /** @brief Stay at the current rung. */
+      None,
+      /** @brief Ask ground to switch to the rung. */
+      Request,
+      /** @brief Switch to the rung without asking ground. */
+      Switch,
+    };
+
+    /** @brief A step the controller asks for. */
+    struct step {
+      /** @brief What to do. */
+      Action  action;
+      /** @brief The rung of RFM23::MODEM_LADDER to request or switch to. */
+      uint8_t rung;
+    };
+
+    step update(const RFM23::link_quality &link, uint8_t rung);
+    void switched(uint8_t previous);
+
+  private:
+    /** @brief The rung to revert to if a switch is not confirmed. */
+    uint8_t       previous_rung = 0;
+    /** @brief Whether the last switch still awaits a frame from ground. */
+    bool          on_probation  = false;
+    /** @brief The time since a switch was last requested. */
+    elapsedMillis since_request = RFM23_MODEM_REQUEST_INTERVAL;
+  };
+} // namespace Devices
+} // namespace Artemis
+
+#endif // _MODEM_LADDER_H
@@ -8,6 +8,20 @@
 
 namespace Artemis {
 namespace Devices {
+  const RH_RF22::ModemConfigChoice RFM23::MODEM_LADDER[RFM23_MODEM_RUNGS] = {
+      RH_RF22::FSK_Rb2Fd5,      RH_RF22::FSK_Rb4_8Fd45,
+      RH_RF22::FSK_Rb9_6Fd45,   RH_RF22::FSK_Rb19_2Fd9_6,
+      RH_RF22::FSK_Rb38_4Fd19_6,
+  };
+
+  const int16_t RFM23::MODEM_MIN_RSSI[RFM23_MODEM_RUNGS] = {
+      -128, -100, -95, -90, -85,
+  };
+
+  const uint32_t RFM23::MODEM_BITRATE[RFM23_MODEM_RUNGS] = {
+      2000, 4800, 9600, 19200, 38400,
+  };
+
   /**
    * @brief Construct a new RFM23 object. Wraps the RH_RFM23 constructor.
    *
@@ -55,13 +69,19 @@ namespace Devices {
     rfm23.setTxPower(config.tx_power);
 
     timeout = 0;
-    while (!rfm23.setModemConfig(RH_RF22::FSK_Rb2Fd5)) {
+    modem_rung = 0;
+    while (!rfm23.setModemConfig(MODEM_LADDER[modem_rung])) {
       if (timeout > 10000) {
         print_debug(Helpers::RFM23,
                     "Failed to set config: modem configuration");
         return false;
       }
     }
+    // Corrupted frames must reach the FEC decoder instead of being dropped by
+    // the radio, so frames without FEC carry a CRC of their own instead.
+    rfm23.spiWrite(RH_RF22_REG_30_DATA_ACCESS_CONTROL,
+                   rfm23.spiRead(RH_RF22_REG_30_DATA_ACCESS_CONTROL) &
+                       ~RH_RF22_ENCRC);
     if (!rfm23.sleep()) {
       print_debug(Helpers::RFM23, "Failed to set radio in sleep mode");
       return false;
@@ -69,6 +89,10 @@ namespace Devices {
 
     print_debug(Helpers::RFM23, "Radio initialized");
     rfm23.setModeIdle();
+    quality       = {};
+    rx_bad_base   = rfm23.rxBad();
+    rx_fec_failed = 0;
+    stats();
     return true;
   }
 
@@ -81,82 +105,600 @@ namespace Devices {
   /**
    * @brief Sends a packet through the radio.
    *
+   * The wrapped packet is split into as many numbered fragments as it needs,
+   * and each fragment is sent as its own radio frame with send_frame().
+   * FEC-protected frames carry fewer packet bytes, to leave room for parity,
+   * and the others end with RFM23_FRAME_CRC.
+   *
    * @param packet The packet to be sent.
-   * @return true The packet was successfully sent.
+   * @param fec The forward error correction applied to every frame.
+   * @return true Every fragment of the packet was handed to the radio for
+   * transmission.
    * @return false There was an error sending the packet.
-   *
-   * @todo The function puts the rfm23 into sleep mode, then idle mode. Is this
-   * intended? idle overrides sleep.
-   *
-   * @todo The transmit and receive pins are set low and high respectively.
-   * check if this is intended behavior. either change the pin definitions or
-   * use setGpioReversed().
    */
-  bool RFM23::send(PacketComm &packet) {
-    digitalWrite(config.pins.rx_on, HIGH);
-    digitalWrite(config.pins.tx_on, LOW);
-
+  bool RFM23::send(PacketComm &packet, FecMode fec) {
     packet.wrapped.resize(0);
     if (!packet.Wrap()) {
       print_debug(Helpers::RFM23, "Failed to wrap packet");
       return false;
     }
-    if (packet.wrapped.size() > RH_RF22_MAX_MESSAGE_LEN) {
+    size_t chunk = fec == FecMode::ReedSolomon ? RFM23_FEC_FRAGMENT_PAYLOAD
+                                               : RFM23_FRAGMENT_PAYLOAD;
+    size_t count = (packet.wrapped.size() + chunk - 1) / chunk;
+    if (count > RFM23_MAX_FRAGMENTS) {
       print_debug(Helpers::RFM23, "Wrapped packet exceeds size limits");
       return false;
     }
 
-    print_hexdump(Helpers::RFM23, "Radio Sending: ", packet.wrapped.data(),
-                  packet.wrapped.size());
+    uint8_t  frame[RH_RF22_MAX_MESSAGE_LEN];
+    uint8_t *header = &frame[RFM23_FEC_TAG];
+    frame[0]        = (uint8_t)fec;
+    header[0]       = next_message_id++;
+    header[2]       = (uint8_t)count;
+    for (size_t i = 0; i < count; i++) {
+      size_t offset = i * chunk;
+      size_t size   = packet.wrapped.size() - offset;
+      if (size > chunk) {
+        size = chunk;
+      }
+      header[1] = (uint8_t)i;
+      memcpy(&header[RFM23_FRAGMENT_HEADER], &packet.wrapped[offset], size);
+      uint8_t length = RFM23_FEC_TAG + RFM23_FRAGMENT_HEADER + size;
+      if (fec == FecMode::ReedSolomon) {
+        length = encode_fec(frame, length);
+      } else {
+        uint16_t crc    = frame_crc(frame, length);
+        frame[length++] = crc & 0xFF;
+        frame[length++] = crc >> 8;
+      }
+      if (!send_frame(frame, length)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Sends a single frame through the radio.
+   *
+   * The frame is handed to the radio as soon as the previous frame has been
+   * sent and the configured inter-frame gap has passed. This returns once the
+   * radio starts transmitting, without waiting for the transmission to finish,
+   * so the caller can prepare the next frame in the meantime.
+   *
+   * @param frame The frame to be sent.
+   * @param length The length of the frame, at most RH_RF22_MAX_MESSAGE_LEN.
+   * @return true The frame was handed to the radio for transmission.
+   * @return false The radio refused the frame.
+   *
+   * @todo The transmit and receive pins are set low and high respectively.
+   * check if this is intended behavior. either change the pin definitions or
+   * use setGpioReversed().
+   */
+  bool RFM23::send_frame(uint8_t *frame, uint8_t length) {
+    wait_sent(1000);
+    // Signed, since a frame that finished early was stamped in the future,
+    // though never by more than a frame's airtime. A stamp further ahead is
+    // one micros() has wrapped past since, and has long gone.
+    int32_t ahead = frame_airtime(RH_RF22_MAX_MESSAGE_LEN);
+    while (true) {
+      int32_t since = micros() - tx_done_at;
+      if (since >= (int32_t)config.tx_gap * 1000 || since <= -ahead) {
+        break;
+      }
+      threads.yield();
+    }
+
+    digitalWrite(config.pins.rx_on, HIGH);
+    digitalWrite(config.pins.tx_on, LOW);
+    print_hexdump(Helpers::RFM23, "Radio Sending: ", frame, length);
+    frame_record   record = {};
+    record.time           = millis();
+    record.length         = length;
+    record.sent           = true;
+    uint32_t       start  = micros();
     Threads::Scope lock(*spi_mtx);
-    if (!rfm23.send(packet.wrapped.data(), packet.wrapped.size())) {
+    record.lock_wait = micros() - start;
+    if (!rfm23.send(frame, length)) {
       print_debug(Helpers::RFM23, "Failed to queue outgoing packet to radio");
+      record.error = FrameError::Refused;
+      log_frame(record);
       return false;
     }
-    if (!rfm23.waitPacketSent(1000)) {
-      print_debug(Helpers::RFM23, "Timed out waiting for packet transmission");
+    record.airtime  = frame_airtime(length);
+    tx_airtime     += record.airtime;
+    tx_done_at      = micros() + record.airtime;
+    last_sent       = frames_logged;
+    log_frame(record);
+    return true;
+  }
+
+  /**
+   * @brief Add Reed-Solomon parity to a frame.
+   *
+   * Byte i after the FEC tag belongs to codeword i % RFM23_FEC_DEPTH, so the
+   * frame's bytes stay in order while neighbouring bytes fall in different
+   * codewords. The parity of each codeword is appended, and keeps the same
+   * pattern across the end of the data.
+   *
+   * @param frame The frame, with room for RFM23_FEC_PARITY more bytes.
+   * @param length The length of the frame, including the FEC tag.
+   * @return uint8_t The length of the frame with its parity.
+   */
+  uint8_t RFM23::encode_fec(uint8_t *frame, uint8_t length) {
+    uint8_t *data = &frame[RFM23_FEC_TAG];
+    uint8_t  size = length - RFM23_FEC_TAG;
+    uint8_t  codeword[RH_RF22_MAX_MESSAGE_LEN];
+    uint8_t  parity[RFM23_FEC_ROOTS];
+    for (uint8_t c = 0; c < RFM23_FEC_DEPTH; c++) {
+      uint8_t n = 0;
+      for (uint8_t i = c; i < size; i += RFM23_FEC_DEPTH) {
+        codeword[n++] = data[i];
+      }
+      rs.encode(codeword, n, parity);
+      uint8_t *next = &data[size + parity_offset(size, c)];
+      for (uint8_t k = 0; k < RFM23_FEC_ROOTS; k++) {
+        next[k * RFM23_FEC_DEPTH] = parity[k];
+      }
+    }
+    return length + RFM23_FEC_PARITY;
+  }
+
+  /**
+   * @brief Check a received frame's FEC tag, and repair the frame if it is
+   * FEC-protected.
+   *
+   * The tag is read as whichever FecMode it is closest to, bit by bit. A
+   * frame without FEC must match its CRC instead. On success, the frame's
+   * tag is set to that mode and its parity or CRC is stripped.
+   *
+   * @param frame The received frame. Errors are corrected in place.
+   * @param length The length of the frame, updated to drop the parity.
+   * @return true The frame is intact, or has been repaired.
+   * @return false The tag is ambiguous, the frame has more errors than FEC
+   * can correct, or it does not match its CRC.
+   */
+  bool RFM23::decode_fec(uint8_t *frame, uint8_t &length) {
+    uint8_t bits = __builtin_popcount(frame[0]);
+    if (length <= RFM23_FEC_TAG || (bits > 3 && bits < 5)) {
+      rx_fec_failed++;
+      return false;
+    }
+    if (bits <= 3) {
+      frame[0] = (uint8_t)FecMode::None;
+      if (length < RFM23_FEC_TAG + RFM23_FRAME_CRC ||
+          frame_crc(frame, length - RFM23_FRAME_CRC) !=
+              (frame[length - 2] | (frame[length - 1] << 8))) {
+        rx_fec_failed++;
+        return false;
+      }
+      length -= RFM23_FRAME_CRC;
+      return true;
+    }
+    if (length <= RFM23_FEC_TAG + RFM23_FEC_PARITY) {
+      rx_fec_failed++;
       return false;
     }
 
-    rfm23.sleep();
-    rfm23.setModeIdle();
+    uint8_t *data = &frame[RFM23_FEC_TAG];
+    uint8_t  size = length - RFM23_FEC_TAG - RFM23_FEC_PARITY;
+    uint8_t  codeword[RH_RF22_MAX_MESSAGE_LEN];
+    for (uint8_t c = 0; c < RFM23_FEC_DEPTH; c++) {
+      uint8_t n = 0;
+      for (uint8_t i = c; i < size; i += RFM23_FEC_DEPTH) {
+        codeword[n++] = data[i];
+      }
+      uint8_t *next = &data[size + parity_offset(size, c)];
+      for (uint8_t k = 0; k < RFM23_FEC_ROOTS; k++) {
+        codeword[n + k] = next[k * RFM23_FEC_DEPTH];
+      }
+      int16_t corrected = rs.decode(codeword, n + RFM23_FEC_ROOTS);
+      if (corrected < 0) {
+        rx_fec_failed++;
+        return false;
+      }
+      quality.corrected += corrected;
+      n                  = 0;
+      for (uint8_t i = c; i < size; i += RFM23_FEC_DEPTH) {
+        data[i] = codeword[n++];
+      }
+    }
+    frame[0]  = (uint8_t)FecMode::ReedSolomon;
+    length   -= RFM23_FEC_PARITY;
     return true;
   }
 
   /**
-   * @brief Receive a packet from the radio.
+   * @brief Wait for the frame being transmitted, if any, to be sent.
    *
-   * @param packet The packet that will hold the received data.
-   * @param timeout The time to wait for a packet from the radio.
-   * @return int32_t The size of the received packet, or -1 if failed to
-   * receive.
+   * The radio's interrupt handler finishes the transmission and returns the
+   * radio to idle, so the SPI interface is free for other users while this
+   * waits. A frame that does not finish in time is aborted.
+   *
+   * @param timeout The time to wait for the frame to be sent.
+   * @return true The radio is not transmitting.
+   * @return false The frame timed out and was aborted.
+   */
+  bool RFM23::wait_sent(uint16_t timeout) {
+    if (rfm23.mode() != RHGenericDriver::RHModeTx) {
+      return true;
+    }
+    uint32_t start   = micros();
+    bool     sent    = rfm23.waitPacketSent(timeout);
+    uint32_t waited  = micros() - start;
+    tx_done_at       = micros();
+
+    period_stats.sent_wait += waited;
+    if (waited > period_stats.sent_wait_max) {
+      period_stats.sent_wait_max = waited;
+    }
+    if (!sent) {
+      period_stats.tx_timeouts++;
+    }
+    if (frames_logged - last_sent <= RFM23_FRAME_LOG) {
+      frame_record &record = frame_log[last_sent % RFM23_FRAME_LOG];
+      record.sent_wait     = waited;
+      if (!sent) {
+        record.error = FrameError::Timeout;
+      }
+    }
+    if (!sent) {
+      print_debug(Helpers::RFM23, "Timed out waiting for packet transmission");
+      Threads::Scope lock(*spi_mtx);
+      rfm23.setModeIdle();
+    }
+    return sent;
+  }
+
+  /**
+   * @brief Check whether the radio has received a packet.
+   *
+   * If the radio is not transmitting, this puts it in receive mode. Reception
+   * then runs in the radio's interrupt handler, which copies a complete frame
+   * out of the radio's FIFO on its own. Once the radio is listening, this is
+   * only a check of that handler's flag.
+   *
+   * @return true A received packet is waiting to be read with recv().
+   * @return false No packet has been received yet.
    *
    * @todo The transmit and receive pins are set high and low respectively.
    * check if this is intended behavior. either change the pin definitions or
    * use setGpioReversed().
    */
+  bool RFM23::available() {
+    Threads::Scope lock(*spi_mtx);
+    if (rfm23.mode() != RHGenericDriver::RHModeRx &&
+        rfm23.mode() != RHGenericDriver::RHModeTx) {
+      digitalWrite(config.pins.rx_on, LOW);
+      digitalWrite(config.pins.tx_on, HIGH);
+    }
+    return rfm23.available();
+  }
+
+  /**
+   * @brief Receive a packet from the radio.
+   *
+   * Frames are read as they arrive, repaired by decode_fec(), and passed to
+   * reassemble() until one of them completes a packet. The radio goes back to
+   * receive mode as soon as each frame is read, since it holds only one. The
+   * SPI mutex is only held while the radio is polled or a frame is read, never
+   * for the whole wait, so other threads can transmit or use the SPI
+   * interface while this waits for a packet.
+   *
+   * @param packet The packet that will hold the received data.
+   * @param timeout The time to wait for a packet from the radio. Pass 0 to
+   * only read a frame that has already been received.
+   * @return int32_t The size of the received packet, or -1 if failed to
+   * receive.
+   */
   int32_t RFM23::recv(PacketComm &packet, uint16_t timeout) {
-    digitalWrite(config.pins.rx_on, LOW);
-    digitalWrite(config.pins.tx_on, HIGH);
+    elapsedMillis waited;
+    while (true) {
+      while (!available()) {
+        if (waited >= timeout) {
+          return -1;
+        }
+        threads.yield();
+      }
 
-    Threads::Scope lock(*spi_mtx);
-    if (rfm23.waitAvailableTimeout(timeout)) {
-      packet.wrapped.resize(0);
-      packet.wrapped.resize(RH_RF22_MAX_MESSAGE_LEN);
-      uint8_t bytes_recieved = packet.wrapped.size();
-      if (rfm23.recv(packet.wrapped.data(), &bytes_recieved)) {
-        packet.wrapped.resize(bytes_recieved);
-        if (packet.Unwrap() < 0) {
-          print_debug(Helpers::RFM23,
-                      "Data was received, but not in packetcomm format.");
+      uint8_t      frame[RH_RF22_MAX_MESSAGE_LEN];
+      uint8_t      bytes_recieved = sizeof(frame);
+      int16_t      rssi;
+      frame_record record = {};
+      record.time         = millis();
+      {
+        uint32_t       start = micros();
+        Threads::Scope lock(*spi_mtx);
+        record.lock_wait = micros() - start;
+        if (!rfm23.recv(frame, &bytes_recieved)) {
+          record.error = FrameError::ReadFailed;
+          log_frame(record);
           return -1;
         }
-        rfm23.setModeIdle();
-        return packet.wrapped.size();
+        rssi = rfm23.lastRssi();
+        // The radio idles once it has a frame, so listen again at once for
+        // the next fragment rather than when the caller next polls.
+        rfm23.available();
+      }
+      record.rssi    = rssi;
+      record.length  = bytes_recieved;
+      record.airtime = frame_airtime(bytes_recieved);
+      bool intact    = decode_fec(frame, bytes_recieved);
+      if (!intact) {
+        record.error = FrameError::Corrupted;
+      }
+      log_frame(record);
+      if (intact) {
+        quality.rssi =
+            quality.good == 0 ? rssi : (3 * quality.rssi + rssi) / 4;
+        quality.good++;
+        quality.since_rx = 0;
+      }
+      if (intact && reassemble(frame, bytes_recieved, packet)) {
+        break;
+      }
+      if (waited >= timeout) {
+        return -1;
       }
     }
-    rfm23.setModeIdle();
-    return -1;
+
+    if (packet.Unwrap() < 0) {
+      print_debug(Helpers::RFM23,
+                  "Data was received, but not in packetcomm format.");
+      return -1;
+    }
+    return packet.wrapped.size();
+  }
+
+  /**
+   * @brief Add a received frame to the packet it is a fragment of.
+   *
+   * Each packet being reassembled takes one of RFM23_REASSEMBLY_SLOTS slots. A
+   * packet whose fragments stop arriving for RFM23_REASSEMBLY_TIMEOUT loses
+   * its slot to the next new packet. If every slot is still in use, the new
+   * packet takes the slot that has waited longest for a fragment, since a
+   * packet's fragments are sent back to back and that one will not be
+   * completed. Duplicate fragments are ignored.
+   *
+   * @param frame The received frame, already checked by decode_fec().
+   * @param length The length of the frame.
+   * @param packet The packet whose wrapped vector will hold the reassembled
+   * bytes, once the last missing fragment arrives.
+   * @return true The frame completed a packet.
+   * @return false The packet is still missing fragments, or the frame was
+   * malformed.
+   */
+  bool RFM23::reassemble(uint8_t *frame, uint8_t length, PacketComm &packet) {
+    if (length <= RFM23_FEC_TAG + RFM23_FRAGMENT_HEADER) {
+      print_debug(Helpers::RFM23, "Received a frame too short to hold data");
+      return false;
+    }
+    uint8_t *header = &frame[RFM23_FEC_TAG];
+    uint8_t  id     = header[0];
+    uint8_t  index  = header[1];
+    uint8_t  count  = header[2];
+    uint8_t  size   = length - RFM23_FEC_TAG - RFM23_FRAGMENT_HEADER;
+    uint8_t  chunk  = frame[0] == (uint8_t)FecMode::ReedSolomon
+                          ? RFM23_FEC_FRAGMENT_PAYLOAD
+                          : RFM23_FRAGMENT_PAYLOAD;
+    if (count == 0 || count > RFM23_MAX_FRAGMENTS || index >= count ||
+        (index < count - 1 && size != chunk)) {
+      print_debug(Helpers::RFM23, "Received a malformed fragment");
+      return false;
+    }
+
+    // Unfragmented packets skip the reassembly slots altogether.
+    if (count == 1) {
+      packet.wrapped.assign(&header[RFM23_FRAGMENT_HEADER], &frame[length]);
+      return true;
+    }
+
+    reassembly_slot *slot   = nullptr;
+    reassembly_slot *unused = nullptr;
+    reassembly_slot *oldest = nullptr;
+    for (auto &candidate : reassembly) {
+      bool expired = candidate.age > RFM23_REASSEMBLY_TIMEOUT;
+      if (candidate.received != 0 && !expired && candidate.id == id &&
+          candidate.count == count && candidate.chunk == chunk) {
+        slot = &candidate;
+        break;
+      }
+      if (candidate.received == 0 || expired) {
+        unused = &candidate;
+      }
+      if (oldest == nullptr || candidate.age > oldest->age) {
+        oldest = &candidate;
+      }
+    }
+    if (slot == nullptr) {
+      if (unused == nullptr) {
+        print_debug(Helpers::RFM23, "Abandoning an incomplete packet");
+        unused = oldest;
+      }
+      slot           = unused;
+      slot->id       = id;
+      slot->count    = count;
+      slot->chunk    = chunk;
+      slot->received = 0;
+      slot->length   = 0;
+    }
+
+    uint64_t bit = (uint64_t)1 << index;
+    slot->age    = 0;
+    if (slot->received & bit) {
+      return false;
+    }
+    memcpy(&slot->buffer[index * chunk], &header[RFM23_FRAGMENT_HEADER], size);
+    slot->received |= bit;
+    slot->length   += size;
+
+    uint64_t all = count == 64 ? ~(uint64_t)0 : ((uint64_t)1 << count) - 1;
+    if (slot->received != all) {
+      return false;
+    }
+    packet.wrapped.assign(slot->buffer, slot->buffer + slot->length);
+    slot->received = 0;
+    return true;
+  }
+
+  /**
+   * @brief Switch the radio to a rung of the modem configuration ladder.
+   *
+   * Any frame being transmitted is allowed to finish first. Both ends of the
+   * link must switch together, so this should only follow a switch agreed on
+   * with ground. The link quality is reset, since it no longer applies.
+   *
+   * @param rung The index into MODEM_LADDER to switch to.
+   * @return true The radio is now using the new configuration.
+   * @return false The rung does not exist, or the radio refused it.
+   */
+  bool RFM23::set_modem(uint8_t rung) {
+    if (rung >= RFM23_MODEM_RUNGS) {
+      return false;
+    }
+    wait_sent(1000);
+    {
+      Threads::Scope lock(*spi_mtx);
+      if (!rfm23.setModemConfig(MODEM_LADDER[rung])) {
+        print_debug(Helpers::RFM23,
+                    "Failed to set config: modem configuration");
+        return false;
+      }
+    }
+    print_debug(Helpers::RFM23, "Switched to modem rung ", (uint16_t)rung);
+    modem_rung = rung;
+    reset_link();
+    return true;
+  }
+
+  /** @brief The rung of MODEM_LADDER the radio is using. */
+  uint8_t RFM23::modem() const { return modem_rung; }
+
+  /**
+   * @brief Get the time a frame takes to transmit at the current rung.
+   *
+   * @param length The length of the frame's data.
+   * @return uint32_t The frame's airtime, in microseconds.
+   */
+  uint32_t RFM23::frame_airtime(uint8_t length) const {
+    return (uint64_t)(RFM23_FRAME_OVERHEAD + length) * 8 * 1000000 /
+           MODEM_BITRATE[modem_rung];
+  }
+
+  /**
+   * @brief Get the CRC-16/CCITT of a frame sent without FEC.
+   *
+   * The FEC tag is left out, since decode_fec() has already read it, and may
+   * have corrected it.
+   *
+   * @param frame The frame, starting with its FEC tag.
+   * @param length The length of the frame, without its CRC.
+   * @return uint16_t The CRC.
+   */
+  uint16_t RFM23::frame_crc(const uint8_t *frame, uint8_t length) {
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = RFM23_FEC_TAG; i < length; i++) {
+      crc ^= frame[i] << 8;
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+      }
+    }
+    return crc;
+  }
+
+  /**
+   * @brief Add a frame to the frame log and the current period's statistics.
+   *
+   * @param record The record of the frame. A sent frame's wait to finish is
+   * added later, by wait_sent().
+   */
+  void RFM23::log_frame(const frame_record &record) {
+    frame_log[frames_logged++ % RFM23_FRAME_LOG]  = record;
+    period_stats.lock_wait                       += record.lock_wait;
+    if (record.lock_wait > period_stats.lock_wait_max) {
+      period_stats.lock_wait_max = record.lock_wait;
+    }
+
+    if (record.sent) {
+      if (record.error == FrameError::Refused) {
+        period_stats.tx_refused++;
+        return;
+      }
+      period_stats.tx_frames++;
+      period_stats.tx_bytes += record.length;
+      period_stats.airtime  += record.airtime;
+      return;
+    }
+    if (record.error == FrameError::ReadFailed) {
+      period_stats.rx_failed++;
+      return;
+    }
+    if (record.error == FrameError::Corrupted) {
+      period_stats.rx_corrupted++;
+    }
+    if (period_stats.rx_frames == 0 || record.rssi < period_stats.rssi_min) {
+      period_stats.rssi_min = record.rssi;
+    }
+    if (period_stats.rx_frames == 0 || record.rssi > period_stats.rssi_max) {
+      period_stats.rssi_max = record.rssi;
+    }
+    period_stats.rx_frames++;
+    period_stats.rx_bytes += record.length;
+    period_stats.rssi_sum += record.rssi;
+  }
+
+  /**
+   * @brief Copy the most recent frames out of the frame log.
+   *
+   * @param records The array that will hold the records, oldest first.
+   * @param max The most records to copy.
+   * @return size_t The number of records copied, at most RFM23_FRAME_LOG.
+   */
+  size_t RFM23::frames(frame_record *records, size_t max) const {
+    size_t count = frames_logged < RFM23_FRAME_LOG ? frames_logged
+                                                   : RFM23_FRAME_LOG;
+    if (count > max) {
+      count = max;
+    }
+    for (size_t i = 0; i < count; i++) {
+      records[i] = frame_log[(frames_logged - count + i) % RFM23_FRAME_LOG];
+    }
+    return count;
+  }
+
+  /**
+   * @brief Get the link statistics of the current period, and start the next.
+   *
+   * Calling this at a fixed interval gives rolling statistics over that
+   * interval.
+   *
+   * @return link_stats The statistics of the period just ended.
+   */
+  RFM23::link_stats RFM23::stats() {
+    link_stats ended = period_stats;
+    ended.period     = period_age;
+    period_stats     = {};
+    period_age       = 0;
+    return ended;
+  }
+
+  /**
+   * @brief Get the quality of the link since it was last reset.
+   *
+   * @return link_quality A snapshot of the link quality.
+   */
+  RFM23::link_quality RFM23::link() {
+    Threads::Scope lock(*spi_mtx);
+    quality.bad = rfm23.rxBad() - rx_bad_base + rx_fec_failed;
+    return quality;
+  }
+
+  /** @brief Start measuring the link quality afresh. */
+  void RFM23::reset_link() {
+    Threads::Scope lock(*spi_mtx);
+    quality       = {};
+    rx_bad_base   = rfm23.rxBad();
+    rx_fec_failed = 0;
   }
 } // namespace Devices
 } // namespace Artemis
\ No newline at end of file
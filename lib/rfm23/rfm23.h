@@ -8,10 +8,14 @@
 #define _RFM23_H
 
 #include "helpers.h"
+#include "reed_solomon.h"
 #include <RHHardwareSPI1.h>
 #include <RH_RF22.h>
 #include <TeensyThreads.h>
 #include <support/packetcomm.h>
+#ifdef RFM23_SIMULATED
+#include <sim_rf22.h>
+#endif
 
 #undef RH_RF22_MAX_MESSAGE_LEN
 /** @brief Overrides the default maximum message length. */
@@ -19,11 +23,91 @@
 /** @brief The minimum time to wait for a reply from the radio. */
 #define MINIMUM_TIMEOUT         100
 
+/**
+ * @brief The size of the FEC tag at the start of every radio frame.
+ *
+ * The tag says whether the rest of the frame is protected by FEC. Its values
+ * differ in every bit, so a tag survives up to three bit errors.
+ */
+#define RFM23_FEC_TAG            1
+/** @brief The number of Reed-Solomon parity symbols in each codeword. */
+#define RFM23_FEC_ROOTS          8
+/**
+ * @brief The number of Reed-Solomon codewords interleaved in each frame.
+ *
+ * Consecutive bytes of a frame belong to different codewords, so a burst of
+ * up to RFM23_FEC_DEPTH * RFM23_FEC_ROOTS / 2 corrupted bytes is corrected.
+ */
+#define RFM23_FEC_DEPTH          2
+/** @brief The number of parity bytes added to each FEC-protected frame. */
+#define RFM23_FEC_PARITY         (RFM23_FEC_ROOTS * RFM23_FEC_DEPTH)
+/**
+ * @brief The size of the fragment header that follows the FEC tag.
+ *
+ * The header holds the packet's message ID, the fragment's index, and the
+ * packet's total number of fragments, one byte each.
+ */
+#define RFM23_FRAGMENT_HEADER    3
+/**
+ * @brief The size of the CRC-16 that ends every frame sent without FEC.
+ *
+ * The radio's own CRC is disabled so FEC can repair corrupted frames, so
+ * frames without FEC carry this one instead.
+ */
+#define RFM23_FRAME_CRC          2
+/** @brief The number of packet bytes carried by each radio frame. */
+#define RFM23_FRAGMENT_PAYLOAD                                                 \
+  (RH_RF22_MAX_MESSAGE_LEN - RFM23_FEC_TAG - RFM23_FRAGMENT_HEADER -           \
+   RFM23_FRAME_CRC)
+/** @brief The number of packet bytes carried by each FEC-protected frame. */
+#define RFM23_FEC_FRAGMENT_PAYLOAD                                             \
+  (RH_RF22_MAX_MESSAGE_LEN - RFM23_FEC_TAG - RFM23_FRAGMENT_HEADER -           \
+   RFM23_FEC_PARITY)
+/** @brief The most fragments a single packet can be split into. */
+#define RFM23_MAX_FRAGMENTS      64
+/** @brief The number of fragmented packets that can be reassembled at once. */
+#define RFM23_REASSEMBLY_SLOTS   2
+/** @brief The time to wait for the next fragment of a packet. */
+#define RFM23_REASSEMBLY_TIMEOUT (10 * SECONDS)
+
+/**
+ * @brief The bytes the radio sends around every frame's data.
+ *
+ * These are the preamble (4 bytes), the sync word (2), the RadioHead header
+ * (4) and the length byte (1). The radio's CRC is disabled, and replaced by
+ * RFM23_FRAME_CRC or FEC parity inside the frame's data.
+ */
+#define RFM23_FRAME_OVERHEAD         11
+
+/** @brief The number of recent frames kept in the radio's frame log. */
+#define RFM23_FRAME_LOG              16
+
+/** @brief The number of rungs in the radio's modem configuration ladder. */
+#define RFM23_MODEM_RUNGS            5
+/** @brief The frames needed at a rung before its link quality is trusted. */
+#define RFM23_MODEM_MIN_FRAMES       8
+/** @brief The RSSI margin, in dB, needed above the next rung's minimum. */
+#define RFM23_MODEM_HYSTERESIS       3
+/** @brief The time to hear from ground after a switch before reverting. */
+#define RFM23_MODEM_PROBATION        (10 * SECONDS)
+/** @brief The silence after which the link is lost and drops to rung 0. */
+#define RFM23_MODEM_SILENCE          (30 * SECONDS)
+/** @brief The minimum time between modem switch requests to ground. */
+#define RFM23_MODEM_REQUEST_INTERVAL (10 * SECONDS)
+
 namespace Artemis {
 namespace Devices {
   /** @brief The RFM23 radio class. */
   class RFM23 {
   public:
+    /** @brief Enumeration of the forward error correction applied to frames. */
+    enum class FecMode : uint8_t {
+      /** @brief Frames are sent as they are. */
+      None        = 0x00,
+      /** @brief Frames carry interleaved Reed-Solomon parity. */
+      ReedSolomon = 0xFF,
+    };
+
     /** @brief The RFM23 radio configuration. */
     struct __attribute__((packed)) rfm23_config {
       /** @brief The receive/transmit center frequency. */
@@ -47,28 +131,213 @@ namespace Devices {
         /** @brief The receive enable pin. */
         uint8_t rx_on;
       } pins;
+      /** @brief The minimum time, in milliseconds, between sent frames. */
+      uint16_t tx_gap;
     };
 
+    /** @brief Enumeration of the ways a frame can be lost. */
+    enum class FrameError : uint8_t {
+      /** @brief The frame was sent, or received and read, intact. */
+      None,
+      /** @brief The radio refused a frame to send. */
+      Refused,
+      /** @brief A sent frame did not finish in time and was aborted. */
+      Timeout,
+      /** @brief The radio did not hand over a received frame. */
+      ReadFailed,
+      /** @brief A received frame had more errors than FEC could correct. */
+      Corrupted,
+    };
+
+    /** @brief The record of a single frame sent or received. */
+    struct frame_record {
+      /** @brief The time, in milliseconds, the frame was sent or read. */
+      uint32_t   time;
+      /** @brief The frame's airtime, in microseconds. */
+      uint32_t   airtime;
+      /** @brief The time, in microseconds, spent waiting for the SPI mutex. */
+      uint32_t   lock_wait;
+      /**
+       * @brief The time, in microseconds, spent waiting for a sent frame to
+       * finish, once something else needed the radio.
+       */
+      uint32_t   sent_wait;
+      /** @brief The RSSI, in dBm, of a received frame. */
+      int16_t    rssi;
+      /** @brief The length of the frame, including any parity. */
+      uint8_t    length;
+      /** @brief Whether the frame was sent rather than received. */
+      bool       sent;
+      /** @brief How the frame was lost, if it was. */
+      FrameError error;
+    };
+
+    /** @brief The frame log, summed over a reporting period. */
+    struct link_stats {
+      /** @brief The length of the period, in milliseconds. */
+      uint32_t period;
+      /** @brief The number of frames sent. */
+      uint16_t tx_frames;
+      /** @brief The number of frames the radio refused to send. */
+      uint16_t tx_refused;
+      /** @brief The number of sent frames aborted for taking too long. */
+      uint16_t tx_timeouts;
+      /** @brief The number of frames received and read, intact or not. */
+      uint16_t rx_frames;
+      /** @brief The number of received frames that could not be read. */
+      uint16_t rx_failed;
+      /** @brief The number of frames read that FEC could not repair. */
+      uint16_t rx_corrupted;
+      /** @brief The number of bytes sent. */
+      uint32_t tx_bytes;
+      /** @brief The number of bytes read. */
+      uint32_t rx_bytes;
+      /** @brief The airtime, in microseconds, of the frames sent. */
+      uint32_t airtime;
+      /** @brief The total time, in microseconds, waiting for the mutex. */
+      uint32_t lock_wait;
+      /** @brief The longest wait, in microseconds, for the SPI mutex. */
+      uint32_t lock_wait_max;
+      /** @brief The total time, in microseconds, waiting for frames to send. */
+      uint32_t sent_wait;
+      /** @brief The longest wait, in microseconds, for a frame to send. */
+      uint32_t sent_wait_max;
+      /** @brief The sum of the RSSI, in dBm, of the frames read. */
+      int32_t  rssi_sum;
+      /** @brief The weakest RSSI, in dBm, of the frames read. */
+      int16_t  rssi_min;
+      /** @brief The strongest RSSI, in dBm, of the frames read. */
+      int16_t  rssi_max;
+    };
+
+    /** @brief The quality of the link since it was last reset. */
+    struct link_quality {
+      /** @brief The smoothed RSSI, in dBm, of received frames. */
+      int16_t       rssi;
+      /** @brief The number of frames received intact. */
+      uint16_t      good;
+      /** @brief The number of frames lost to CRC, FEC or framing errors. */
+      uint16_t      bad;
+      /** @brief The number of bytes repaired by FEC. */
+      uint16_t      corrected;
+      /** @brief The time since the last intact frame was received. */
+      elapsedMillis since_rx;
+    };
+
+    /**
+     * @brief The modem configuration of each rung, slowest first.
+     *
+     * Rung 0 is the configuration the radio starts in, and the one both ends
+     * fall back to when the link is lost.
+     */
+    static const RH_RF22::ModemConfigChoice MODEM_LADDER[RFM23_MODEM_RUNGS];
+    /** @brief The weakest RSSI, in dBm, each rung can be used at. */
+    static const int16_t MODEM_MIN_RSSI[RFM23_MODEM_RUNGS];
+    /** @brief The bit rate, in bits per second, of each rung. */
+    static const uint32_t MODEM_BITRATE[RFM23_MODEM_RUNGS];
+
     RFM23(uint8_t slaveSelectPin, uint8_t interruptPin,
           RHGenericSPI &spi = hardware_spi1);
     bool    init(rfm23_config cfg, Threads::Mutex *mtx);
     void    reset();
-    bool    send(PacketComm &packet);
+    bool    send(PacketComm &packet, FecMode fec = FecMode::None);
+    bool    wait_sent(uint16_t timeout);
+    bool    available();
     int32_t recv(PacketComm &packet, uint16_t timeout);
+    bool    set_modem(uint8_t rung);
+    uint8_t modem() const;
+    uint32_t frame_airtime(uint8_t length) const;
+    static uint16_t frame_crc(const uint8_t *frame, uint8_t length);
+    /** @brief The total airtime, in microseconds, of every frame sent. */
+    uint32_t airtime() const { return tx_airtime; }
+    link_quality link();
+    void    reset_link();
+    size_t  frames(frame_record *records, size_t max) const;
+    link_stats stats();
 
   private:
+    /** @brief A buffer for reassembling the fragments of one packet. */
+    struct reassembly_slot {
+      /** @brief The message ID of the packet. */
+      uint8_t       id;
+      /** @brief The total number of fragments in the packet. */
+      uint8_t       count;
+      /** @brief The number of packet bytes in every fragment but the last. */
+      uint8_t       chunk;
+      /** @brief The bitmap of fragments received so far, or 0 if unused. */
+      uint64_t      received;
+      /** @brief The number of bytes received so far. */
+      size_t        length;
+      /** @brief The time since the last fragment arrived. */
+      elapsedMillis age;
+      /** @brief The reassembled wrapped packet. */
+      uint8_t       buffer[RFM23_MAX_FRAGMENTS * RFM23_FRAGMENT_PAYLOAD];
+    };
+
+    bool    send_frame(uint8_t *frame, uint8_t length);
+    uint8_t encode_fec(uint8_t *frame, uint8_t length);
+    bool    decode_fec(uint8_t *frame, uint8_t &length);
+    /**
+     * @brief The offset, from the end of a frame's data, of a codeword's
+     * first parity byte.
+     */
+    static uint8_t parity_offset(uint8_t size, uint8_t codeword) {
+      return (codeword + RFM23_FEC_DEPTH - size % RFM23_FEC_DEPTH) %
+             RFM23_FEC_DEPTH;
+    }
+    bool    reassemble(uint8_t *frame, uint8_t length, PacketComm &packet);
+    void    log_frame(const frame_record &record);
+
     /**
      * @brief The core radio object.
      *
      * The RFM23 class is a wrapper around the [RadioHead
      * RH_RF22](http://www.airspayce.com/mikem/arduino/RadioHead/classRH__RF22.html)
-     * object.
+     * object. When built with RFM23_SIMULATED, a SimRF22 takes its place, and
+     * the radio transmits over sim_medium instead.
      */
+#ifdef RFM23_SIMULATED
+    SimRF22         rfm23;
+#else
     RH_RF22         rfm23;
+#endif
     /** @brief The mutex used to lock the SPI interface to the radio. */
     Threads::Mutex *spi_mtx;
     /** @brief The configuration of the RFM23 class. */
     rfm23_config    config;
+    /**
+     * @brief The time, in microseconds, the last frame finished sending.
+     *
+     * This is set from the frame's airtime when it is sent, and corrected by
+     * wait_sent() if it sees the frame finish.
+     */
+    uint32_t        tx_done_at = 0;
+    /** @brief The message ID given to the next packet sent. */
+    uint8_t         next_message_id = 0;
+    /** @brief The packets currently being reassembled. */
+    reassembly_slot reassembly[RFM23_REASSEMBLY_SLOTS] = {};
+    /** @brief The rung of MODEM_LADDER the radio is using. */
+    uint8_t         modem_rung = 0;
+    /** @brief The quality of the link at the current rung. */
+    link_quality    quality    = {};
+    /** @brief The driver's count of bad frames when the link was reset. */
+    uint16_t        rx_bad_base = 0;
+    /** @brief The frames FEC or CRC rejected since the link was reset. */
+    uint16_t        rx_fec_failed = 0;
+    /** @brief The airtime, in microseconds, of every frame sent. */
+    uint32_t        tx_airtime = 0;
+    /** @brief The most recent frames, oldest overwritten first. */
+    frame_record    frame_log[RFM23_FRAME_LOG] = {};
+    /** @brief The number of frames ever logged. */
+    uint32_t        frames_logged = 0;
+    /** @brief The frames_logged number of the last frame sent. */
+    uint32_t        last_sent     = 0;
+    /** @brief The frame log summed over the current reporting period. */
+    link_stats      period_stats  = {};
+    /** @brief The time since the current reporting period started. */
+    elapsedMillis   period_age;
+    /** @brief The Reed-Solomon codec for FEC-protected frames. */
+    ReedSolomon     rs{RFM23_FEC_ROOTS};
   };
 } // namespace Devices
 } // namespace Artemis
@@ -0,0 +1,467 @@
+/**
+ * @file sim_rf22.cpp
+ * @brief The simulated RFM23 radio.
+ *
+ * This file contains definitions for the simulated RH_RF22 driver and the
+ * simulated radio channel it transmits over.
+ */
+#include "sim_rf22.h"
+#include <string.h>
+
+/** @brief The bytes the radio sends around every frame's data. */
+#define SIM_RF22_FRAME_OVERHEAD 11
+
+SimMedium sim_medium;
+
+/**
+ * @brief Construct a new SimMedium, with the default channel model.
+ *
+ * @param seed The seed of the channel's random number generator.
+ */
+SimMedium::SimMedium(uint32_t seed)
+    : seed(seed == 0 ? 1 : seed), state(this->seed) {}
+
+/**
+ * @brief Attach a radio to the channel.
+ *
+ * @return uint8_t The radio's end of the channel, or SIM_MEDIUM_ENDS if every
+ * end is taken.
+ */
+uint8_t SimMedium::attach() {
+  if (ends >= SIM_MEDIUM_ENDS) {
+    return SIM_MEDIUM_ENDS;
+  }
+  return ends++;
+}
+
+/**
+ * @brief Send a frame from one radio to the other.
+ *
+ * The channel model decides whether the frame is lost and which of its bits
+ * are flipped. Frames already on their way to the sending radio that arrive
+ * during the transmission are lost.
+ *
+ * @param end The sending radio's end of the channel.
+ * @param data The frame.
+ * @param length The length of the frame, at most SIM_RF22_MAX_FRAME.
+ * @param start The time, in microseconds, the transmission starts.
+ * @param airtime The time, in microseconds, the transmission takes.
+ */
+void SimMedium::transmit(uint8_t end, const uint8_t *data, uint8_t length,
+                         uint32_t start, uint32_t airtime) {
+  Threads::Scope lock(mtx);
+  counters.sent++;
+  sim_link &own  = links[end];
+  own.busy_from  = start;
+  own.busy_until = start + airtime;
+  for (uint8_t i = 0; i < own.count; i++) {
+    sim_frame &frame = own.frames[(own.head + i) % SIM_MEDIUM_FRAMES];
+    if (busy(own, frame.arrives_at)) {
+      frame.collided = true;
+    }
+  }
+
+  sim_link &link = links[(end + 1) % SIM_MEDIUM_ENDS];
+  if (!link.in_burst && uniform() < channel.burst_start) {
+    link.in_burst = true;
+  }
+  if (link.in_burst) {
+    counters.lost++;
+    if (uniform() < channel.burst_end) {
+      link.in_burst = false;
+    }
+    return;
+  }
+  if (length > SIM_RF22_MAX_FRAME || link.count == SIM_MEDIUM_FRAMES) {
+    counters.lost++;
+    return;
+  }
+
+  sim_frame &frame =
+      link.frames[(link.head + link.count) % SIM_MEDIUM_FRAMES];
+  frame.sent_at    = start;
+  frame.arrives_at = start + airtime + channel.delay;
+  frame.length     = length;
+  memcpy(frame.data, data, length);
+  bool flipped = false;
+  if (channel.bit_error_rate > 0) {
+    for (uint16_t bit = 0; bit < 8 * length; bit++) {
+      if (uniform() < channel.bit_error_rate) {
+        frame.data[bit / 8] ^= 1 << (bit % 8);
+        flipped              = true;
+      }
+    }
+  }
+  if (flipped) {
+    counters.corrupted++;
+  }
+
+  // With nobody listening, the frame is delivered as soon as it arrives.
+  if (ends < SIM_MEDIUM_ENDS) {
+    counters.delivered++;
+    counters.bytes   += length;
+    counters.latency += airtime + channel.delay;
+    return;
+  }
+  frame.collided = busy(link, frame.arrives_at);
+  link.count++;
+}
+
+/**
+ * @brief Start or stop a radio listening for frames.
+ *
+ * Frames that arrived before now are received or missed as the radio was
+ * listening until now.
+ *
+ * @param end The radio's end of the channel.
+ * @param now The time, in microseconds.
+ * @param on Whether the radio listens from now on.
+ */
+void SimMedium::listen(uint8_t end, uint32_t now, bool on) {
+  Threads::Scope lock(mtx);
+  settle(end, now);
+  links[end].listening = on;
+}
+
+/**
+ * @brief Check whether a radio holds a frame it has received.
+ *
+ * @param end The receiving radio's end of the channel.
+ * @param now The time, in microseconds.
+ * @return true A frame is waiting to be taken.
+ * @return false No frame has been received.
+ */
+bool SimMedium::arrived(uint8_t end, uint32_t now) {
+  Threads::Scope lock(mtx);
+  return ready(end, now);
+}
+
+/**
+ * @brief Take the frame a radio has received.
+ *
+ * The radio does not listen again until told to with listen().
+ *
+ * @param end The receiving radio's end of the channel.
+ * @param now The time, in microseconds.
+ * @param data The buffer that will hold the frame, SIM_RF22_MAX_FRAME bytes
+ * long.
+ * @param length The length of the frame.
+ * @return true A frame was taken.
+ * @return false No frame has been received.
+ */
+bool SimMedium::take(uint8_t end, uint32_t now, uint8_t *data,
+                     uint8_t *length) {
+  Threads::Scope lock(mtx);
+  if (!ready(end, now)) {
+    return false;
+  }
+  sim_link  &link  = links[end];
+  sim_frame &frame = link.received;
+  memcpy(data, frame.data, frame.length);
+  *length            = frame.length;
+  counters.delivered++;
+  counters.bytes    += frame.length;
+  counters.latency  += now - frame.sent_at;
+  link.holding       = false;
+  return true;
+}
+
+/**
+ * @brief Drop every frame in flight, zero the counters, and restart the
+ * random number generator.
+ *
+ * Attached radios stay attached, and those listening keep listening.
+ */
+void SimMedium::reset() {
+  Threads::Scope lock(mtx);
+  for (auto &link : links) {
+    bool listening = link.listening;
+    link           = {};
+    link.listening = listening;
+  }
+  counters = {};
+  state    = seed;
+}
+
+/** @brief Settle the frames that have arrived, then check for a frame. */
+bool SimMedium::ready(uint8_t end, uint32_t now) {
+  settle(end, now);
+  return links[end].holding;
+}
+
+/**
+ * @brief Receive or drop every frame that has arrived at a radio.
+ *
+ * The first intact frame to arrive while the radio listens is received, and
+ * the radio stops listening, as the RFM23 idles once it has a frame. Every
+ * other frame is lost, as a collision if the radio was transmitting.
+ */
+void SimMedium::settle(uint8_t end, uint32_t now) {
+  sim_link &link = links[end];
+  while (link.count > 0) {
+    sim_frame &frame = link.frames[link.head];
+    if ((int32_t)(now - frame.arrives_at) < 0) {
+      return;
+    }
+    if (frame.collided) {
+      counters.collided++;
+      link.collided++;
+    } else if (link.listening && !link.holding) {
+      link.received  = frame;
+      link.holding   = true;
+      link.listening = false;
+    } else {
+      counters.missed++;
+    }
+    link.head = (link.head + 1) % SIM_MEDIUM_FRAMES;
+    link.count--;
+  }
+}
+
+/** @brief Whether a radio is transmitting at a given time. */
+bool SimMedium::busy(const sim_link &link, uint32_t time) {
+  return time - link.busy_from < link.busy_until - link.busy_from;
+}
+
+/** @brief The next number from the xorshift random number generator. */
+uint32_t SimMedium::next_random() {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/** @brief A random number uniformly distributed in [0, 1). */
+float SimMedium::uniform() { return (next_random() >> 8) / 16777216.0f; }
+
+/**
+ * @brief Construct a new SimRF22. Matches the RH_RF22 constructor.
+ *
+ * The radio attaches to its channel in init(), so radios constructed before
+ * the channel are safe.
+ *
+ * @param slaveSelectPin Unused.
+ * @param interruptPin Unused.
+ * @param spi Unused.
+ * @param medium The channel the radio transmits over.
+ */
+SimRF22::SimRF22(uint8_t slaveSelectPin, uint8_t interruptPin,
+                 RHGenericSPI &spi, SimMedium &medium)
+    : medium(medium), end(SIM_MEDIUM_ENDS) {}
+
+/**
+ * @brief Attach the radio to its channel, if it is not already.
+ *
+ * @return true The radio is attached.
+ * @return false Every end of the channel is taken.
+ */
+bool SimRF22::init() {
+  if (end >= SIM_MEDIUM_ENDS) {
+    end = medium.attach();
+  }
+  set_mode(RHGenericDriver::RHModeIdle);
+  return end < SIM_MEDIUM_ENDS;
+}
+
+/** @brief Abort any transmission and return to idle. */
+void SimRF22::reset() { set_mode(RHGenericDriver::RHModeIdle); }
+
+/** @brief Accept any frequency. */
+bool SimRF22::setFrequency(float centre, float afcPullInRange) {
+  return true;
+}
+
+/** @brief Accept any transmit power. */
+void SimRF22::setTxPower(uint8_t power) {}
+
+/**
+ * @brief Set the bit rate from a modem configuration.
+ *
+ * @param index The modem configuration.
+ * @return true The configuration is an FSK configuration the simulation
+ * knows the bit rate of.
+ * @return false The configuration is not simulated.
+ */
+bool SimRF22::setModemConfig(RH_RF22::ModemConfigChoice index) {
+  switch (index) {
+    case RH_RF22::FSK_Rb2Fd5:
+    case RH_RF22::GFSK_Rb2Fd5: {
+      bitrate = 2000;
+      return true;
+    }
+    case RH_RF22::FSK_Rb2_4Fd36: {
+      bitrate = 2400;
+      return true;
+    }
+    case RH_RF22::FSK_Rb4_8Fd45: {
+      bitrate = 4800;
+      return true;
+    }
+    case RH_RF22::FSK_Rb9_6Fd45: {
+      bitrate = 9600;
+      return true;
+    }
+    case RH_RF22::FSK_Rb19_2Fd9_6: {
+      bitrate = 19200;
+      return true;
+    }
+    case RH_RF22::FSK_Rb38_4Fd19_6: {
+      bitrate = 38400;
+      return true;
+    }
+    case RH_RF22::FSK_Rb57_6Fd28_8: {
+      bitrate = 57600;
+      return true;
+    }
+    case RH_RF22::FSK_Rb125Fd125: {
+      bitrate = 125000;
+      return true;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+
+/** @brief Read a register, as last written. */
+uint8_t SimRF22::spiRead(uint8_t reg) { return registers[reg & 0x7F]; }
+
+/** @brief Write a register. The write has no effect on the simulation. */
+uint8_t SimRF22::spiWrite(uint8_t reg, uint8_t val) {
+  registers[reg & 0x7F] = val;
+  return 0;
+}
+
+/** @brief Put the radio to sleep. */
+bool SimRF22::sleep() {
+  set_mode(RHGenericDriver::RHModeSleep);
+  return true;
+}
+
+/** @brief Put the radio in idle mode. */
+void SimRF22::setModeIdle() { set_mode(RHGenericDriver::RHModeIdle); }
+
+/** @brief Put the radio in receive mode. */
+void SimRF22::setModeRx() { set_mode(RHGenericDriver::RHModeRx); }
+
+/**
+ * @brief Get the radio's mode.
+ *
+ * A transmission ends on its own once its airtime has passed, and reception
+ * once a frame has been received, as they would in the real driver's
+ * interrupt handler.
+ *
+ * @return RHGenericDriver::RHMode The radio's mode.
+ */
+RHGenericDriver::RHMode SimRF22::mode() {
+  if (radio_mode == RHGenericDriver::RHModeTx &&
+      (int32_t)(micros() - tx_end) >= 0) {
+    radio_mode = RHGenericDriver::RHModeIdle;
+  }
+  if (radio_mode == RHGenericDriver::RHModeRx &&
+      medium.arrived(end, micros())) {
+    radio_mode = RHGenericDriver::RHModeIdle;
+  }
+  return radio_mode;
+}
+
+/**
+ * @brief Start transmitting a frame, once any earlier frame has been sent.
+ *
+ * @param data The frame.
+ * @param len The length of the frame, at most SIM_RF22_MAX_FRAME.
+ * @return true The frame is being transmitted.
+ * @return false The frame is too long, or the radio is not attached.
+ */
+bool SimRF22::send(const uint8_t *data, uint8_t len) {
+  if (len > SIM_RF22_MAX_FRAME || end >= SIM_MEDIUM_ENDS) {
+    return false;
+  }
+  while (mode() == RHGenericDriver::RHModeTx) {
+    yield();
+  }
+  uint32_t airtime =
+      (uint64_t)(SIM_RF22_FRAME_OVERHEAD + len) * 8 * 1000000 / bitrate;
+  set_mode(RHGenericDriver::RHModeTx);
+  tx_start = micros();
+  tx_end   = tx_start + airtime;
+  medium.transmit(end, data, len, tx_start, airtime);
+  return true;
+}
+
+/**
+ * @brief Wait for the frame being transmitted, if any, to be sent.
+ *
+ * @param timeout The time, in milliseconds, to wait.
+ * @return true The radio is not transmitting.
+ * @return false The frame is still being transmitted.
+ */
+bool SimRF22::waitPacketSent(uint16_t timeout) {
+  uint32_t start = millis();
+  while (mode() == RHGenericDriver::RHModeTx) {
+    if (millis() - start >= timeout) {
+      return false;
+    }
+    yield();
+  }
+  return true;
+}
+
+/**
+ * @brief Check whether a frame has been received, listening if the radio is
+ * not transmitting and holds no frame.
+ *
+ * @return true A frame is waiting to be read with recv().
+ * @return false No frame has been received yet.
+ */
+bool SimRF22::available() {
+  if (end >= SIM_MEDIUM_ENDS) {
+    return false;
+  }
+  if (medium.arrived(end, micros())) {
+    mode();
+    return true;
+  }
+  if (mode() == RHGenericDriver::RHModeTx) {
+    return false;
+  }
+  if (radio_mode != RHGenericDriver::RHModeRx) {
+    set_mode(RHGenericDriver::RHModeRx);
+  }
+  return false;
+}
+
+/**
+ * @brief Read a received frame.
+ *
+ * @param buf The buffer that will hold the frame.
+ * @param len The size of the buffer, updated to the length of the frame. A
+ * longer frame is cut short.
+ * @return true A frame was read.
+ * @return false No frame has been received.
+ */
+bool SimRF22::recv(uint8_t *buf, uint8_t *len) {
+  uint8_t frame[SIM_RF22_MAX_FRAME];
+  uint8_t length;
+  if (!available() || !medium.take(end, micros(), frame, &length)) {
+    return false;
+  }
+  if (length < *len) {
+    *len = length;
+  }
+  memcpy(buf, frame, *len);
+  last_rssi = medium.model().rssi;
+  return true;
+}
+
+/**
+ * @brief Change the radio's mode, listening only in receive mode.
+ *
+ * @param next The new mode.
+ */
+void SimRF22::set_mode(RHGenericDriver::RHMode next) {
+  radio_mode = next;
+  if (end < SIM_MEDIUM_ENDS) {
+    medium.listen(end, micros(), next == RHGenericDriver::RHModeRx);
+  }
+}
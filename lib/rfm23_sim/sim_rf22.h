@@ -0,0 +1,232 @@
+/**
+ * @file sim_rf22.h
+ * @brief The header file for the simulated RFM23 radio.
+ *
+ * This file contains declarations for a stand-in for the RadioHead RH_RF22
+ * driver, and for the simulated radio channel it transmits over. The RFM23
+ * class uses it in place of the real driver when built with RFM23_SIMULATED.
+ */
+#ifndef _SIM_RF22_H
+#define _SIM_RF22_H
+
+#include <Arduino.h>
+#include <RH_RF22.h>
+#include <TeensyThreads.h>
+
+/** @brief The longest frame, in bytes, the simulated channel carries. */
+#define SIM_RF22_MAX_FRAME 64
+/** @brief The number of frames in flight each way at once. */
+#define SIM_MEDIUM_FRAMES  16
+/** @brief The number of radios that can share a channel. */
+#define SIM_MEDIUM_ENDS    2
+
+/**
+ * @brief The model of the simulated radio channel.
+ *
+ * Losses follow a two-state Gilbert model: a burst starts before a frame with
+ * probability burst_start, every frame sent during a burst is lost, and the
+ * burst ends after each frame with probability burst_end. Frames sent outside
+ * a burst have each bit flipped with probability bit_error_rate.
+ */
+struct sim_channel_model {
+  /** @brief The probability of each bit being flipped outside a burst. */
+  float    bit_error_rate = 1e-5f;
+  /** @brief The probability of a burst of losses starting at each frame. */
+  float    burst_start    = 0.01f;
+  /** @brief The probability of a burst ending after each frame in it. */
+  float    burst_end      = 0.25f;
+  /** @brief The one-way propagation delay, in microseconds. */
+  uint32_t delay          = 10000;
+  /** @brief The RSSI, in dBm, of every frame received. */
+  int16_t  rssi           = -95;
+};
+
+/** @brief The traffic counters of the simulated channel. */
+struct sim_medium_stats {
+  /** @brief The number of frames transmitted. */
+  uint32_t sent;
+  /** @brief The number of frames read by a receiver, or sent to nobody. */
+  uint32_t delivered;
+  /** @brief The number of frames lost to bursts or a full channel. */
+  uint32_t lost;
+  /** @brief The number of frames sent with at least one bit flipped. */
+  uint32_t corrupted;
+  /** @brief The number of frames that arrived while the receiver sent. */
+  uint32_t collided;
+  /**
+   * @brief The number of frames that arrived while the receiver was idle,
+   * asleep, or still holding an earlier frame.
+   */
+  uint32_t missed;
+  /** @brief The number of bytes delivered. */
+  uint32_t bytes;
+  /**
+   * @brief The total time, in microseconds, from the start of each delivered
+   * frame's transmission until it was read.
+   */
+  uint32_t latency;
+};
+
+/**
+ * @brief The simulated radio channel.
+ *
+ * Up to SIM_MEDIUM_ENDS radios attach to the channel, and each frame one
+ * sends arrives at the other once its airtime and the propagation delay have
+ * passed. With a single radio attached, frames are counted as delivered when
+ * they arrive, so the radio's transmit throughput can be measured on its own.
+ *
+ * As on the RFM23, a receiver has room for a single frame, and only takes one
+ * while it listens. A radio listens from listen() until a frame arrives, or
+ * until it stops listening to transmit, idle or sleep. A frame arriving while
+ * its receiver does not listen is missed.
+ *
+ * The channel's randomness comes from a seeded generator, so a run can be
+ * repeated exactly. The radios on either end may run on separate threads.
+ */
+class SimMedium {
+public:
+  SimMedium(uint32_t seed = 1);
+
+  uint8_t                  attach();
+  void                     transmit(uint8_t end, const uint8_t *data,
+                                    uint8_t length, uint32_t start,
+                                    uint32_t airtime);
+  void                     listen(uint8_t end, uint32_t now, bool on);
+  bool                     arrived(uint8_t end, uint32_t now);
+  bool                     take(uint8_t end, uint32_t now, uint8_t *data,
+                                uint8_t *length);
+  void                     reset();
+  /** @brief The number of frames a radio lost to collisions, modulo 2^16. */
+  uint16_t collisions(uint8_t end) const { return links[end].collided; }
+
+  /** @brief Change the model of the channel. */
+  void set_model(const sim_channel_model &model) { channel = model; }
+  /** @brief The model of the channel. */
+  const sim_channel_model &model() const { return channel; }
+  /** @brief The traffic counters since the last reset. */
+  sim_medium_stats         stats() const { return counters; }
+
+private:
+  /** @brief A frame on its way to a radio. */
+  struct sim_frame {
+    /** @brief The time, in microseconds, the frame started transmitting. */
+    uint32_t sent_at;
+    /** @brief The time, in microseconds, the frame reaches the receiver. */
+    uint32_t arrives_at;
+    /** @brief The length of the frame. */
+    uint8_t  length;
+    /** @brief Whether the frame arrives while the receiver transmits. */
+    bool     collided;
+    /** @brief The frame's bytes, as they will be received. */
+    uint8_t  data[SIM_RF22_MAX_FRAME];
+  };
+
+  /** @brief The frames on their way to one radio. */
+  struct sim_link {
+    /** @brief The frames in flight, oldest first from head. */
+    sim_frame frames[SIM_MEDIUM_FRAMES];
+    /** @brief The frame the radio has received and not yet read. */
+    sim_frame received;
+    /** @brief The index of the oldest frame. */
+    uint8_t   head;
+    /** @brief The number of frames in flight. */
+    uint8_t   count;
+    /** @brief Whether the radio holds a frame it has not read. */
+    bool      holding;
+    /** @brief Whether the radio listens for a frame. */
+    bool      listening;
+    /** @brief Whether the link is in a burst of losses. */
+    bool      in_burst;
+    /** @brief The time, in microseconds, the receiver last started sending. */
+    uint32_t  busy_from;
+    /** @brief The time, in microseconds, the receiver finishes sending. */
+    uint32_t  busy_until;
+    /** @brief The number of frames lost to collisions. */
+    uint16_t  collided;
+  };
+
+  bool              ready(uint8_t end, uint32_t now);
+  void              settle(uint8_t end, uint32_t now);
+  static bool       busy(const sim_link &link, uint32_t time);
+  uint32_t          next_random();
+  float             uniform();
+
+  /** @brief The model of the channel. */
+  sim_channel_model channel;
+  /** @brief The frames in flight, indexed by the receiving radio. */
+  sim_link          links[SIM_MEDIUM_ENDS] = {};
+  /** @brief The number of radios attached. */
+  uint8_t           ends                   = 0;
+  /** @brief The seed the generator starts from after a reset. */
+  uint32_t          seed;
+  /** @brief The state of the xorshift random number generator. */
+  uint32_t          state;
+  /** @brief The traffic counters since the last reset. */
+  sim_medium_stats  counters = {};
+  /** @brief The mutex guarding the frames in flight and the counters. */
+  Threads::Mutex    mtx;
+};
+
+/** @brief The channel simulated radios attach to unless told otherwise. */
+extern SimMedium sim_medium;
+
+/**
+ * @brief A simulated RFM23, standing in for the RadioHead RH_RF22 driver.
+ *
+ * It has the members of RH_RF22 the RFM23 class uses, and sends and receives
+ * frames over a SimMedium instead of the SPI interface. Transmissions take
+ * the airtime of the frame at the bit rate of the modem configuration, plus
+ * the radio's preamble, sync word, header and length byte. As on the real
+ * radio, it only receives in receive mode, which available() and setModeRx()
+ * enter and a received frame leaves, and holds one frame until recv() reads
+ * it. Frames that arrive while it transmits, idles or sleeps are lost, and
+ * register writes are kept but have no effect.
+ */
+class SimRF22 {
+public:
+  SimRF22(uint8_t slaveSelectPin, uint8_t interruptPin, RHGenericSPI &spi,
+          SimMedium &medium = sim_medium);
+
+  bool                    init();
+  void                    reset();
+  bool                    setFrequency(float centre,
+                                       float afcPullInRange = 0.05);
+  void                    setTxPower(uint8_t power);
+  bool                    setModemConfig(RH_RF22::ModemConfigChoice index);
+  uint8_t                 spiRead(uint8_t reg);
+  uint8_t                 spiWrite(uint8_t reg, uint8_t val);
+  bool                    sleep();
+  void                    setModeIdle();
+  void                    setModeRx();
+  RHGenericDriver::RHMode mode();
+  bool                    send(const uint8_t *data, uint8_t len);
+  bool                    waitPacketSent(uint16_t timeout);
+  bool                    available();
+  bool                    recv(uint8_t *buf, uint8_t *len);
+  /** @brief The RSSI, in dBm, of the last frame received. */
+  int16_t                 lastRssi() { return last_rssi; }
+  /** @brief The number of frames lost on reception. */
+  uint16_t                rxBad() { return medium.collisions(end); }
+
+private:
+  void                    set_mode(RHGenericDriver::RHMode next);
+
+  /** @brief The channel the radio transmits over. */
+  SimMedium              &medium;
+  /** @brief The radio's end of the channel. */
+  uint8_t                 end;
+  /** @brief The radio's mode, as of the last check. */
+  RHGenericDriver::RHMode radio_mode = RHGenericDriver::RHModeInitialising;
+  /** @brief The bit rate, in bits per second, of the modem configuration. */
+  uint32_t                bitrate    = 2000;
+  /** @brief The time, in microseconds, the current transmission started. */
+  uint32_t                tx_start   = 0;
+  /** @brief The time, in microseconds, the current transmission ends. */
+  uint32_t                tx_end     = 0;
+  /** @brief The RSSI, in dBm, of the last frame received. */
+  int16_t                 last_rssi  = 0;
+  /** @brief The radio's registers, as last written. */
+  uint8_t                 registers[0x80] = {};
+};
+
+#endif // _SIM_RF22_H
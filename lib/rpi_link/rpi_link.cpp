@@ -0,0 +1,190 @@
+/**
+ * @file rpi_link.cpp
+ * @brief The Raspberry Pi link's baud negotiation.
+ *
+ * This file contains definitions for the baud negotiation of the Raspberry
+ * Pi's serial link.
+ */
+#include "rpi_link.h"
+
+const uint32_t RpiLink::BAUD_LADDER[RPI_BAUD_RUNGS] = {
+    RPI_BASE_BAUD, 115200, 230400, 460800, 921600,
+};
+
+/**
+ * @brief Construct a new RPi link.
+ *
+ * The serial port must already be open at RPI_BASE_BAUD.
+ *
+ * @param serial The serial port to the RPi.
+ * @param request The function asking the RPi for a baud rate.
+ * @param ping The function pinging the RPi.
+ * @param switching The function called before the serial port switches rate.
+ */
+RpiLink::RpiLink(HardwareSerial &serial, baud_sender request,
+                 ping_sender ping, switch_handler switching)
+    : serial(serial), request(request), ping(ping), switching(switching) {}
+
+/**
+ * @brief Go back to RPI_BASE_BAUD, where a booting RPi listens, and stop
+ * negotiating.
+ */
+void RpiLink::reset() {
+  set_baud(0);
+  enter(RpiLinkState::Steady);
+}
+
+/**
+ * @brief Start negotiating the fastest baud rate with the RPi.
+ *
+ * The link must be at RPI_BASE_BAUD, with the RPi heard from.
+ */
+void RpiLink::negotiate() {
+  trial_rung = baud_ceiling;
+  request_baud();
+}
+
+/**
+ * @brief Run the baud negotiation.
+ *
+ * This never waits. If the RPi agrees to the trial rung's rate, both ends
+ * switch, and the switch holds if the RPi answers a ping at the new rate.
+ * Once the link is steady, its errors are checked.
+ *
+ * @return true The link is steady, and packets can be sent.
+ * @return false The baud rate is being negotiated.
+ */
+bool RpiLink::update() {
+  switch (current) {
+    case RpiLinkState::Steady: {
+      check_errors();
+      break;
+    }
+    case RpiLinkState::AwaitingBaud: {
+      if (baud_replied && baud_agreed == BAUD_LADDER[trial_rung]) {
+        set_baud(trial_rung);
+        pong_received = false;
+        if (ping()) {
+          enter(RpiLinkState::AwaitingPong);
+        } else {
+          fall_back();
+        }
+      } else if (baud_replied || since_step >= RPI_REPLY_TIMEOUT) {
+        trial_rung--;
+        request_baud();
+      }
+      break;
+    }
+    case RpiLinkState::AwaitingPong: {
+      if (pong_received) {
+        enter(RpiLinkState::Steady);
+        print_debug(Helpers::RPI, "RPi link running at ", baud(), " baud");
+      } else if (since_step >= RPI_REPLY_TIMEOUT) {
+        print_debug(Helpers::RPI, "RPi did not answer at ", baud(), " baud");
+        fall_back();
+      }
+      break;
+    }
+    case RpiLinkState::Probation: {
+      if (since_step >= RPI_BAUD_PROBATION) {
+        trial_rung--;
+        request_baud();
+      }
+      break;
+    }
+  }
+  return steady();
+}
+
+/** @brief Count a malformed frame received from the RPi. */
+void RpiLink::error() { errors++; }
+
+/** @brief Note that the RPi answered a ping. */
+void RpiLink::pong() { pong_received = true; }
+
+/**
+ * @brief Note the RPi's answer to a baud request.
+ *
+ * @param baud The baud rate the RPi agreed to, or 0 if it refused.
+ */
+void RpiLink::baud_reply(uint32_t baud) {
+  baud_agreed  = baud;
+  baud_replied = true;
+}
+
+/**
+ * @brief Ask the RPi for the trial rung's baud rate.
+ *
+ * Rungs the request cannot be sent for are skipped. Once the trial rung
+ * reaches the base rate, the negotiation is over.
+ */
+void RpiLink::request_baud() {
+  for (; trial_rung > 0; trial_rung--) {
+    baud_replied = false;
+    if (request(BAUD_LADDER[trial_rung])) {
+      enter(RpiLinkState::AwaitingBaud);
+      return;
+    }
+  }
+  enter(RpiLinkState::Steady);
+  print_debug(Helpers::RPI, "RPi link running at ", baud(), " baud");
+}
+
+/**
+ * @brief Fall back to RPI_BASE_BAUD after a failed switch, and wait out
+ * RPI_BAUD_PROBATION before trying the rung below the trial rung.
+ */
+void RpiLink::fall_back() {
+  set_baud(0);
+  enter(RpiLinkState::Probation);
+}
+
+/**
+ * @brief Fall back to a slower baud rate on errors.
+ *
+ * The malformed frames are counted over each RPI_ERROR_WINDOW. If there are
+ * more than RPI_MAX_ERRORS, the rate is lowered for good, the RPi is told to
+ * fall back, and the rate is negotiated again after RPI_BAUD_PROBATION.
+ */
+void RpiLink::check_errors() {
+  if (since_check < RPI_ERROR_WINDOW) {
+    return;
+  }
+  since_check    = 0;
+  uint32_t count = errors;
+  errors         = 0;
+  if (baud_rung == 0 || count <= RPI_MAX_ERRORS) {
+    return;
+  }
+  print_debug(Helpers::RPI, "Too many errors at ", baud(),
+              " baud, falling back");
+  baud_ceiling = baud_rung - 1;
+  trial_rung   = baud_rung;
+  // The RPi may not hear this, but falls back on its own after
+  // RPI_BAUD_PROBATION without pings.
+  request(RPI_BASE_BAUD);
+  fall_back();
+}
+
+/**
+ * @brief Switch the serial port's baud rate.
+ *
+ * The switching function first writes out what is waiting at the old rate,
+ * and drops what was received. Bytes received around the switch are garbled,
+ * so they are dropped too.
+ *
+ * @param rung The rung of BAUD_LADDER to switch to.
+ */
+void RpiLink::set_baud(uint8_t rung) {
+  switching();
+  serial.flush();
+  serial.begin(BAUD_LADDER[rung]);
+  serial.clear();
+  baud_rung = rung;
+}
+
+/** @brief Move to a state, and start timing it. */
+void RpiLink::enter(RpiLinkState state) {
+  current    = state;
+  since_step = 0;
+}
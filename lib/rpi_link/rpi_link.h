@@ -0,0 +1,138 @@
+/**
+ * @file rpi_link.h
+ * @brief The header file for the Raspberry Pi link's baud negotiation.
+ *
+ * This file contains declarations for the state machine that negotiates the
+ * fastest baud rate the serial link to the Raspberry Pi holds, and falls back
+ * to a slower one when it does not.
+ */
+#ifndef _RPI_LINK_H
+#define _RPI_LINK_H
+
+#include "helpers.h"
+#include <Arduino.h>
+
+/** @brief The baud rate the RPi link starts at, and falls back to. */
+#define RPI_BASE_BAUD      9600
+/** @brief The number of baud rates the RPi link can run at. */
+#define RPI_BAUD_RUNGS     5
+/** @brief The time, in milliseconds, the RPi has to answer a request. */
+#define RPI_REPLY_TIMEOUT  500
+/**
+ * @brief The time, in milliseconds, the RPi waits for a ping after switching
+ * baud rate before it falls back to RPI_BASE_BAUD.
+ */
+#define RPI_BAUD_PROBATION (2 * SECONDS)
+/** @brief The time, in milliseconds, link errors are counted over. */
+#define RPI_ERROR_WINDOW   (10 * SECONDS)
+/**
+ * @brief The most link errors in an RPI_ERROR_WINDOW before the link falls
+ * back to a slower baud rate.
+ */
+#define RPI_MAX_ERRORS     8
+
+/** @brief Enumeration of the states of the link's baud negotiation. */
+enum class RpiLinkState : uint8_t {
+  /** @brief The link runs at its rung, and errors are counted. */
+  Steady,
+  /** @brief The RPi has been asked for the trial rung's rate. */
+  AwaitingBaud,
+  /** @brief Both ends are at the trial rung, and the RPi has been pinged. */
+  AwaitingPong,
+  /** @brief Back at RPI_BASE_BAUD, waiting for the RPi to fall back too. */
+  Probation,
+};
+
+/**
+ * @brief The baud negotiation of the Raspberry Pi's serial link.
+ *
+ * negotiate() tries each rung of BAUD_LADDER from the ceiling down, until one
+ * holds. For each, the RPi is sent a baud request, and if it agrees, both
+ * ends switch and the RPi is pinged at the new rate. A refused or unanswered
+ * request moves on to the next rung down. An unanswered ping falls back to
+ * RPI_BASE_BAUD, and waits out RPI_BAUD_PROBATION, so the RPi has fallen back
+ * too, before the next rung down is asked for. The link stays at
+ * RPI_BASE_BAUD if no rung holds.
+ *
+ * Once the link is steady, the malformed frames reported with error() are
+ * counted over each RPI_ERROR_WINDOW. More than RPI_MAX_ERRORS lower the
+ * ceiling for good, tell the RPi to fall back, and negotiate again after
+ * RPI_BAUD_PROBATION.
+ *
+ * The link switches the serial port itself, and never waits. The RPi channel
+ * calls update() from its loop, sends the requests and pings through the
+ * functions it gave the link, and reports the RPi's answers with pong() and
+ * baud_reply().
+ */
+class RpiLink {
+public:
+  /** @brief A function that asks the RPi for a baud rate. */
+  typedef bool (*baud_sender)(uint32_t baud);
+  /** @brief A function that pings the RPi. */
+  typedef bool (*ping_sender)();
+  /**
+   * @brief A function called before the serial port switches rate, which
+   * writes out what is waiting at the old rate and drops what was received.
+   */
+  typedef void (*switch_handler)();
+
+  /** @brief The baud rates the link can run at, slowest first. */
+  static const uint32_t BAUD_LADDER[RPI_BAUD_RUNGS];
+
+  RpiLink(HardwareSerial &serial, baud_sender request, ping_sender ping,
+          switch_handler switching);
+
+  void         reset();
+  void         negotiate();
+  bool         update();
+  void         error();
+  void         pong();
+  void         baud_reply(uint32_t baud);
+
+  /** @brief The state of the negotiation. */
+  RpiLinkState state() const { return current; }
+  /** @brief Whether the link is steady, and packets can be sent. */
+  bool         steady() const { return current == RpiLinkState::Steady; }
+  /** @brief The rung of BAUD_LADDER the link runs at. */
+  uint8_t      rung() const { return baud_rung; }
+  /** @brief The baud rate the link runs at. */
+  uint32_t     baud() const { return BAUD_LADDER[baud_rung]; }
+
+private:
+  void            request_baud();
+  void            fall_back();
+  void            check_errors();
+  void            set_baud(uint8_t rung);
+  void            enter(RpiLinkState state);
+
+  /** @brief The serial port to the RPi. */
+  HardwareSerial &serial;
+  /** @brief The function asking the RPi for a baud rate. */
+  baud_sender     request;
+  /** @brief The function pinging the RPi. */
+  ping_sender     ping;
+  /** @brief The function called before the serial port switches rate. */
+  switch_handler  switching;
+  /** @brief The state of the negotiation. */
+  RpiLinkState    current      = RpiLinkState::Steady;
+  /** @brief The rung of BAUD_LADDER the link runs at. */
+  uint8_t         baud_rung    = 0;
+  /** @brief The highest rung of BAUD_LADDER negotiation may try. */
+  uint8_t         baud_ceiling = RPI_BAUD_RUNGS - 1;
+  /** @brief The rung of BAUD_LADDER being negotiated. */
+  uint8_t         trial_rung   = 0;
+  /** @brief The time since the negotiation last changed state. */
+  elapsedMillis   since_step;
+  /** @brief Whether the RPi answered the last ping. */
+  bool            pong_received = false;
+  /** @brief Whether the RPi answered the last baud request. */
+  bool            baud_replied  = false;
+  /** @brief The baud rate the RPi agreed to, or 0 if it refused. */
+  uint32_t        baud_agreed   = 0;
+  /** @brief The malformed frames received since the errors were checked. */
+  uint32_t        errors        = 0;
+  /** @brief The time since the errors were last checked. */
+  elapsedMillis   since_check;
+};
+
+#endif // _RPI_LINK_H
@@ -0,0 +1,145 @@
+/**
+ * @file rpi_session.cpp
+ * @brief The Raspberry Pi power session.
+ *
+ * This file contains definitions for the Raspberry Pi's power session.
+ */
+#include "rpi_session.h"
+
+/**
+ * @brief Power the RPi, if it is off.
+ *
+ * An RPi that was just switched off is left off for RPI_MIN_OFF_TIME first,
+ * so it fully loses power before it boots again. This includes the time
+ * after the Teensy starts.
+ *
+ * @return true The RPi has power, or is to be powered now.
+ * @return false The RPi has not been off long enough.
+ */
+bool RpiSession::power_on() {
+  if (current != RpiState::Off) {
+    return true;
+  }
+  if (millis() - entered < RPI_MIN_OFF_TIME) {
+    return false;
+  }
+  enter(RpiState::Booting);
+  return true;
+}
+
+/** @brief Start shutting the RPi down, if it has power. */
+void RpiSession::halt() {
+  if (current == RpiState::Booting || current == RpiState::Ready) {
+    enter(RpiState::ShuttingDown);
+  }
+}
+
+/**
+ * @brief Note that the RPi was heard from.
+ *
+ * A booting RPi is ready as soon as it is heard from.
+ */
+void RpiSession::heard() {
+  last_word = millis();
+  if (current == RpiState::Booting) {
+    enter(RpiState::Ready);
+  }
+}
+
+/** @brief Cut the power of an RPi that has acknowledged a halt. */
+void RpiSession::halt_acknowledged() {
+  if (current == RpiState::ShuttingDown) {
+    enter(RpiState::Off);
+  }
+}
+
+/**
+ * @brief Apply the session's timeouts.
+ *
+ * @return true The state has changed.
+ * @return false The state is the same.
+ */
+bool RpiSession::update() {
+  uint32_t now = millis();
+  switch (current) {
+    case RpiState::Booting: {
+      if (now - entered >= RPI_BOOT_TIMEOUT) {
+        enter(RpiState::Off);
+        return true;
+      }
+      break;
+    }
+    case RpiState::Ready: {
+      if (now - last_word >= RPI_SILENCE_TIMEOUT) {
+        enter(RpiState::Booting);
+        return true;
+      }
+      break;
+    }
+    case RpiState::ShuttingDown: {
+      if (now - entered >= RPI_HALT_TIMEOUT) {
+        enter(RpiState::Off);
+        return true;
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Whether the RPi should be sent a ping, or a halt while shutting
+ * down, now.
+ *
+ * A true result counts as the ping or halt having been sent.
+ *
+ * @return true A ping or halt is due.
+ * @return false Nothing is due.
+ */
+bool RpiSession::contact_due() {
+  uint32_t now      = millis();
+  uint32_t interval = 0;
+  switch (current) {
+    case RpiState::Booting: {
+      interval = RPI_BOOT_PING_INTERVAL;
+      break;
+    }
+    case RpiState::Ready: {
+      if (now - last_word < RPI_QUIET_TIME) {
+        return false;
+      }
+      interval = RPI_QUIET_TIME;
+      break;
+    }
+    case RpiState::ShuttingDown: {
+      interval = RPI_HALT_INTERVAL;
+      break;
+    }
+    default: {
+      return false;
+    }
+  }
+  if (contacting && now - contacted < interval) {
+    return false;
+  }
+  contacting = true;
+  contacted  = now;
+  return true;
+}
+
+/**
+ * @brief Move the session to a new state.
+ *
+ * @param state The new state.
+ */
+void RpiSession::enter(RpiState state) {
+  current    = state;
+  entered    = millis();
+  contacting = false;
+  if (state == RpiState::Ready) {
+    last_word = entered;
+  }
+}
@@ -0,0 +1,104 @@
+/**
+ * @file rpi_session.h
+ * @brief The header file for the Raspberry Pi power session.
+ *
+ * This file contains declarations for the state machine that decides when the
+ * Raspberry Pi is powered, when it is ready for packets, and when its power
+ * can be cut.
+ */
+#ifndef _RPI_SESSION_H
+#define _RPI_SESSION_H
+
+#include "helpers.h"
+#include <Arduino.h>
+
+/** @brief The time, in milliseconds, between pings to a booting RPi. */
+#define RPI_BOOT_PING_INTERVAL 250
+/** @brief The longest time, in milliseconds, the RPi may take to boot. */
+#define RPI_BOOT_TIMEOUT       (90 * SECONDS)
+/**
+ * @brief The time, in milliseconds, a ready RPi may be silent before it is
+ * pinged.
+ */
+#define RPI_QUIET_TIME         (3 * SECONDS)
+/**
+ * @brief The time, in milliseconds, a ready RPi may be silent before it is
+ * taken to be booting again.
+ */
+#define RPI_SILENCE_TIMEOUT    (15 * SECONDS)
+/** @brief The time, in milliseconds, between halts sent to the RPi. */
+#define RPI_HALT_INTERVAL      (1 * SECONDS)
+/**
+ * @brief The longest time, in milliseconds, the RPi may take to acknowledge a
+ * halt before its power is cut anyway.
+ */
+#define RPI_HALT_TIMEOUT       (20 * SECONDS)
+/**
+ * @brief The shortest time, in milliseconds, the RPi is left off before it is
+ * powered again.
+ */
+#define RPI_MIN_OFF_TIME       (2 * SECONDS)
+
+/** @brief Enumeration of the states of the RPi's power session. */
+enum class RpiState : uint8_t {
+  /** @brief The RPi has no power. */
+  Off,
+  /** @brief The RPi has power, and has not been heard from since. */
+  Booting,
+  /** @brief The RPi has been heard from, and takes packets. */
+  Ready,
+  /** @brief The RPi has been told to halt, and still has power. */
+  ShuttingDown,
+};
+
+/**
+ * @brief The Raspberry Pi's power session.
+ *
+ * The session starts Off. power_on() moves it to Booting, and the RPi is
+ * pinged every RPI_BOOT_PING_INTERVAL until it answers or sends a heartbeat,
+ * both of which the RPi channel reports with heard(). The session is then
+ * Ready, and the RPi is only pinged after RPI_QUIET_TIME without a word from
+ * it. A ready RPi silent for RPI_SILENCE_TIMEOUT is taken to have rebooted,
+ * and is Booting again.
+ *
+ * halt() moves the session to ShuttingDown, and a halt is sent every
+ * RPI_HALT_INTERVAL until the RPi acknowledges it with halt_acknowledged(),
+ * which cuts its power straight away. The power is cut regardless after
+ * RPI_HALT_TIMEOUT, or after RPI_BOOT_TIMEOUT of booting.
+ *
+ * The session does not touch any pins or send anything itself. The RPi
+ * channel calls update() and contact_due() from its loop, powers the RPi
+ * while powered(), and sends a ping or a halt when one is due.
+ */
+class RpiSession {
+public:
+  bool     power_on();
+  void     halt();
+  void     heard();
+  void     halt_acknowledged();
+  bool     update();
+  bool     contact_due();
+
+  /** @brief The state of the session. */
+  RpiState state() const { return current; }
+  /** @brief Whether the RPi should have power. */
+  bool     powered() const { return current != RpiState::Off; }
+  /** @brief Whether the RPi takes packets. */
+  bool     ready() const { return current == RpiState::Ready; }
+
+private:
+  void     enter(RpiState state);
+
+  /** @brief The state of the session. */
+  RpiState current    = RpiState::Off;
+  /** @brief The time, in milliseconds, the current state was entered. */
+  uint32_t entered    = 0;
+  /** @brief The time, in milliseconds, the RPi was last heard from. */
+  uint32_t last_word  = 0;
+  /** @brief The time, in milliseconds, of the last ping or halt sent. */
+  uint32_t contacted  = 0;
+  /** @brief Whether a ping or halt has been sent in the current state. */
+  bool     contacting = false;
+};
+
+#endif // _RPI_SESSION_H
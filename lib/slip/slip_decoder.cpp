@@ -0,0 +1,113 @@
+/**
+ * @file slip_decoder.cpp
+ * @brief The streaming SLIP decoder.
+ *
+ * This file contains definitions for the incremental SLIP decoder.
+ */
+#include "slip_decoder.h"
+
+namespace {
+  /** @brief The byte that ends every frame. */
+  const uint8_t END     = 0xC0;
+  /** @brief The byte that starts an escape sequence. */
+  const uint8_t ESC     = 0xDB;
+  /** @brief The escaped form of END. */
+  const uint8_t ESC_END = 0xDC;
+  /** @brief The escaped form of ESC. */
+  const uint8_t ESC_ESC = 0xDD;
+} // namespace
+
+/**
+ * @brief Construct a new SlipDecoder, waiting for the first END.
+ *
+ * @param max_frame The longest decoded frame, in bytes, to accept.
+ */
+SlipDecoder::SlipDecoder(size_t max_frame) : max_frame(max_frame) {}
+
+/**
+ * @brief Decode bytes from the stream, up to the end of the next frame.
+ *
+ * Runs of ordinary bytes are copied into the frame in one go, so the cost per
+ * byte is little more than a comparison.
+ *
+ * @param bytes The bytes read from the stream.
+ * @param size The number of bytes read.
+ * @param consumed The number of bytes decoded. If a frame or error was
+ * returned, the rest should be passed to the next call.
+ * @param frame The buffer the frame is decoded into. It must be empty when a
+ * frame starts, and is passed back in unchanged until the frame is complete.
+ * @return SlipStatus Whether frame holds a complete frame, still needs more
+ * bytes, or held a bad frame that has been cleared.
+ */
+SlipStatus SlipDecoder::decode(const uint8_t *bytes, size_t size,
+                               size_t &consumed, std::vector<uint8_t> &frame) {
+  size_t i = 0;
+  while (i < size) {
+    switch (state) {
+      case State::Hunt:
+      case State::Discard: {
+        while (i < size && bytes[i] != END) {
+          i++;
+        }
+        if (i < size) {
+          i++;
+          frame.clear();
+          state = State::Data;
+        }
+        break;
+      }
+      case State::Data: {
+        size_t run = i;
+        while (run < size && bytes[run] != END && bytes[run] != ESC) {
+          run++;
+        }
+        if (frame.size() + (run - i) > max_frame) {
+          consumed = run;
+          return discard(frame);
+        }
+        frame.insert(frame.end(), bytes + i, bytes + run);
+        i = run;
+        if (i == size) {
+          break;
+        }
+        if (bytes[i++] == ESC) {
+          state = State::Escape;
+        } else if (!frame.empty()) {
+          decoded++;
+          consumed = i;
+          return SlipStatus::Frame;
+        }
+        break;
+      }
+      case State::Escape: {
+        uint8_t escaped = bytes[i];
+        if ((escaped != ESC_END && escaped != ESC_ESC) ||
+            frame.size() >= max_frame) {
+          // An END here both ends the bad frame and starts the next one.
+          if (escaped != END) {
+            i++;
+          }
+          consumed = i;
+          return discard(frame);
+        }
+        i++;
+        frame.push_back(escaped == ESC_END ? END : ESC);
+        state = State::Data;
+        break;
+      }
+    }
+  }
+  consumed = size;
+  return SlipStatus::Incomplete;
+}
+
+/** @brief Forget any partial frame, and wait for the next END. */
+void SlipDecoder::reset() { state = State::Hunt; }
+
+/** @brief Drop the frame being decoded, and skip to the next END. */
+SlipStatus SlipDecoder::discard(std::vector<uint8_t> &frame) {
+  frame.clear();
+  discarded++;
+  state = State::Discard;
+  return SlipStatus::Error;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file slip_decoder.h
+ * @brief The header file for the streaming SLIP decoder.
+ *
+ * This file contains declarations for the decoder that turns a stream of
+ * SLIP-encoded bytes from a serial port back into frames. It does not depend
+ * on the Teensy, so it can be built and benchmarked on a host.
+ */
+#ifndef _SLIP_DECODER_H
+#define _SLIP_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** @brief The longest decoded frame, in bytes, a SlipDecoder accepts. */
+#define SLIP_MAX_FRAME 2048
+
+/** @brief Enumeration of the outcomes of feeding bytes to a SlipDecoder. */
+enum class SlipStatus : uint8_t {
+  /** @brief Every byte was consumed without completing a frame. */
+  Incomplete,
+  /** @brief A frame was completed, and the bytes after it were left. */
+  Frame,
+  /** @brief A malformed or oversized frame was discarded. */
+  Error,
+};
+
+/**
+ * @brief An incremental, non-blocking SLIP decoder.
+ *
+ * Bytes are fed in as they arrive, in pieces of any size, and are decoded
+ * straight into the caller's frame buffer. The decoder keeps its place
+ * between calls, including in the middle of an escape sequence, so a frame
+ * may be split across any number of reads.
+ *
+ * Bytes before the first END are ignored, since the frame they belong to
+ * cannot be recovered. Empty frames between back-to-back ENDs are skipped. A
+ * frame with an invalid escape sequence, or longer than max_frame, is
+ * discarded up to the next END.
+ */
+class SlipDecoder {
+public:
+  SlipDecoder(size_t max_frame = SLIP_MAX_FRAME);
+
+  SlipStatus decode(const uint8_t *bytes, size_t size, size_t &consumed,
+                    std::vector<uint8_t> &frame);
+  void       reset();
+
+  /** @brief The number of frames decoded, modulo 2^32. */
+  uint32_t   frames() const { return decoded; }
+  /** @brief The number of frames discarded, modulo 2^32. */
+  uint32_t   errors() const { return discarded; }
+
+private:
+  /** @brief Enumeration of the decoder's states. */
+  enum class State : uint8_t {
+    /** @brief Waiting for the first END. */
+    Hunt,
+    /** @brief Reading a frame's bytes. */
+    Data,
+    /** @brief After an ESC, waiting for the escaped byte. */
+    Escape,
+    /** @brief Skipping a bad frame until the next END. */
+    Discard,
+  };
+
+  SlipStatus discard(std::vector<uint8_t> &frame);
+
+  /** @brief The longest frame accepted. */
+  size_t     max_frame;
+  /** @brief The decoder's state. */
+  State      state     = State::Hunt;
+  /** @brief The number of frames decoded. */
+  uint32_t   decoded   = 0;
+  /** @brief The number of frames discarded. */
+  uint32_t   discarded = 0;
+};
+
+#endif // _SLIP_DECODER_H
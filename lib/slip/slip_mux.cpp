@@ -0,0 +1,328 @@
+/**
+ * @file slip_mux.cpp
+ * @brief The multiplexer of streams over a SLIP link.
+ *
+ * This file contains definitions for the multiplexer of message streams.
+ */
+#include "slip_mux.h"
+
+namespace {
+  /** @brief The bits of a header's first byte holding the stream. */
+  const uint8_t STREAM_MASK = 0x0F;
+  /** @brief The flag marking a segment that starts its message. */
+  const uint8_t FIRST       = 0x20;
+  /** @brief The flag marking a credit frame. */
+  const uint8_t CREDIT      = 0x40;
+  /** @brief The flag marking a segment with more of its message to follow. */
+  const uint8_t MORE        = 0x80;
+  /** @brief The size of a message's length in the send queue. */
+  const size_t  TX_RECORD   = 2;
+  /** @brief The size of a message's length and segment count when received. */
+  const size_t  RX_RECORD   = 3;
+} // namespace
+
+static_assert(SLIP_MUX_STREAMS <= 16, "SlipMux streams must fit in 4 bits");
+static_assert(SLIP_MUX_WINDOW < 128, "SlipMux window must be below 128");
+static_assert((SLIP_MUX_TX_QUEUE & (SLIP_MUX_TX_QUEUE - 1)) == 0 &&
+                  (SLIP_MUX_RX_QUEUE & (SLIP_MUX_RX_QUEUE - 1)) == 0,
+              "SlipMux queues must be powers of two");
+static_assert(SLIP_MUX_RX_QUEUE >=
+                  SLIP_MUX_MAX_MESSAGE + SLIP_MUX_WINDOW * RX_RECORD,
+              "SlipMux receive queue must hold a whole window");
+
+/** @brief Construct a new SlipMux, with every stream given a weight of 1. */
+SlipMux::SlipMux() {}
+
+/**
+ * @brief Set a stream's share of the link.
+ *
+ * @param stream The stream.
+ * @param weight The number of full segments the stream may send each turn.
+ */
+void SlipMux::set_weight(uint8_t stream, uint8_t weight) {
+  if (stream < SLIP_MUX_STREAMS && weight > 0) {
+    tx[stream].weight = weight;
+  }
+}
+
+/**
+ * @brief Queue a message on a stream.
+ *
+ * @param stream The stream.
+ * @param message The message.
+ * @param size The size of the message, at most SLIP_MUX_MAX_MESSAGE.
+ * @return true The message has been queued.
+ * @return false The stream's queue has no room, or the message is too long.
+ */
+bool SlipMux::send(uint8_t stream, const uint8_t *message, size_t size) {
+  if (stream >= SLIP_MUX_STREAMS || size > SLIP_MUX_MAX_MESSAGE) {
+    return false;
+  }
+  byte_ring<SLIP_MUX_TX_QUEUE> &queue = tx[stream].queue;
+  if (queue.free() < TX_RECORD + size) {
+    return false;
+  }
+  uint8_t length[TX_RECORD] = {(uint8_t)size, (uint8_t)(size >> 8)};
+  queue.write(0, length, TX_RECORD);
+  queue.write(TX_RECORD, message, size);
+  queue.commit(TX_RECORD + size);
+  return true;
+}
+
+/**
+ * @brief Get the next frame to send over the link.
+ *
+ * Credit frames go first. Then the streams with a segment to send and the
+ * credit to send it take turns: a stream gets its weight in segments' worth
+ * of bytes at the start of its turn, and sends segments while they fit.
+ *
+ * @param frame The buffer the frame is written to, of at least
+ * SLIP_MUX_FRAME bytes.
+ * @param size Set to the size of the frame.
+ * @return true frame holds a frame to SLIP-encode and send.
+ * @return false There is nothing to send.
+ */
+bool SlipMux::next_frame(uint8_t *frame, size_t &size) {
+  for (uint8_t stream = 0; stream < SLIP_MUX_STREAMS; stream++) {
+    if (rx[stream].credit_due) {
+      frame[0]              = CREDIT | stream;
+      frame[1]              = rx[stream].released;
+      size                  = SLIP_MUX_HEADER;
+      rx[stream].credit_due = false;
+      return true;
+    }
+  }
+
+  // Two passes over the streams give every stream with data a new quantum,
+  // which always covers a segment.
+  for (uint8_t i = 0; i <= 2 * SLIP_MUX_STREAMS; i++) {
+    tx_stream &stream = tx[turn];
+    if (!sendable(turn)) {
+      stream.deficit = 0;
+    } else {
+      if (!started) {
+        stream.deficit += (size_t)stream.weight * SLIP_MUX_SEGMENT;
+        started         = true;
+      }
+      size_t length = segment_size(turn);
+      if (length <= stream.deficit) {
+        stream.deficit -= length;
+        emit_segment(turn, frame, size);
+        return true;
+      }
+    }
+    turn    = (turn + 1) % SLIP_MUX_STREAMS;
+    started = false;
+  }
+  return false;
+}
+
+/**
+ * @brief Process a frame received over the link.
+ *
+ * @param frame The frame, SLIP-decoded.
+ * @param size The size of the frame.
+ * @return true The frame was a credit frame or a segment, and has been
+ * processed.
+ * @return false The frame was malformed, or the receiver had no room for it.
+ */
+bool SlipMux::receive(const uint8_t *frame, size_t size) {
+  if (size < SLIP_MUX_HEADER || size > SLIP_MUX_FRAME ||
+      (frame[0] & STREAM_MASK) >= SLIP_MUX_STREAMS) {
+    dropped++;
+    return false;
+  }
+  uint8_t stream = frame[0] & STREAM_MASK;
+  if (frame[0] & CREDIT) {
+    tx_stream &sender = tx[stream];
+    // A stale credit would claim segments that were never sent.
+    if ((uint8_t)(sender.next_seq - frame[1]) <= SLIP_MUX_WINDOW) {
+      sender.released = frame[1];
+    }
+    return true;
+  }
+
+  rx_stream &receiver = rx[stream];
+  uint8_t    seq      = frame[1];
+  if (seq != receiver.expected) {
+    // The segments in between were lost, and with them the message they
+    // belonged to. None of them hold space, so they are released.
+    discard_partial(receiver);
+    receiver.released   += (uint8_t)(seq - receiver.expected);
+    receiver.credit_due  = true;
+  }
+  receiver.expected = seq + 1;
+  if (!(frame[0] & FIRST) && receiver.segments == 0) {
+    // The start of this segment's message was lost, so the rest of it is
+    // dropped as it arrives.
+    receiver.released++;
+    receiver.credit_due = true;
+    return true;
+  }
+
+  size_t length = size - SLIP_MUX_HEADER;
+  if (receiver.partial + length > SLIP_MUX_MAX_MESSAGE ||
+      receiver.queue.free() < RX_RECORD + receiver.partial + length) {
+    discard_partial(receiver);
+    receiver.released++;
+    receiver.credit_due = true;
+    return false;
+  }
+  receiver.queue.write(RX_RECORD + receiver.partial, &frame[SLIP_MUX_HEADER],
+                       length);
+  receiver.partial += length;
+  receiver.segments++;
+  if (frame[0] & MORE) {
+    return true;
+  }
+  uint8_t record[RX_RECORD] = {(uint8_t)receiver.partial,
+                               (uint8_t)(receiver.partial >> 8),
+                               receiver.segments};
+  receiver.queue.write(0, record, RX_RECORD);
+  receiver.queue.commit(RX_RECORD + receiver.partial);
+  receiver.partial  = 0;
+  receiver.segments = 0;
+  return true;
+}
+
+/**
+ * @brief Take the next message received on a stream.
+ *
+ * The segments it was sent in are released, so the sender may send more.
+ *
+ * @param stream The stream.
+ * @param message Set to the message.
+ * @return true A message was taken.
+ * @return false No whole message is waiting on the stream.
+ */
+bool SlipMux::pop(uint8_t stream, std::vector<uint8_t> &message) {
+  if (stream >= SLIP_MUX_STREAMS || rx[stream].queue.size() == 0) {
+    return false;
+  }
+  rx_stream &receiver = rx[stream];
+  uint8_t    record[RX_RECORD];
+  receiver.queue.read(0, record, RX_RECORD);
+  size_t length = record[0] | (record[1] << 8);
+  message.resize(length);
+  receiver.queue.read(RX_RECORD, message.data(), length);
+  receiver.queue.drop(RX_RECORD + length);
+  receiver.released   += record[2];
+  receiver.credit_due  = true;
+  return true;
+}
+
+/**
+ * @brief Send every stream's credit again.
+ *
+ * This should be called now and then, so a sender whose last credit frame
+ * was lost does not wait forever.
+ */
+void SlipMux::refresh_credits() {
+  for (auto &receiver : rx) {
+    receiver.credit_due = true;
+  }
+}
+
+/**
+ * @brief Start the streams over, as the other end does.
+ *
+ * Messages partly received are dropped, and messages partly sent will be sent
+ * again from the start. Messages waiting to be sent are kept.
+ */
+void SlipMux::reset() {
+  for (auto &sender : tx) {
+    sender.sent     = 0;
+    sender.next_seq = 0;
+    sender.released = 0;
+    sender.deficit  = 0;
+  }
+  for (auto &receiver : rx) {
+    receiver.queue.clear();
+    receiver.partial    = 0;
+    receiver.segments   = 0;
+    receiver.expected   = 0;
+    receiver.released   = 0;
+    receiver.credit_due = false;
+  }
+  turn    = 0;
+  started = false;
+}
+
+/**
+ * @brief Drop every message waiting to be sent.
+ *
+ * A message partly sent is cut short. Its stream skips a sequence number, so
+ * the other end sees a gap and drops the part it has.
+ */
+void SlipMux::clear() {
+  for (auto &sender : tx) {
+    if (sender.sent > 0) {
+      sender.next_seq++;
+    }
+    sender.queue.clear();
+    sender.sent    = 0;
+    sender.deficit = 0;
+  }
+}
+
+/**
+ * @brief The number of segments a stream may send before it needs credit.
+ *
+ * @param stream The stream.
+ * @return uint8_t The number of segments, at most SLIP_MUX_WINDOW.
+ */
+uint8_t SlipMux::credits(uint8_t stream) const {
+  uint8_t unreleased = tx[stream].next_seq - tx[stream].released;
+  return unreleased >= SLIP_MUX_WINDOW ? 0 : SLIP_MUX_WINDOW - unreleased;
+}
+
+/** @brief Whether a stream has a segment to send and the credit for it. */
+bool SlipMux::sendable(uint8_t stream) const {
+  return tx[stream].queue.size() > 0 && credits(stream) > 0;
+}
+
+/** @brief The size of the next segment of a stream with a message queued. */
+size_t SlipMux::segment_size(uint8_t stream) const {
+  const tx_stream &sender = tx[stream];
+  uint8_t          length[TX_RECORD];
+  sender.queue.read(0, length, TX_RECORD);
+  size_t remaining = (length[0] | (length[1] << 8)) - sender.sent;
+  return remaining < SLIP_MUX_SEGMENT ? remaining : SLIP_MUX_SEGMENT;
+}
+
+/**
+ * @brief Write the next segment of a stream's first message to a frame.
+ *
+ * @param stream The stream.
+ * @param frame The buffer the frame is written to.
+ * @param size Set to the size of the frame.
+ */
+void SlipMux::emit_segment(uint8_t stream, uint8_t *frame, size_t &size) {
+  tx_stream &sender = tx[stream];
+  uint8_t    length[TX_RECORD];
+  sender.queue.read(0, length, TX_RECORD);
+  size_t  total   = length[0] | (length[1] << 8);
+  size_t  segment = segment_size(stream);
+  bool    more    = sender.sent + segment < total;
+  uint8_t flags   = (more ? MORE : 0) | (sender.sent == 0 ? FIRST : 0);
+  frame[0]        = stream | flags;
+  frame[1]        = sender.next_seq++;
+  sender.queue.read(TX_RECORD + sender.sent, &frame[SLIP_MUX_HEADER], segment);
+  size         = SLIP_MUX_HEADER + segment;
+  sender.sent += segment;
+  if (!more) {
+    sender.queue.drop(TX_RECORD + total);
+    sender.sent = 0;
+  }
+}
+
+/** @brief Drop the message a stream was receiving, releasing its segments. */
+void SlipMux::discard_partial(rx_stream &stream) {
+  if (stream.segments == 0) {
+    return;
+  }
+  dropped++;
+  stream.released += stream.segments;
+  stream.partial   = 0;
+  stream.segments  = 0;
+}
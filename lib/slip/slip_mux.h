@@ -0,0 +1,210 @@
+/**
+ * @file slip_mux.h
+ * @brief The header file for the multiplexer of streams over a SLIP link.
+ *
+ * This file contains declarations for the layer that carries several logical
+ * streams of messages over one SLIP-framed serial link, so a long transfer on
+ * one stream does not hold up short messages on another. It does not depend
+ * on the Teensy, so it can be built and tested on a host.
+ */
+#ifndef _SLIP_MUX_H
+#define _SLIP_MUX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** @brief The number of streams on the link. Stream 0 is the control stream. */
+#define SLIP_MUX_STREAMS     3
+/**
+ * @brief The most message bytes carried by one SLIP frame.
+ *
+ * A control message waits behind at most one turn of each other stream, so
+ * this bounds its latency along with the streams' weights: 128 bytes are
+ * 1.4 ms at 921600 baud, and a whole turn of the RPi link's bulk streams
+ * under 5 ms.
+ */
+#define SLIP_MUX_SEGMENT     128
+/** @brief The size of the header at the start of every SLIP frame. */
+#define SLIP_MUX_HEADER      2
+/** @brief The longest SLIP frame, before escaping, the multiplexer sends. */
+#define SLIP_MUX_FRAME       (SLIP_MUX_HEADER + SLIP_MUX_SEGMENT)
+/**
+ * @brief The number of segments of each stream the receiver has room for.
+ *
+ * This is each stream's credit: a sender never has more segments of a stream
+ * unreleased by the receiver. It must be below 128.
+ */
+#define SLIP_MUX_WINDOW      12
+/**
+ * @brief The longest message, in bytes, a stream carries.
+ *
+ * The longest the RPi link sends is a file chunk of FILE_READ_SIZE bytes, at
+ * just over 1 KB once wrapped.
+ */
+#define SLIP_MUX_MAX_MESSAGE (SLIP_MUX_WINDOW * SLIP_MUX_SEGMENT)
+/**
+ * @brief The size, in bytes, of each stream's queue of messages to send.
+ * Must be a power of two.
+ *
+ * Each stream has a send queue and a receive buffer, both in static memory,
+ * so a SlipMux takes a little over 4 KB per stream. A send queue holds one
+ * message of the longest size and a few short ones behind it.
+ */
+#define SLIP_MUX_TX_QUEUE    2048
+/**
+ * @brief The size, in bytes, of each stream's buffer of received messages.
+ *
+ * It holds a whole window of segments, and the 3-byte record header of each.
+ * Must be a power of two.
+ */
+#define SLIP_MUX_RX_QUEUE    2048
+
+/**
+ * @brief A multiplexer of message streams over a SLIP link.
+ *
+ * Each end queues messages on a stream with send(), and asks next_frame()
+ * for the next frame to SLIP-encode and write. Messages are cut into
+ * segments of up to SLIP_MUX_SEGMENT bytes, and the streams take turns by
+ * deficit round robin: each turn, a stream may send up to its weight in
+ * segments' worth of bytes. A short message on the control stream therefore
+ * waits behind at most one turn of each bulk stream, however long the bulk
+ * messages are.
+ *
+ * Flow control is per stream, by credit. The receiver buffers the segments
+ * of each stream until the messages they make up are taken with pop(), and
+ * tells the sender how many segments it has released in total. A sender
+ * only sends a stream's segment while fewer than SLIP_MUX_WINDOW of them are
+ * unreleased, so a stream the receiver is not reading stops without
+ * stopping the others. Credit frames take priority over data.
+ *
+ * Every frame starts with a 2-byte header. The first byte holds the stream,
+ * and flags for a credit frame, for a segment with more of its message to
+ * follow, and for a segment that starts its message. In a data frame, the
+ * second byte is the segment's sequence number within its stream, and the
+ * segment follows. In a credit frame, it is the number of segments of that
+ * stream the receiver has released, modulo 256.
+ *
+ * @verbatim
+  bit 7   bit 6    bit 5   bits 0-3   1 byte                  N bytes
++-------+--------+-------+----------+-----------------------+---------+
+| more  | credit | first |  stream  | sequence / released   | segment |
++-------+--------+-------+----------+-----------------------+---------+
+   @endverbatim
+ *
+ * Frames are not resent. A gap in a stream's sequence numbers drops the
+ * message it cut short, along with the rest of that message as it arrives,
+ * and the receiver counts the lost and dropped segments as released, so
+ * credit is never lost along with them. Credits are absolute counts, so a
+ * lost credit frame is made up for by the next one, and refresh_credits()
+ * resends them all. Both ends must reset() together, such as when the link
+ * changes baud rate. Messages waiting to be sent survive a reset, and clear()
+ * drops them.
+ */
+class SlipMux {
+public:
+  SlipMux();
+
+  void     set_weight(uint8_t stream, uint8_t weight);
+  bool     send(uint8_t stream, const uint8_t *message, size_t size);
+  bool     next_frame(uint8_t *frame, size_t &size);
+  bool     receive(const uint8_t *frame, size_t size);
+  bool     pop(uint8_t stream, std::vector<uint8_t> &message);
+  void     refresh_credits();
+  void     reset();
+  void     clear();
+  uint8_t  credits(uint8_t stream) const;
+
+  /** @brief The number of bytes waiting to be sent on a stream. */
+  size_t   queued(uint8_t stream) const { return tx[stream].queue.size(); }
+  /** @brief The number of frames dropped or messages cut short, mod 2^32. */
+  uint32_t errors() const { return dropped; }
+
+private:
+  /** @brief A byte ring buffer. Size must be a power of two. */
+  template <size_t Size> struct byte_ring {
+    /** @brief The number of bytes in the ring. */
+    size_t size() const { return head - tail; }
+    /** @brief The number of bytes that can be added. */
+    size_t free() const { return Size - size(); }
+    /** @brief Copy bytes to the ring, offset bytes past its end. */
+    void write(size_t offset, const uint8_t *bytes, size_t count) {
+      for (size_t i = 0; i < count; i++) {
+        buffer[(head + offset + i) & (Size - 1)] = bytes[i];
+      }
+    }
+    /** @brief Copy bytes from the ring, offset bytes past its start. */
+    void read(size_t offset, uint8_t *bytes, size_t count) const {
+      for (size_t i = 0; i < count; i++) {
+        bytes[i] = buffer[(tail + offset + i) & (Size - 1)];
+      }
+    }
+    /** @brief Add the bytes written to the end of the ring. */
+    void commit(size_t count) { head += count; }
+    /** @brief Remove bytes from the start of the ring. */
+    void drop(size_t count) { tail += count; }
+    /** @brief Empty the ring. */
+    void clear() { tail = head; }
+
+    /** @brief The bytes in the ring. */
+    uint8_t buffer[Size];
+    /** @brief The number of bytes ever added. */
+    size_t  head = 0;
+    /** @brief The number of bytes ever removed. */
+    size_t  tail = 0;
+  };
+
+  /** @brief The sending end of a stream. */
+  struct tx_stream {
+    /** @brief The messages to send, each after its 2-byte length. */
+    byte_ring<SLIP_MUX_TX_QUEUE> queue;
+    /** @brief The bytes of the first message already sent. */
+    size_t                       sent     = 0;
+    /** @brief The sequence number of the next segment. */
+    uint8_t                      next_seq = 0;
+    /** @brief The number of segments the receiver has released. */
+    uint8_t                      released = 0;
+    /** @brief The number of full segments the stream may send each turn. */
+    uint8_t                      weight   = 1;
+    /** @brief The bytes the stream may still send this turn. */
+    size_t                       deficit  = 0;
+  };
+
+  /** @brief The receiving end of a stream. */
+  struct rx_stream {
+    /**
+     * @brief The messages received, each after its 2-byte length and its
+     * number of segments. The message being received follows them, not yet
+     * committed.
+     */
+    byte_ring<SLIP_MUX_RX_QUEUE> queue;
+    /** @brief The bytes received of the message being received. */
+    size_t                       partial    = 0;
+    /** @brief The segments received of the message being received. */
+    uint8_t                      segments   = 0;
+    /** @brief The sequence number of the next segment expected. */
+    uint8_t                      expected   = 0;
+    /** @brief The number of segments released. */
+    uint8_t                      released   = 0;
+    /** @brief Whether the sender has to be told about released segments. */
+    bool                         credit_due = false;
+  };
+
+  bool      sendable(uint8_t stream) const;
+  size_t    segment_size(uint8_t stream) const;
+  void      emit_segment(uint8_t stream, uint8_t *frame, size_t &size);
+  void      discard_partial(rx_stream &stream);
+
+  /** @brief The sending ends of the streams. */
+  tx_stream tx[SLIP_MUX_STREAMS];
+  /** @brief The receiving ends of the streams. */
+  rx_stream rx[SLIP_MUX_STREAMS];
+  /** @brief The stream whose turn it is. */
+  uint8_t   turn    = 0;
+  /** @brief Whether the current stream has had its quantum for this turn. */
+  bool      started = false;
+  /** @brief The number of frames dropped or messages cut short. */
+  uint32_t  dropped = 0;
+};
+
+#endif // _SLIP_MUX_H
@@ -0,0 +1,137 @@
+/**
+ * @file slip_tx_ring.h
+ * @brief The header file for the SLIP transmit ring buffer.
+ *
+ * This file contains the definition of the ring buffer that SLIP-encodes
+ * frames as they are queued, and hands the encoded bytes to a serial port in
+ * contiguous spans. It does not depend on the Teensy, so it can be built and
+ * benchmarked on a host.
+ */
+#ifndef _SLIP_TX_RING_H
+#define _SLIP_TX_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A byte ring buffer holding SLIP-encoded frames on their way out.
+ *
+ * push() escapes a frame straight into the ring, between two ENDs, so frames
+ * are encoded without any intermediate buffer. The sender then asks for the
+ * longest contiguous span of encoded bytes with span(), writes as much of it
+ * as the serial port will take without blocking, and reports how much it
+ * wrote with consume(). A frame is only pushed if it fits whole, so a full
+ * ring never holds a partial frame.
+ *
+ * The ring is meant to be filled and drained by the same thread, and does no
+ * locking of its own.
+ *
+ * @tparam Size The number of bytes in the ring. Must be a power of two.
+ */
+template <size_t Size> class SlipTxRing {
+  static_assert(Size >= 2 && (Size & (Size - 1)) == 0,
+                "SlipTxRing size must be a power of two");
+
+public:
+  /**
+   * @brief SLIP-encode a frame into the ring.
+   *
+   * @param frame The frame to be encoded.
+   * @param size The size of the frame.
+   * @return true The frame was encoded into the ring.
+   * @return false The encoded frame does not fit in the free space.
+   */
+  bool push(const uint8_t *frame, size_t size) {
+    size_t room = free();
+    // Most frames fit even if every byte needed escaping, so the exact size
+    // is only worked out when the ring is nearly full.
+    if (room < 2 * size + 2 && room < encoded_size(frame, size)) {
+      return false;
+    }
+    put(END);
+    for (size_t i = 0; i < size; i++) {
+      uint8_t byte = frame[i];
+      if (byte == END) {
+        put(ESC);
+        put(ESC_END);
+      } else if (byte == ESC) {
+        put(ESC);
+        put(ESC_ESC);
+      } else {
+        put(byte);
+      }
+    }
+    put(END);
+    return true;
+  }
+
+  /**
+   * @brief Get the longest contiguous run of encoded bytes waiting to be sent.
+   *
+   * @param data Set to the first byte of the run.
+   * @return size_t The number of bytes in the run, or 0 if the ring is empty.
+   * A ring that wraps around takes two calls to drain.
+   */
+  size_t span(const uint8_t *&data) const {
+    size_t start  = tail & (Size - 1);
+    size_t length = head - tail;
+    data          = &buffer[start];
+    return length < Size - start ? length : Size - start;
+  }
+
+  /**
+   * @brief Remove bytes that have been sent from the front of the ring.
+   *
+   * @param count The number of bytes sent, at most the last span() length.
+   */
+  void consume(size_t count) { tail += count; }
+
+  /** @brief Discard every byte waiting to be sent. */
+  void clear() { tail = head; }
+
+  /** @brief The number of encoded bytes waiting to be sent. */
+  size_t size() const { return head - tail; }
+
+  /** @brief The number of bytes that can be pushed. */
+  size_t free() const { return Size - size(); }
+
+  /** @brief Whether every byte has been sent. */
+  bool empty() const { return head == tail; }
+
+  /**
+   * @brief Get the size of a frame once SLIP-encoded.
+   *
+   * @param frame The frame.
+   * @param size The size of the frame.
+   * @return size_t The size of the frame with its escapes and ENDs.
+   */
+  static size_t encoded_size(const uint8_t *frame, size_t size) {
+    size_t length = size + 2;
+    for (size_t i = 0; i < size; i++) {
+      length += frame[i] == END || frame[i] == ESC;
+    }
+    return length;
+  }
+
+private:
+  /** @brief The byte that ends every frame. */
+  static const uint8_t END     = 0xC0;
+  /** @brief The byte that starts an escape sequence. */
+  static const uint8_t ESC     = 0xDB;
+  /** @brief The escaped form of END. */
+  static const uint8_t ESC_END = 0xDC;
+  /** @brief The escaped form of ESC. */
+  static const uint8_t ESC_ESC = 0xDD;
+
+  /** @brief Append a byte to the ring, which must have room for it. */
+  void put(uint8_t byte) { buffer[head++ & (Size - 1)] = byte; }
+
+  /** @brief The encoded bytes. */
+  uint8_t buffer[Size];
+  /** @brief The number of bytes ever pushed, modulo the size of size_t. */
+  size_t  head = 0;
+  /** @brief The number of bytes ever consumed, modulo the size of size_t. */
+  size_t  tail = 0;
+};
+
+#endif // _SLIP_TX_RING_H
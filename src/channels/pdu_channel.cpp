@@ -16,7 +16,7 @@ namespace Channels {
   namespace PDU {
     using Artemis::Devices::PDU;
     /** @brief The packet used throughout the channel. */
-    PacketComm    packet;
+    PacketHandle  packet;
     /** @brief The PDU object used throughout the channel. */
     PDU           pdu(&Serial1, 115200);
     /** @brief The time at which an action has started.*/
@@ -117,7 +117,7 @@ namespace Channels {
           while (timeElapsed <= DEPLOYMENT_LENGTH) {
             handle_queue();
             regulate_temperature();
-            threads.delay(DEPLOYMENT_LOOP_INTERVAL);
+            WaitQueue(pdu_queue, DEPLOYMENT_LOOP_INTERVAL);
           }
         } else {
           print_debug(Helpers::PDU, "Satellite was already deployed");
@@ -150,35 +150,49 @@ namespace Channels {
         handle_queue();
         regulate_temperature();
         update_watchdog_timer();
-        threads.delay(100);
+        WaitQueue(pdu_queue, 100);
       }
     }
 
     /**
      * @brief Helper function to handle packet queue.
      *
-     * This is a helper function called in loop() that checks for packets and
-     * routes them to the PDU.
+     * This is a helper function called in loop() that pulls every packet
+     * waiting in the queue as a single batch, and handles them all before
+     * returning.
      */
     void handle_queue() {
-      if (PullQueue(packet, pdu_queue, pdu_queue_mtx)) {
-        print_debug(Helpers::PDU, "Pulled packet of type ",
-                    (uint16_t)packet.header.type, " from queue.");
-        switch (packet.header.type) {
-          case PacketComm::TypeId::CommandEpsCommunicate: {
-            test_communicating_with_pdu();
-            break;
-          }
-          case PacketComm::TypeId::CommandEpsSwitchName: {
-            set_switch_on_pdu();
-          }
-          case PacketComm::TypeId::CommandEpsSwitchStatus: {
-            report_pdu_switch_status();
-            break;
-          }
-          default:
-            break;
+      PacketHandle batch[QUEUE_BATCH_SIZE];
+      size_t       count = PullQueue(batch, QUEUE_BATCH_SIZE, pdu_queue);
+      for (size_t i = 0; i < count; i++) {
+        packet = std::move(batch[i]);
+        handle_packet();
+      }
+    }
+
+    /**
+     * @brief Helper function to handle a packet pulled from the queue.
+     *
+     * This is a helper function called in handle_queue() that routes the
+     * packet to the PDU.
+     */
+    void handle_packet() {
+      print_debug(Helpers::PDU, "Pulled packet of type ",
+                  (uint16_t)packet->header.type, " from queue.");
+      switch (packet->header.type) {
+        case PacketComm::TypeId::CommandEpsCommunicate: {
+          test_communicating_with_pdu();
+          break;
         }
+        case PacketComm::TypeId::CommandEpsSwitchName: {
+          set_switch_on_pdu();
+        }
+        case PacketComm::TypeId::CommandEpsSwitchStatus: {
+          report_pdu_switch_status();
+          break;
+        }
+        default:
+          break;
       }
     }
 
@@ -194,16 +208,16 @@ namespace Channels {
       if ((millis() - startTime) >= PDU_COMMUNICATION_TIMEOUT) {
         print_debug(Helpers::PDU, "Timed out trying to ping PDU");
       } else {
-        packet.header.nodedest = packet.header.nodeorig;
-        packet.header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
-        route_packet_to_main(packet);
+        packet->header.nodedest = packet->header.nodeorig;
+        packet->header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
+        route_packet_to_main(std::move(packet));
       }
     }
 
     /** @brief Helper function to set a switch on the PDU. */
     void set_switch_on_pdu() {
-      PDU::PDU_SW       switchID    = (PDU::PDU_SW)packet.data[0];
-      PDU::PDU_SW_State switchState = (PDU::PDU_SW_State)packet.data[1];
+      PDU::PDU_SW       switchID    = (PDU::PDU_SW)packet->data[0];
+      PDU::PDU_SW_State switchState = (PDU::PDU_SW_State)packet->data[1];
 
       startTime                     = millis();
       while (!pdu.set_switch(switchID, switchState) &&
@@ -231,6 +245,11 @@ namespace Channels {
         print_debug(Helpers::PDU,
                     "Timed out trying to refresh PDU switch states");
       } else {
+        PacketHandle response = packet_pool.acquire();
+        if (!response) {
+          print_debug(Helpers::PDU, "Packet pool exhausted");
+          return;
+        }
         Devices::Switches::switchbeacon beacon;
         beacon.deci = uptime;
         for (int i = 0; i < NUMBER_OF_SWITCHES; i++) {
@@ -238,15 +257,15 @@ namespace Channels {
         }
         beacon.sw[NUMBER_OF_SWITCHES] = digitalRead(UART6_TX);
 
-        packet.header.type            = PacketComm::TypeId::DataObcBeacon;
-        packet.header.nodeorig        = (uint8_t)NODES::TEENSY_NODE_ID;
-        packet.header.nodedest        = (uint8_t)NODES::GROUND_NODE_ID;
-        packet.header.chanin          = 0;
-        packet.header.chanout         = Channel_ID::RFM23_CHANNEL;
-        packet.data.resize(sizeof(beacon));
-        memcpy(packet.data.data(), &beacon, sizeof(beacon));
+        response->header.type         = PacketComm::TypeId::DataObcBeacon;
+        response->header.nodeorig     = (uint8_t)NODES::TEENSY_NODE_ID;
+        response->header.nodedest     = (uint8_t)NODES::GROUND_NODE_ID;
+        response->header.chanin       = 0;
+        response->header.chanout      = Channel_ID::RFM23_CHANNEL;
+        response->data.resize(sizeof(beacon));
+        memcpy(response->data.data(), &beacon, sizeof(beacon));
 
-        route_packet_to_main(packet);
+        route_packet_to_main(std::move(response));
       }
     }
 
@@ -4,16 +4,19 @@
  *
  * The definition of the RFM23 channel.
  */
+#include "artemisbeacons.h"
 #include "channels/artemis_channels.h"
+#include <modem_ladder.h>
 #include <rfm23.h>
 
 namespace Artemis {
 namespace Channels {
   /** @brief The RFM23 channel. */
   namespace RFM23 {
+    using Artemis::Devices::ModemLadder;
     using Artemis::Devices::RFM23;
     /** @brief The packet used throughout the channel. */
-    PacketComm          packet;
+    PacketHandle        packet;
     /** @brief The radio's configuration used throughout the channel. */
     RFM23::rfm23_config config = {
         .freq     = 433,
@@ -28,9 +31,20 @@ namespace Channels {
                    .tx_on    = TX_ON,
                    .rx_on    = RX_ON,
                    },
+        .tx_gap = 0,
     };
     /** @brief The radio object used throughout the channel. */
     RFM23 radio(config.pins.cs, config.pins.nirq, hardware_spi1);
+    /** @brief The controller walking the radio up and down the modem ladder. */
+    ModemLadder   ladder;
+    /** @brief The reliable transport carrying bulk data to ground. */
+    ArqSender     bulk(ARQ_WINDOW);
+    /** @brief The frame used to send bulk data through the radio. */
+    PacketComm    bulk_frame;
+    /** @brief The time since the last link health beacon. */
+    elapsedMillis since_link_beacon;
+    /** @brief The bulk retransmission count at the last link health beacon. */
+    uint32_t      retransmissions_reported = 0;
 
     /**
      * @brief The top-level channel definition.
@@ -54,6 +68,11 @@ namespace Channels {
       print_debug(Helpers::RFM23, "RFM23 channel starting...");
       while (!radio.init(config, &spi1_mtx)) {
       }
+      bulk_frame.header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
+      bulk_frame.header.nodedest = (uint8_t)NODES::GROUND_NODE_ID;
+      bulk_frame.header.type     = RADIO_BULK_DATA;
+      bulk_frame.header.chanin   = 0;
+      bulk_frame.header.chanout  = Channel_ID::RFM23_CHANNEL;
     }
 
     /**
@@ -66,58 +85,287 @@ namespace Channels {
       while (true) {
         receive_from_radio();
         handle_queue();
-        threads.delay(10);
+        handle_bulk();
+        update_modem();
+        beacon_link();
+        WaitQueue(rfm23_queue, 10, lowest_allowed());
       }
     }
 
-    /** @brief Helper function to receive a packet from the RFM23 radio. */
+    /**
+     * @brief Helper function to receive a packet from the RFM23 radio.
+     *
+     * The radio receives in the background, so this only reads a packet that
+     * has already arrived and returns straight away otherwise. This leaves the
+     * channel free to transmit queued packets while the radio listens.
+     */
     void receive_from_radio() {
-      int32_t timeout = (5 - rfm23_queue.size()) * SECONDS;
-      if (timeout < MINIMUM_TIMEOUT) {
-        timeout = MINIMUM_TIMEOUT;
-      }
-      if (radio.recv(packet, (uint16_t)timeout) >= 0) {
-        print_debug(Helpers::RFM23, "Received ", (int32_t)packet.wrapped.size(),
-                    " bytes from radio.");
-        print_hexdump(Helpers::RFM23, "Raw bytes: ", &packet.wrapped[0],
-                      packet.wrapped.size());
-        threads.delay(2 * SECONDS);
-        route_packet_to_main(packet);
+      if (!radio.available()) {
+        return;
+      }
+      PacketHandle received = packet_pool.acquire();
+      if (!received) {
+        print_debug(Helpers::RFM23, "Packet pool exhausted");
+        return;
+      }
+      if (radio.recv(*received, 0) >= 0) {
+        print_debug(Helpers::RFM23, "Received ",
+                    (int32_t)received->wrapped.size(), " bytes from radio.");
+        print_hexdump(Helpers::RFM23, "Raw bytes: ", &received->wrapped[0],
+                      received->wrapped.size());
+        route_packet_to_main(std::move(received));
       }
     }
 
     /**
      * @brief Helper function to handle packet queue.
      *
-     * This is a helper function called in loop() that checks for packets and
-     * routes them to the RFM23 radio.
+     * This is a helper function called in loop() that handles up to
+     * QUEUE_BATCH_SIZE packets waiting in the queue before returning. Each
+     * packet is pulled from the classes the airtime budget still allows, so
+     * as the budget runs out, beacons are held back first, then responses.
+     * Held-back packets wait in the queue, where its drop policies apply.
      */
     void handle_queue() {
-      if (PullQueue(packet, rfm23_queue, rfm23_queue_mtx)) {
-        switch (packet.header.type) {
-          print_debug(Helpers::RFM23, "Pulled packet of type ",
-                      (uint16_t)packet.header.type, " from queue.");
-          case PacketComm::TypeId::DataObcBeacon:
-          case PacketComm::TypeId::DataObcPong:
-          case PacketComm::TypeId::DataEpsResponse:
-          case PacketComm::TypeId::DataRadioResponse:
-          case PacketComm::TypeId::DataAdcsResponse:
-          case PacketComm::TypeId::DataObcResponse: {
-            if (!radio.send(packet)) {
-              print_debug(
-                  Helpers::RFM23,
-                  "Failed to send packet through RFM23. Dropping packet.");
-            }
-            threads.delay(500);
-            break;
-          }
-          default: {
-            print_debug(Helpers::RFM23,
-                        "Type not yet handled. Dropping packet.");
-            break;
+      for (size_t i = 0; i < QUEUE_BATCH_SIZE; i++) {
+        if (!PullQueue(packet, rfm23_queue, lowest_allowed())) {
+          return;
+        }
+        handle_packet();
+      }
+    }
+
+    /**
+     * @brief Helper function to find which packets the airtime budget allows.
+     *
+     * Commands are handled without transmitting, so they are always allowed.
+     *
+     * @return PacketPriority The lowest-priority class that may be sent.
+     */
+    PacketPriority lowest_allowed() {
+      if (rfm23_airtime.allows(RFM23_AIRTIME_BEACON_RESERVE)) {
+        return PacketPriority::Beacon;
+      }
+      if (rfm23_airtime.allows(RFM23_AIRTIME_RESPONSE_RESERVE)) {
+        return PacketPriority::Response;
+      }
+      return PacketPriority::Command;
+    }
+
+    /**
+     * @brief Helper function to handle a packet pulled from the queue.
+     *
+     * This is a helper function called in handle_queue() that routes the
+     * packet to the RFM23 radio.
+     */
+    void handle_packet() {
+      if (packet->header.type == RADIO_MODEM_SWITCH) {
+        if (!packet->data.empty()) {
+          switch_modem(packet->data[0]);
+        }
+        return;
+      }
+      if (packet->header.type == RADIO_BULK_ACK) {
+        bulk.acknowledge(*packet);
+        return;
+      }
+      switch (packet->header.type) {
+        print_debug(Helpers::RFM23, "Pulled packet of type ",
+                    (uint16_t)packet->header.type, " from queue.");
+        case PacketComm::TypeId::DataObcBeacon:
+        case PacketComm::TypeId::DataObcPong:
+        case PacketComm::TypeId::DataEpsResponse:
+        case PacketComm::TypeId::DataRadioResponse:
+        case PacketComm::TypeId::DataAdcsResponse:
+        case PacketComm::TypeId::DataObcResponse: {
+          if (!transmit(*packet)) {
+            print_debug(
+                Helpers::RFM23,
+                "Failed to send packet through RFM23. Dropping packet.");
           }
+          break;
+        }
+        default: {
+          print_debug(Helpers::RFM23,
+                      "Type not yet handled. Dropping packet.");
+          break;
+        }
+      }
+    }
+
+    /**
+     * @brief Helper function to send a packet through the radio.
+     *
+     * The airtime the packet's frames took, including any that were sent
+     * before a later one failed, is spent from the airtime budget.
+     *
+     * @param outgoing The packet to be sent.
+     * @return true The packet was sent.
+     * @return false The radio failed to send the packet.
+     */
+    bool transmit(PacketComm &outgoing) {
+      uint32_t before = radio.airtime();
+      bool     sent   = radio.send(outgoing, fec_mode(outgoing));
+      rfm23_airtime.spend(radio.airtime() - before);
+      return sent;
+    }
+
+    /**
+     * @brief Helper function to choose the FEC applied to a packet's frames.
+     *
+     * Responses, bulk data and modem requests are costly to lose, since they
+     * are only sent again after a timeout or a new command from ground, so
+     * they are protected by Reed-Solomon. Beacons are sent again every round
+     * anyway, and keep the full frame for their payload.
+     *
+     * @param packet The packet about to be sent.
+     * @return RFM23::FecMode The FEC applied to every frame of the packet.
+     */
+    RFM23::FecMode fec_mode(const PacketComm &packet) {
+      switch (packet.header.type) {
+        case PacketComm::TypeId::DataObcBeacon:
+        case PacketComm::TypeId::DataObcPong: {
+          return RFM23::FecMode::None;
         }
+        default: {
+          return RFM23::FecMode::ReedSolomon;
+        }
+      }
+    }
+
+    /**
+     * @brief Helper function to send bulk data reliably.
+     *
+     * This is a helper function called in loop() that fills the ARQ window
+     * from the bulk queue, then sends every frame that is new or whose
+     * retransmit timer has expired. Packets stay in the window, and in the
+     * packet pool, until ground acknowledges them.
+     *
+     * Bulk data is the least urgent traffic, so it stops once the airtime
+     * budget falls to RFM23_AIRTIME_BULK_RESERVE. Frames it holds back are
+     * sent by a later call.
+     */
+    void handle_bulk() {
+      while (bulk.ready() && PullQueue(packet, rfm23_bulk_queue)) {
+        bulk.push(packet);
+      }
+      while (rfm23_airtime.allows(RFM23_AIRTIME_BULK_RESERVE) &&
+             bulk.poll(bulk_frame)) {
+        if (!transmit(bulk_frame)) {
+          print_debug(Helpers::RFM23, "Failed to send bulk frame");
+        }
+      }
+    }
+
+    /**
+     * @brief Helper function to adapt the modem configuration to the link.
+     *
+     * This is a helper function called in loop() that takes the step the
+     * ModemLadder asks for: a request to ground, whose reply is handled by
+     * switch_modem(), or a switch back down when a switch went unconfirmed or
+     * the link went silent.
+     */
+    void update_modem() {
+      ModemLadder::step step = ladder.update(radio.link(), radio.modem());
+      if (step.action == ModemLadder::Action::Request) {
+        request_modem(step.rung);
+      } else if (step.action == ModemLadder::Action::Switch) {
+        radio.set_modem(step.rung);
+      }
+    }
+
+    /**
+     * @brief Helper function to beacon the health of the link.
+     *
+     * This is a helper function called in loop() that reports the radio's
+     * link statistics every RFM23_LINK_BEACON_INTERVAL, starting a new
+     * period each time.
+     */
+    void beacon_link() {
+      if (since_link_beacon < RFM23_LINK_BEACON_INTERVAL) {
+        return;
+      }
+      since_link_beacon = 0;
+
+      RFM23::link_stats stats  = radio.stats();
+      uint32_t          period = stats.period > 0 ? stats.period : 1;
+      uint32_t          resent = bulk.retransmissions();
+      uint32_t          locks  = stats.tx_frames + stats.tx_refused +
+                        stats.rx_frames + stats.rx_failed;
+      auto              clamp  = [](uint64_t value) -> uint16_t {
+        return value > UINT16_MAX ? UINT16_MAX : value;
+      };
+
+      Devices::linkbeacon beacon;
+      beacon.deci            = millis();
+      beacon.period          = stats.period;
+      beacon.rung            = radio.modem();
+      beacon.tx_frames       = stats.tx_frames;
+      beacon.tx_refused      = stats.tx_refused;
+      beacon.tx_timeouts     = stats.tx_timeouts;
+      beacon.retransmissions = clamp(resent - retransmissions_reported);
+      beacon.rx_frames       = stats.rx_frames;
+      beacon.rx_failed       = stats.rx_failed;
+      beacon.rx_corrupted    = stats.rx_corrupted;
+      beacon.tx_rate         = clamp((uint64_t)stats.tx_bytes * 1000 / period);
+      beacon.rx_rate         = clamp((uint64_t)stats.rx_bytes * 1000 / period);
+      beacon.duty            = clamp(stats.airtime / period);
+      if (stats.rx_frames > 0) {
+        beacon.rssi     = stats.rssi_sum / stats.rx_frames;
+        beacon.rssi_min = stats.rssi_min;
+        beacon.rssi_max = stats.rssi_max;
+      }
+      if (locks > 0) {
+        beacon.lock_wait = clamp(stats.lock_wait / locks);
+      }
+      beacon.lock_wait_max = clamp(stats.lock_wait_max);
+      if (stats.tx_frames > 0) {
+        beacon.sent_wait = clamp(stats.sent_wait / 1000 / stats.tx_frames);
+      }
+      beacon.sent_wait_max     = clamp(stats.sent_wait_max / 1000);
+      retransmissions_reported = resent;
+      route_beacon_to_rfm23(&beacon, sizeof(beacon));
+    }
+
+    /**
+     * @brief Helper function to ask ground to switch the modem configuration.
+     *
+     * The request is sent straight away rather than queued, since it concerns
+     * the link itself, and may spend the airtime every other sender leaves.
+     * If even that is gone, the ModemLadder asks again later.
+     *
+     * @param rung The rung of RFM23::MODEM_LADDER being requested.
+     */
+    void request_modem(uint8_t rung) {
+      if (!rfm23_airtime.allows(0)) {
+        return;
+      }
+      PacketHandle request = packet_pool.acquire();
+      if (!request) {
+        return;
+      }
+      request->header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
+      request->header.nodedest = (uint8_t)NODES::GROUND_NODE_ID;
+      request->header.type     = RADIO_MODEM_REQUEST;
+      request->header.chanin   = 0;
+      request->header.chanout  = Channel_ID::RFM23_CHANNEL;
+      request->data.push_back(rung);
+      transmit(*request);
+    }
+
+    /**
+     * @brief Helper function to switch the modem configuration for ground.
+     *
+     * The switch is on probation until a frame is received at the new rung.
+     *
+     * @param rung The rung of RFM23::MODEM_LADDER ground switched to.
+     */
+    void switch_modem(uint8_t rung) {
+      uint8_t current = radio.modem();
+      if (rung == current || !radio.set_modem(rung)) {
+        return;
       }
+      ladder.switched(current);
     }
   } // namespace RFM23
 } // namespace Channels
@@ -5,7 +5,19 @@
  * The definition of the Raspberry Pi channel.
  */
 #include "channels/artemis_channels.h"
+#include <file_downlink.h>
 #include <pdu.h>
+#include <rpi_link.h>
+#include <rpi_session.h>
+#include <slip_decoder.h>
+#include <slip_mux.h>
+#include <slip_tx_ring.h>
+
+// The longest message the RPi sends is a wrapped file chunk, with its CRC.
+static_assert(SLIP_MUX_MAX_MESSAGE >= sizeof(PacketComm::header) +
+                                          FILE_CHUNK_HEADER + FILE_READ_SIZE +
+                                          2,
+              "A file chunk from the RPi must fit in one SlipMux message");
 
 namespace Artemis {
 namespace Channels {
@@ -13,9 +25,46 @@ namespace Channels {
   namespace RPI {
     using Artemis::Devices::PDU;
     /** @brief The packet used throughout the channel. */
-    PacketComm packet;
-    /** @brief Whether the Raspberry Pi is on and active. */
-    bool       piIsOn = false;
+    PacketHandle            packet;
+    /** @brief The Raspberry Pi's power session. */
+    RpiSession              session;
+    /** @brief The session state the channel last acted on. */
+    RpiState                session_state = RpiState::Off;
+    /** @brief The packet being received from the Raspberry Pi. */
+    PacketHandle            incoming;
+    /** @brief The decoder of the SLIP stream from the Raspberry Pi. */
+    SlipDecoder             slip(SLIP_MUX_FRAME);
+    /** @brief The frame being decoded from the Raspberry Pi. */
+    std::vector<uint8_t>    rx_frame;
+    /** @brief The streams multiplexed over the link. */
+    SlipMux                 mux;
+    /** @brief The frame being moved from mux to tx_ring. */
+    uint8_t                 tx_frame[SLIP_MUX_FRAME];
+    /** @brief The bytes read from the serial port but not yet decoded. */
+    uint8_t                 rx_buffer[RPI_RX_CHUNK];
+    /** @brief The index of the first byte in rx_buffer not yet decoded. */
+    size_t                  rx_start = 0;
+    /** @brief The number of bytes in rx_buffer. */
+    size_t                  rx_end   = 0;
+    /** @brief The SLIP-encoded bytes waiting to be written to the RPi. */
+    SlipTxRing<RPI_TX_RING> tx_ring;
+    /** @brief A packet pulled from the queue that mux had no room for. */
+    PacketHandle            waiting;
+    /** @brief The memory added to the serial port's receive buffer. */
+    uint8_t                 serial_rx_memory[RPI_SERIAL_RX_BUFFER];
+    /** @brief The memory added to the serial port's transmit buffer. */
+    uint8_t                 serial_tx_memory[RPI_SERIAL_TX_BUFFER];
+    /** @brief The baud negotiation of the serial link. */
+    RpiLink                 link(Serial2, send_baud_request, ping_pi,
+                                 restart_link);
+    /** @brief The time since every stream's credit was last sent. */
+    elapsedMillis           since_credits;
+    /** @brief The file being sent to ground. */
+    FileDownlink            downlink(FILE_DOWNLINK_CHUNK);
+    /** @brief The frame used to ask the RPi for part of a file. */
+    PacketComm              read_frame;
+    /** @brief A chunk of the file the bulk queue had no room for yet. */
+    PacketHandle            chunk;
 
     /**
      * @brief The top-level channel definition.
@@ -24,7 +73,7 @@ namespace Channels {
      * Arduino script, it has a setup() function that is run once, then loop()
      * runs forever.
      */
-    void       rpi_channel() {
+    void                    rpi_channel() {
       setup();
       loop();
     }
@@ -32,164 +81,600 @@ namespace Channels {
     /**
      * @brief The Raspberry Pi setup function.
      *
-     * This function is run once, when the channel is started. It connects to
-     * the Raspberry Pi over a serial connection.
-     *
-     * @todo Ensure the Pi is on before completing setup.
+     * This function is run once, when the channel is started. It opens the
+     * serial connection to the Raspberry Pi at RPI_BASE_BAUD, and leaves the
+     * Pi off until a packet for it arrives.
      */
     void setup() {
       print_debug(Helpers::RPI, "RPI channel starting...");
-      Serial2.begin(9600);
+      digitalWrite(RPI_ENABLE, LOW);
+      mux.set_weight(RPI_STREAM_CONTROL, RPI_CONTROL_WEIGHT);
+      mux.set_weight(RPI_STREAM_PACKETS, RPI_PACKETS_WEIGHT);
+      Serial2.addMemoryForRead(serial_rx_memory, sizeof(serial_rx_memory));
+      Serial2.addMemoryForWrite(serial_tx_memory, sizeof(serial_tx_memory));
+      Serial2.begin(RPI_BASE_BAUD);
       while (!Serial2) {
       }
-      // Try pinging the RPi to ensure we can communicate with it.
-      // Retry and wait until a ping is successful before continuing.
-      // Set the piIsOn variable when successful.
     }
 
     /**
      * @brief The Raspberry Pi loop function.
      *
      * This function runs in an infinite loop after setup() completes. It routes
-     * packets going to and coming from the Raspberry Pi.
-     *
-     * @todo Handle the case where the Pi is not on.
+     * packets going to and coming from the Raspberry Pi, and runs the Pi's
+     * power session: packets wait in the queue until the Pi is ready, and
+     * the first of them powers it.
      */
     void loop() {
       while (true) {
-        if (!piIsOn) {
-          // Try pinging the RPi to ensure we can communicate with it.
-          // Retry and wait until a ping is successful before continuing.
-          // Set the piIsOn variable when successful.
-        }
-        receive_from_pi();
-        handle_queue();
-        threads.delay(100);
-      }
-    }
-
-    /**
-     * @brief Helper function to receive a packet from the Raspberry Pi.
-     * 
-     * It seems that the micro-cosmos implementation of PacketComm/SLIPLib does 
-     * not provide a convenient get_slip() method. This means that we need to 
-     * manually parse the Serial stream for something that *looks like* SLIP
-     * packets. From there, we use the standard SLIPUnPacketize() method to turn
-     * it back into a regular packet for routing.
-     * 
-     * This method is temporarily extra-documented, to explain how this 
-     * searching works.
-     * 
-     * @todo See if there's a better way of doing this.
-     */
-    void receive_from_pi() {
-      // While there are bytes available on the serial connection to the RPi
-      while(Serial2.available()){
-        // Read a character from that connection.
-        uint8_t inChar = Serial2.read();
-        // If it is our magic character,
-        if(inChar == 0xC0){
-          // Create a large buffer for the incoming packet.
-          uint8_t readBuffer[2048];
-          // Clear the buffer.
-          memset(readBuffer, 0, sizeof(readBuffer));
-          // Read the packet's bytes in from the serial connection.
-          // Note that this reads everything between the start and end flags 
-          // (each of which are 0xC0), but does not include those flags.
-          // Therefore, write these incoming bytes to the buffer starting from 
-          // the *second* position in the array (index 1), and cap the maximum
-          // number of bytes to read to be the size of the buffer plus both 
-          // flags.
-          size_t readBytes = Serial2.readBytesUntil((SLIP_FEND), &readBuffer[1], (size_t)2046);
-          // Resize the packetized copy of the packet to be the number of bytes 
-          // read in, plus the start and end flags.
-          packet.packetized.resize(readBytes + 2);
-          // Manually add the start...
-          readBuffer[0] = 0xC0;
-          // ...and end flags to the buffer at the appropriate places, "capping
-          // off" the received data.
-          readBuffer[readBytes + 1] = 0xC0;
-          // Copy the packet in the buffer to the actual packet, in the 
-          // packetized vector for further processing.
-          memcpy(packet.packetized.data(), &readBuffer[0], readBytes + 2);
-          
-          // Invoke the micro-cosmos SLIPUnPacketize. This assumes that the 
-          // packet's packetized vector has the start and end flags, as well as 
-          // a CRC checksum at the end.
-          if(!packet.SLIPUnPacketize()){
-            print_debug(Helpers::RPI, "Failed to SLIP unpacketize incoming packet");
-            return;
+        if (since_credits >= RPI_CREDIT_INTERVAL) {
+          since_credits = 0;
+          mux.refresh_credits();
+        }
+        bool received = receive_from_pi();
+        update_session();
+        if (!session.ready()) {
+          hold_queue();
+        } else if (link.update()) {
+          handle_queue();
+          handle_downlink();
+        }
+        flush_to_pi();
+        // Come back soon if the serial port could not take every byte, the
+        // RPi is sending, a file is being sent, the Pi is booting or
+        // shutting down, or the RPi's answer about the baud rate is due. The
+        // RPi only sends a window of each stream before it waits for credit.
+        bool busy = received || !tx_ring.empty() || downlink.active() ||
+                    (session.powered() && !session.ready()) ||
+                    link.state() == RpiLinkState::AwaitingBaud ||
+                    link.state() == RpiLinkState::AwaitingPong;
+        // Nothing more is taken from the queue while a packet is held for a
+        // Pi that is not ready, or while the baud rate is being negotiated,
+        // so the queue is not waited on then.
+        bool taking = session.ready() ? link.steady() : !waiting;
+        if (taking) {
+          WaitQueue(rpi_queue, busy ? 1 : 100);
+        } else {
+          threads.delay(busy ? 1 : 100);
+        }
+      }
+    }
+
+    /**
+     * @brief Helper function to run the Raspberry Pi's power session.
+     *
+     * This is a helper function called in loop() that applies the session's
+     * timeouts, acts on any change of state since the last call, and sends
+     * the ping or halt the session asks for. The Pi is powered while the
+     * session says so, and the baud rate is negotiated once it is ready.
+     * Once it is off, whatever was on its way to it is dropped, but packets
+     * still in the queue, or held in waiting, are kept, and power it again
+     * through hold_queue() once it has been off for RPI_MIN_OFF_TIME.
+     */
+    void update_session() {
+      session.update();
+      if (session.state() != session_state) {
+        session_state = session.state();
+        switch (session_state) {
+          case RpiState::Booting: {
+            print_debug(Helpers::RPI, "Waiting for RPi to boot");
+            digitalWrite(RPI_ENABLE, HIGH);
+            // A booting Pi listens at the base rate.
+            link.reset();
+            break;
+          }
+          case RpiState::Ready: {
+            print_debug(Helpers::RPI, "RPi is ready");
+            link.negotiate();
+            break;
           }
+          case RpiState::ShuttingDown: {
+            print_debug(Helpers::RPI, "Waiting for RPi to halt");
+            break;
+          }
+          case RpiState::Off: {
+            print_debug(Helpers::RPI, "Turning off RPi");
+            digitalWrite(RPI_ENABLE, LOW);
+            mux.clear();
+            tx_ring.clear();
+            downlink.cancel();
+            chunk.release();
+            break;
+          }
+        }
+      }
+      if (session.contact_due()) {
+        send_control(session.state() == RpiState::ShuttingDown
+                         ? PacketComm::TypeId::CommandObcHalt
+                         : PacketComm::TypeId::CommandObcPing,
+                     nullptr, 0);
+      }
+    }
 
-          print_debug(Helpers::RPI, "Pushing packet of type ",
-                    (uint16_t)packet.header.type, " to main queue.");
-          
-          // If the un-packetizing is successful, pass the packet to be routed 
-          // in the main queue.
-          PushQueue(packet, main_queue, main_queue_mtx);
+    /**
+     * @brief Helper function to hold packets for a Raspberry Pi that is not
+     * ready.
+     *
+     * This is a helper function called in loop() instead of handle_queue().
+     * The first packet in the queue is held in waiting, where handle_queue()
+     * takes it from once the Pi is ready, and powers the Pi, as soon as it has
+     * been off for RPI_MIN_OFF_TIME if it was just switched off. A halt or
+     * switch-off for a Pi that is already off is dropped.
+     */
+    void hold_queue() {
+      if (!waiting && !PullQueue(waiting, rpi_queue)) {
+        return;
+      }
+      if (session.state() == RpiState::Off && switches_pi_off(*waiting)) {
+        waiting.release();
+        return;
+      }
+      session.power_on();
+    }
+
+    /**
+     * @brief Helper function to receive packets from the Raspberry Pi.
+     *
+     * Whatever bytes the serial port holds are read in chunks and fed to the
+     * SLIP decoder, and every frame it decodes is handed to the multiplexer.
+     * Nothing here waits for more bytes: a partial frame stays in the
+     * decoder, and any bytes read but not yet decoded stay in rx_buffer,
+     * until the next call. The messages the multiplexer has put back together
+     * are then routed.
+     *
+     * @return true Bytes were read from the serial port.
+     * @return false The serial port had nothing to read.
+     */
+    bool receive_from_pi() {
+      bool received = false;
+      while (true) {
+        if (rx_start == rx_end) {
+          int available = Serial2.available();
+          if (available <= 0) {
+            break;
+          }
+          received = true;
+          rx_start = 0;
+          rx_end   = Serial2.readBytes(
+              rx_buffer,
+              available < RPI_RX_CHUNK ? (size_t)available : RPI_RX_CHUNK);
+        }
+
+        size_t     consumed;
+        SlipStatus status    = slip.decode(&rx_buffer[rx_start],
+                                           rx_end - rx_start, consumed,
+                                           rx_frame);
+        rx_start            += consumed;
+        if (status == SlipStatus::Error) {
+          print_debug(Helpers::RPI, "Discarded malformed SLIP frame from RPi");
+          link.error();
+        } else if (status == SlipStatus::Frame) {
+          if (!mux.receive(rx_frame.data(), rx_frame.size())) {
+            print_debug(Helpers::RPI, "Discarded frame from RPi");
+            link.error();
+          }
+          rx_frame.clear();
         }
-        // Note that, implicitly, this discards anything outside the bounds of
-        // the first packet. This means that the last few bytes of the first 
-        // partial packet will be discarded. This is considered expected 
-        // behavior, since there's nothing you can do to get that first packet's
-        // bytes anyways.
       }
+      deliver_from_pi();
+      return received;
     }
 
     /**
-     * @brief Helper function to handle packet queue.
+     * @brief Helper function to route the messages the RPi has sent.
      *
-     * This is a helper function called in loop() that checks for packets and
-     * routes them to the Raspberry Pi.
+     * The control stream is emptied first, then the packet stream, then the
+     * file stream. Each message is taken from the multiplexer into the wrapped
+     * vector of a pooled packet. If the pool runs dry, the rest wait in the
+     * multiplexer, which holds back the RPi's credit until they are taken.
      */
-    void handle_queue() {
-      if (PullQueue(packet, rpi_queue, rpi_queue_mtx)) {
-        print_debug(Helpers::RPI, "Pulled packet of type ",
-                    (uint16_t)packet.header.type, " from Raspberry Pi queue.");
-        switch (packet.header.type) {
-          case PacketComm::TypeId::CommandEpsSwitchName: {
-            if ((PDU::PDU_SW)packet.data[0] == PDU::PDU_SW::RPI &&
-                packet.data[1] == 0) {
-              shut_down_pi();
+    void deliver_from_pi() {
+      for (uint8_t stream :
+           {RPI_STREAM_CONTROL, RPI_STREAM_PACKETS, RPI_STREAM_FILES}) {
+        while (true) {
+          if (!incoming) {
+            incoming = packet_pool.acquire();
+            if (!incoming) {
+              print_debug(Helpers::RPI, "Packet pool exhausted");
+              return;
             }
-            break;
           }
-          default: {
-            send_to_pi();
+          if (!mux.pop(stream, incoming->wrapped)) {
             break;
           }
+          route_from_pi();
         }
       }
     }
 
-    /** @brief Shuts down the Raspberry Pi and kills the channel.*/
-    void shut_down_pi() {
-      packet.header.type = PacketComm::TypeId::CommandObcHalt;
-      send_to_pi();
-      // Wait 20s to give the rpi time to turn off
-      threads.delay(20 * SECONDS);
-      digitalWrite(RPI_ENABLE, LOW);
+    /**
+     * @brief Helper function to route a packet received from the Raspberry Pi.
+     *
+     * The packet's wrapped vector holds a whole message from the RPi,
+     * including its CRC. Any packet that unwraps shows the RPi is alive. It
+     * is pushed to the main queue, unless it is a heartbeat, a halt
+     * acknowledgement, or answers the channel's own ping, baud request or
+     * file read, and its buffer is reused for the next message otherwise.
+     */
+    void route_from_pi() {
+      if (incoming->Unwrap() < 0) {
+        print_debug(Helpers::RPI, "Failed to unwrap incoming packet");
+        incoming->wrapped.clear();
+        link.error();
+        return;
+      }
+      session.heard();
+      if (incoming->header.nodedest == (uint8_t)NODES::TEENSY_NODE_ID &&
+          handle_link_reply()) {
+        incoming->wrapped.clear();
+        return;
+      }
+      print_debug(Helpers::RPI, "Pushing packet of type ",
+                  (uint16_t)incoming->header.type, " to main queue.");
+      PushQueue(incoming, main_queue);
+      incoming.release();
+    }
 
-      // Empty RPI Queue
-      while (!rpi_queue.empty()) {
-        rpi_queue.pop_front();
+    /**
+     * @brief Helper function to handle packet queue.
+     *
+     * This is a helper function called in loop() that pulls up to a batch of
+     * packets from the queue, one at a time, and handles them. A packet that
+     * did not fit in the transmit ring last time is retried first, and
+     * nothing more is pulled until it fits, so packets wait in the queue
+     * rather than in the channel.
+     */
+    void handle_queue() {
+      for (size_t i = 0; i < QUEUE_BATCH_SIZE; i++) {
+        if (waiting) {
+          packet = std::move(waiting);
+        } else if (!PullQueue(packet, rpi_queue)) {
+          return;
+        }
+        handle_packet();
+        if (waiting) {
+          return;
+        }
+        // A halted Pi will not accept the rest of the batch.
+        if (packet->header.type == PacketComm::TypeId::CommandObcHalt) {
+          break;
+        }
       }
+    }
 
-      piIsOn = false;
+    /**
+     * @brief Helper function to handle a packet pulled from the queue.
+     *
+     * This is a helper function called in handle_queue() that routes the
+     * packet to the Raspberry Pi.
+     */
+    void handle_packet() {
+      print_debug(Helpers::RPI, "Pulled packet of type ",
+                  (uint16_t)packet->header.type, " from Raspberry Pi queue.");
+      if (packet->header.type == FILE_DOWNLINK) {
+        start_downlink();
+        return;
+      }
+      switch (packet->header.type) {
+        case PacketComm::TypeId::CommandEpsSwitchName: {
+          if (switches_pi_off(*packet)) {
+            shut_down_pi();
+          }
+          break;
+        }
+        case PacketComm::TypeId::CommandObcHalt: {
+          shut_down_pi();
+          break;
+        }
+        default: {
+          send_to_pi();
+          break;
+        }
+      }
     }
 
-    /** @brief Helper function to send a packet to the Raspberry Pi. */
+    /**
+     * @brief Helper function to tell whether a packet switches the Raspberry
+     * Pi off.
+     *
+     * @param command The packet.
+     * @return true The packet halts the Pi, or switches its PDU switch off.
+     * @return false The packet is anything else.
+     */
+    bool switches_pi_off(const PacketComm &command) {
+      if (command.header.type == PacketComm::TypeId::CommandObcHalt) {
+        return true;
+      }
+      return command.header.type == PacketComm::TypeId::CommandEpsSwitchName &&
+             command.data.size() >= 2 &&
+             (PDU::PDU_SW)command.data[0] == PDU::PDU_SW::RPI &&
+             command.data[1] == 0;
+    }
+
+    /**
+     * @brief Starts shutting down the Raspberry Pi.
+     *
+     * Anything still waiting to be sent is moot now. The session sends the
+     * halt on the control stream, and the Pi's power is cut as soon as it
+     * acknowledges it.
+     */
+    void shut_down_pi() {
+      mux.clear();
+      session.halt();
+    }
+
+    /**
+     * @brief Helper function to send a packet to the Raspberry Pi.
+     *
+     * The packet is queued on its stream of the multiplexer, and as much as
+     * the serial port will take is written out. If the stream's queue is too
+     * full, the packet is kept in waiting and retried once it has drained.
+     */
     void send_to_pi() {
-      if (!packet.SLIPPacketize()) {
-        print_debug(Helpers::RPI, "Failed to wrap and SLIP packetize");
-      }
-      print_hexdump(Helpers::RPI, "Forwarding to RPi: ", &packet.packetized[0],
-                    packet.packetized.size());
-      for (size_t i = 0; i < packet.packetized.size(); i++) {
-        if (Serial2.write(packet.packetized[i]) != 1) {
-          print_debug(Helpers::RPI,
-                      "Failed to send byte to RPi: ", (u_int32_t)i);
-          piIsOn = false;
+      if (!packet->Wrap()) {
+        print_debug(Helpers::RPI, "Failed to wrap packet");
+        return;
+      }
+      const uint8_t *frame = packet->wrapped.data();
+      size_t         size  = packet->wrapped.size();
+      if (!mux.send(stream_of(packet->header.type), frame, size)) {
+        if (size > SLIP_MUX_MAX_MESSAGE) {
+          print_debug(Helpers::RPI, "Packet too long to send to RPi: ",
+                      (uint32_t)size);
+          return;
+        }
+        waiting = std::move(packet);
+        return;
+      }
+      print_hexdump(Helpers::RPI, "Forwarding to RPi: ", packet->wrapped.data(),
+                    size);
+      flush_to_pi();
+    }
+
+    /**
+     * @brief Helper function to pick the stream a packet goes on.
+     *
+     * The RPi picks streams for its packets the same way.
+     *
+     * @param type The type of the packet.
+     * @return uint8_t The multiplexer stream.
+     */
+    uint8_t stream_of(PacketComm::TypeId type) {
+      if (type == PacketComm::TypeId::CommandObcPing ||
+          type == PacketComm::TypeId::DataObcPong ||
+          type == PacketComm::TypeId::CommandObcHalt || type == RPI_HALT_ACK ||
+          type == RPI_HEARTBEAT || type == RPI_BAUD_REQUEST ||
+          type == FILE_READ_REQUEST) {
+        return RPI_STREAM_CONTROL;
+      }
+      if (type == FILE_CHUNK) {
+        return RPI_STREAM_FILES;
+      }
+      return RPI_STREAM_PACKETS;
+    }
+
+    /**
+     * @brief Helper function to write to the Raspberry Pi.
+     *
+     * The transmit ring is topped up with the multiplexer's next frames until
+     * it holds RPI_TX_LOW_WATER bytes, so the frames are picked as late as
+     * possible, and contiguous spans of it are written in bulk, each no
+     * longer than the room left in the serial port's transmit buffer. This
+     * never blocks: whatever the port cannot take yet is left for the next
+     * call.
+     */
+    void flush_to_pi() {
+      const uint8_t *data;
+      size_t         length;
+      while (true) {
+        size_t size;
+        while (tx_ring.size() < RPI_TX_LOW_WATER &&
+               mux.next_frame(tx_frame, size)) {
+          tx_ring.push(tx_frame, size);
+        }
+        if ((length = tx_ring.span(data)) == 0) {
+          return;
+        }
+        int room = Serial2.availableForWrite();
+        if (room <= 0) {
+          return;
+        }
+        size_t written = Serial2.write(
+            data, length < (size_t)room ? length : (size_t)room);
+        if (written == 0) {
+          return;
+        }
+        tx_ring.consume(written);
+      }
+    }
+
+    /**
+     * @brief Helper function to write the control stream out to the RPi.
+     *
+     * Unlike flush_to_pi(), this waits, yielding to other threads, until the
+     * control stream and the transmit ring are empty or RPI_REPLY_TIMEOUT has
+     * passed.
+     *
+     * @return true The control stream and the ring were emptied.
+     * @return false The serial port did not take every byte in time.
+     */
+    bool drain_to_pi() {
+      elapsedMillis draining;
+      while ((!tx_ring.empty() || mux.queued(RPI_STREAM_CONTROL) > 0) &&
+             draining < RPI_REPLY_TIMEOUT) {
+        flush_to_pi();
+        threads.yield();
+      }
+      return tx_ring.empty() && mux.queued(RPI_STREAM_CONTROL) == 0;
+    }
+
+    /**
+     * @brief Helper function to ask the RPi for a baud rate, for the link.
+     *
+     * @param baud The baud rate.
+     * @return true The request is queued to be sent.
+     * @return false The request could not be queued.
+     */
+    bool send_baud_request(uint32_t baud) {
+      return send_control(RPI_BAUD_REQUEST, &baud, sizeof(baud));
+    }
+
+    /**
+     * @brief Helper function to ping the RPi, for the link.
+     *
+     * @return true The ping is queued to be sent.
+     * @return false The ping could not be queued.
+     */
+    bool ping_pi() {
+      return send_control(PacketComm::TypeId::CommandObcPing, nullptr, 0);
+    }
+
+    /**
+     * @brief Helper function to start the link over before the serial port
+     * switches baud rate.
+     *
+     * Control packets still waiting to be sent go out at the old rate first.
+     * Bytes received around the switch are garbled, so they are dropped along
+     * with any partial frame, and the streams start over, as they do on the
+     * RPi.
+     */
+    void restart_link() {
+      if (!drain_to_pi()) {
+        tx_ring.clear();
+      }
+      slip.reset();
+      mux.reset();
+      rx_start = rx_end = 0;
+      rx_frame.clear();
+    }
+
+    /**
+     * @brief Helper function to send the channel's own packet to the RPi.
+     *
+     * The packet goes on its stream of the multiplexer straight away, ahead
+     * of anything still in the queue.
+     *
+     * @param type The type of the packet.
+     * @param data The packet's data.
+     * @param size The size of the data.
+     * @return true The packet is queued to be sent.
+     * @return false No packet was free, or the stream had no room.
+     */
+    bool send_control(PacketComm::TypeId type, const void *data, size_t size) {
+      PacketHandle control = packet_pool.acquire();
+      if (!control) {
+        print_debug(Helpers::RPI, "Packet pool exhausted");
+        return false;
+      }
+      control->header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
+      control->header.nodedest = (uint8_t)NODES::RPI_NODE_ID;
+      control->header.type     = type;
+      control->header.chanin   = 0;
+      control->header.chanout  = Channel_ID::RPI_CHANNEL;
+      control->data.resize(size);
+      if (size > 0) {
+        memcpy(control->data.data(), data, size);
+      }
+      if (!control->Wrap() ||
+          !mux.send(stream_of(type), control->wrapped.data(),
+                    control->wrapped.size())) {
+        print_debug(Helpers::RPI, "Failed to send control packet to RPi");
+        return false;
+      }
+      flush_to_pi();
+      return true;
+    }
+
+    /**
+     * @brief Helper function to take the RPi's answers to the channel.
+     *
+     * @return true The incoming packet was a pong, a heartbeat, a halt
+     * acknowledgement, a baud reply or a chunk of a file, and has been
+     * handled.
+     * @return false The incoming packet is for the rest of the satellite.
+     */
+    bool handle_link_reply() {
+      if (incoming->header.type == PacketComm::TypeId::DataObcPong) {
+        link.pong();
+        return true;
+      }
+      if (incoming->header.type == RPI_HEARTBEAT) {
+        return true;
+      }
+      if (incoming->header.type == RPI_HALT_ACK) {
+        session.halt_acknowledged();
+        return true;
+      }
+      if (incoming->header.type == RPI_BAUD_REQUEST) {
+        uint32_t agreed = 0;
+        if (incoming->data.size() >= sizeof(agreed)) {
+          memcpy(&agreed, incoming->data.data(), sizeof(agreed));
+        }
+        link.baud_reply(agreed);
+        return true;
+      }
+      if (incoming->header.type == FILE_CHUNK) {
+        downlink.receive(*incoming);
+        return true;
+      }
+      return false;
+    }
+
+    /**
+     * @brief Helper function to start sending a file to ground.
+     *
+     * This is a helper function called in handle_packet() for a FILE_DOWNLINK
+     * from ground.
+     */
+    void start_downlink() {
+      if (packet->data.size() < 6) {
+        return;
+      }
+      uint16_t file   = packet->data[0] | (packet->data[1] << 8);
+      uint32_t offset = 0;
+      for (uint8_t i = 0; i < 4; i++) {
+        offset |= (uint32_t)packet->data[2 + i] << (8 * i);
+      }
+      print_debug(Helpers::RPI, "Sending file ", file, " from offset ", offset);
+      downlink.start(file, offset);
+    }
+
+    /**
+     * @brief Helper function to move a file from the RPi to the radio.
+     *
+     * This is a helper function called in loop() that asks the RPi for the
+     * next part of the file whenever the downlink has room for it, and hands
+     * every chunk that is ready to the RFM23's bulk queue. The queue never
+     * drops a packet, so a chunk it has no room for is held until it does.
+     */
+    void handle_downlink() {
+      if (downlink.read_request(read_frame)) {
+        send_control(FILE_READ_REQUEST, read_frame.data.data(),
+                     read_frame.data.size());
+      }
+      while (true) {
+        if (!chunk) {
+          chunk = packet_pool.acquire();
+          if (!chunk) {
+            return;
+          }
+          if (!downlink.next_chunk(*chunk)) {
+            chunk.release();
+            return;
+          }
+          chunk->header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
+          chunk->header.nodedest = (uint8_t)NODES::GROUND_NODE_ID;
+          chunk->header.type     = FILE_CHUNK;
+          chunk->header.chanin   = 0;
+          chunk->header.chanout  = Channel_ID::RFM23_CHANNEL;
+          if (!downlink.active()) {
+            print_debug(Helpers::RPI, "Finished sending file ",
+                        downlink.file());
+          }
+        }
+        if (rfm23_bulk_queue.headroom(packet_priority(*chunk)) == 0 ||
+            route_packet_to_rfm23_bulk(chunk) == PushResult::Rejected) {
+          return;
         }
       }
     }
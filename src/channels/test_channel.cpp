@@ -11,8 +11,6 @@ namespace Artemis {
 namespace Channels {
   /** @brief The tests channel. */
   namespace TEST {
-    /** @brief The packet used throughout the tests. */
-    PacketComm    packet;
     /** @brief The time since the Raspberry Pi has been turned on. */
     elapsedMillis piShutdownTimer = 0;
     /** @brief Whether the Raspberry Pi is off. */
@@ -77,13 +75,17 @@ namespace Channels {
      */
     void turn_on_rpi() {
       if (piIsOff) {
-        packet.header.type     = PacketComm::TypeId::CommandEpsSwitchName;
-        packet.header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
-        packet.header.nodedest = (uint8_t)NODES::TEENSY_NODE_ID;
-        packet.data.resize(0);
-        packet.data.push_back((uint8_t)Artemis::Devices::PDU::PDU_SW::RPI);
-        packet.data.push_back(1);
-        route_packet_to_main(packet);
+        PacketHandle packet = packet_pool.acquire();
+        if (!packet) {
+          return;
+        }
+        packet->header.type     = PacketComm::TypeId::CommandEpsSwitchName;
+        packet->header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
+        packet->header.nodedest = (uint8_t)NODES::TEENSY_NODE_ID;
+        packet->data.resize(0);
+        packet->data.push_back((uint8_t)Artemis::Devices::PDU::PDU_SW::RPI);
+        packet->data.push_back(1);
+        route_packet_to_main(std::move(packet));
         piIsOff         = false;
         piShutdownTimer = 0;
       }
@@ -98,13 +100,17 @@ namespace Channels {
      */
     void turn_off_rpi() {
       if (piShutdownTimer > (10 * SECONDS) && !piIsOff) {
-        packet.header.type     = PacketComm::TypeId::CommandEpsSwitchName;
-        packet.header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
-        packet.header.nodedest = (uint8_t)NODES::RPI_NODE_ID;
-        packet.data.clear();
-        packet.data.push_back((uint8_t)Artemis::Devices::PDU::PDU_SW::RPI);
-        packet.data.push_back(0);
-        route_packet_to_main(packet);
+        PacketHandle packet = packet_pool.acquire();
+        if (!packet) {
+          return;
+        }
+        packet->header.type     = PacketComm::TypeId::CommandEpsSwitchName;
+        packet->header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
+        packet->header.nodedest = (uint8_t)NODES::RPI_NODE_ID;
+        packet->data.clear();
+        packet->data.push_back((uint8_t)Artemis::Devices::PDU::PDU_SW::RPI);
+        packet->data.push_back(0);
+        route_packet_to_main(std::move(packet));
         piIsOff = true;
       }
     }
@@ -117,11 +123,15 @@ namespace Channels {
      */
     void rpi_take_picture_from_teensy() {
       if (!piIsOff) {
-        packet.header.type     = (PacketComm::TypeId)0x882;
-        packet.header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
-        packet.header.nodedest = (uint8_t)NODES::RPI_NODE_ID;
-        packet.data.resize(0);
-        route_packet_to_rpi(packet);
+        PacketHandle packet = packet_pool.acquire();
+        if (!packet) {
+          return;
+        }
+        packet->header.type     = (PacketComm::TypeId)0x882;
+        packet->header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
+        packet->header.nodedest = (uint8_t)NODES::RPI_NODE_ID;
+        packet->data.resize(0);
+        route_packet_to_rpi(std::move(packet));
       }
     }
 
@@ -132,11 +142,15 @@ namespace Channels {
      * commanding it to take a picture.
      */
     void rpi_take_picture_from_ground() {
-      packet.header.type     = PacketComm::TypeId::CommandCameraCapture;
-      packet.header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
-      packet.header.nodedest = (uint8_t)NODES::RPI_NODE_ID;
-      packet.data.clear();
-      route_packet_to_main(packet);
+      PacketHandle packet = packet_pool.acquire();
+      if (!packet) {
+        return;
+      }
+      packet->header.type     = PacketComm::TypeId::CommandCameraCapture;
+      packet->header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
+      packet->header.nodedest = (uint8_t)NODES::RPI_NODE_ID;
+      packet->data.clear();
+      route_packet_to_main(std::move(packet));
     }
 
     /**
@@ -146,13 +160,17 @@ namespace Channels {
      * commanding it to enable all PDU switches.
      */
     void pdu_switch_all_on() {
-      packet.header.type     = PacketComm::TypeId::CommandEpsSwitchName;
-      packet.header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
-      packet.header.nodedest = (uint8_t)NODES::TEENSY_NODE_ID;
-      packet.data.resize(0);
-      packet.data.push_back((uint8_t)Artemis::Devices::PDU::PDU_SW::All);
-      packet.data.push_back(1);
-      route_packet_to_main(packet);
+      PacketHandle packet = packet_pool.acquire();
+      if (!packet) {
+        return;
+      }
+      packet->header.type     = PacketComm::TypeId::CommandEpsSwitchName;
+      packet->header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
+      packet->header.nodedest = (uint8_t)NODES::TEENSY_NODE_ID;
+      packet->data.resize(0);
+      packet->data.push_back((uint8_t)Artemis::Devices::PDU::PDU_SW::All);
+      packet->data.push_back(1);
+      route_packet_to_main(std::move(packet));
     }
 
     /**
@@ -162,12 +180,16 @@ namespace Channels {
      * commanding it to report the status of all PDU switches.
      */
     void pdu_switch_status() {
-      packet.header.type     = PacketComm::TypeId::CommandEpsSwitchStatus;
-      packet.header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
-      packet.header.nodedest = (uint8_t)NODES::TEENSY_NODE_ID;
-      packet.data.clear();
-      packet.data.push_back((uint8_t)Artemis::Devices::PDU::PDU_SW::All);
-      route_packet_to_pdu(packet);
+      PacketHandle packet = packet_pool.acquire();
+      if (!packet) {
+        return;
+      }
+      packet->header.type     = PacketComm::TypeId::CommandEpsSwitchStatus;
+      packet->header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
+      packet->header.nodedest = (uint8_t)NODES::TEENSY_NODE_ID;
+      packet->data.clear();
+      packet->data.push_back((uint8_t)Artemis::Devices::PDU::PDU_SW::All);
+      route_packet_to_pdu(std::move(packet));
     }
 
     /**
@@ -177,23 +199,27 @@ namespace Channels {
      * commanding it to send a packet of data to the ground.
      */
     void rfm23_transmit() {
-      packet.header.type     = PacketComm::TypeId::DataObcResponse;
-      packet.header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
-      packet.header.nodedest = (uint8_t)NODES::GROUND_NODE_ID;
-      packet.header.chanin   = 0;
-      packet.header.chanout  = Artemis::Channels::Channel_ID::RFM23_CHANNEL;
+      PacketHandle packet = packet_pool.acquire();
+      if (!packet) {
+        return;
+      }
+      packet->header.type     = PacketComm::TypeId::DataObcResponse;
+      packet->header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
+      packet->header.nodedest = (uint8_t)NODES::GROUND_NODE_ID;
+      packet->header.chanin   = 0;
+      packet->header.chanout  = Artemis::Channels::Channel_ID::RFM23_CHANNEL;
 
-      packet.data.resize(0);
+      packet->data.resize(0);
       String data_str = "Hello World!" + String(packet_count);
       Helpers::print_hexdump(Helpers::TEST,
                              "data_str: ", (uint8_t *)data_str.c_str(),
                              data_str.length());
       for (size_t i = 0; i < data_str.length(); i++) {
-        packet.data.push_back(data_str[i] - '0');
+        packet->data.push_back(data_str[i] - '0');
       }
       packet_count++;
 
-      route_packet_to_main(packet);
+      route_packet_to_main(std::move(packet));
     }
 
     /** @brief Report on the status of all currently running threads. */
@@ -217,25 +243,35 @@ namespace Channels {
                            "% utilization)");
     }
 
-    /** @brief Report on the size of each of the queues. */
+    /** @brief Report on the occupancy and traffic of each of the queues. */
     void report_queue_size() {
-      Helpers::print_debug(Helpers::TEST, "main_queue contains ",
-                           main_queue.size(), " packets, with a size of ",
-                           sizeof(PacketComm) * main_queue.size(), " bytes");
-      Helpers::print_debug(Helpers::TEST, "rfm23_queue contains ",
-                           rfm23_queue.size(), " packets, with a size of ",
-                           sizeof(PacketComm) * rfm23_queue.size(), " bytes");
-      Helpers::print_debug(Helpers::TEST, "pdu_queue contains ",
-                           pdu_queue.size(), " packets, with a size of ",
-                           sizeof(PacketComm) * pdu_queue.size(), " bytes");
-      Helpers::print_debug(Helpers::TEST, "rpi_queue contains ",
-                           rpi_queue.size(), " packets, with a size of ",
-                           sizeof(PacketComm) * rpi_queue.size(), " bytes");
-      Helpers::print_debug(Helpers::TEST, "Packets in queues are taking up ",
-                           sizeof(PacketComm) *
-                               (main_queue.size() + rfm23_queue.size() +
-                                pdu_queue.size() + rpi_queue.size()),
-                           " bytes");
+      report_queue("main_queue", main_queue);
+      report_queue("rfm23_queue", rfm23_queue);
+      report_queue("pdu_queue", pdu_queue);
+      report_queue("rpi_queue", rpi_queue);
+      Helpers::print_debug(Helpers::TEST, "Packet pool has ",
+                           packet_pool.available(), "/", PACKET_POOL_SIZE,
+                           " buffers free");
+    }
+
+    /**
+     * @brief Report on the occupancy and traffic of a queue.
+     *
+     * @param name The name of the queue.
+     * @param queue The queue to be reported.
+     */
+    void report_queue(const char *name, PacketQueue &queue) {
+      queue_stats stats = queue.telemetry();
+      Helpers::print_debug(Helpers::TEST, name, " contains ", queue.size(),
+                           " packets (high-water ", stats.high_water,
+                           "), enqueued ", stats.enqueued, ", dequeued ",
+                           stats.dequeued, ", dropped ", stats.dropped);
+      std::ostringstream dwell;
+      for (size_t i = 0; i < QUEUE_DWELL_BUCKETS; i++) {
+        dwell << " " << stats.dwell[i];
+      }
+      Helpers::print_debug(Helpers::TEST, name,
+                           " dwell histogram:", dwell.str().c_str());
     }
   } // namespace TEST
 } // namespace Channels
@@ -6,6 +6,9 @@
  * satellite.
  */
 #include "config/artemis_defs.h"
+#include "artemisbeacons.h"
+#include "channels/artemis_channels.h"
+#include "helpers.h"
 
 /**
  * @brief The list of active threads.
@@ -23,23 +26,19 @@ std::map<string, NODES>      NodeType = {
     {   "artemis_rpi",    NODES::RPI_NODE_ID},
 };
 
+/** @brief The pool of packet buffers shared by every channel. */
+PacketPool             packet_pool;
+
 /** @brief The packet queue for the main channel. */
-std::deque<PacketComm> main_queue;
+PacketQueue            main_queue(QUEUE_CLASS_CONFIG);
 /** @brief The packet queue for the RFM23 channel. */
-std::deque<PacketComm> rfm23_queue;
+PacketQueue            rfm23_queue(QUEUE_CLASS_CONFIG);
+/** @brief The queue of bulk data the RFM23 channel sends reliably. */
+PacketQueue            rfm23_bulk_queue(BULK_QUEUE_CLASS_CONFIG);
 /** @brief The packet queue for the PDU channel. */
-std::deque<PacketComm> pdu_queue;
+PacketQueue            pdu_queue(QUEUE_CLASS_CONFIG);
 /** @brief The packet queue for the Raspberry Pi channel. */
-std::deque<PacketComm> rpi_queue;
-
-/** @brief The mutex for the main channel's packet queue. */
-Threads::Mutex         main_queue_mtx;
-/** @brief The mutex for the RFM23 channel's packet queue. */
-Threads::Mutex         rfm23_queue_mtx;
-/** @brief The mutex for the PDU channel's packet queue. */
-Threads::Mutex         pdu_queue_mtx;
-/** @brief The mutex for the Raspberry Pi channel's packet queue. */
-Threads::Mutex         rpi_queue_mtx;
+PacketQueue            rpi_queue(QUEUE_CLASS_CONFIG);
 
 /** @brief The mutex for the SPI1 interface. */
 Threads::Mutex         spi1_mtx;
@@ -49,6 +48,17 @@ Threads::Mutex         i2c1_mtx;
 /** @brief Whether the satellite is in deployment mode. */
 bool                   deploymentmode = false;
 
+/** @brief The codec compressing beacons into keyframes and deltas. */
+BeaconEncoder          beacon_encoder(BEACON_KEYFRAME_INTERVAL);
+/** @brief The packer aggregating beacons for the RFM23. */
+BeaconPacker           beacon_packer(beacon_encoder, BEACON_AGGREGATE_SIZE,
+                                     BEACON_AGGREGATE_DEADLINE,
+                                     acquire_beacon_packet,
+                                     route_packet_to_rfm23);
+
+/** @brief The RFM23's transmit airtime budget. */
+AirtimeBudget rfm23_airtime(RFM23_AIRTIME_BUDGET, RFM23_AIRTIME_WINDOW);
+
 /**
  * @brief Kill a running thread.
  *
@@ -70,61 +80,188 @@ bool                   kill_thread(uint8_t target_channel_id) {
   }
   return false;
 }
+/**
+ * @brief Determine the priority class of a packet.
+ *
+ * Beacons are routine telemetry and have the lowest priority. Replies to
+ * commands come next. Everything else is treated as a command.
+ *
+ * @param packet The packet to be classified.
+ * @return PacketPriority The priority class of the packet.
+ */
+PacketPriority packet_priority(const PacketComm &packet) {
+  switch (packet.header.type) {
+    case PacketComm::TypeId::DataObcBeacon: {
+      return PacketPriority::Beacon;
+    }
+    case PacketComm::TypeId::DataObcPong:
+    case PacketComm::TypeId::DataEpsResponse:
+    case PacketComm::TypeId::DataRadioResponse:
+    case PacketComm::TypeId::DataAdcsResponse:
+    case PacketComm::TypeId::DataObcResponse: {
+      return PacketPriority::Response;
+    }
+    default: {
+      return PacketPriority::Command;
+    }
+  }
+}
 /**
  * @brief Push a packet into a queue.
  *
- * This is a helper function to push a packet into a queue of packets. It will
- * push out the first packet in the queue if the queue is too large.
+ * This is a helper function to push a packet into a queue of packets. The
+ * packet is placed in the priority class given by packet_priority(). If that
+ * class is full, the class's drop policy decides which packet is lost. Only
+ * the handle is moved into the queue; the packet itself is not copied.
  *
- * @param packet The packet object that will be pushed into the queue.
- * @param queue The queue of packets to be pulled from.
- * @param mtx The mutex used to lock the queue.
+ * @param packet The handle of the packet that will be pushed into the queue.
+ * The queue takes ownership of the packet, leaving the handle empty, unless
+ * the packet is rejected.
+ * @param queue The queue of packets to be pushed to.
+ * @return PushResult Whether the packet was queued, and whether an older
+ * packet was evicted to make room for it. Producers can use this to back off
+ * while the queue's consumer is saturated.
  */
-void PushQueue(PacketComm &packet, std::deque<PacketComm> &queue,
-               Threads::Mutex &mtx) {
-  Threads::Scope lock(mtx);
-  if (queue.size() == MAXQUEUESIZE) {
-    queue.pop_front();
+PushResult PushQueue(PacketHandle &packet, PacketQueue &queue) {
+  if (!packet) {
+    return PushResult::Rejected;
+  }
+  PacketComm::TypeId type   = packet->header.type;
+  PushResult         result = queue.push(packet, packet_priority(*packet));
+  if (result == PushResult::Rejected) {
+    print_debug(Helpers::MAIN, "Queue full, lost packet of type ",
+                (uint16_t)type);
   }
-  queue.push_back(packet);
+  return result;
 }
 /**
  * @brief Pull a packet from a queue.
  *
- * This is a helper function to check a queue of packets for a packet.
+ * This is a helper function to check a queue of packets for a packet. Packets
+ * are pulled from the highest-priority class that is not empty.
  *
- * @param packet The packet object that will carry the pulled packet, if there
- * is one.
+ * @param packet The handle that will own the pulled packet, if there is one.
+ * Any packet it previously owned is returned to the pool.
  * @param queue The queue of packets to be pulled from.
- * @param mtx The mutex used to lock the queue.
+ * @param lowest The lowest-priority class that may be pulled from.
  * @return true A packet has been pulled from the queue. The passed-in packet
  * now contains its contents.
- * @return false The queue does not contain any packets.
+ * @return false The queue does not contain any packets of priority lowest or
+ * higher.
  */
-bool PullQueue(PacketComm &packet, std::deque<PacketComm> &queue,
-               Threads::Mutex &mtx) {
-  Threads::Scope lock(mtx);
-  if (queue.size() > 0) {
-    packet = queue.front();
-    queue.pop_front();
-    return true;
-  }
-  return false;
+bool PullQueue(PacketHandle &packet, PacketQueue &queue,
+               PacketPriority lowest) {
+  return queue.pop(packet, lowest);
+}
+/**
+ * @brief Pull a batch of packets from a queue.
+ *
+ * This is a helper function for a channel to drain its queue at once rather
+ * than one packet per loop iteration. Packets are ordered by priority class,
+ * then by age.
+ *
+ * @param packets The array of handles that will own the pulled packets.
+ * @param max The maximum number of packets to pull.
+ * @param queue The queue of packets to be pulled from.
+ * @return size_t The number of packets pulled.
+ */
+size_t PullQueue(PacketHandle *packets, size_t max, PacketQueue &queue) {
+  return queue.pop_batch(packets, max);
+}
+/**
+ * @brief Wait for a packet the caller can pull to arrive in a queue.
+ *
+ * This is a helper function for a channel to sleep until it has work to do.
+ * It returns as soon as a producer pushes a packet of class lowest or higher
+ * into the queue, rather than after a fixed delay. While waiting, the calling
+ * thread gives up its time slice on every check, as it would during
+ * threads.delay().
+ *
+ * Packets below lowest do not end the wait. A channel holding such packets
+ * back, as the RFM23 channel does once its airtime budget runs low, waits out
+ * the timeout instead of returning at once and spinning on packets it will
+ * not pull.
+ *
+ * @param queue The queue of packets to wait on.
+ * @param timeout The maximum time to wait, in milliseconds.
+ * @param lowest The lowest-priority class the caller will pull.
+ * @return true The queue contains at least one packet the caller can pull.
+ * @return false The timeout expired with no such packet in the queue.
+ */
+bool WaitQueue(PacketQueue &queue, uint32_t timeout, PacketPriority lowest) {
+  return queue.wait(timeout, lowest);
 }
 
 /** @brief Wrapper function to send a packet to the main channel. */
-void route_packet_to_main(PacketComm packet) {
-  PushQueue(packet, main_queue, main_queue_mtx);
+PushResult route_packet_to_main(PacketHandle packet) {
+  return PushQueue(packet, main_queue);
 }
 /** @brief Wrapper function to send a packet to the RFM23. */
-void route_packet_to_rfm23(PacketComm packet) {
-  PushQueue(packet, rfm23_queue, rfm23_queue_mtx);
+PushResult route_packet_to_rfm23(PacketHandle packet) {
+  return PushQueue(packet, rfm23_queue);
+}
+/**
+ * @brief Wrapper function to send a packet reliably through the RFM23.
+ *
+ * @param packet The packet to be sent. It is left with the caller if the bulk
+ * queue is full.
+ */
+PushResult route_packet_to_rfm23_bulk(PacketHandle &packet) {
+  return PushQueue(packet, rfm23_bulk_queue);
 }
 /** @brief Wrapper function to send a packet to the PDU. */
-void route_packet_to_pdu(PacketComm packet) {
-  PushQueue(packet, pdu_queue, pdu_queue_mtx);
+PushResult route_packet_to_pdu(PacketHandle packet) {
+  return PushQueue(packet, pdu_queue);
 }
 /** @brief Wrapper function to send a packet to the Raspberry Pi. */
-void route_packet_to_rpi(PacketComm packet) {
-  PushQueue(packet, rpi_queue, rpi_queue_mtx);
+PushResult route_packet_to_rpi(PacketHandle packet) {
+  return PushQueue(packet, rpi_queue);
+}
+
+/**
+ * @brief Acquire a packet addressed as a beacon from the Teensy to ground.
+ *
+ * @return PacketHandle The beacon packet, or an empty handle if the packet
+ * pool is exhausted.
+ */
+PacketHandle acquire_beacon_packet() {
+  PacketHandle packet = packet_pool.acquire();
+  if (packet) {
+    packet->header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
+    packet->header.nodedest = (uint8_t)NODES::GROUND_NODE_ID;
+    packet->header.type     = PacketComm::TypeId::DataObcBeacon;
+    packet->header.chanin   = 0;
+    packet->header.chanout  = Artemis::Channels::Channel_ID::RFM23_CHANNEL;
+  }
+  return packet;
+}
+/**
+ * @brief Send a beacon to the RFM23, packed together with other beacons.
+ *
+ * Small beacons are collected into a single AggregateBeacon packet, so they
+ * share one PacketComm header and CRC and fill whole radio frames. The
+ * aggregate is sent once the next beacon would not fit in
+ * BEACON_AGGREGATE_SIZE bytes, or by flush_beacons_if_due() once its first
+ * beacon has waited BEACON_AGGREGATE_DEADLINE. A beacon too large to share a
+ * packet is sent on its own.
+ *
+ * Beacon types registered with beacon_encoder are first compressed into a
+ * CompressedBeacon. The packing is done by BeaconPacker.
+ *
+ * @param beacon The beacon structure, starting with its BeaconType.
+ * @param size The size of the beacon structure.
+ * @return PushResult The result of pushing any packet this sent to the RFM23
+ * queue, or Accepted if the beacon is still waiting in the aggregate.
+ */
+PushResult route_beacon_to_rfm23(const void *beacon, size_t size) {
+  return beacon_packer.add(beacon, size);
 }
+/**
+ * @brief Send the aggregated beacon packet now, however full it is.
+ *
+ * @return PushResult The result of pushing the aggregate to the RFM23 queue,
+ * or Accepted if there was nothing to send.
+ */
+PushResult flush_beacons() { return beacon_packer.flush(); }
+/** @brief Send the aggregated beacon packet if it has waited long enough. */
+void flush_beacons_if_due() { beacon_packer.flush_if_due(); }
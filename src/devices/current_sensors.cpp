@@ -48,12 +48,8 @@ namespace Devices {
       setup();
     }
 
-    PacketComm     packet;
     currentbeacon1 beacon1;
     currentbeacon2 beacon2;
-    packet.header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
-    packet.header.nodedest = (uint8_t)NODES::GROUND_NODE_ID;
-    packet.header.type     = PacketComm::TypeId::DataObcBeacon;
 
     for (auto &it : current_sensors) {
       const int i = std::distance(current_sensors.begin(),
@@ -70,18 +66,9 @@ namespace Devices {
     }
 
     beacon1.deci = uptime;
-    packet.data.resize(sizeof(beacon1));
-    memcpy(packet.data.data(), &beacon1, sizeof(beacon1));
-    packet.header.chanin  = 0;
-    packet.header.chanout = Artemis::Channels::Channel_ID::RFM23_CHANNEL;
-    route_packet_to_rfm23(packet);
-
     beacon2.deci = uptime;
-    packet.data.resize(sizeof(beacon2));
-    memcpy(packet.data.data(), &beacon2, sizeof(beacon2));
-    packet.header.chanin  = 0;
-    packet.header.chanout = Artemis::Channels::Channel_ID::RFM23_CHANNEL;
-    route_packet_to_rfm23(packet);
+    route_beacon_to_rfm23(&beacon1, sizeof(beacon1));
+    route_beacon_to_rfm23(&beacon2, sizeof(beacon2));
   }
 }
 }
\ No newline at end of file
@@ -67,8 +67,7 @@ namespace Devices {
       setup();
     }
 
-    PacketComm packet;
-    gpsbeacon  beacon;
+    gpsbeacon beacon;
     beacon.deci = uptime;
 
     if (gps->fix) {
@@ -100,14 +99,7 @@ namespace Devices {
       beacon.altitude   = 0;
       beacon.satellites = 0;
     }
-    packet.header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
-    packet.header.nodedest = (uint8_t)NODES::GROUND_NODE_ID;
-    packet.header.type     = PacketComm::TypeId::DataObcBeacon;
-    packet.data.resize(sizeof(beacon));
-    memcpy(packet.data.data(), &beacon, sizeof(beacon));
-    packet.header.chanin  = 0;
-    packet.header.chanout = Artemis::Channels::Channel_ID::RFM23_CHANNEL;
-    route_packet_to_rfm23(packet);
+    route_beacon_to_rfm23(&beacon, sizeof(beacon));
   }
 }
 }
\ No newline at end of file
@@ -45,8 +45,7 @@ namespace Devices {
       setup();
     }
 
-    PacketComm packet;
-    magbeacon  beacon;
+    magbeacon beacon;
     beacon.deci = uptime;
 
     sensors_event_t event;
@@ -57,16 +56,8 @@ namespace Devices {
     beacon.magy            = (event.magnetic.y);
     beacon.magz            = (event.magnetic.z);
 
-    packet.header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
-    packet.header.nodedest = (uint8_t)NODES::GROUND_NODE_ID;
-    packet.header.type     = PacketComm::TypeId::DataObcBeacon;
-    packet.data.resize(sizeof(beacon));
-    memcpy(packet.data.data(), &beacon, sizeof(beacon));
-    packet.header.chanin  = 0;
-    packet.header.chanout = Artemis::Channels::Channel_ID::RFM23_CHANNEL;
-    route_packet_to_rfm23(packet);
-
-    return true;
+    return route_beacon_to_rfm23(&beacon, sizeof(beacon)) !=
+           PushResult::Rejected;
   }
 }
 }
\ No newline at end of file
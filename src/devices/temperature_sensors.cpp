@@ -36,7 +36,6 @@ namespace Devices {
    * powered on.
    */
   void TemperatureSensors::read(uint32_t uptime) {
-    PacketComm        packet;
     temperaturebeacon beacon;
     beacon.deci = uptime;
 
@@ -49,16 +48,9 @@ namespace Devices {
           (temperatureF - 32) * 5 / 9;
     }
 
-    beacon.teensy_tempC    = InternalTemperature.readTemperatureC();
+    beacon.teensy_tempC = InternalTemperature.readTemperatureC();
 
-    packet.header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
-    packet.header.nodedest = (uint8_t)NODES::GROUND_NODE_ID;
-    packet.header.type     = PacketComm::TypeId::DataObcBeacon;
-    packet.data.resize(sizeof(beacon));
-    memcpy(packet.data.data(), &beacon, sizeof(beacon));
-    packet.header.chanin  = 0;
-    packet.header.chanout = Artemis::Channels::Channel_ID::RFM23_CHANNEL;
-    route_packet_to_rfm23(packet);
+    route_beacon_to_rfm23(&beacon, sizeof(beacon));
   }
 }
 }
\ No newline at end of file
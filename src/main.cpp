@@ -9,6 +9,7 @@
 #include "artemisbeacons.h"
 #include "channels/artemis_channels.h"
 #include "helpers.h"
+#include "packet_router.h"
 #include <Arduino.h>
 #include <USBHost_t36.h>
 #include <pdu.h>
@@ -22,16 +23,24 @@ extern "C" uint32_t set_arm_clock(uint32_t frequency);
 
 void setup_connections();
 void setup_devices();
+void setup_beacon_codec();
 void setup_threads();
 
 void beacon_artemis_devices();
+void beacon_queue_telemetry();
+void beacon_airtime();
+PushResult beacon_queue(PacketQueue &queue, uint8_t queue_id);
 void beacon_if_deployed();
 void route_packets();
 
 void route_packet_to_ground();
-void ensure_rpi_is_powered();
+void route_packet_to_powered_rpi();
+void forward_packet_to_pdu();
+void forward_packet_to_rfm23();
+void switch_rpi();
+void send_beacons();
+bool rpi_can_be_powered();
 void send_pong_reply();
-void enable_rpi();
 void report_rpi_enabled();
 void update_pdu_switches();
 
@@ -42,7 +51,7 @@ Devices::Magnetometer       magnetometer;
 Devices::CurrentSensors     current_sensors;
 Devices::GPS                gps;
 Devices::TemperatureSensors temperature_sensors;
-PacketComm                  packet;
+PacketHandle                packet;
 USBHost                     usb;
 elapsedMillis               uptime;
 
@@ -68,6 +77,7 @@ void setup() {
   setup_connections();
   delay(3 * SECONDS);
   setup_devices();
+  setup_beacon_codec();
   setup_threads();
   threads.delay(5 * SECONDS);
   Helpers::print_debug(Helpers::MAIN, "Teensy Flight Software Setup Complete");
@@ -83,8 +93,9 @@ void setup() {
 void loop() {
   beacon_if_deployed();
   route_packets();
+  flush_beacons_if_due();
   gps.update();
-  threads.delay(100);
+  WaitQueue(main_queue, 100);
 }
 
 /** @brief Helper function to set up connections on the Teensy. */
@@ -112,6 +123,57 @@ void setup_devices() {
   }
 }
 
+/**
+ * @brief Helper function to register the beacons beacon_encoder compresses.
+ *
+ * Each reading is quantized a little finer than its sensor resolves: 1 mm/s^2
+ * and 0.1 mrad/s for the IMU, 10 nT for the magnetometer, 1 mV and 10 uA for
+ * the current sensors, and 0.01 degrees Celsius for every temperature.
+ */
+void setup_beacon_codec() {
+  using namespace Devices;
+  const int8_t imu_exponents[] = {-3, -3, -3, -4, -4, -4, -2};
+  const int8_t mag_exponents[] = {-2, -2, -2};
+  int8_t       current1_exponents[2 * ARTEMIS_CURRENT_BEACON_1_COUNT];
+  int8_t       current2_exponents[2 * (ARTEMIS_CURRENT_SENSOR_COUNT -
+                                      ARTEMIS_CURRENT_BEACON_1_COUNT)];
+  int8_t       temperature_exponents[ARTEMIS_TEMP_SENSOR_COUNT + 1];
+  for (size_t i = 0; i < sizeof(current1_exponents); i++) {
+    current1_exponents[i] = i < ARTEMIS_CURRENT_BEACON_1_COUNT ? -3 : -2;
+  }
+  for (size_t i = 0; i < sizeof(current2_exponents); i++) {
+    current2_exponents[i] = i < sizeof(current2_exponents) / 2 ? -3 : -2;
+  }
+  for (size_t i = 0; i < sizeof(temperature_exponents); i++) {
+    temperature_exponents[i] = -2;
+  }
+  static_assert(sizeof(IMU::imubeacon) ==
+                    BEACON_CODEC_HEADER + 4 * sizeof(imu_exponents),
+                "imubeacon does not match its exponents");
+  static_assert(sizeof(Magnetometer::magbeacon) ==
+                    BEACON_CODEC_HEADER + 4 * sizeof(mag_exponents),
+                "magbeacon does not match its exponents");
+  static_assert(sizeof(TemperatureSensors::temperaturebeacon) ==
+                    BEACON_CODEC_HEADER + 4 * sizeof(temperature_exponents),
+                "temperaturebeacon does not match its exponents");
+
+  if (!beacon_encoder.add_stream((uint8_t)BeaconType::IMUBeacon,
+                                 imu_exponents, sizeof(imu_exponents)) ||
+      !beacon_encoder.add_stream((uint8_t)BeaconType::MagnetometerBeacon,
+                                 mag_exponents, sizeof(mag_exponents)) ||
+      !beacon_encoder.add_stream((uint8_t)BeaconType::CurrentBeacon1,
+                                 current1_exponents,
+                                 sizeof(current1_exponents)) ||
+      !beacon_encoder.add_stream((uint8_t)BeaconType::CurrentBeacon2,
+                                 current2_exponents,
+                                 sizeof(current2_exponents)) ||
+      !beacon_encoder.add_stream((uint8_t)BeaconType::TemperatureBeacon,
+                                 temperature_exponents,
+                                 sizeof(temperature_exponents))) {
+    print_debug(Helpers::MAIN, "Failed to register beacon compression");
+  }
+}
+
 /** @brief Helper function to set up threads on the Teensy. */
 void setup_threads() {
   if (threads.setSliceMillis(10) != 1) {
@@ -159,6 +221,48 @@ void beacon_artemis_devices() {
     print_debug(Helpers::MAIN, "Failed to read magnetometer");
   }
   gps.read(uptime);
+  beacon_airtime();
+  beacon_queue_telemetry();
+  flush_beacons();
+}
+
+/** @brief Helper function to beacon the RFM23's airtime budget. */
+void beacon_airtime() {
+  Devices::airtimebeacon beacon;
+  beacon.deci      = uptime;
+  beacon.budget    = RFM23_AIRTIME_BUDGET;
+  beacon.window    = RFM23_AIRTIME_WINDOW / SECONDS;
+  beacon.consumed  = rfm23_airtime.consumed();
+  beacon.remaining = rfm23_airtime.remaining() / 1000;
+  route_beacon_to_rfm23(&beacon, sizeof(beacon));
+}
+
+/** @brief Helper function to beacon the telemetry of every packet queue. */
+void beacon_queue_telemetry() {
+  // Queue beacons are the least urgent, so stop as soon as they start pushing
+  // other beacons out of the radio queue.
+  if (beacon_queue(main_queue, 0) != PushResult::Accepted ||
+      beacon_queue(rfm23_queue, Channels::Channel_ID::RFM23_CHANNEL) !=
+          PushResult::Accepted ||
+      beacon_queue(pdu_queue, Channels::Channel_ID::PDU_CHANNEL) !=
+          PushResult::Accepted) {
+    return;
+  }
+  beacon_queue(rpi_queue, Channels::Channel_ID::RPI_CHANNEL);
+}
+
+/**
+ * @brief Helper function to beacon the telemetry of a packet queue.
+ *
+ * @param queue The queue to be reported.
+ * @param queue_id The Channel_ID of the channel consuming the queue, or 0 for
+ * the main queue.
+ * @return PushResult The result of pushing the beacon into the RFM23 queue.
+ */
+PushResult beacon_queue(PacketQueue &queue, uint8_t queue_id) {
+  Devices::queuebeacon beacon =
+      Devices::pack_queuebeacon(queue.telemetry(), queue_id, uptime);
+  return route_beacon_to_rfm23(&beacon, sizeof(beacon));
 }
 
 /** @brief Helper function to beacon Artemis devices if in deployment mode. */
@@ -167,86 +271,82 @@ void beacon_if_deployed() {
   if (deploymentmode) {
     // Check if it's time to read the sensors
     if (deploymentbeacon >= readInterval) {
-      Helpers::print_debug(Helpers::MAIN, "Deployment beacons sending");
-      beacon_artemis_devices();
-      update_pdu_switches();
+      // If the radio has not sent a single beacon since the last round, it is
+      // saturated. Skip this round rather than evict beacons still waiting.
+      if (rfm23_queue.headroom(PacketPriority::Beacon) == 0) {
+        Helpers::print_debug(Helpers::MAIN,
+                             "Radio congested, skipping deployment beacons");
+      } else {
+        Helpers::print_debug(Helpers::MAIN, "Deployment beacons sending");
+        beacon_artemis_devices();
+        update_pdu_switches();
+      }
       // Reset the timer
       deploymentbeacon = 0;
     }
   }
 }
 
-/** @brief Helper function to route packets. */
+/**
+ * @brief The main channel's route table.
+ *
+ * Each entry maps a destination node, and optionally a packet type and
+ * sub-key (the first data byte), to the handler for matching packets. To
+ * handle a new command, add a route here. Packets matching no route are
+ * dropped.
+ */
+constexpr auto routes = Router::sort_routes(Router::route_table<12>{{
+    Router::route(NODES::GROUND_NODE_ID, route_packet_to_ground),
+    Router::route(NODES::RPI_NODE_ID, route_packet_to_powered_rpi),
+    Router::route(NODES::TEENSY_NODE_ID, PacketComm::TypeId::CommandObcPing,
+                  send_pong_reply),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsCommunicate,
+                  forward_packet_to_pdu),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchName,
+                  forward_packet_to_pdu),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchName,
+                  (uint8_t)Devices::PDU::PDU_SW::RPI, switch_rpi),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchStatus,
+                  forward_packet_to_pdu),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchStatus,
+                  (uint8_t)Devices::PDU::PDU_SW::RPI, report_rpi_enabled),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandObcSendBeacon, send_beacons),
+    Router::route(NODES::TEENSY_NODE_ID, RADIO_MODEM_SWITCH,
+                  forward_packet_to_rfm23),
+    Router::route(NODES::TEENSY_NODE_ID, RADIO_BULK_ACK,
+                  forward_packet_to_rfm23),
+    Router::route(NODES::TEENSY_NODE_ID, FILE_DOWNLINK,
+                  route_packet_to_powered_rpi),
+}});
+static_assert(Router::unique_routes(routes), "Duplicate route in route table");
+
+/** @brief Helper function to route every packet waiting in the main queue. */
 void route_packets() {
-  if (PullQueue(packet, main_queue, main_queue_mtx)) {
-    if (packet.header.nodedest == (uint8_t)NODES::GROUND_NODE_ID) {
-      route_packet_to_ground();
-    } else if (packet.header.nodedest == (uint8_t)NODES::RPI_NODE_ID) {
-      ensure_rpi_is_powered();
-      route_packet_to_rpi(packet);
-    } else if (packet.header.nodedest == (uint8_t)NODES::TEENSY_NODE_ID) {
-      switch (packet.header.type) {
-        case PacketComm::TypeId::CommandObcPing: {
-          send_pong_reply();
-          break;
-        }
-        case PacketComm::TypeId::CommandEpsCommunicate: {
-          route_packet_to_pdu(packet);
-          break;
-        }
-        case PacketComm::TypeId::CommandEpsSwitchName: {
-          Devices::PDU::PDU_SW switchid = (Devices::PDU::PDU_SW)packet.data[0];
-          switch (switchid) {
-            case Devices::PDU::PDU_SW::RPI: {
-              if (packet.data[1] == 0) {
-                route_packet_to_rpi(packet);
-              } else if (packet.data[2] == 1) {
-                enable_rpi();
-                threads.delay(5 * SECONDS);
-              } else {
-                ensure_rpi_is_powered();
-              }
-              break;
-            }
-            default: {
-              route_packet_to_pdu(packet);
-              break;
-            }
-          }
-          break;
-        }
-        case PacketComm::TypeId::CommandEpsSwitchStatus: {
-          Devices::PDU::PDU_SW switchid = (Devices::PDU::PDU_SW)packet.data[0];
-          switch (switchid) {
-            case Devices::PDU::PDU_SW::RPI: {
-              report_rpi_enabled();
-              break;
-            }
-            default: {
-              route_packet_to_pdu(packet);
-              break;
-            }
-          }
-          break;
-        }
-        case PacketComm::TypeId::CommandObcSendBeacon: {
-          beacon_artemis_devices();
-          update_pdu_switches();
-          break;
-        }
-        default: {
-          break;
-        }
-      }
+  PacketHandle batch[QUEUE_BATCH_SIZE];
+  size_t       count = PullQueue(batch, QUEUE_BATCH_SIZE, main_queue);
+  for (size_t i = 0; i < count; i++) {
+    packet         = std::move(batch[i]);
+    int16_t subkey = packet->data.empty() ? -1 : packet->data[0];
+    Router::route_handler handler =
+        routes.find(packet->header.nodedest, (uint16_t)packet->header.type,
+                    subkey);
+    if (handler != nullptr) {
+      handler();
     }
   }
 }
 
 /** @brief Helper function to route packets to ground. */
 void route_packet_to_ground() {
-  switch (packet.header.chanout) {
+  switch (packet->header.chanout) {
     case Channels::Channel_ID::RFM23_CHANNEL: {
-      route_packet_to_rfm23(packet);
+      route_packet_to_rfm23(std::move(packet));
       break;
     }
     default: {
@@ -256,65 +356,106 @@ void route_packet_to_ground() {
 }
 
 /**
- * @brief Helper function to ensure the Raspberry Pi is powered.
+ * @brief Helper function to route packets to the Raspberry Pi.
+ *
+ * The RPi channel powers the Pi for the packet, and sends it once the Pi is
+ * ready, so the packet is dropped if the battery cannot power the Pi.
+ */
+void route_packet_to_powered_rpi() {
+  if (!rpi_can_be_powered()) {
+    print_debug(Helpers::MAIN, "Battery too low to power RPi");
+    return;
+  }
+  route_packet_to_rpi(std::move(packet));
+}
+
+/** @brief Helper function to forward packets to the PDU. */
+void forward_packet_to_pdu() { route_packet_to_pdu(std::move(packet)); }
+
+/** @brief Helper function to forward packets to the RFM23. */
+void forward_packet_to_rfm23() { route_packet_to_rfm23(std::move(packet)); }
+
+/**
+ * @brief Helper function to switch the Raspberry Pi on or off.
+ *
+ * The RPi channel handles both. Switching the Pi on is refused if the battery
+ * is too low, unless the third data byte forces it. A packet too short to
+ * say which is dropped.
+ */
+void switch_rpi() {
+  if (packet->data.size() < 2) {
+    print_debug(Helpers::MAIN, "RPi switch packet too short");
+    return;
+  }
+  if (packet->data[1] == 0 ||
+      (packet->data.size() > 2 && packet->data[2] == 1)) {
+    route_packet_to_rpi(std::move(packet));
+  } else {
+    route_packet_to_powered_rpi();
+  }
+}
+
+/** @brief Helper function to beacon all devices and PDU switches. */
+void send_beacons() {
+  beacon_artemis_devices();
+  update_pdu_switches();
+}
+
+/**
+ * @brief Helper function to check the Raspberry Pi can be powered.
  *
  * @todo This should still function if the current sensors are not enabled via
  * build flags.
+ *
+ * @return true The Pi is powered, or the battery can power it.
+ * @return false The battery voltage is too low to power the Pi.
  */
-void ensure_rpi_is_powered() {
-  if (!digitalRead(UART6_RX)) {
-    float curr_V =
-        current_sensors.current_sensors["battery_board"]->getBusVoltage_V();
-    if (curr_V >= 7.0) {
-      enable_rpi();
-      threads.delay(5 * SECONDS);
-    } else {
-      update_pdu_switches();
-    }
+bool rpi_can_be_powered() {
+  if (digitalRead(RPI_ENABLE)) {
+    return true;
   }
+  float curr_V =
+      current_sensors.current_sensors["battery_board"]->getBusVoltage_V();
+  if (curr_V >= 7.0) {
+    return true;
+  }
+  update_pdu_switches();
+  return false;
 }
 
 /** @brief Helper function to send a pong reply. */
 void send_pong_reply() {
-  packet.header.nodedest = packet.header.nodeorig;
-  packet.header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
-  packet.header.type     = PacketComm::TypeId::DataObcPong;
-  packet.data.resize(0);
+  packet->header.nodedest = packet->header.nodeorig;
+  packet->header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
+  packet->header.type     = PacketComm::TypeId::DataObcPong;
+  packet->data.resize(0);
   const char *data = "Pong";
   for (size_t i = 0; i < strlen(data); i++) {
-    packet.data.push_back(data[i]);
+    packet->data.push_back(data[i]);
   }
   route_packet_to_ground();
 }
 
-/** @brief Helper function to enable the Raspberry Pi. */
-void enable_rpi() {
-  Helpers::print_debug(Helpers::MAIN, "Turning on RPi");
-  digitalWrite(RPI_ENABLE, HIGH);
-  int thread_id = 0;
-  if ((thread_id = threads.addThread(Channels::RPI::rpi_channel)) == -1) {
-    print_debug(Helpers::MAIN, "Failed to start rpi_channel");
-  } else {
-    thread_list.push_back({thread_id, Channels::Channel_ID::RPI_CHANNEL});
-  }
-}
-
 /** @brief Helper function to report if the Raspberry Pi is enabled. */
 void report_rpi_enabled() {
-  packet.data.resize(1);
-  packet.data.push_back(digitalRead(RPI_ENABLE));
-  packet.header.type     = PacketComm::TypeId::DataEpsResponse;
-  packet.header.nodedest = packet.header.nodeorig;
-  packet.header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
-  route_packet_to_rfm23(packet);
+  packet->data.resize(1);
+  packet->data.push_back(digitalRead(RPI_ENABLE));
+  packet->header.type     = PacketComm::TypeId::DataEpsResponse;
+  packet->header.nodedest = packet->header.nodeorig;
+  packet->header.nodeorig = (uint8_t)NODES::TEENSY_NODE_ID;
+  route_packet_to_rfm23(std::move(packet));
 }
 
 /** @brief Helper function to request PDU switch state update. */
 void update_pdu_switches() {
-  packet.header.type     = PacketComm::TypeId::CommandEpsSwitchStatus;
-  packet.header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
-  packet.header.nodedest = (uint8_t)NODES::TEENSY_NODE_ID;
-  packet.data.clear();
-  packet.data.push_back((uint8_t)Artemis::Devices::PDU::PDU_SW::All);
-  route_packet_to_pdu(packet);
+  PacketHandle request = packet_pool.acquire();
+  if (!request) {
+    print_debug(Helpers::MAIN, "Packet pool exhausted");
+    return;
+  }
+  request->header.type     = PacketComm::TypeId::CommandEpsSwitchStatus;
+  request->header.nodeorig = (uint8_t)NODES::GROUND_NODE_ID;
+  request->header.nodedest = (uint8_t)NODES::TEENSY_NODE_ID;
+  request->data.push_back((uint8_t)Artemis::Devices::PDU::PDU_SW::All);
+  route_packet_to_pdu(std::move(request));
 }
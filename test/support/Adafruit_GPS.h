@@ -0,0 +1,16 @@
+/**
+ * @file Adafruit_GPS.h
+ * @brief A host stand-in for the Adafruit GPS library, for the native tests.
+ */
+#ifndef _TEST_ADAFRUIT_GPS_H
+#define _TEST_ADAFRUIT_GPS_H
+
+#include <Arduino.h>
+
+/** @brief A GPS receiver on a serial port. */
+class Adafruit_GPS {
+public:
+  Adafruit_GPS(HardwareSerial *serial) {}
+};
+
+#endif // _TEST_ADAFRUIT_GPS_H
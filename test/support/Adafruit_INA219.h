@@ -0,0 +1,16 @@
+/**
+ * @file Adafruit_INA219.h
+ * @brief A host stand-in for the Adafruit INA219 library, for the native tests.
+ */
+#ifndef _TEST_ADAFRUIT_INA219_H
+#define _TEST_ADAFRUIT_INA219_H
+
+#include <Adafruit_Sensor.h>
+
+/** @brief An INA219 current sensor at an I2C address. */
+class Adafruit_INA219 {
+public:
+  Adafruit_INA219(uint8_t address) {}
+};
+
+#endif // _TEST_ADAFRUIT_INA219_H
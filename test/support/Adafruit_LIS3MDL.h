@@ -0,0 +1,14 @@
+/**
+ * @file Adafruit_LIS3MDL.h
+ * @brief A host stand-in for the Adafruit LIS3MDL library, for the native
+ * tests.
+ */
+#ifndef _TEST_ADAFRUIT_LIS3MDL_H
+#define _TEST_ADAFRUIT_LIS3MDL_H
+
+#include <Adafruit_Sensor.h>
+
+/** @brief An LIS3MDL magnetometer. */
+class Adafruit_LIS3MDL {};
+
+#endif // _TEST_ADAFRUIT_LIS3MDL_H
@@ -0,0 +1,14 @@
+/**
+ * @file Adafruit_LSM6DSOX.h
+ * @brief A host stand-in for the Adafruit LSM6DSOX library, for the native
+ * tests.
+ */
+#ifndef _TEST_ADAFRUIT_LSM6DSOX_H
+#define _TEST_ADAFRUIT_LSM6DSOX_H
+
+#include <Adafruit_Sensor.h>
+
+/** @brief An LSM6DSOX inertial measurement unit. */
+class Adafruit_LSM6DSOX {};
+
+#endif // _TEST_ADAFRUIT_LSM6DSOX_H
@@ -0,0 +1,11 @@
+/**
+ * @file Adafruit_Sensor.h
+ * @brief A host stand-in for the Adafruit unified sensor library, for the
+ * native tests.
+ */
+#ifndef _TEST_ADAFRUIT_SENSOR_H
+#define _TEST_ADAFRUIT_SENSOR_H
+
+#include <Arduino.h>
+
+#endif // _TEST_ADAFRUIT_SENSOR_H
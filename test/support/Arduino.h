@@ -0,0 +1,137 @@
+/**
+ * @file Arduino.h
+ * @brief A host stand-in for the Teensy core, for the native tests.
+ *
+ * This file contains the parts of the Teensy core the libraries use. Time is
+ * simulated: it only passes when a test advances it, or when the code under
+ * test waits with yield() or delay(). Waits therefore take no real time, and a
+ * run can be repeated exactly.
+ */
+#ifndef _TEST_ARDUINO_H
+#define _TEST_ARDUINO_H
+
+#include <atomic>
+#include <iomanip>
+#include <map>
+#include <math.h>
+#include <sstream>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+#define HIGH   1
+#define LOW    0
+#define INPUT  0
+#define OUTPUT 1
+
+/* The analog pins of the Teensy 4.1. */
+#define A0     14
+#define A1     15
+#define A2     16
+#define A3     17
+#define A4     18
+#define A5     19
+#define A6     20
+#define A7     21
+#define A8     22
+#define A9     23
+#define A10    24
+#define A11    25
+#define A12    26
+#define A13    27
+#define A14    38
+#define A15    39
+#define A16    40
+#define A17    41
+
+/** @brief The simulated time each yield() lets pass, in microseconds. */
+#define HOST_YIELD_TIME 10
+/** @brief The number of pins a test can read back. */
+#define HOST_PINS       64
+
+/** @brief The simulated time, in microseconds, since the test started. */
+inline std::atomic<uint64_t> host_time{0};
+/** @brief The level each pin was last written. */
+inline uint8_t               host_pins[HOST_PINS] = {};
+
+/** @brief Let a number of simulated microseconds pass. */
+inline void     advance_micros(uint32_t us) { host_time += us; }
+/** @brief Let a number of simulated milliseconds pass. */
+inline void     advance_millis(uint32_t ms) {
+  host_time += (uint64_t)ms * 1000;
+}
+/** @brief Start the simulated clock over. */
+inline void     reset_time() { host_time = 0; }
+
+inline uint32_t micros() { return (uint32_t)host_time.load(); }
+inline uint32_t millis() { return (uint32_t)(host_time.load() / 1000); }
+inline void     delay(uint32_t ms) { advance_millis(ms); }
+inline void     delayMicroseconds(uint32_t us) { advance_micros(us); }
+inline void     yield() {
+  advance_micros(HOST_YIELD_TIME);
+  std::this_thread::yield();
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode) {}
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+  host_pins[pin % HOST_PINS] = value;
+}
+inline uint8_t digitalRead(uint8_t pin) { return host_pins[pin % HOST_PINS]; }
+
+/** @brief The time since the counter was last set, in milliseconds. */
+class elapsedMillis {
+public:
+  elapsedMillis(uint32_t value = 0) : start(millis() - value) {}
+  operator uint32_t() const { return millis() - start; }
+  elapsedMillis &operator=(uint32_t value) {
+    start = millis() - value;
+    return *this;
+  }
+
+private:
+  uint32_t start;
+};
+
+/** @brief The time since the counter was last set, in microseconds. */
+class elapsedMicros {
+public:
+  elapsedMicros(uint32_t value = 0) : start(micros() - value) {}
+  operator uint32_t() const { return micros() - start; }
+  elapsedMicros &operator=(uint32_t value) {
+    start = micros() - value;
+    return *this;
+  }
+
+private:
+  uint32_t start;
+};
+
+/** @brief A serial port whose output is discarded. */
+class HardwareSerial {
+public:
+  void   begin(uint32_t baud) { this->baud = baud; }
+  void   end() {}
+  void   flush() {}
+  void   clear() {}
+  int    available() { return 0; }
+  int    read() { return -1; }
+  int    availableForWrite() { return 64; }
+  size_t write(uint8_t byte) { return 1; }
+  size_t write(const uint8_t *data, size_t size) { return size; }
+  template <typename T> size_t print(const T &value) { return 0; }
+  template <typename T> size_t println(const T &value) { return 0; }
+  explicit operator bool() const { return true; }
+
+  /** @brief The baud rate the port was last opened at. */
+  uint32_t baud = 0;
+};
+
+inline HardwareSerial Serial;
+inline HardwareSerial Serial7;
+
+#endif // _TEST_ARDUINO_H
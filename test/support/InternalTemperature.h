@@ -0,0 +1,11 @@
+/**
+ * @file InternalTemperature.h
+ * @brief A host stand-in for the Teensy internal temperature library, for the
+ * native tests.
+ */
+#ifndef _TEST_INTERNAL_TEMPERATURE_H
+#define _TEST_INTERNAL_TEMPERATURE_H
+
+#include <Arduino.h>
+
+#endif // _TEST_INTERNAL_TEMPERATURE_H
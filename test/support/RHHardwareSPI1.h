@@ -0,0 +1,22 @@
+/**
+ * @file RHHardwareSPI1.h
+ * @brief A host stand-in for the RadioHead SPI1 interface, for the native
+ * tests.
+ */
+#ifndef _TEST_RH_HARDWARE_SPI1_H
+#define _TEST_RH_HARDWARE_SPI1_H
+
+#include <RH_RF22.h>
+
+/** @brief The pins of an SPI bus. */
+class SPIClass {
+public:
+  void setMISO(uint8_t pin) {}
+  void setMOSI(uint8_t pin) {}
+  void setSCK(uint8_t pin) {}
+};
+
+inline SPIClass     SPI1;
+inline RHGenericSPI hardware_spi1;
+
+#endif // _TEST_RH_HARDWARE_SPI1_H
@@ -0,0 +1,54 @@
+/**
+ * @file RH_RF22.h
+ * @brief A host stand-in for the RadioHead RH_RF22 declarations, for the
+ * native tests.
+ *
+ * The native tests build the RFM23 class with RFM23_SIMULATED, so only the
+ * types and registers SimRF22 and the RFM23 class refer to are needed.
+ */
+#ifndef _TEST_RH_RF22_H
+#define _TEST_RH_RF22_H
+
+#include <Arduino.h>
+
+#define RH_RF22_MAX_MESSAGE_LEN            255
+#define RH_RF22_REG_30_DATA_ACCESS_CONTROL 0x30
+#define RH_RF22_ENCRC                      0x04
+
+/** @brief The SPI interface of a RadioHead driver. */
+class RHGenericSPI {};
+
+/** @brief The base of every RadioHead driver. */
+class RHGenericDriver {
+public:
+  /** @brief Enumeration of the modes of a radio. */
+  typedef enum {
+    RHModeInitialising = 0,
+    RHModeSleep,
+    RHModeIdle,
+    RHModeTx,
+    RHModeRx,
+    RHModeCad,
+  } RHMode;
+};
+
+/** @brief The RFM22/23 driver. */
+class RH_RF22 : public RHGenericDriver {
+public:
+  /** @brief Enumeration of the canned modem configurations. */
+  typedef enum {
+    UnmodulatedCarrier = 0,
+    FSK_Rb2Fd5,
+    FSK_Rb2_4Fd36,
+    FSK_Rb4_8Fd45,
+    FSK_Rb9_6Fd45,
+    FSK_Rb19_2Fd9_6,
+    FSK_Rb38_4Fd19_6,
+    FSK_Rb57_6Fd28_8,
+    FSK_Rb125Fd125,
+    GFSK_Rb2Fd5,
+    OOK_Rb1_2Bw75,
+  } ModemConfigChoice;
+};
+
+#endif // _TEST_RH_RF22_H
@@ -0,0 +1,10 @@
+/**
+ * @file SD.h
+ * @brief A host stand-in for the SD card library, for the native tests.
+ */
+#ifndef _TEST_SD_H
+#define _TEST_SD_H
+
+#include <Arduino.h>
+
+#endif // _TEST_SD_H
@@ -0,0 +1,50 @@
+/**
+ * @file TeensyThreads.h
+ * @brief A host stand-in for TeensyThreads, for the native tests.
+ *
+ * This file contains the parts of TeensyThreads the libraries use. Mutexes are
+ * host mutexes, so code under test may run on several host threads.
+ */
+#ifndef _TEST_TEENSY_THREADS_H
+#define _TEST_TEENSY_THREADS_H
+
+#include <Arduino.h>
+#include <mutex>
+
+/** @brief The thread scheduler. */
+class Threads {
+public:
+  /** @brief A mutex shared between threads. */
+  class Mutex {
+  public:
+    int lock(unsigned int timeout_ms = 0) {
+      mutex.lock();
+      return 1;
+    }
+    int unlock() {
+      mutex.unlock();
+      return 1;
+    }
+    int try_lock() { return mutex.try_lock() ? 1 : 0; }
+
+  private:
+    std::mutex mutex;
+  };
+
+  /** @brief A lock on a mutex held until the end of its scope. */
+  class Scope {
+  public:
+    Scope(Mutex &m) : mutex(m) { mutex.lock(); }
+    ~Scope() { mutex.unlock(); }
+
+  private:
+    Mutex &mutex;
+  };
+
+  void yield() { ::yield(); }
+  void delay(int ms) { ::delay(ms); }
+};
+
+inline Threads threads;
+
+#endif // _TEST_TEENSY_THREADS_H
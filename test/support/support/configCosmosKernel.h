@@ -0,0 +1,11 @@
+/**
+ * @file configCosmosKernel.h
+ * @brief A host stand-in for the micro-cosmos configuration, for the native
+ * tests.
+ */
+#ifndef _TEST_CONFIG_COSMOS_KERNEL_H
+#define _TEST_CONFIG_COSMOS_KERNEL_H
+
+#include <Arduino.h>
+
+#endif // _TEST_CONFIG_COSMOS_KERNEL_H
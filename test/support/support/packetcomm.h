@@ -0,0 +1,104 @@
+/**
+ * @file packetcomm.h
+ * @brief A host stand-in for the micro-cosmos PacketComm, for the native
+ * tests.
+ *
+ * This file contains a PacketComm with the same header, vectors and wrapped
+ * format as the micro-cosmos one: the header, then the data, then a CRC-16 of
+ * both, least significant byte first.
+ */
+#ifndef _TEST_PACKETCOMM_H
+#define _TEST_PACKETCOMM_H
+
+#include <Arduino.h>
+
+/** @brief A packet passed between nodes and channels. */
+class PacketComm {
+public:
+  /** @brief Enumeration of the packet types the flight software uses. */
+  enum class TypeId : uint16_t {
+    None                   = 0,
+    DataObcBeacon          = 0x10,
+    DataObcPong            = 0x41,
+    DataEpsResponse        = 0x43,
+    DataRadioResponse      = 0x44,
+    DataAdcsResponse       = 0x45,
+    DataObcResponse        = 0x46,
+    CommandObcPing         = 0x701,
+    CommandObcHalt         = 0x702,
+    CommandObcSendBeacon   = 0x703,
+    CommandEpsCommunicate  = 0x710,
+    CommandEpsSwitchName   = 0x711,
+    CommandEpsSwitchStatus = 0x712,
+    CommandCameraCapture   = 0x881,
+  };
+
+  /** @brief The header at the start of every wrapped packet. */
+  struct __attribute__((packed)) Header {
+    uint16_t data_size = 0;
+    TypeId   type      = TypeId::None;
+    uint8_t  nodeorig  = 0;
+    uint8_t  nodedest  = 0;
+    uint8_t  chanin    = 0;
+    uint8_t  chanout   = 0;
+  };
+
+  Header          header;
+  vector<uint8_t> data;
+  vector<uint8_t> wrapped;
+  vector<uint8_t> packetized;
+
+  /** @brief Wrap the header and data, with their CRC, into wrapped. */
+  bool Wrap() {
+    header.data_size = data.size();
+    wrapped.resize(sizeof(header) + data.size() + 2);
+    memcpy(wrapped.data(), &header, sizeof(header));
+    if (!data.empty()) {
+      memcpy(&wrapped[sizeof(header)], data.data(), data.size());
+    }
+    uint16_t crc                = crc16(wrapped.data(), wrapped.size() - 2);
+    wrapped[wrapped.size() - 2] = crc & 0xFF;
+    wrapped[wrapped.size() - 1] = crc >> 8;
+    return true;
+  }
+
+  /**
+   * @brief Unwrap wrapped into the header and data.
+   *
+   * @return int32_t The size of the wrapped packet, or -1 if it is too short,
+   * its size does not match its header, or its CRC does not match.
+   */
+  int32_t Unwrap() {
+    if (wrapped.size() < sizeof(header) + 2) {
+      return -1;
+    }
+    Header unwrapped;
+    memcpy(&unwrapped, wrapped.data(), sizeof(unwrapped));
+    if (sizeof(header) + unwrapped.data_size + 2 != wrapped.size()) {
+      return -1;
+    }
+    uint16_t crc = wrapped[wrapped.size() - 2] |
+                   (wrapped[wrapped.size() - 1] << 8);
+    if (crc != crc16(wrapped.data(), wrapped.size() - 2)) {
+      return -1;
+    }
+    header = unwrapped;
+    data.assign(wrapped.begin() + sizeof(header), wrapped.end() - 2);
+    return wrapped.size();
+  }
+
+private:
+  /** @brief The CRC-16/CCITT of a buffer. */
+  static uint16_t crc16(const uint8_t *bytes, size_t size) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < size; i++) {
+      crc ^= bytes[i] << 8;
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+      }
+    }
+    return crc;
+  }
+};
+
+#endif // _TEST_PACKETCOMM_H
@@ -0,0 +1,193 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the radio airtime budget and its reserves.
+ *
+ * The RFM23 channel's senders are simulated one millisecond at a time, each
+ * checking the budget against its reserve in priority order the way the
+ * channel does, while sending full frames at the slowest modem rung.
+ */
+#include "config/artemis_defs.h"
+#include <airtime.h>
+#include <algorithm>
+#include <deque>
+#include <rfm23.h>
+#include <string.h>
+#include <unity.h>
+
+/** @brief The airtime, in microseconds, of a full frame at 2 kbps. */
+#define FRAME_AIRTIME                                                          \
+  ((RH_RF22_MAX_MESSAGE_LEN + RFM23_FRAME_OVERHEAD) * 8 * 1000000UL / 2000)
+/** @brief The length, in milliseconds, of each simulation. */
+#define SIMULATION (30 * 60 * SECONDS)
+
+/** @brief The senders sharing the budget, most important first. */
+enum Sender : uint8_t { Control, Response, Beacon, Bulk, SENDERS };
+
+/** @brief The reserve each sender leaves, as the RFM23 channel sets them. */
+static const uint32_t RESERVES[SENDERS] = {
+    0,
+    RFM23_AIRTIME_RESPONSE_RESERVE,
+    RFM23_AIRTIME_BEACON_RESERVE,
+    RFM23_AIRTIME_BULK_RESERVE,
+};
+
+/** @brief What a sender offered and got in a simulation. */
+struct sender_result {
+  /** @brief The frames the sender queued. */
+  uint32_t offered  = 0;
+  /** @brief The frames the sender transmitted. */
+  uint32_t sent     = 0;
+  /** @brief The longest time, in milliseconds, a frame waited. */
+  uint32_t max_wait = 0;
+};
+
+/** @brief The outcome of a simulation. */
+struct simulation_result {
+  /** @brief What each sender offered and got. */
+  sender_result sender[SENDERS];
+  /** @brief The total airtime, in microseconds, transmitted. */
+  uint64_t      airtime = 0;
+};
+
+void setUp(void) { reset_time(); }
+
+void tearDown(void) {}
+
+/**
+ * @brief Simulate the senders over SIMULATION.
+ *
+ * @param periods The time, in milliseconds, between each sender's frames, or
+ * 0 for a sender that always has a frame waiting.
+ * @param reserves The reserve each sender passes to AirtimeBudget::allows().
+ * @return simulation_result What the senders offered and got.
+ */
+static simulation_result simulate(const uint32_t *periods,
+                                  const uint32_t *reserves) {
+  AirtimeBudget        budget(RFM23_AIRTIME_BUDGET, RFM23_AIRTIME_WINDOW);
+  simulation_result    result;
+  std::deque<uint32_t> waiting[SENDERS];
+  uint32_t             busy_until = 0;
+  for (uint32_t now = 0; now < SIMULATION; now++, advance_millis(1)) {
+    for (uint8_t s = 0; s < SENDERS; s++) {
+      if (periods[s] == 0 ? waiting[s].empty()
+                          : (now + 97 * s) % periods[s] == 0) {
+        waiting[s].push_back(now);
+        result.sender[s].offered++;
+      }
+    }
+    if (now < busy_until) {
+      continue;
+    }
+    for (uint8_t s = 0; s < SENDERS; s++) {
+      if (waiting[s].empty() || !budget.allows(reserves[s])) {
+        continue;
+      }
+      sender_result &sender = result.sender[s];
+      sender.sent++;
+      sender.max_wait = std::max(sender.max_wait, now - waiting[s].front());
+      waiting[s].pop_front();
+      budget.spend(FRAME_AIRTIME);
+      result.airtime += FRAME_AIRTIME;
+      busy_until      = now + FRAME_AIRTIME / 1000;
+      break;
+    }
+  }
+  return result;
+}
+
+/** @brief Report what each sender offered and got in a simulation. */
+static void report(const char *name, const simulation_result &result) {
+  const char *senders[SENDERS] = {"control", "responses", "beacons", "bulk"};
+  char        text[160];
+  int         length = snprintf(text, sizeof(text), "%s: %.2f%% duty,", name,
+                                100.0 * result.airtime / SIMULATION / 1000);
+  for (uint8_t s = 0; s < SENDERS; s++) {
+    const sender_result &sender = result.sender[s];
+    length += snprintf(&text[length], sizeof(text) - length,
+                       " %s %u/%u (%u ms)", senders[s], sender.sent,
+                       sender.offered, sender.max_wait);
+  }
+  TEST_MESSAGE(text);
+}
+
+/** @brief Check that a simulation stayed within the airtime budget. */
+static void check_budget(const simulation_result &result) {
+  uint64_t windows = SIMULATION / RFM23_AIRTIME_WINDOW;
+  TEST_ASSERT_LESS_OR_EQUAL((windows + 1) * RFM23_AIRTIME_BUDGET * 1000 +
+                                FRAME_AIRTIME,
+                            result.airtime);
+}
+
+/**
+ * @brief The reserves leave each sender's budget to the ones above it, and
+ * leave link control at least three full frames.
+ */
+void test_reserve_order(void) {
+  TEST_ASSERT_GREATER_OR_EQUAL(3 * FRAME_AIRTIME,
+                               RFM23_AIRTIME_RESPONSE_RESERVE);
+  for (uint8_t s = 1; s < SENDERS; s++) {
+    TEST_ASSERT_GREATER_THAN(RESERVES[s - 1], RESERVES[s]);
+  }
+  TEST_ASSERT_LESS_THAN(RFM23_AIRTIME_BUDGET * 1000, RESERVES[Bulk]);
+}
+
+/**
+ * @brief Under an overload of every class, the budget holds, link control and
+ * responses get all they ask for, beacons get what is left, and bulk data,
+ * the least important, gets next to nothing.
+ */
+void test_reserve_overload(void) {
+  const uint32_t    periods[SENDERS] = {30 * SECONDS, 5 * SECONDS, 2500, 0};
+  simulation_result result           = simulate(periods, RESERVES);
+  report("Overload", result);
+  check_budget(result);
+  TEST_ASSERT_EQUAL(result.sender[Control].offered,
+                    result.sender[Control].sent);
+  TEST_ASSERT_LESS_OR_EQUAL(FRAME_AIRTIME / 1000,
+                            result.sender[Control].max_wait);
+  TEST_ASSERT_LESS_OR_EQUAL(1, result.sender[Response].offered -
+                                   result.sender[Response].sent);
+  TEST_ASSERT_LESS_THAN(result.sender[Beacon].offered * 3 / 4,
+                        result.sender[Beacon].sent);
+  TEST_ASSERT_GREATER_THAN(result.sender[Beacon].offered / 4,
+                           result.sender[Beacon].sent);
+  TEST_ASSERT_LESS_THAN(result.sender[Beacon].sent / 10,
+                        result.sender[Bulk].sent);
+}
+
+/**
+ * @brief A storm of responses is held to the budget, but cannot delay link
+ * control for longer than a frame already on the air, as it could without a
+ * response reserve.
+ */
+void test_response_storm(void) {
+  const uint32_t periods[SENDERS] = {30 * SECONDS, 1 * SECONDS, 0, 0};
+  uint32_t       unreserved[SENDERS];
+  memcpy(unreserved, RESERVES, sizeof(unreserved));
+  unreserved[Response] = 0;
+
+  simulation_result result = simulate(periods, RESERVES);
+  report("Response storm", result);
+  check_budget(result);
+  TEST_ASSERT_EQUAL(result.sender[Control].offered,
+                    result.sender[Control].sent);
+  TEST_ASSERT_LESS_OR_EQUAL(FRAME_AIRTIME / 1000,
+                            result.sender[Control].max_wait);
+  TEST_ASSERT_LESS_THAN(result.sender[Response].offered / 2,
+                        result.sender[Response].sent);
+
+  reset_time();
+  simulation_result without = simulate(periods, unreserved);
+  report("Without a response reserve", without);
+  check_budget(without);
+  TEST_ASSERT_GREATER_THAN(FRAME_AIRTIME / 1000,
+                           without.sender[Control].max_wait);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_reserve_order);
+  RUN_TEST(test_reserve_overload);
+  RUN_TEST(test_response_storm);
+  return UNITY_END();
+}
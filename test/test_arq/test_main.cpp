@@ -0,0 +1,410 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the selective-repeat ARQ transport.
+ *
+ * A sender and a receiver are connected directly, with frames and
+ * acknowledgements dropped, reordered or held back by each test. Time is
+ * simulated, so retransmit timers are checked exactly.
+ */
+#include <arq.h>
+#include <unity.h>
+#include <vector>
+
+/** @brief The window of the sender and receiver under test. */
+#define WINDOW         8
+/** @brief The simulated time, in milliseconds, between exchanges. */
+#define EXCHANGE_STEP  100
+/** @brief The number of packets sent through the lossy link. */
+#define LOSSY_PACKETS  500
+
+/** @brief The pool the packets are taken from. */
+static PacketPool pool;
+
+void setUp(void) { reset_time(); }
+
+void tearDown(void) {}
+
+/** @brief Push a packet numbered n, returning whether the sender took it. */
+static bool push(ArqSender &sender, uint16_t n) {
+  PacketHandle packet = pool.acquire();
+  TEST_ASSERT_TRUE(packet);
+  packet->header.type = PacketComm::TypeId::DataObcBeacon;
+  packet->data.assign({(uint8_t)(n & 0xFF), (uint8_t)(n >> 8)});
+  return sender.push(packet);
+}
+
+/** @brief Pop every packet the receiver has in order, adding its number. */
+static void pop_all(ArqReceiver &receiver, std::vector<uint16_t> &popped) {
+  PacketHandle packet;
+  while (receiver.pop(packet)) {
+    TEST_ASSERT_EQUAL(2, packet->data.size());
+    popped.push_back(packet->data[0] | (packet->data[1] << 8));
+  }
+}
+
+/** @brief Poll every frame the sender has to send right now. */
+static std::vector<PacketComm> poll_all(ArqSender &sender) {
+  std::vector<PacketComm> frames;
+  PacketComm              frame;
+  while (sender.poll(frame)) {
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+/** @brief Hand a frame to the receiver and its acknowledgement back. */
+static void deliver(ArqSender &sender, ArqReceiver &receiver,
+                    const PacketComm &frame) {
+  PacketComm ack;
+  receiver.receive(frame);
+  receiver.acknowledgement(ack);
+  sender.acknowledge(ack);
+}
+
+/**
+ * @brief Exchange frames and acknowledgements, each lost with a probability,
+ * until every packet in flight is acknowledged or time runs out.
+ *
+ * @param loss The probability of losing each frame and acknowledgement.
+ * @param limit The most simulated time, in milliseconds, to run for.
+ */
+static void exchange(ArqSender &sender, ArqReceiver &receiver,
+                     std::vector<uint16_t> &popped, float loss,
+                     uint32_t limit) {
+  static uint32_t state = 1;
+  auto            kept  = [&] {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) * (1.0f / (1 << 24)) >= loss;
+  };
+  for (uint32_t t = 0; t < limit && sender.in_flight() > 0;
+       t += EXCHANGE_STEP) {
+    for (const PacketComm &frame : poll_all(sender)) {
+      if (!kept()) {
+        continue;
+      }
+      PacketComm ack;
+      receiver.receive(frame);
+      receiver.acknowledgement(ack);
+      if (kept()) {
+        sender.acknowledge(ack);
+      }
+    }
+    pop_all(receiver, popped);
+    advance_millis(EXCHANGE_STEP);
+  }
+}
+
+/** @brief Check that the packets popped are numbered from first, in order. */
+static void assert_numbered(const std::vector<uint16_t> &popped,
+                            uint16_t first, size_t count) {
+  TEST_ASSERT_EQUAL(count, popped.size());
+  for (size_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL(first + i, popped[i]);
+  }
+}
+
+/** @brief A window of packets crosses a lossless link once each, in order. */
+void test_in_order(void) {
+  ArqSender             sender(WINDOW);
+  ArqReceiver           receiver(pool, WINDOW);
+  std::vector<uint16_t> popped;
+  uint16_t              n = 0;
+  while (push(sender, n)) {
+    n++;
+  }
+  TEST_ASSERT_EQUAL(WINDOW, n);
+  TEST_ASSERT_FALSE(sender.ready());
+
+  exchange(sender, receiver, popped, 0, EXCHANGE_STEP);
+  assert_numbered(popped, 0, WINDOW);
+  TEST_ASSERT_EQUAL(0, sender.in_flight());
+  TEST_ASSERT_EQUAL(0, sender.retransmissions());
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool.available());
+}
+
+/**
+ * @brief Frames arriving out of order are held until the gap fills, the
+ * SACK bitmap reports them, and only the lost frame is sent again.
+ */
+void test_sack_reordering(void) {
+  ArqSender             sender(WINDOW);
+  ArqReceiver           receiver(pool, WINDOW);
+  std::vector<uint16_t> popped;
+  for (uint16_t n = 0; n < WINDOW; n++) {
+    TEST_ASSERT_TRUE(push(sender, n));
+  }
+  std::vector<PacketComm> frames = poll_all(sender);
+  TEST_ASSERT_EQUAL(WINDOW, frames.size());
+
+  for (size_t i = WINDOW - 1; i > 0; i--) {
+    deliver(sender, receiver, frames[i]);
+  }
+  pop_all(receiver, popped);
+  TEST_ASSERT_EQUAL(0, popped.size());
+  PacketComm ack;
+  receiver.acknowledgement(ack);
+  TEST_ASSERT_EQUAL(ARQ_ACK_SIZE, ack.data.size());
+  TEST_ASSERT_EQUAL(0, ack.data[1] | (ack.data[2] << 8));
+  TEST_ASSERT_EQUAL((1 << (WINDOW - 1)) - 1, ack.data[3]);
+  TEST_ASSERT_EQUAL(WINDOW, sender.in_flight());
+
+  advance_millis(sender.timeout());
+  frames = poll_all(sender);
+  TEST_ASSERT_EQUAL(1, frames.size());
+  TEST_ASSERT_EQUAL(0, frames[0].data[1] | (frames[0].data[2] << 8));
+  TEST_ASSERT_EQUAL(1, sender.retransmissions());
+
+  deliver(sender, receiver, frames[0]);
+  pop_all(receiver, popped);
+  assert_numbered(popped, 0, WINDOW);
+  TEST_ASSERT_EQUAL(0, sender.in_flight());
+}
+
+/**
+ * @brief A packet is sent again without waiting for its timer once
+ * ARQ_REORDER_THRESHOLD packets sent after it are acknowledged, and only
+ * once for each transmission, without doubling the timeout.
+ */
+void test_fast_retransmit(void) {
+  ArqSender             sender(WINDOW);
+  ArqReceiver           receiver(pool, WINDOW);
+  std::vector<uint16_t> popped;
+  for (uint16_t n = 0; n < WINDOW; n++) {
+    TEST_ASSERT_TRUE(push(sender, n));
+  }
+  std::vector<PacketComm> frames = poll_all(sender);
+  for (size_t i = 1; i < ARQ_REORDER_THRESHOLD; i++) {
+    deliver(sender, receiver, frames[i]);
+  }
+  TEST_ASSERT_EQUAL(0, poll_all(sender).size());
+  deliver(sender, receiver, frames[ARQ_REORDER_THRESHOLD]);
+  uint32_t                timeout = sender.timeout();
+  std::vector<PacketComm> resent  = poll_all(sender);
+  TEST_ASSERT_EQUAL(1, resent.size());
+  TEST_ASSERT_EQUAL(0, resent[0].data[1] | (resent[0].data[2] << 8));
+  TEST_ASSERT_EQUAL(1, sender.retransmissions());
+  TEST_ASSERT_EQUAL(timeout, sender.timeout());
+
+  for (size_t i = ARQ_REORDER_THRESHOLD + 1; i < WINDOW; i++) {
+    deliver(sender, receiver, frames[i]);
+  }
+  TEST_ASSERT_EQUAL(0, poll_all(sender).size());
+  deliver(sender, receiver, resent[0]);
+  pop_all(receiver, popped);
+  assert_numbered(popped, 0, WINDOW);
+  TEST_ASSERT_EQUAL(0, sender.in_flight());
+}
+
+/**
+ * @brief Duplicates and frames beyond the window are refused, and the
+ * acknowledgement still describes what the receiver holds.
+ */
+void test_duplicates(void) {
+  ArqSender   sender(2 * WINDOW);
+  ArqReceiver receiver(pool, WINDOW);
+  for (uint16_t n = 0; n <= WINDOW; n++) {
+    TEST_ASSERT_TRUE(push(sender, n));
+  }
+  std::vector<PacketComm> frames = poll_all(sender);
+  TEST_ASSERT_TRUE(receiver.receive(frames[1]));
+  TEST_ASSERT_FALSE(receiver.receive(frames[1]));
+  TEST_ASSERT_FALSE(receiver.receive(frames[WINDOW]));
+  TEST_ASSERT_TRUE(receiver.receive(frames[0]));
+  TEST_ASSERT_FALSE(receiver.receive(frames[0]));
+
+  PacketComm ack;
+  receiver.acknowledgement(ack);
+  TEST_ASSERT_EQUAL(2, ack.data[1] | (ack.data[2] << 8));
+  TEST_ASSERT_EQUAL(0, ack.data[3]);
+}
+
+/**
+ * @brief The retransmit timeout doubles on each expiry, once for a burst of
+ * frames lost together, up to ARQ_MAX_TIMEOUT, and follows the round-trip
+ * time once frames are acknowledged.
+ */
+void test_rto_backoff(void) {
+  ArqSender sender(WINDOW);
+  for (uint16_t n = 0; n < 4; n++) {
+    TEST_ASSERT_TRUE(push(sender, n));
+  }
+  TEST_ASSERT_EQUAL(4, poll_all(sender).size());
+  TEST_ASSERT_EQUAL(ARQ_INITIAL_TIMEOUT, sender.timeout());
+
+  advance_millis(ARQ_INITIAL_TIMEOUT - 1);
+  TEST_ASSERT_EQUAL(0, poll_all(sender).size());
+  advance_millis(1);
+  TEST_ASSERT_EQUAL(1, poll_all(sender).size());
+  TEST_ASSERT_EQUAL(2 * ARQ_INITIAL_TIMEOUT, sender.timeout());
+  advance_millis(ARQ_INITIAL_TIMEOUT);
+  TEST_ASSERT_EQUAL(3, poll_all(sender).size());
+  TEST_ASSERT_EQUAL(2 * ARQ_INITIAL_TIMEOUT, sender.timeout());
+  TEST_ASSERT_EQUAL(4, sender.retransmissions());
+
+  uint32_t expected = 2 * ARQ_INITIAL_TIMEOUT;
+  while (expected < ARQ_MAX_TIMEOUT) {
+    advance_millis(sender.timeout());
+    TEST_ASSERT_GREATER_THAN(0, poll_all(sender).size());
+    expected = 2 * expected > ARQ_MAX_TIMEOUT ? ARQ_MAX_TIMEOUT : 2 * expected;
+    TEST_ASSERT_EQUAL(expected, sender.timeout());
+  }
+  advance_millis(ARQ_MAX_TIMEOUT);
+  TEST_ASSERT_GREATER_THAN(0, poll_all(sender).size());
+  TEST_ASSERT_EQUAL(ARQ_MAX_TIMEOUT, sender.timeout());
+
+  ArqSender   fresh(WINDOW);
+  ArqReceiver receiver(pool, WINDOW);
+  TEST_ASSERT_TRUE(push(fresh, 0));
+  std::vector<PacketComm> frames = poll_all(fresh);
+  advance_millis(400);
+  deliver(fresh, receiver, frames[0]);
+  TEST_ASSERT_EQUAL(400 + 4 * 200, fresh.timeout());
+}
+
+/**
+ * @brief A sender that restarts opens a new session, and the receiver
+ * starts over in it instead of refusing its packets, even when the new
+ * session has the old one's number.
+ */
+void test_sender_restart(void) {
+  ArqReceiver           receiver(pool, WINDOW);
+  std::vector<uint16_t> popped;
+  PacketComm            stale;
+  for (uint8_t run = 0; run < 3; run++) {
+    // The last two senders start at the same microsecond, so the last one
+    // reopens the session of the one before it.
+    reset_time();
+    advance_micros(run > 0 ? 1 : 0);
+    ArqSender sender(WINDOW);
+    popped.clear();
+    for (uint16_t n = 0; n < 10; n++) {
+      TEST_ASSERT_TRUE(push(sender, 100 * run + n));
+      if (n == 0 && run > 0) {
+        sender.acknowledge(stale);
+        TEST_ASSERT_EQUAL(1, sender.in_flight());
+      }
+      if (n == 4 || n == 9) {
+        exchange(sender, receiver, popped, 0, ARQ_SILENCE_TIMEOUT);
+      }
+    }
+    assert_numbered(popped, 100 * run, 10);
+    TEST_ASSERT_EQUAL(0, sender.in_flight());
+    receiver.acknowledgement(stale);
+  }
+}
+
+/**
+ * @brief When the receiver restarts, the sender sends the packets it still
+ * holds again in a new session, including those only the SACK bitmap
+ * covered.
+ */
+void test_receiver_restart(void) {
+  ArqSender             sender(WINDOW);
+  ArqReceiver           receiver(pool, WINDOW);
+  std::vector<uint16_t> popped;
+  for (uint16_t n = 0; n < 3; n++) {
+    TEST_ASSERT_TRUE(push(sender, n));
+  }
+  exchange(sender, receiver, popped, 0, ARQ_SILENCE_TIMEOUT);
+  uint8_t session = sender.session();
+
+  for (uint16_t n = 3; n < 7; n++) {
+    TEST_ASSERT_TRUE(push(sender, n));
+  }
+  std::vector<PacketComm> frames = poll_all(sender);
+  deliver(sender, receiver, frames[1]);
+  TEST_ASSERT_EQUAL(4, sender.in_flight());
+  receiver.reset();
+  deliver(sender, receiver, frames[2]);
+  TEST_ASSERT_NOT_EQUAL(session, sender.session());
+
+  popped.clear();
+  exchange(sender, receiver, popped, 0, ARQ_SILENCE_TIMEOUT);
+  assert_numbered(popped, 3, 4);
+  TEST_ASSERT_EQUAL(0, sender.in_flight());
+}
+
+/**
+ * @brief Once nothing has been acknowledged for ARQ_SILENCE_TIMEOUT, only
+ * the oldest packet is sent, every ARQ_MAX_TIMEOUT, and the sender picks up
+ * where it left off when the receiver answers.
+ */
+void test_silence(void) {
+  ArqSender             sender(WINDOW);
+  ArqReceiver           receiver(pool, WINDOW);
+  std::vector<uint16_t> popped;
+  for (uint16_t n = 0; n < 4; n++) {
+    TEST_ASSERT_TRUE(push(sender, n));
+  }
+  uint32_t frames = 0;
+  for (uint32_t t = 0; t < ARQ_SILENCE_TIMEOUT; t += EXCHANGE_STEP) {
+    frames += poll_all(sender).size();
+    advance_millis(EXCHANGE_STEP);
+  }
+  TEST_ASSERT_TRUE(sender.silent());
+  TEST_ASSERT_GREATER_THAN(4, frames);
+
+  std::vector<PacketComm> probes;
+  for (uint32_t t = 0; t < 5 * ARQ_MAX_TIMEOUT; t += EXCHANGE_STEP) {
+    for (const PacketComm &frame : poll_all(sender)) {
+      probes.push_back(frame);
+    }
+    advance_millis(EXCHANGE_STEP);
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(5, probes.size());
+  TEST_ASSERT_GREATER_OR_EQUAL(4, probes.size());
+  for (const PacketComm &probe : probes) {
+    TEST_ASSERT_EQUAL(0, probe.data[1] | (probe.data[2] << 8));
+  }
+
+  deliver(sender, receiver, probes.back());
+  TEST_ASSERT_FALSE(sender.silent());
+  exchange(sender, receiver, popped, 0, ARQ_SILENCE_TIMEOUT);
+  assert_numbered(popped, 0, 4);
+}
+
+/**
+ * @brief Hundreds of packets cross a link losing a third of the frames and
+ * acknowledgements each way, exactly once each and in order.
+ */
+void test_lossy_transfer(void) {
+  ArqSender             sender(WINDOW);
+  ArqReceiver           receiver(pool, WINDOW);
+  std::vector<uint16_t> popped;
+  uint16_t              pushed = 0;
+  uint32_t              steps  = 0;
+  while (popped.size() < LOSSY_PACKETS) {
+    while (pushed < LOSSY_PACKETS && push(sender, pushed)) {
+      pushed++;
+    }
+    exchange(sender, receiver, popped, 0.33f, EXCHANGE_STEP);
+    TEST_ASSERT_LESS_THAN(100000, ++steps);
+  }
+  assert_numbered(popped, 0, LOSSY_PACKETS);
+  exchange(sender, receiver, popped, 0, ARQ_SILENCE_TIMEOUT);
+  TEST_ASSERT_EQUAL(0, sender.in_flight());
+
+  char message[96];
+  snprintf(message, sizeof(message),
+           "%u packets, %u retransmissions, %u s, final RTO %u ms",
+           LOSSY_PACKETS, sender.retransmissions(), millis() / 1000,
+           sender.timeout());
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool.available());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_in_order);
+  RUN_TEST(test_sack_reordering);
+  RUN_TEST(test_fast_retransmit);
+  RUN_TEST(test_duplicates);
+  RUN_TEST(test_rto_backoff);
+  RUN_TEST(test_sender_restart);
+  RUN_TEST(test_receiver_restart);
+  RUN_TEST(test_silence);
+  RUN_TEST(test_lossy_transfer);
+  return UNITY_END();
+}
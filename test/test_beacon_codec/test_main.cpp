@@ -0,0 +1,463 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of beacon aggregation and compression.
+ *
+ * Beacons are packed the way route_beacon_to_rfm23() packs them and unpacked
+ * the way ground does. Compressed beacons are made from a synthetic trace
+ * shaped like the satellite's sensor beacons, and decoded the way ground
+ * decodes them.
+ */
+#include <beacon_aggregate.h>
+#include <beacon_codec.h>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#include <unity.h>
+
+/** @brief The size of an aggregate in these tests, as BEACON_AGGREGATE_SIZE. */
+#define AGGREGATE_SIZE    128
+/** @brief The keyframe interval in these tests, as BEACON_KEYFRAME_INTERVAL. */
+#define KEYFRAME_INTERVAL 10
+/** @brief The number of beacons of each type in the synthetic trace. */
+#define TRACE_BEACONS     1000
+
+/** @brief The state of the xorshift generator adding sensor noise. */
+static uint32_t state;
+
+void setUp(void) { state = 1; }
+
+void tearDown(void) {}
+
+/** @brief Fill a beacon with its type, then bytes counting up from it. */
+static void make_beacon(uint8_t *beacon, size_t size, uint8_t type) {
+  beacon[0] = type;
+  for (size_t i = 1; i < size; i++) {
+    beacon[i] = type + i;
+  }
+}
+
+/** @brief Beacons packed into an aggregate come back out whole, in order. */
+void test_aggregate_round_trip(void) {
+  uint8_t      aggregate[AGGREGATE_SIZE];
+  uint8_t      beacons[3][40];
+  const size_t sizes[] = {29, 1, 40};
+  size_t       length  = 0;
+  for (size_t i = 0; i < 3; i++) {
+    make_beacon(beacons[i], sizes[i], i + 1);
+    size_t next = beacon_aggregate_size(length, sizes[i]);
+    length = pack_beacon_aggregate(aggregate, length, beacons[i], sizes[i]);
+    TEST_ASSERT_EQUAL(next, length);
+  }
+  TEST_ASSERT_EQUAL(1 + 3 + 29 + 1 + 40, length);
+  TEST_ASSERT_EQUAL(BEACON_AGGREGATE_TYPE, aggregate[0]);
+
+  beacon_span found[4];
+  TEST_ASSERT_EQUAL(3, unpack_beacon_aggregate(aggregate, length, found, 4));
+  for (size_t i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL(sizes[i], found[i].size);
+    TEST_ASSERT_EQUAL_MEMORY(beacons[i], found[i].data, sizes[i]);
+  }
+}
+
+/**
+ * @brief Filling aggregates the way route_beacon_to_rfm23() does never
+ * overflows one, and every beacon lands in exactly one aggregate.
+ */
+void test_aggregate_fill(void) {
+  uint8_t  aggregate[AGGREGATE_SIZE];
+  uint8_t  beacon[AGGREGATE_SIZE];
+  size_t   length   = 0;
+  uint32_t packed   = 0;
+  uint32_t unpacked = 0;
+  uint32_t flushes  = 0;
+  auto     flush    = [&] {
+    beacon_span found[AGGREGATE_SIZE / 2];
+    int16_t     count =
+        unpack_beacon_aggregate(aggregate, length, found, AGGREGATE_SIZE / 2);
+    TEST_ASSERT_GREATER_THAN(0, count);
+    for (int16_t i = 0; i < count; i++) {
+      TEST_ASSERT_EQUAL(found[i].data[0] + 1, found[i].data[1]);
+    }
+    unpacked += count;
+    flushes++;
+    length = 0;
+  };
+  for (uint8_t n = 0; n < 200; n++) {
+    size_t size = 2 + (n * 7) % 60;
+    make_beacon(beacon, size, n);
+    if (length > 0 && beacon_aggregate_size(length, size) > AGGREGATE_SIZE) {
+      flush();
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(AGGREGATE_SIZE,
+                              beacon_aggregate_size(length, size));
+    length = pack_beacon_aggregate(aggregate, length, beacon, size);
+    packed++;
+  }
+  flush();
+  TEST_ASSERT_EQUAL(packed, unpacked);
+  TEST_ASSERT_LESS_THAN(packed / 2, flushes);
+}
+
+/** @brief Empty and oversized beacons are refused. */
+void test_aggregate_limits(void) {
+  uint8_t aggregate[BEACON_AGGREGATE_MAX + 3];
+  uint8_t beacon[BEACON_AGGREGATE_MAX + 1] = {};
+  TEST_ASSERT_EQUAL(0, pack_beacon_aggregate(aggregate, 0, beacon, 0));
+  TEST_ASSERT_EQUAL(0, pack_beacon_aggregate(aggregate, 0, beacon,
+                                             BEACON_AGGREGATE_MAX + 1));
+  TEST_ASSERT_EQUAL(BEACON_AGGREGATE_MAX + 2,
+                    pack_beacon_aggregate(aggregate, 0, beacon,
+                                          BEACON_AGGREGATE_MAX));
+}
+
+/**
+ * @brief Aggregates with the wrong type, a beacon running past the end, an
+ * empty beacon or too many beacons are rejected.
+ */
+void test_aggregate_malformed(void) {
+  beacon_span   found[2];
+  const uint8_t good[]      = {BEACON_AGGREGATE_TYPE, 1, 0xAA, 2, 0xBB, 0xCC};
+  TEST_ASSERT_EQUAL(2, unpack_beacon_aggregate(good, sizeof(good), found, 2));
+  TEST_ASSERT_EQUAL(0xCC, found[1].data[1]);
+  TEST_ASSERT_EQUAL(0, unpack_beacon_aggregate(good, 1, found, 2));
+
+  const uint8_t wrong[]     = {BEACON_AGGREGATE_TYPE + 1, 1, 0xAA};
+  const uint8_t truncated[] = {BEACON_AGGREGATE_TYPE, 3, 0xAA, 0xBB};
+  const uint8_t empty[]     = {BEACON_AGGREGATE_TYPE, 0, 1, 0xAA};
+  TEST_ASSERT_EQUAL(-1, unpack_beacon_aggregate(wrong, sizeof(wrong), found,
+                                                2));
+  TEST_ASSERT_EQUAL(-1, unpack_beacon_aggregate(truncated, sizeof(truncated),
+                                                found, 2));
+  TEST_ASSERT_EQUAL(-1, unpack_beacon_aggregate(empty, sizeof(empty), found,
+                                                2));
+  TEST_ASSERT_EQUAL(-1, unpack_beacon_aggregate(good, sizeof(good), found, 1));
+  TEST_ASSERT_EQUAL(-1, unpack_beacon_aggregate(good, 0, found, 2));
+}
+
+/** @brief A beacon type in the synthetic trace. */
+struct trace_stream {
+  /** @brief The beacon type. */
+  uint8_t type;
+  /** @brief The number of float readings. */
+  uint8_t fields;
+  /** @brief The power of ten each reading is quantized to. */
+  int8_t  exponent[BEACON_CODEC_MAX_FIELDS];
+  /** @brief The mean of each reading. */
+  float   mean[BEACON_CODEC_MAX_FIELDS];
+  /** @brief The peak noise on each reading. */
+  float   noise[BEACON_CODEC_MAX_FIELDS];
+};
+
+/**
+ * @brief The beacons of the synthetic trace, registered with the exponents
+ * setup_beacon_codec() uses: IMU accelerations, rates and temperature,
+ * magnetometer field, currents and voltages, and temperatures.
+ */
+static const trace_stream TRACE[] = {
+    {4,
+     7,
+     {-3, -3, -3, -4, -4, -4, -2},
+     {0.12f, -0.05f, 9.79f, 0.002f, -0.001f, 0.0005f, 21.5f},
+     {0.02f, 0.02f, 0.02f, 0.002f, 0.002f, 0.002f, 0.1f}},
+    {5, 3, {-2, -2, -2}, {18.4f, -7.2f, 41.9f}, {0.3f, 0.3f, 0.3f}},
+    {2,
+     4,
+     {-3, -3, -2, -2},
+     {3.301f, 5.02f, 120.0f, 88.0f},
+     {0.01f, 0.01f, 2.0f, 2.0f}},
+    {3,
+     6,
+     {-3, -3, -3, -2, -2, -2},
+     {3.3f, 5.0f, 7.4f, 45.0f, 210.0f, 600.0f},
+     {0.01f, 0.01f, 0.02f, 2.0f, 5.0f, 10.0f}},
+    {1,
+     8,
+     {-2, -2, -2, -2, -2, -2, -2, -2},
+     {20.0f, 22.5f, 19.0f, -5.0f, 31.0f, 25.0f, 24.0f, 21.0f},
+     {0.05f, 0.05f, 0.05f, 0.05f, 0.05f, 0.05f, 0.05f, 0.05f}},
+};
+
+/** @brief The number of beacon types in the synthetic trace. */
+#define TRACE_STREAMS (sizeof(TRACE) / sizeof(TRACE[0]))
+
+/** @brief A uniformly distributed number between -1 and 1. */
+static float noise() {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return (float)(state % 2001) / 1000.0f - 1.0f;
+}
+
+/** @brief Write a beacon of a type, deci and readings, as the sensors do. */
+static size_t make_sensor_beacon(uint8_t *beacon, uint8_t type,
+                                 uint32_t deci, const float *readings,
+                                 uint8_t fields) {
+  beacon[0] = type;
+  memcpy(&beacon[1], &deci, sizeof(deci));
+  memcpy(&beacon[BEACON_CODEC_HEADER], readings, 4 * fields);
+  return BEACON_CODEC_HEADER + 4 * (size_t)fields;
+}
+
+/**
+ * @brief Write the n-th beacon of a trace stream: each reading drifts slowly
+ * around its mean, over one orbit of 600 beacons, with noise on top.
+ */
+static size_t make_trace_beacon(uint8_t *beacon, const trace_stream &stream,
+                                uint32_t n) {
+  float readings[BEACON_CODEC_MAX_FIELDS];
+  for (uint8_t i = 0; i < stream.fields; i++) {
+    float drift = 10 * stream.noise[i] * sinf(n * 2 * M_PI / 600 + i);
+    readings[i] = stream.mean[i] + drift + stream.noise[i] * noise();
+  }
+  return make_sensor_beacon(beacon, stream.type, 10 * n, readings,
+                            stream.fields);
+}
+
+/** @brief Register every trace stream with an encoder. */
+static void add_trace_streams(BeaconEncoder &encoder) {
+  for (const auto &stream : TRACE) {
+    TEST_ASSERT_TRUE(
+        encoder.add_stream(stream.type, stream.exponent, stream.fields));
+  }
+}
+
+/**
+ * @brief Check that a rebuilt beacon matches the original, to within half the
+ * quantum of each reading.
+ */
+static void check_decoded(const uint8_t *original, const uint8_t *decoded,
+                          size_t size, const int8_t *exponents) {
+  TEST_ASSERT_EQUAL_MEMORY(original, decoded, BEACON_CODEC_HEADER);
+  for (size_t i = 0; BEACON_CODEC_HEADER + 4 * i < size; i++) {
+    float expected, actual;
+    memcpy(&expected, &original[BEACON_CODEC_HEADER + 4 * i], 4);
+    memcpy(&actual, &decoded[BEACON_CODEC_HEADER + 4 * i], 4);
+    float quantum = powf(10, exponents[i]);
+    TEST_ASSERT_FLOAT_WITHIN(0.51f * quantum + fabsf(expected) * 1e-6f,
+                             expected, actual);
+  }
+}
+
+/**
+ * @brief Every beacon of the trace survives the codec, a keyframe is sent
+ * every KEYFRAME_INTERVAL beacons of each type, and the 7-bit sequence number
+ * wraps without breaking the chain of deltas.
+ */
+void test_codec_round_trip(void) {
+  BeaconEncoder encoder(KEYFRAME_INTERVAL);
+  BeaconDecoder decoder;
+  add_trace_streams(encoder);
+  for (uint32_t n = 0; n < 300; n++) {
+    for (const auto &stream : TRACE) {
+      uint8_t beacon[BEACON_CODEC_MAX_DECODED];
+      uint8_t encoded[BEACON_CODEC_MAX_ENCODED];
+      uint8_t decoded[BEACON_CODEC_MAX_DECODED];
+      size_t  size   = make_trace_beacon(beacon, stream, n);
+      size_t  length = encoder.encode(beacon, size, encoded);
+      TEST_ASSERT_GREATER_THAN(0, length);
+      TEST_ASSERT_EQUAL(stream.type, encoded[0]);
+      TEST_ASSERT_EQUAL(n % KEYFRAME_INTERVAL == 0,
+                        (encoded[1] & BEACON_CODEC_KEYFRAME) != 0);
+      TEST_ASSERT_EQUAL((n + 1) & 0x7F, encoded[1] & 0x7F);
+      TEST_ASSERT_EQUAL(size, decoder.decode(encoded, length, decoded));
+      check_decoded(beacon, decoded, size, stream.exponent);
+    }
+  }
+}
+
+/**
+ * @brief A lost delta breaks every later delta of its type, and only its
+ * type, until the next keyframe, which the encoder also sends after reset().
+ * A restarted decoder waits for a keyframe.
+ */
+void test_codec_lost_delta(void) {
+  BeaconEncoder encoder(KEYFRAME_INTERVAL);
+  BeaconDecoder decoder;
+  add_trace_streams(encoder);
+  uint8_t beacon[BEACON_CODEC_MAX_DECODED];
+  uint8_t encoded[BEACON_CODEC_MAX_ENCODED];
+  uint8_t decoded[BEACON_CODEC_MAX_DECODED];
+  auto    send = [&](const trace_stream &stream, uint32_t n, bool lost) {
+    size_t size   = make_trace_beacon(beacon, stream, n);
+    size_t length = encoder.encode(beacon, size, encoded);
+    TEST_ASSERT_GREATER_THAN(0, length);
+    return lost ? 0 : decoder.decode(encoded, length, decoded);
+  };
+
+  for (uint32_t n = 0; n < 2 * KEYFRAME_INTERVAL; n++) {
+    bool   broken = n >= 3 && n < KEYFRAME_INTERVAL;
+    size_t size   = send(TRACE[0], n, n == 3);
+    TEST_ASSERT_EQUAL(broken ? 0 : BEACON_CODEC_HEADER + 4 * TRACE[0].fields,
+                      size);
+    TEST_ASSERT_GREATER_THAN(0, send(TRACE[1], n, false));
+  }
+
+  send(TRACE[0], 20, true);
+  TEST_ASSERT_EQUAL(0, send(TRACE[0], 21, false));
+  encoder.reset();
+  TEST_ASSERT_GREATER_THAN(0, send(TRACE[0], 22, false));
+  TEST_ASSERT_TRUE(encoded[1] & BEACON_CODEC_KEYFRAME);
+  TEST_ASSERT_GREATER_THAN(0, send(TRACE[0], 23, false));
+
+  decoder.reset();
+  TEST_ASSERT_EQUAL(0, send(TRACE[0], 24, false));
+  encoder.reset();
+  TEST_ASSERT_GREATER_THAN(0, send(TRACE[0], 25, false));
+  check_decoded(beacon, decoded, BEACON_CODEC_HEADER + 4 * TRACE[0].fields,
+                TRACE[0].exponent);
+}
+
+/**
+ * @brief Readings at the edge of the quantization, deltas that need every
+ * byte of a varint, a wrapping deci and negative exponents survive the
+ * codec. Readings the quantization cannot hold, and beacons without a
+ * stream, are left uncompressed.
+ */
+void test_codec_edges(void) {
+  const int8_t  exponents[] = {0, 0, -8, 7};
+  BeaconEncoder encoder(100);
+  BeaconDecoder decoder;
+  TEST_ASSERT_TRUE(encoder.add_stream(7, exponents, 4));
+  uint8_t beacon[BEACON_CODEC_MAX_DECODED];
+  uint8_t encoded[BEACON_CODEC_MAX_ENCODED];
+  uint8_t decoded[BEACON_CODEC_MAX_DECODED];
+
+  const float    steps[][4] = {{1e9f, -1e9f, 1.5e-8f, 1e14f},
+                               {-1e9f, 1e9f, -1.5e-8f, -1e14f},
+                               {0.0f, -0.0f, 0.0f, 0.0f},
+                               {1.0f, -1.0f, 1e-8f, 1e7f},
+                               {-1e9f, 1e9f, -2e-8f, -1e16f}};
+  const uint32_t decis[]    = {0xFFFFFFF0, 0x00000010, 0, 0xFFFFFFFF, 1};
+  for (size_t n = 0; n < 5; n++) {
+    size_t size   = make_sensor_beacon(beacon, 7, decis[n], steps[n], 4);
+    size_t length = encoder.encode(beacon, size, encoded);
+    TEST_ASSERT_GREATER_THAN(0, length);
+    TEST_ASSERT_LESS_OR_EQUAL(BEACON_CODEC_MAX_ENCODED, length);
+    TEST_ASSERT_EQUAL(size, decoder.decode(encoded, length, decoded));
+    check_decoded(beacon, decoded, size, exponents);
+    if (n == 1) {
+      TEST_ASSERT_EQUAL(2 + 1 + 5 + 5 + 1 + 4, length);
+    }
+  }
+
+  const float bad[][4] = {{1.1e9f, 0, 0, 0},
+                          {NAN, 0, 0, 0},
+                          {0, INFINITY, 0, 0},
+                          {0, 0, 0, 1e17f}};
+  for (const auto &readings : bad) {
+    size_t size = make_sensor_beacon(beacon, 7, 0, readings, 4);
+    TEST_ASSERT_EQUAL(0, encoder.encode(beacon, size, encoded));
+  }
+  size_t size = make_sensor_beacon(beacon, 8, 0, steps[3], 4);
+  TEST_ASSERT_EQUAL(0, encoder.encode(beacon, size, encoded));
+  size = make_sensor_beacon(beacon, 7, 0, steps[3], 3);
+  TEST_ASSERT_EQUAL(0, encoder.encode(beacon, size, encoded));
+  TEST_ASSERT_FALSE(encoder.add_stream(0, exponents, 4));
+  TEST_ASSERT_FALSE(encoder.add_stream(9, exponents, 0));
+  const int8_t out_of_range[] = {8};
+  TEST_ASSERT_FALSE(encoder.add_stream(9, out_of_range, 1));
+}
+
+/**
+ * @brief Truncated, overlong and unknown compressed beacons are refused.
+ */
+void test_codec_malformed(void) {
+  BeaconDecoder decoder;
+  uint8_t       decoded[BEACON_CODEC_MAX_DECODED];
+  const uint8_t keyframe[] = {7, 0x81, 5, 2, 0x00, 2, 3};
+  TEST_ASSERT_EQUAL(BEACON_CODEC_HEADER + 8,
+                    decoder.decode(keyframe, sizeof(keyframe), decoded));
+  float reading;
+  memcpy(&reading, &decoded[BEACON_CODEC_HEADER + 4], 4);
+  TEST_ASSERT_EQUAL_FLOAT(-2.0f, reading);
+
+  const uint8_t delta[]    = {7, 0x02, 10, 1, 1};
+  const uint8_t long_var[] = {7, 0x02, 0x80, 0x80, 0x80, 0x80, 0x80, 1, 1, 1};
+  for (size_t cut = 0; cut < sizeof(keyframe); cut++) {
+    TEST_ASSERT_EQUAL(0, decoder.decode(keyframe, cut, decoded));
+  }
+  TEST_ASSERT_EQUAL(0, decoder.decode(delta, sizeof(delta) - 1, decoded));
+  TEST_ASSERT_EQUAL(0, decoder.decode(long_var, sizeof(long_var), decoded));
+  TEST_ASSERT_EQUAL(BEACON_CODEC_HEADER + 8,
+                    decoder.decode(delta, sizeof(delta), decoded));
+  TEST_ASSERT_EQUAL(0, decoder.decode(delta, sizeof(delta), decoded));
+
+  const uint8_t orphan[] = {8, 0x01, 0, 0};
+  const uint8_t fields[] = {8, 0x81, 0, BEACON_CODEC_MAX_FIELDS + 1};
+  TEST_ASSERT_EQUAL(0, decoder.decode(orphan, sizeof(orphan), decoded));
+  TEST_ASSERT_EQUAL(0, decoder.decode(fields, sizeof(fields), decoded));
+}
+
+/**
+ * @brief Measures how much the codec shrinks the synthetic trace, and how
+ * long an encode takes on the host.
+ */
+void test_codec_compression(void) {
+  using clock = std::chrono::steady_clock;
+  BeaconEncoder encoder(KEYFRAME_INTERVAL);
+  BeaconDecoder decoder;
+  add_trace_streams(encoder);
+  static uint8_t beacons[TRACE_BEACONS][TRACE_STREAMS]
+                        [BEACON_CODEC_MAX_DECODED];
+  static size_t  sizes[TRACE_BEACONS][TRACE_STREAMS];
+  static uint8_t encoded[TRACE_BEACONS][TRACE_STREAMS]
+                        [BEACON_CODEC_MAX_ENCODED];
+  static size_t  lengths[TRACE_BEACONS][TRACE_STREAMS];
+  for (uint32_t n = 0; n < TRACE_BEACONS; n++) {
+    for (size_t s = 0; s < TRACE_STREAMS; s++) {
+      sizes[n][s] = make_trace_beacon(beacons[n][s], TRACE[s], n);
+    }
+  }
+
+  auto start = clock::now();
+  for (uint32_t n = 0; n < TRACE_BEACONS; n++) {
+    for (size_t s = 0; s < TRACE_STREAMS; s++) {
+      lengths[n][s] = encoder.encode(beacons[n][s], sizes[n][s],
+                                     encoded[n][s]);
+    }
+  }
+  double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+  char   text[120];
+  size_t raw_total     = 0;
+  size_t encoded_total = 0;
+  for (size_t s = 0; s < TRACE_STREAMS; s++) {
+    size_t raw     = 0;
+    size_t written = 0;
+    for (uint32_t n = 0; n < TRACE_BEACONS; n++) {
+      uint8_t decoded[BEACON_CODEC_MAX_DECODED];
+      TEST_ASSERT_GREATER_THAN(0, lengths[n][s]);
+      TEST_ASSERT_EQUAL(sizes[n][s], decoder.decode(encoded[n][s],
+                                                    lengths[n][s], decoded));
+      raw     += sizes[n][s];
+      written += lengths[n][s];
+    }
+    snprintf(text, sizeof(text),
+             "Type %u: %.1f bytes per beacon, down from %.1f (%.2fx)",
+             TRACE[s].type, (double)written / TRACE_BEACONS,
+             (double)raw / TRACE_BEACONS, (double)raw / written);
+    TEST_MESSAGE(text);
+    raw_total     += raw;
+    encoded_total += written;
+  }
+  snprintf(text, sizeof(text),
+           "Overall %.2fx smaller, %.0f ns per encode on the host",
+           (double)raw_total / encoded_total,
+           elapsed * 1e9 / (TRACE_BEACONS * TRACE_STREAMS));
+  TEST_MESSAGE(text);
+  TEST_ASSERT_GREATER_THAN(2 * encoded_total, raw_total);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_aggregate_round_trip);
+  RUN_TEST(test_aggregate_fill);
+  RUN_TEST(test_aggregate_limits);
+  RUN_TEST(test_aggregate_malformed);
+  RUN_TEST(test_codec_round_trip);
+  RUN_TEST(test_codec_lost_delta);
+  RUN_TEST(test_codec_edges);
+  RUN_TEST(test_codec_malformed);
+  RUN_TEST(test_codec_compression);
+  return UNITY_END();
+}
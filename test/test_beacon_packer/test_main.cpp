@@ -0,0 +1,203 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the beacon packer.
+ *
+ * The packer takes its packets from a pool and hands each finished one to a
+ * stand-in route, which keeps it so the test can unpack it the way ground
+ * does.
+ */
+#include <beacon_packer.h>
+#include <unity.h>
+
+/** @brief The size of an aggregate in these tests, as BEACON_AGGREGATE_SIZE. */
+#define AGGREGATE_SIZE    128
+/** @brief The deadline in these tests, as BEACON_AGGREGATE_DEADLINE. */
+#define AGGREGATE_TIME    1000
+/** @brief The keyframe interval in these tests, as BEACON_KEYFRAME_INTERVAL. */
+#define KEYFRAME_INTERVAL 10
+/** @brief The type of the compressed beacon in these tests. */
+#define COMPRESSED_TYPE   4
+
+/** @brief The pool the packer's packets are taken from. */
+static PacketPool           pool;
+/** @brief The packets the packer has sent, oldest first. */
+static vector<PacketHandle> sent;
+
+/** @brief Take a packet for the packer from the pool. */
+static PacketHandle take() { return pool.acquire(); }
+
+/** @brief Keep a packet the packer sent. */
+static PushResult keep(PacketHandle packet) {
+  sent.push_back(std::move(packet));
+  return PushResult::Accepted;
+}
+
+void setUp(void) {
+  reset_time();
+  sent.clear();
+}
+
+void tearDown(void) { sent.clear(); }
+
+/** @brief Fill a beacon with its type, then bytes counting up from it. */
+static void make_beacon(uint8_t *beacon, size_t size, uint8_t type) {
+  beacon[0] = type;
+  for (size_t i = 1; i < size; i++) {
+    beacon[i] = type + i;
+  }
+}
+
+/** @brief Unpack a sent aggregate, checking it holds the expected beacons. */
+static void check_aggregate(const PacketHandle &packet, uint8_t first,
+                            int16_t count, size_t size) {
+  beacon_span found[AGGREGATE_SIZE / 2];
+  TEST_ASSERT_EQUAL(count,
+                    unpack_beacon_aggregate(packet->data.data(),
+                                            packet->data.size(), found,
+                                            AGGREGATE_SIZE / 2));
+  uint8_t beacon[AGGREGATE_SIZE];
+  for (int16_t i = 0; i < count; i++) {
+    make_beacon(beacon, size, first + i);
+    TEST_ASSERT_EQUAL(size, found[i].size);
+    TEST_ASSERT_EQUAL_MEMORY(beacon, found[i].data, size);
+  }
+}
+
+/**
+ * @brief Beacons wait in the aggregate until the next one would not fit, and
+ * flush() sends the rest, so every packet but the last is as full as whole
+ * beacons make it.
+ */
+void test_aggregate_until_full(void) {
+  BeaconEncoder encoder(KEYFRAME_INTERVAL);
+  BeaconPacker  packer(encoder, AGGREGATE_SIZE, AGGREGATE_TIME, take, keep);
+  uint8_t       beacon[30];
+  // 1 + 4 * 31 bytes fill an aggregate, and a fifth beacon does not fit.
+  for (uint8_t n = 0; n < 10; n++) {
+    make_beacon(beacon, sizeof(beacon), n + 1);
+    TEST_ASSERT_TRUE(packer.add(beacon, sizeof(beacon)) ==
+                     PushResult::Accepted);
+    TEST_ASSERT_EQUAL(n / 4, sent.size());
+  }
+  TEST_ASSERT_TRUE(packer.flush() == PushResult::Accepted);
+  TEST_ASSERT_EQUAL(3, sent.size());
+  check_aggregate(sent[0], 1, 4, sizeof(beacon));
+  check_aggregate(sent[1], 5, 4, sizeof(beacon));
+  check_aggregate(sent[2], 9, 2, sizeof(beacon));
+  TEST_ASSERT_EQUAL(1 + 4 * 31, sent[0]->data.size());
+
+  TEST_ASSERT_TRUE(packer.flush() == PushResult::Accepted);
+  TEST_ASSERT_EQUAL(3, sent.size());
+}
+
+/**
+ * @brief A beacon too large to share a packet is sent on its own, as it is,
+ * without flushing the aggregate, and a packer with no room sends every
+ * beacon that way.
+ */
+void test_beacon_alone(void) {
+  BeaconEncoder encoder(KEYFRAME_INTERVAL);
+  BeaconPacker  packer(encoder, AGGREGATE_SIZE, AGGREGATE_TIME, take, keep);
+  uint8_t       small[20];
+  uint8_t       large[AGGREGATE_SIZE];
+  make_beacon(small, sizeof(small), 1);
+  make_beacon(large, sizeof(large), 2);
+  packer.add(small, sizeof(small));
+  packer.add(large, sizeof(large));
+  TEST_ASSERT_EQUAL(1, sent.size());
+  TEST_ASSERT_EQUAL(sizeof(large), sent[0]->data.size());
+  TEST_ASSERT_EQUAL_MEMORY(large, sent[0]->data.data(), sizeof(large));
+  packer.flush();
+  TEST_ASSERT_EQUAL(2, sent.size());
+  check_aggregate(sent[1], 1, 1, sizeof(small));
+
+  BeaconPacker unpacked(encoder, 0, AGGREGATE_TIME, take, keep);
+  unpacked.add(small, sizeof(small));
+  TEST_ASSERT_EQUAL(3, sent.size());
+  TEST_ASSERT_EQUAL_MEMORY(small, sent[2]->data.data(), sizeof(small));
+}
+
+/**
+ * @brief A beacon of a registered type is compressed into a
+ * BEACON_CODEC_TYPE beacon, which ground decodes back into the original.
+ */
+void test_compressed(void) {
+  BeaconEncoder encoder(KEYFRAME_INTERVAL);
+  BeaconDecoder decoder;
+  BeaconPacker  packer(encoder, AGGREGATE_SIZE, AGGREGATE_TIME, take, keep);
+  const int8_t  exponents[] = {-2, -2};
+  TEST_ASSERT_TRUE(encoder.add_stream(COMPRESSED_TYPE, exponents, 2));
+  struct __attribute__((packed)) {
+    uint8_t  type     = COMPRESSED_TYPE;
+    uint32_t deci     = 1234;
+    float    value[2] = {21.5f, -3.25f};
+  } beacon;
+  packer.add(&beacon, sizeof(beacon));
+  packer.flush();
+  TEST_ASSERT_EQUAL(1, sent.size());
+
+  beacon_span found[1];
+  TEST_ASSERT_EQUAL(1, unpack_beacon_aggregate(sent[0]->data.data(),
+                                               sent[0]->data.size(), found, 1));
+  TEST_ASSERT_EQUAL(BEACON_CODEC_TYPE, found[0].data[0]);
+  TEST_ASSERT_LESS_THAN(sizeof(beacon) + 1, found[0].size);
+  uint8_t decoded[BEACON_CODEC_MAX_DECODED];
+  TEST_ASSERT_EQUAL(sizeof(beacon), decoder.decode(found[0].data + 1,
+                                                   found[0].size - 1, decoded));
+  TEST_ASSERT_EQUAL_MEMORY(&beacon, decoded, sizeof(beacon));
+}
+
+/**
+ * @brief flush_if_due() sends the aggregate once its first beacon has waited
+ * the deadline, however many beacons joined it since.
+ */
+void test_deadline(void) {
+  BeaconEncoder encoder(KEYFRAME_INTERVAL);
+  BeaconPacker  packer(encoder, AGGREGATE_SIZE, AGGREGATE_TIME, take, keep);
+  uint8_t       beacon[10];
+  packer.flush_if_due();
+  TEST_ASSERT_EQUAL(0, sent.size());
+  for (uint8_t n = 0; n < 3; n++) {
+    make_beacon(beacon, sizeof(beacon), n + 1);
+    packer.add(beacon, sizeof(beacon));
+    advance_millis(AGGREGATE_TIME / 3);
+    packer.flush_if_due();
+    TEST_ASSERT_EQUAL(0, sent.size());
+  }
+  advance_millis(AGGREGATE_TIME - 3 * (AGGREGATE_TIME / 3));
+  packer.flush_if_due();
+  TEST_ASSERT_EQUAL(1, sent.size());
+  check_aggregate(sent[0], 1, 3, sizeof(beacon));
+}
+
+/** @brief A beacon is rejected when the pool has no packet to put it in. */
+void test_pool_exhausted(void) {
+  BeaconEncoder        encoder(KEYFRAME_INTERVAL);
+  BeaconPacker         packer(encoder, AGGREGATE_SIZE, AGGREGATE_TIME, take,
+                              keep);
+  vector<PacketHandle> held;
+  while (PacketHandle packet = pool.acquire()) {
+    held.push_back(std::move(packet));
+  }
+  uint8_t small[10];
+  uint8_t large[AGGREGATE_SIZE];
+  make_beacon(small, sizeof(small), 1);
+  make_beacon(large, sizeof(large), 2);
+  TEST_ASSERT_TRUE(packer.add(small, sizeof(small)) == PushResult::Rejected);
+  TEST_ASSERT_TRUE(packer.add(large, sizeof(large)) == PushResult::Rejected);
+  held.pop_back();
+  TEST_ASSERT_TRUE(packer.add(small, sizeof(small)) == PushResult::Accepted);
+  packer.flush();
+  TEST_ASSERT_EQUAL(1, sent.size());
+  check_aggregate(sent[0], 1, 1, sizeof(small));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_aggregate_until_full);
+  RUN_TEST(test_beacon_alone);
+  RUN_TEST(test_compressed);
+  RUN_TEST(test_deadline);
+  RUN_TEST(test_pool_exhausted);
+  return UNITY_END();
+}
@@ -0,0 +1,351 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the chunked file downlink.
+ *
+ * A stand-in RPi answers the downlink's read requests from a file in memory,
+ * and a stand-in ground station writes every chunk it is sent into its copy
+ * of the file. Time is simulated, so read timeouts are checked exactly.
+ */
+#include <algorithm>
+#include <file_downlink.h>
+#include <unity.h>
+#include <vector>
+
+/** @brief The most file bytes in each chunk, as the RPi channel sets it. */
+#define CHUNK     58
+/** @brief The ID of the file on the stand-in RPi. */
+#define FILE_ID   7
+/** @brief The size of the file on the stand-in RPi. */
+#define FILE_SIZE 20000
+
+using bytes = std::vector<uint8_t>;
+
+/** @brief The state of the xorshift generator making file contents. */
+static uint32_t state;
+
+void setUp(void) {
+  state = 1;
+  reset_time();
+}
+
+void tearDown(void) {}
+
+/** @brief The next number from the xorshift generator. */
+static uint32_t next_random() {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/** @brief Read a little-endian integer of the given size from a packet. */
+static uint32_t get_le(const PacketComm &packet, size_t at, uint8_t size) {
+  uint32_t value = 0;
+  for (uint8_t i = 0; i < size; i++) {
+    value |= (uint32_t)packet.data[at + i] << (8 * i);
+  }
+  return value;
+}
+
+/** @brief Append a little-endian integer of the given size to a packet. */
+static void put_le(PacketComm &packet, uint32_t value, uint8_t size) {
+  for (uint8_t i = 0; i < size; i++) {
+    packet.data.push_back(value >> (8 * i));
+  }
+}
+
+/** @brief The RPi's end of a file downlink, holding one file. */
+struct stand_in_pi {
+  /** @brief The file's bytes. */
+  bytes                 file;
+  /** @brief The number of read requests answered from the file. */
+  uint32_t              reads = 0;
+  /** @brief The offset of every read answered from the file. */
+  std::vector<uint32_t> offsets;
+
+  /** @brief Answer a read request with a chunk of the file. */
+  void answer(const PacketComm &request, PacketComm &chunk) {
+    TEST_ASSERT_EQUAL(FILE_READ_HEADER, request.data.size());
+    uint16_t id     = get_le(request, 0, 2);
+    uint32_t offset = get_le(request, 2, 4);
+    uint32_t length = get_le(request, 6, 2);
+    TEST_ASSERT_LESS_OR_EQUAL(FILE_READ_SIZE, length);
+    chunk.data.clear();
+    put_le(chunk, id, 2);
+    put_le(chunk, offset, 4);
+    if (id != FILE_ID) {
+      put_le(chunk, FILE_SIZE_MISSING, 4);
+      return;
+    }
+    put_le(chunk, file.size(), 4);
+    if (offset < file.size()) {
+      length = std::min<uint32_t>(length, file.size() - offset);
+      chunk.data.insert(chunk.data.end(), &file[offset],
+                        &file[offset] + length);
+    }
+    reads++;
+    offsets.push_back(offset);
+  }
+};
+
+/** @brief Ground's end of a file downlink, writing chunks into place. */
+struct stand_in_ground {
+  /** @brief Ground's copy of the file. */
+  bytes    file;
+  /** @brief The offset just past the last byte received. */
+  uint32_t next   = 0;
+  /** @brief The number of chunks received. */
+  uint32_t chunks = 0;
+  /** @brief The file size the last chunk reported. */
+  uint32_t size   = 0;
+
+  /** @brief Write a chunk into place, checking it follows the last one. */
+  void take(const PacketComm &chunk) {
+    TEST_ASSERT_GREATER_OR_EQUAL(FILE_CHUNK_HEADER, chunk.data.size());
+    TEST_ASSERT_EQUAL(FILE_ID, get_le(chunk, 0, 2));
+    uint32_t offset = get_le(chunk, 2, 4);
+    size            = get_le(chunk, 6, 4);
+    size_t length   = chunk.data.size() - FILE_CHUNK_HEADER;
+    TEST_ASSERT_LESS_OR_EQUAL(CHUNK, length);
+    TEST_ASSERT_EQUAL(next, offset);
+    if (file.size() < offset + length) {
+      file.resize(offset + length);
+    }
+    std::copy(chunk.data.begin() + FILE_CHUNK_HEADER, chunk.data.end(),
+              file.begin() + offset);
+    next = offset + length;
+    chunks++;
+  }
+};
+
+/** @brief A stand-in RPi holding FILE_SIZE random bytes. */
+static stand_in_pi make_pi() {
+  stand_in_pi pi;
+  pi.file.resize(FILE_SIZE);
+  for (auto &byte : pi.file) {
+    byte = next_random() >> 16;
+  }
+  return pi;
+}
+
+/**
+ * @brief Run a transfer until it ends or ground has taken a number of
+ * chunks, answering every read request at once.
+ *
+ * @return uint32_t The number of chunks ground took.
+ */
+static uint32_t pump(FileDownlink &downlink, stand_in_pi &pi,
+                     stand_in_ground &ground, uint32_t most = UINT32_MAX) {
+  PacketComm request;
+  PacketComm chunk;
+  uint32_t   taken = 0;
+  while (downlink.active() && taken < most) {
+    if (downlink.read_request(request)) {
+      pi.answer(request, chunk);
+      TEST_ASSERT_TRUE(downlink.receive(chunk));
+    }
+    while (taken < most && downlink.next_chunk(chunk)) {
+      ground.take(chunk);
+      taken++;
+    }
+  }
+  return taken;
+}
+
+/** @brief Check ground's copy matches the file from an offset on. */
+static void check_copy(const stand_in_pi &pi, const stand_in_ground &ground,
+                       uint32_t from) {
+  TEST_ASSERT_EQUAL(pi.file.size(), ground.file.size());
+  TEST_ASSERT_EQUAL(pi.file.size(), ground.size);
+  TEST_ASSERT_EQUAL_MEMORY(&pi.file[from], &ground.file[from],
+                           pi.file.size() - from);
+}
+
+/**
+ * @brief A whole file comes down in full chunks, bar the last, and the
+ * transfer ends with the last byte.
+ */
+void test_whole_file(void) {
+  stand_in_pi     pi = make_pi();
+  stand_in_ground ground;
+  FileDownlink    downlink(CHUNK);
+  downlink.start(FILE_ID, 0);
+  TEST_ASSERT_TRUE(downlink.active());
+  uint32_t taken = pump(downlink, pi, ground);
+  TEST_ASSERT_FALSE(downlink.active());
+  TEST_ASSERT_EQUAL((FILE_SIZE + CHUNK - 1) / CHUNK, taken);
+  TEST_ASSERT_EQUAL((FILE_SIZE + FILE_READ_SIZE - 1) / FILE_READ_SIZE,
+                    pi.reads);
+  check_copy(pi, ground, 0);
+}
+
+/**
+ * @brief The staging ring fills to its last whole read and no further, and
+ * reads and chunks that cross the end of the ring wrap around it intact.
+ */
+void test_stage_wraps(void) {
+  stand_in_pi     pi = make_pi();
+  stand_in_ground ground;
+  FileDownlink    downlink(CHUNK);
+  const uint32_t  from = FILE_STAGE_SIZE - 1000;
+  downlink.start(FILE_ID, from);
+  ground.next = from;
+
+  PacketComm request;
+  PacketComm chunk;
+  while (downlink.read_request(request)) {
+    pi.answer(request, chunk);
+    TEST_ASSERT_TRUE(downlink.receive(chunk));
+  }
+  TEST_ASSERT_EQUAL(FILE_STAGE_SIZE / FILE_READ_SIZE, pi.reads);
+  TEST_ASSERT_EQUAL(FILE_STAGE_SIZE, downlink.staged());
+  TEST_ASSERT_GREATER_THAN(FILE_STAGE_SIZE,
+                           (pi.offsets[0] & (FILE_STAGE_SIZE - 1)) +
+                               FILE_READ_SIZE);
+
+  // A chunk's worth of room is not a whole read's.
+  TEST_ASSERT_TRUE(downlink.next_chunk(chunk));
+  ground.take(chunk);
+  TEST_ASSERT_FALSE(downlink.read_request(request));
+
+  pump(downlink, pi, ground);
+  TEST_ASSERT_FALSE(downlink.active());
+  check_copy(pi, ground, from);
+}
+
+/**
+ * @brief A transfer cut short by the end of a pass resumes from the first
+ * byte ground is missing: from the staging ring if the byte is still in it,
+ * and from the RPi after a reboot, or if the byte has left the ring.
+ */
+void test_resume(void) {
+  stand_in_pi     pi = make_pi();
+  stand_in_ground ground;
+  FileDownlink    downlink(CHUNK);
+  downlink.start(FILE_ID, 0);
+  pump(downlink, pi, ground, 100);
+  TEST_ASSERT_TRUE(downlink.active());
+
+  // Ground heard all but the last 3 chunks of the pass, which are resent
+  // from the staging ring rather than read again.
+  uint32_t staged_to = downlink.offset() + downlink.staged();
+  uint32_t missing   = ground.next - 3 * CHUNK;
+  uint32_t reads     = pi.reads;
+  ground.next        = missing;
+  downlink.start(FILE_ID, missing);
+  TEST_ASSERT_EQUAL(missing, downlink.offset());
+  TEST_ASSERT_EQUAL(staged_to - missing, downlink.staged());
+  pump(downlink, pi, ground, 150);
+  TEST_ASSERT_GREATER_THAN(reads, pi.reads);
+  TEST_ASSERT_EQUAL(staged_to, pi.offsets[reads]);
+
+  // A byte since overwritten in the ring is read from the RPi again.
+  missing     = downlink.offset() + downlink.staged() - FILE_STAGE_SIZE - 1;
+  reads       = pi.reads;
+  ground.next = missing;
+  downlink.start(FILE_ID, missing);
+  TEST_ASSERT_EQUAL(0, downlink.staged());
+  pump(downlink, pi, ground, 20);
+  TEST_ASSERT_EQUAL(missing, pi.offsets[reads]);
+
+  // The Teensy reboots, and ground asks again from its first missing byte.
+  PacketComm   request;
+  PacketComm   chunk;
+  FileDownlink rebooted(CHUNK);
+  missing = ground.next;
+  rebooted.start(FILE_ID, missing);
+  TEST_ASSERT_EQUAL(0, rebooted.staged());
+  TEST_ASSERT_TRUE(rebooted.read_request(request));
+  TEST_ASSERT_EQUAL(FILE_ID, get_le(request, 0, 2));
+  TEST_ASSERT_EQUAL(missing, get_le(request, 2, 4));
+  pi.answer(request, chunk);
+  TEST_ASSERT_TRUE(rebooted.receive(chunk));
+  pump(rebooted, pi, ground, 50);
+
+  // Ground lost more than was staged since the reboot, so the bytes are read
+  // from the RPi again.
+  missing     = ground.next - 60 * CHUNK;
+  ground.next = missing;
+  rebooted.start(FILE_ID, missing);
+  TEST_ASSERT_EQUAL(0, rebooted.staged());
+  TEST_ASSERT_TRUE(rebooted.read_request(request));
+  TEST_ASSERT_EQUAL(missing, get_le(request, 2, 4));
+  pi.answer(request, chunk);
+  TEST_ASSERT_TRUE(rebooted.receive(chunk));
+  pump(rebooted, pi, ground);
+  TEST_ASSERT_FALSE(rebooted.active());
+  check_copy(pi, ground, 0);
+}
+
+/**
+ * @brief An unanswered read is asked again every FILE_READ_TIMEOUT, for the
+ * same bytes, and the transfer is dropped after FILE_READ_ATTEMPTS. A late
+ * answer is still taken, and starts the count again.
+ */
+void test_retry_exhaustion(void) {
+  stand_in_pi  pi = make_pi();
+  FileDownlink downlink(CHUNK);
+  PacketComm   request;
+  PacketComm   chunk;
+  downlink.start(FILE_ID, 0);
+
+  std::vector<uint32_t> asked;
+  for (uint32_t t = 0; t < 10 * FILE_READ_TIMEOUT; t += 100) {
+    if (downlink.read_request(request)) {
+      TEST_ASSERT_EQUAL(pi.reads * FILE_READ_SIZE, get_le(request, 2, 4));
+      asked.push_back(millis());
+    }
+    if (asked.size() == 3 && pi.reads == 0) {
+      pi.answer(request, chunk);
+      TEST_ASSERT_TRUE(downlink.receive(chunk));
+      TEST_ASSERT_EQUAL(FILE_READ_SIZE, downlink.staged());
+    }
+    advance_millis(100);
+  }
+  TEST_ASSERT_FALSE(downlink.active());
+  TEST_ASSERT_FALSE(downlink.receive(chunk));
+
+  // Three reads of the first bytes, the third answered, then
+  // FILE_READ_ATTEMPTS reads of the next, a FILE_READ_TIMEOUT apart.
+  TEST_ASSERT_EQUAL(3 + FILE_READ_ATTEMPTS, asked.size());
+  for (size_t i = 1; i < asked.size(); i++) {
+    if (i != 3) {
+      TEST_ASSERT_EQUAL(FILE_READ_TIMEOUT, asked[i] - asked[i - 1]);
+    }
+  }
+  TEST_ASSERT_FALSE(downlink.read_request(request));
+}
+
+/**
+ * @brief A file the RPi does not have, or an offset past its end, ends the
+ * transfer with a chunk of no bytes.
+ */
+void test_missing_file(void) {
+  stand_in_pi  pi = make_pi();
+  FileDownlink downlink(CHUNK);
+  PacketComm   request;
+  PacketComm   chunk;
+  for (uint32_t offset : {(uint32_t)0, (uint32_t)FILE_SIZE + 5}) {
+    downlink.start(offset == 0 ? FILE_ID + 1 : FILE_ID, offset);
+    TEST_ASSERT_TRUE(downlink.read_request(request));
+    pi.answer(request, chunk);
+    TEST_ASSERT_TRUE(downlink.receive(chunk));
+    TEST_ASSERT_TRUE(downlink.next_chunk(chunk));
+    TEST_ASSERT_EQUAL(FILE_CHUNK_HEADER, chunk.data.size());
+    TEST_ASSERT_EQUAL(offset, get_le(chunk, 2, 4));
+    TEST_ASSERT_EQUAL(offset == 0 ? FILE_SIZE_MISSING : FILE_SIZE,
+                      get_le(chunk, 6, 4));
+    TEST_ASSERT_FALSE(downlink.active());
+    TEST_ASSERT_FALSE(downlink.next_chunk(chunk));
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_whole_file);
+  RUN_TEST(test_stage_wraps);
+  RUN_TEST(test_resume);
+  RUN_TEST(test_retry_exhaustion);
+  RUN_TEST(test_missing_file);
+  return UNITY_END();
+}
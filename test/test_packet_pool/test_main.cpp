@@ -0,0 +1,212 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests and an allocation benchmark of the static packet pool.
+ *
+ * Global operator new is replaced with one that counts allocations, so the
+ * benchmark can check that circulating packets stops allocating once every
+ * buffer has been used.
+ */
+#include <chrono>
+#include <new>
+#include <packet_pool.h>
+#include <stdlib.h>
+#include <unity.h>
+
+/** @brief The number of packets passed through the benchmark. */
+#define BENCHMARK_PACKETS 100000
+/** @brief The size of each benchmark packet's data. */
+#define BENCHMARK_DATA    200
+
+/** @brief The number of heap allocations made so far. */
+static std::atomic<uint32_t> allocations{0};
+
+void *operator new(size_t size) {
+  allocations++;
+  void *memory = malloc(size ? size : 1);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+
+void operator delete(void *memory, size_t size) noexcept {
+  operator delete(memory);
+}
+
+/** @brief The pool under test, too large for the stack. */
+static PacketPool *pool;
+
+void setUp(void) { pool = new PacketPool(); }
+
+void tearDown(void) { delete pool; }
+
+/** @brief A handle returns its buffer when it goes out of scope. */
+void test_release_on_destruction(void) {
+  {
+    PacketHandle packet = pool->acquire();
+    TEST_ASSERT_TRUE((bool)packet);
+    TEST_ASSERT_EQUAL(PACKET_POOL_SIZE - 1, pool->available());
+  }
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool->available());
+}
+
+/** @brief release() returns the buffer once, and empties the handle. */
+void test_release(void) {
+  PacketHandle packet = pool->acquire();
+  packet.release();
+  TEST_ASSERT_FALSE((bool)packet);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool->available());
+  packet.release();
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool->available());
+}
+
+/**
+ * @brief Moving a handle moves ownership, and assigning over a handle returns
+ * the buffer it owned.
+ */
+void test_move(void) {
+  PacketHandle first = pool->acquire();
+  first->data        = {1, 2, 3};
+  PacketComm  *owned = &*first;
+
+  PacketHandle moved(std::move(first));
+  TEST_ASSERT_FALSE((bool)first);
+  TEST_ASSERT_TRUE(&*moved == owned);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE - 1, pool->available());
+
+  PacketHandle other = pool->acquire();
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE - 2, pool->available());
+  other = std::move(moved);
+  TEST_ASSERT_FALSE((bool)moved);
+  TEST_ASSERT_TRUE(&*other == owned);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE - 1, pool->available());
+
+  other = std::move(other);
+  TEST_ASSERT_TRUE((bool)other);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE - 1, pool->available());
+}
+
+/** @brief A handle passed through a queue keeps its buffer until popped. */
+void test_queue_ownership(void) {
+  RingQueue<PacketHandle, 4> queue;
+  PacketHandle               packet = pool->acquire();
+  TEST_ASSERT_TRUE(queue.push(std::move(packet)));
+  TEST_ASSERT_FALSE((bool)packet);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE - 1, pool->available());
+  queue.clear();
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool->available());
+}
+
+/**
+ * @brief An exhausted pool hands out empty handles, and recovers as buffers
+ * come back, with every buffer acquired cleared.
+ */
+void test_exhaustion(void) {
+  static PacketHandle packets[PACKET_POOL_SIZE];
+  for (auto &packet : packets) {
+    packet              = pool->acquire();
+    packet->header.type = PacketComm::TypeId::CommandObcPing;
+    packet->data        = {0xAA};
+    TEST_ASSERT_TRUE((bool)packet);
+  }
+  TEST_ASSERT_EQUAL(0, pool->available());
+  TEST_ASSERT_FALSE((bool)pool->acquire());
+
+  packets[7].release();
+  PacketHandle recovered = pool->acquire();
+  TEST_ASSERT_TRUE((bool)recovered);
+  TEST_ASSERT_TRUE(recovered->header.type == PacketComm::TypeId::None);
+  TEST_ASSERT_TRUE(recovered->data.empty());
+  TEST_ASSERT_FALSE((bool)pool->acquire());
+
+  recovered.release();
+  for (auto &packet : packets) {
+    packet.release();
+  }
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool->available());
+  for (auto &packet : packets) {
+    packet = pool->acquire();
+    TEST_ASSERT_TRUE((bool)packet);
+  }
+  for (auto &packet : packets) {
+    packet.release();
+  }
+}
+
+/** @brief Fill a packet's data and wrapped bytes, as a channel would. */
+static void fill(PacketComm &packet, uint32_t n) {
+  packet.header.type = PacketComm::TypeId::DataObcBeacon;
+  packet.data.resize(BENCHMARK_DATA);
+  packet.data[0] = (uint8_t)n;
+  packet.wrapped.assign(packet.data.begin(), packet.data.end());
+}
+
+/**
+ * @brief Circulating pooled packets through a queue allocates nothing once
+ * every buffer has been used, where a fresh PacketComm per packet allocates
+ * every time.
+ */
+void test_allocation_benchmark(void) {
+  RingQueue<PacketHandle, 8> queue;
+  PacketHandle               packet;
+  for (uint32_t n = 0; n < 2 * PACKET_POOL_SIZE; n++) {
+    packet = pool->acquire();
+    fill(*packet, n);
+    queue.push(std::move(packet));
+    queue.pop(packet);
+  }
+  packet.release();
+
+  uint32_t before = allocations;
+  auto     start  = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < BENCHMARK_PACKETS; n++) {
+    packet = pool->acquire();
+    fill(*packet, n);
+    queue.push(std::move(packet));
+    queue.pop(packet);
+  }
+  packet.release();
+  auto     pooled_time = std::chrono::steady_clock::now() - start;
+  uint32_t pooled      = allocations - before;
+
+  RingQueue<PacketComm, 8> copies;
+  PacketComm               popped;
+  before = allocations;
+  start  = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < BENCHMARK_PACKETS; n++) {
+    PacketComm fresh;
+    fill(fresh, n);
+    copies.push(std::move(fresh));
+    copies.pop(popped);
+  }
+  auto     fresh_time = std::chrono::steady_clock::now() - start;
+  uint32_t fresh      = allocations - before;
+
+  char message[160];
+  snprintf(message, sizeof(message),
+           "pooled: %u allocations, %.0f ns/packet; fresh: %u allocations, "
+           "%.0f ns/packet",
+           pooled,
+           std::chrono::duration<double, std::nano>(pooled_time).count() /
+               BENCHMARK_PACKETS,
+           fresh,
+           std::chrono::duration<double, std::nano>(fresh_time).count() /
+               BENCHMARK_PACKETS);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL(0, pooled);
+  TEST_ASSERT_GREATER_OR_EQUAL(BENCHMARK_PACKETS, fresh);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool->available());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_release_on_destruction);
+  RUN_TEST(test_release);
+  RUN_TEST(test_move);
+  RUN_TEST(test_queue_ownership);
+  RUN_TEST(test_exhaustion);
+  RUN_TEST(test_allocation_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,598 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the multi-priority packet queue.
+ *
+ * These check each drop policy and the counters it moves, the headroom and
+ * dwell-time telemetry and its packing into the queue beacon, and that
+ * commands keep a bounded latency through a queue flooded with beacons. A
+ * benchmark compares draining a full queue one packet and one batch at a time,
+ * and a congestion scenario counts the beacons a producer wastes with and
+ * without checking headroom first. A producer thread routing packets to a
+ * channel loop measures how long they wait to be handled, with the loop
+ * waiting on its queue and with the fixed delay it slept for before.
+ */
+#include "artemisbeacons.h"
+#include "config/artemis_defs.h"
+#include <chrono>
+#include <priority_queue.h>
+#include <thread>
+#include <unity.h>
+
+/** @brief The number of service ticks in the beacon flood. */
+#define FLOOD_TICKS       1000
+/** @brief The number of beacons pushed during each tick of the flood. */
+#define FLOOD_BEACONS     4
+/** @brief The number of ticks between commands during the flood. */
+#define FLOOD_COMMAND_GAP 10
+/** @brief The tag of every beacon in the flood. */
+#define FLOOD_BEACON_TAG  0xFF
+/** @brief The sleep, in milliseconds, between pulls of a channel loop. */
+#define DRAIN_LOOP_DELAY  10
+/** @brief The number of times the full queue is drained when timed. */
+#define DRAIN_ROUNDS      20000
+/** @brief The number of ticks in the congestion scenario. */
+#define CONGESTED_TICKS   1000
+/** @brief The number of beacons in each round a producer reads. */
+#define CONGESTED_ROUND   6
+/** @brief The number of ticks the radio takes to send each beacon. */
+#define CONGESTED_SEND    2
+/** @brief The number of packets routed to the channel loop. */
+#define ROUTED_PACKETS    100
+/** @brief The longest time, in milliseconds, between routed packets. */
+#define ROUTED_GAP        200
+/** @brief The time, in milliseconds, the channel loop waits or sleeps. */
+#define CHANNEL_LOOP_TIME 100
+
+static_assert(FLOOD_TICKS / FLOOD_COMMAND_GAP < FLOOD_BEACON_TAG,
+              "Command tags must not reach the beacon tag");
+
+/** @brief The pool the queued packets come from. */
+static PacketPool *pool;
+
+void setUp(void) {
+  pool = new PacketPool();
+  reset_time();
+}
+
+void tearDown(void) { delete pool; }
+
+/** @brief Acquire a packet, tagged in its first data byte. */
+static PacketHandle tagged(uint8_t tag) {
+  PacketHandle packet = pool->acquire();
+  packet->data        = {tag};
+  return packet;
+}
+
+/** @brief Push a tagged packet into a class of a queue. */
+template <size_t Slots>
+static PushResult push(PriorityPacketQueue<Slots> &queue, uint8_t tag,
+                       PacketPriority priority) {
+  PacketHandle packet = tagged(tag);
+  return queue.push(packet, priority);
+}
+
+/** @brief Pop a packet and return its tag, or -1 if there is none. */
+template <size_t Slots>
+static int pop_tag(PriorityPacketQueue<Slots> &queue,
+                   PacketPriority lowest = PacketPriority::Beacon) {
+  PacketHandle packet;
+  return queue.pop(packet, lowest) ? packet->data[0] : -1;
+}
+
+/** @brief A class configured to drop its oldest packet evicts it. */
+void test_drop_oldest(void) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  queue.configure(PacketPriority::Beacon, {2, DropPolicy::DropOldest});
+  TEST_ASSERT_TRUE(push(queue, 1, PacketPriority::Beacon) ==
+                   PushResult::Accepted);
+  TEST_ASSERT_TRUE(push(queue, 2, PacketPriority::Beacon) ==
+                   PushResult::Accepted);
+  TEST_ASSERT_TRUE(push(queue, 3, PacketPriority::Beacon) ==
+                   PushResult::EvictedOther);
+  TEST_ASSERT_EQUAL(1, queue.stats(PacketPriority::Beacon).evicted);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE - 2, pool->available());
+  TEST_ASSERT_EQUAL(2, pop_tag(queue));
+  TEST_ASSERT_EQUAL(3, pop_tag(queue));
+}
+
+/** @brief A class configured to drop its newest packet discards it. */
+void test_drop_newest(void) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  queue.configure(PacketPriority::Response, {1, DropPolicy::DropNewest});
+  TEST_ASSERT_TRUE(push(queue, 1, PacketPriority::Response) ==
+                   PushResult::Accepted);
+  PacketHandle packet = tagged(2);
+  TEST_ASSERT_TRUE(queue.push(packet, PacketPriority::Response) ==
+                   PushResult::Rejected);
+  TEST_ASSERT_FALSE((bool)packet);
+  TEST_ASSERT_EQUAL(1, queue.stats(PacketPriority::Response).dropped);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE - 1, pool->available());
+  TEST_ASSERT_EQUAL(1, pop_tag(queue));
+}
+
+/** @brief A class configured to reject leaves the packet with the caller. */
+void test_reject(void) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  queue.configure(PacketPriority::Command, {1, DropPolicy::Reject});
+  TEST_ASSERT_TRUE(push(queue, 1, PacketPriority::Command) ==
+                   PushResult::Accepted);
+  PacketHandle packet = tagged(2);
+  TEST_ASSERT_TRUE(queue.push(packet, PacketPriority::Command) ==
+                   PushResult::Rejected);
+  TEST_ASSERT_TRUE((bool)packet);
+  TEST_ASSERT_EQUAL(2, packet->data[0]);
+  TEST_ASSERT_EQUAL(1, queue.stats(PacketPriority::Command).rejected);
+  TEST_ASSERT_EQUAL(1, queue.telemetry().dropped);
+}
+
+/**
+ * @brief Higher classes are pulled first, and classes below the lowest one
+ * asked for stay queued.
+ */
+void test_priority_order(void) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  push(queue, 3, PacketPriority::Beacon);
+  push(queue, 2, PacketPriority::Response);
+  push(queue, 1, PacketPriority::Command);
+  TEST_ASSERT_EQUAL(1, pop_tag(queue, PacketPriority::Response));
+  TEST_ASSERT_EQUAL(2, pop_tag(queue, PacketPriority::Response));
+  TEST_ASSERT_EQUAL(-1, pop_tag(queue, PacketPriority::Response));
+  TEST_ASSERT_EQUAL(1, queue.size(PacketPriority::Beacon));
+
+  PacketHandle batch[4];
+  push(queue, 4, PacketPriority::Command);
+  TEST_ASSERT_EQUAL(2, queue.pop_batch(batch, 4));
+  TEST_ASSERT_EQUAL(4, batch[0]->data[0]);
+  TEST_ASSERT_EQUAL(3, batch[1]->data[0]);
+}
+
+/**
+ * @brief A queue holding only classes the caller will not pull has nothing
+ * pending for it, so a channel holding beacons back does not wake for them.
+ */
+void test_pending(void) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  TEST_ASSERT_FALSE(queue.pending());
+  push(queue, 1, PacketPriority::Beacon);
+  TEST_ASSERT_TRUE(queue.pending());
+  TEST_ASSERT_FALSE(queue.pending(PacketPriority::Response));
+  TEST_ASSERT_FALSE(queue.pending(PacketPriority::Command));
+  push(queue, 2, PacketPriority::Response);
+  TEST_ASSERT_TRUE(queue.pending(PacketPriority::Response));
+  TEST_ASSERT_FALSE(queue.pending(PacketPriority::Command));
+}
+
+/** @brief Headroom counts down to 0, and capacities are clamped to Slots. */
+void test_headroom(void) {
+  PriorityPacketQueue<4> queue(QUEUE_CLASS_CONFIG);
+  TEST_ASSERT_EQUAL(4, queue.headroom(PacketPriority::Beacon));
+  queue.configure(PacketPriority::Beacon, {3, DropPolicy::DropOldest});
+  TEST_ASSERT_EQUAL(3, queue.headroom(PacketPriority::Beacon));
+  push(queue, 1, PacketPriority::Beacon);
+  TEST_ASSERT_EQUAL(2, queue.headroom(PacketPriority::Beacon));
+  push(queue, 2, PacketPriority::Beacon);
+  push(queue, 3, PacketPriority::Beacon);
+  TEST_ASSERT_EQUAL(0, queue.headroom(PacketPriority::Beacon));
+  push(queue, 4, PacketPriority::Beacon);
+  TEST_ASSERT_EQUAL(0, queue.headroom(PacketPriority::Beacon));
+  TEST_ASSERT_EQUAL(4, queue.headroom(PacketPriority::Command));
+}
+
+/** @brief Dwell times land in their log-4 buckets, and the last bucket caps. */
+void test_dwell_buckets(void) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  const uint32_t dwell[]    = {0,  1,  3,  4,    15,    16,
+                               63, 64, 4095, 16384, 60000};
+  const size_t   expected[] = {0, 1, 1, 2, 2, 3, 3, 4, 6, 7, 7};
+  for (size_t i = 0; i < sizeof(dwell) / sizeof(dwell[0]); i++) {
+    push(queue, i, PacketPriority::Command);
+    advance_millis(dwell[i]);
+    TEST_ASSERT_EQUAL(i, pop_tag(queue));
+  }
+  uint32_t buckets[QUEUE_DWELL_BUCKETS] = {};
+  for (size_t bucket : expected) {
+    buckets[bucket]++;
+  }
+  queue_stats stats = queue.telemetry();
+  TEST_ASSERT_EQUAL_MEMORY(buckets, stats.dwell, sizeof(buckets));
+  TEST_ASSERT_EQUAL(11, stats.enqueued);
+  TEST_ASSERT_EQUAL(11, stats.dequeued);
+  TEST_ASSERT_EQUAL(1, stats.high_water);
+}
+
+/** @brief The traffic counters add up across classes. */
+void test_telemetry(void) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  queue.configure(PacketPriority::Beacon, {2, DropPolicy::DropOldest});
+  for (uint8_t i = 0; i < 5; i++) {
+    push(queue, i, PacketPriority::Beacon);
+  }
+  push(queue, 9, PacketPriority::Command);
+  queue_stats stats = queue.telemetry();
+  TEST_ASSERT_EQUAL(6, stats.enqueued);
+  TEST_ASSERT_EQUAL(3, stats.dropped);
+  TEST_ASSERT_EQUAL(3, stats.high_water);
+  queue.clear();
+  TEST_ASSERT_TRUE(queue.empty());
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool->available());
+}
+
+/**
+ * @brief A queue's telemetry packs into the 29-byte queue beacon, with the
+ * counters wrapping and the high-water mark saturating.
+ */
+void test_queue_beacon(void) {
+  using namespace Artemis::Devices;
+  static_assert(sizeof(queuebeacon) == 13 + 2 * QUEUE_DWELL_BUCKETS,
+                "Queue beacon layout changed");
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  push(queue, 1, PacketPriority::Command);
+  push(queue, 2, PacketPriority::Beacon);
+  advance_millis(5);
+  pop_tag(queue);
+
+  queuebeacon beacon = pack_queuebeacon(queue.telemetry(), 3, 0x01020304);
+  uint8_t bytes[sizeof(beacon)];
+  memcpy(bytes, &beacon, sizeof(bytes));
+  TEST_ASSERT_EQUAL((uint8_t)BeaconType::QueueBeacon, bytes[0]);
+  TEST_ASSERT_EQUAL(0x04, bytes[1]);
+  TEST_ASSERT_EQUAL(0x01, bytes[4]);
+  TEST_ASSERT_EQUAL(3, bytes[5]);
+  TEST_ASSERT_EQUAL(2, bytes[6] | bytes[7] << 8);
+  TEST_ASSERT_EQUAL(1, bytes[8] | bytes[9] << 8);
+  TEST_ASSERT_EQUAL(0, bytes[10] | bytes[11] << 8);
+  TEST_ASSERT_EQUAL(2, bytes[12]);
+  TEST_ASSERT_EQUAL(1, bytes[13 + 2 * 2] | bytes[14 + 2 * 2] << 8);
+
+  queue_stats stats = {0x10005, 0x20006, 0x30007, 300, {0x40001}};
+  beacon            = pack_queuebeacon(stats, 0, 0);
+  TEST_ASSERT_EQUAL(5, beacon.enqueued);
+  TEST_ASSERT_EQUAL(6, beacon.dequeued);
+  TEST_ASSERT_EQUAL(7, beacon.dropped);
+  TEST_ASSERT_EQUAL(255, beacon.high_water);
+  TEST_ASSERT_EQUAL(1, beacon.dwell[0]);
+  queue.clear();
+}
+
+/** @brief The latency of commands pushed through a flooded queue. */
+struct flood_result {
+  /** @brief The number of commands pulled. */
+  uint32_t delivered;
+  /** @brief The longest a command waited, in ticks. */
+  uint32_t max_latency;
+  /** @brief The number of beacons evicted. */
+  uint32_t evicted;
+};
+
+/**
+ * @brief Flood a queue with beacons faster than it is served, with a command
+ * among them every FLOOD_COMMAND_GAP ticks.
+ *
+ * Each tick, FLOOD_BEACONS beacons are pushed and one packet is pulled, as a
+ * radio sending one frame per tick would. A command is tagged with the tick it
+ * was pushed at, so its latency is known when it is pulled.
+ *
+ * @param queue The queue under test.
+ * @param command The class commands are pushed into.
+ */
+static flood_result flood(PriorityPacketQueue<8> &queue,
+                          PacketPriority          command) {
+  flood_result result = {};
+  for (uint32_t tick = 0; tick < FLOOD_TICKS; tick++) {
+    for (uint8_t i = 0; i < FLOOD_BEACONS; i++) {
+      push(queue, FLOOD_BEACON_TAG, PacketPriority::Beacon);
+    }
+    if (tick % FLOOD_COMMAND_GAP == 0) {
+      push(queue, tick / FLOOD_COMMAND_GAP, command);
+    }
+    int tag = pop_tag(queue);
+    if (tag >= 0 && tag != FLOOD_BEACON_TAG) {
+      uint32_t latency = tick - tag * FLOOD_COMMAND_GAP;
+      if (latency > result.max_latency) {
+        result.max_latency = latency;
+      }
+      result.delivered++;
+    }
+  }
+  result.evicted = queue.stats(PacketPriority::Beacon).evicted;
+  return result;
+}
+
+/**
+ * @brief Commands are neither evicted nor delayed by a beacon flood.
+ *
+ * The same flood through a single class that drops its oldest packets, as
+ * the channel queues did before priority classes, is run for comparison.
+ */
+void test_command_latency_under_flood(void) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  flood_result           classed = flood(queue, PacketPriority::Command);
+
+  PriorityPacketQueue<8> fifo(QUEUE_CLASS_CONFIG);
+  flood_result           shared = flood(fifo, PacketPriority::Beacon);
+
+  char message[128];
+  snprintf(message, sizeof(message),
+           "classed: %u/%u commands, max %u ticks; shared: %u/%u commands",
+           classed.delivered, FLOOD_TICKS / FLOOD_COMMAND_GAP,
+           classed.max_latency, shared.delivered,
+           FLOOD_TICKS / FLOOD_COMMAND_GAP);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL(FLOOD_TICKS / FLOOD_COMMAND_GAP, classed.delivered);
+  TEST_ASSERT_EQUAL(0, classed.max_latency);
+  TEST_ASSERT_GREATER_THAN(0, classed.evicted);
+  TEST_ASSERT_LESS_THAN(FLOOD_TICKS / FLOOD_COMMAND_GAP, shared.delivered);
+}
+
+/** @brief Fill every class of a queue to its capacity. */
+static void fill(PriorityPacketQueue<8> &queue) {
+  for (size_t i = 0; i < PACKET_PRIORITY_COUNT; i++) {
+    for (uint8_t n = 0; n < MAXQUEUESIZE; n++) {
+      push(queue, n, (PacketPriority)i);
+    }
+  }
+}
+
+/**
+ * @brief Drain a full queue the way a channel loop does, sleeping between
+ * pulls, and return the number of loop iterations it took.
+ *
+ * @param queue The queue to drain.
+ * @param batch The most packets each iteration pulls.
+ */
+static uint32_t drain(PriorityPacketQueue<8> &queue, size_t batch) {
+  PacketHandle packets[QUEUE_BATCH_SIZE];
+  uint32_t     iterations = 0;
+  while (!queue.empty()) {
+    size_t count = batch == 1 ? queue.pop(packets[0])
+                              : queue.pop_batch(packets, batch);
+    for (size_t i = 0; i < count; i++) {
+      packets[i].release();
+    }
+    iterations++;
+    delay(DRAIN_LOOP_DELAY);
+  }
+  return iterations;
+}
+
+/** @brief The time, in nanoseconds per packet, to drain a full queue. */
+static double drain_cost(PriorityPacketQueue<8> &queue, size_t batch) {
+  PacketHandle                        packets[QUEUE_BATCH_SIZE];
+  std::chrono::steady_clock::duration spent{};
+  for (uint32_t round = 0; round < DRAIN_ROUNDS; round++) {
+    fill(queue);
+    auto   start = std::chrono::steady_clock::now();
+    size_t count;
+    do {
+      count = batch == 1 ? queue.pop(packets[0])
+                         : queue.pop_batch(packets, batch);
+    } while (count > 0);
+    spent += std::chrono::steady_clock::now() - start;
+  }
+  return std::chrono::duration<double, std::nano>(spent).count() /
+         (DRAIN_ROUNDS * PACKET_PRIORITY_COUNT * MAXQUEUESIZE);
+}
+
+/**
+ * @brief Batch pulls drain a full queue in a few channel loop iterations
+ * instead of one per packet, and cost less per packet on the host.
+ */
+void test_drain_benchmark(void) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  fill(queue);
+  uint32_t start         = millis();
+  uint32_t single        = drain(queue, 1);
+  uint32_t single_millis = millis() - start;
+  fill(queue);
+  start                 = millis();
+  uint32_t batched      = drain(queue, QUEUE_BATCH_SIZE);
+  uint32_t batch_millis = millis() - start;
+
+  double single_cost = drain_cost(queue, 1);
+  double batch_cost  = drain_cost(queue, QUEUE_BATCH_SIZE);
+
+  char message[160];
+  snprintf(message, sizeof(message),
+           "single: %u loops, %u ms, %.1f ns/packet; batch: %u loops, %u ms, "
+           "%.1f ns/packet",
+           single, single_millis, single_cost, batched, batch_millis,
+           batch_cost);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL(PACKET_PRIORITY_COUNT * MAXQUEUESIZE, single);
+  TEST_ASSERT_EQUAL(PACKET_PRIORITY_COUNT * MAXQUEUESIZE / QUEUE_BATCH_SIZE,
+                    batched);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool->available());
+}
+
+/** @brief The work done by a beacon producer feeding a congested radio. */
+struct congestion_result {
+  /** @brief The number of beacons read and pushed. */
+  uint32_t produced;
+  /** @brief The number of beacons the radio sent. */
+  uint32_t sent;
+  /** @brief The number of beacons evicted before they were sent. */
+  uint32_t wasted;
+};
+
+/**
+ * @brief Run a producer that reads a round of beacons every tick into a radio
+ * queue that sends one beacon every CONGESTED_SEND ticks.
+ *
+ * @param backpressure Whether the producer skips a round when the beacon
+ * class has no headroom, as beacon_if_deployed() does.
+ */
+static congestion_result congest(bool backpressure) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  congestion_result      result = {};
+  for (uint32_t tick = 0; tick < CONGESTED_TICKS; tick++) {
+    if (!backpressure || queue.headroom(PacketPriority::Beacon) > 0) {
+      for (uint8_t i = 0; i < CONGESTED_ROUND; i++) {
+        push(queue, i, PacketPriority::Beacon);
+        result.produced++;
+      }
+    }
+    if (tick % CONGESTED_SEND == 0 && pop_tag(queue) >= 0) {
+      result.sent++;
+    }
+  }
+  result.wasted = queue.stats(PacketPriority::Beacon).evicted;
+  queue.clear();
+  return result;
+}
+
+/**
+ * @brief Skipping rounds while the radio has no headroom sends as many
+ * beacons as producing blindly, for less than half the beacons thrown away.
+ */
+void test_congestion_backpressure(void) {
+  congestion_result blind   = congest(false);
+  congestion_result skipped = congest(true);
+
+  char message[160];
+  snprintf(message, sizeof(message),
+           "blind: %u produced, %u sent, %u evicted; backpressure: %u "
+           "produced, %u sent, %u evicted",
+           blind.produced, blind.sent, blind.wasted, skipped.produced,
+           skipped.sent, skipped.wasted);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL(blind.sent, skipped.sent);
+  TEST_ASSERT_LESS_THAN(blind.produced, skipped.produced);
+  TEST_ASSERT_LESS_THAN(blind.wasted / 2, skipped.wasted);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool->available());
+}
+
+/**
+ * @brief A wait ends as soon as a packet the caller can pull is queued, and
+ * only then: packets below the lowest class leave it to the timeout.
+ */
+void test_wait(void) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  uint32_t               start = millis();
+  TEST_ASSERT_FALSE(queue.wait(CHANNEL_LOOP_TIME));
+  TEST_ASSERT_EQUAL(CHANNEL_LOOP_TIME, millis() - start);
+
+  push(queue, 1, PacketPriority::Beacon);
+  start = millis();
+  TEST_ASSERT_FALSE(queue.wait(CHANNEL_LOOP_TIME, PacketPriority::Response));
+  TEST_ASSERT_EQUAL(CHANNEL_LOOP_TIME, millis() - start);
+  start = millis();
+  TEST_ASSERT_TRUE(queue.wait(CHANNEL_LOOP_TIME));
+  TEST_ASSERT_EQUAL(start, millis());
+  queue.clear();
+}
+
+/** @brief The time packets spent between being routed and being handled. */
+struct routing_latency {
+  /** @brief The mean time, in microseconds. */
+  double   mean;
+  /** @brief The longest time, in microseconds. */
+  uint32_t worst;
+};
+
+/**
+ * @brief Push ROUTED_PACKETS packets at random times, the way
+ * route_packet_to_main() is called from other channels, noting the time each
+ * was pushed.
+ */
+static void route_packets(PriorityPacketQueue<8> &queue,
+                          std::vector<uint32_t>  &pushed_at) {
+  uint32_t state = 1;
+  for (uint32_t n = 0; n < ROUTED_PACKETS; n++) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    uint32_t due = micros() + 1000 * (1 + state % ROUTED_GAP);
+    while ((int32_t)(micros() - due) < 0) {
+      std::this_thread::yield();
+    }
+    PacketHandle packet = pool->acquire();
+    packet->data        = {(uint8_t)n};
+    pushed_at[n]        = micros();
+    queue.push(packet, PacketPriority::Command);
+  }
+}
+
+/**
+ * @brief Route packets from a producer thread to a channel loop, and time
+ * each from its push to its pull.
+ *
+ * The channel loop pulls everything queued, as handle_queue() does, then
+ * either waits on its queue or sleeps for CHANNEL_LOOP_TIME. Both give up
+ * their time slice on every check, as threads.delay() does, so simulated time
+ * passes while the loop waits.
+ *
+ * @param fixed_delay Whether the loop sleeps for the whole period rather than
+ * waiting on its queue.
+ */
+static routing_latency route_to_loop(bool fixed_delay) {
+  PriorityPacketQueue<8> queue(QUEUE_CLASS_CONFIG);
+  std::vector<uint32_t>  pushed_at(ROUTED_PACKETS);
+
+  std::thread producer(route_packets, std::ref(queue), std::ref(pushed_at));
+
+  routing_latency latency = {};
+  uint32_t        handled = 0;
+  PacketHandle    packets[QUEUE_BATCH_SIZE];
+  while (handled < ROUTED_PACKETS) {
+    size_t count = queue.pop_batch(packets, QUEUE_BATCH_SIZE);
+    for (size_t i = 0; i < count; i++) {
+      uint32_t waited  = micros() - pushed_at[packets[i]->data[0]];
+      latency.mean    += waited;
+      latency.worst    = std::max(latency.worst, waited);
+      packets[i].release();
+    }
+    handled += count;
+    if (fixed_delay) {
+      elapsedMillis slept;
+      while (slept < CHANNEL_LOOP_TIME) {
+        threads.yield();
+      }
+    } else {
+      queue.wait(CHANNEL_LOOP_TIME);
+    }
+  }
+  producer.join();
+  latency.mean /= ROUTED_PACKETS;
+  return latency;
+}
+
+/**
+ * @brief A channel loop waiting on its queue handles a routed packet within
+ * a time slice or two, where one sleeping for a fixed period kept it for
+ * half the period on average.
+ */
+void test_routing_latency(void) {
+  routing_latency waiting  = route_to_loop(false);
+  routing_latency sleeping = route_to_loop(true);
+
+  char message[160];
+  snprintf(message, sizeof(message),
+           "waiting on the queue: %.0f us mean, %u us worst; fixed %u ms "
+           "delay: %.0f us mean, %u us worst",
+           waiting.mean, waiting.worst, CHANNEL_LOOP_TIME, sleeping.mean,
+           sleeping.worst);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_THAN(1000, waiting.worst);
+  TEST_ASSERT_GREATER_THAN(10 * waiting.mean, sleeping.mean);
+  TEST_ASSERT_LESS_OR_EQUAL(1000 * CHANNEL_LOOP_TIME + 1000, sleeping.worst);
+  TEST_ASSERT_EQUAL(PACKET_POOL_SIZE, pool->available());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_drop_oldest);
+  RUN_TEST(test_drop_newest);
+  RUN_TEST(test_reject);
+  RUN_TEST(test_priority_order);
+  RUN_TEST(test_pending);
+  RUN_TEST(test_headroom);
+  RUN_TEST(test_dwell_buckets);
+  RUN_TEST(test_telemetry);
+  RUN_TEST(test_queue_beacon);
+  RUN_TEST(test_command_latency_under_flood);
+  RUN_TEST(test_drain_benchmark);
+  RUN_TEST(test_congestion_backpressure);
+  RUN_TEST(test_wait);
+  RUN_TEST(test_routing_latency);
+  return UNITY_END();
+}
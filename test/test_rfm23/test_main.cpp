@@ -0,0 +1,1345 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the RFM23 radio class over the simulated radio.
+ *
+ * The radio under test and a stand-in ground radio share sim_medium. Time is
+ * simulated, so frame airtimes and waits are measured exactly.
+ */
+#include "config/artemis_defs.h"
+#include <arq.h>
+#include <artemis_devices.h>
+#include <beacon_packer.h>
+#include <file_downlink.h>
+#include <functional>
+#include <math.h>
+#include <modem_ladder.h>
+#include <rfm23.h>
+#include <unity.h>
+
+using Artemis::Devices::ModemLadder;
+using Artemis::Devices::RFM23;
+
+/** @brief The time, in milliseconds, a receive waits for a packet. */
+#define RX_WAIT      5000
+/** @brief The number of packets sent while a receive waits. */
+#define TX_PACKETS   20
+/** @brief The size of the data of each test packet. */
+#define TX_DATA_SIZE 20
+/** @brief The number of beacons in a burst. */
+#define BURST_SIZE   8
+/** @brief The sleep, in milliseconds, after each send before pipelining. */
+#define BURST_SLEEP  500
+/** @brief The inter-frame gap, in milliseconds, of the gap test. */
+#define TX_GAP       100
+/** @brief The number of packets sent through the lossy channel. */
+#define LOSSY_PACKETS 20
+/** @brief The size of the data of each packet sent through the channel. */
+#define LOSSY_SIZE    2048
+/** @brief The number of packets sent through the ARQ transport. */
+#define BULK_PACKETS  100
+/** @brief The ARQ window of the bulk transfer. */
+#define BULK_WINDOW   8
+/** @brief The most simulated time, in seconds, the bulk transfer may take. */
+#define BULK_LIMIT    600
+/** @brief The size of the file sent through the file downlink. */
+#define DOWNLINK_FILE_SIZE 20000
+/** @brief The ID of the file sent through the file downlink. */
+#define DOWNLINK_FILE_ID   7
+/** @brief The time, in milliseconds, between deployment beacon cycles. */
+#define BEACON_CYCLE_TIME  (5 * 60 * SECONDS)
+/** @brief The number of packets sent at each bit error rate. */
+#define NOISY_PACKETS 500
+/** @brief The length, in seconds, of a simulated pass. */
+#define PASS_LENGTH    600
+/** @brief The RSSI, in dBm, of frames at the horizon. */
+#define PASS_RSSI_LOW  -112
+/** @brief The RSSI, in dBm, of frames overhead. */
+#define PASS_RSSI_HIGH -78
+/** @brief The interval, in milliseconds, between frames from ground. */
+#define PASS_UPLINK    500
+
+/** @brief The configuration of both radios. */
+static const RFM23::rfm23_config config = {
+    .freq     = 433,
+    .tx_power = 0,
+    .pins =
+        {
+               .spi_miso = 1,
+               .spi_mosi = 2,
+               .spi_sck  = 3,
+               .nirq     = 4,
+               .cs       = 5,
+               .tx_on    = 6,
+               .rx_on    = 7,
+               },
+    .tx_gap = 0,
+};
+
+/** @brief The SPI mutex of the radio under test. */
+static Threads::Mutex spi_mtx;
+/** @brief The SPI mutex of the ground radio. */
+static Threads::Mutex ground_mtx;
+/** @brief The radio under test. */
+static RFM23          radio(config.pins.cs, config.pins.nirq);
+/** @brief The ground radio, at the other end of sim_medium. */
+static RFM23          ground(config.pins.cs, config.pins.nirq);
+/** @brief The pool the bulk transfer's packets are taken from. */
+static PacketPool     pool;
+
+void setUp(void) {
+  reset_time();
+  sim_channel_model lossless;
+  lossless.bit_error_rate = 0;
+  lossless.burst_start    = 0;
+  sim_medium.set_model(lossless);
+  sim_medium.reset();
+  TEST_ASSERT_TRUE(radio.init(config, &spi_mtx));
+  TEST_ASSERT_TRUE(ground.init(config, &ground_mtx));
+}
+
+void tearDown(void) {}
+
+/** @brief Fill a packet with data numbered from a start value. */
+static void fill(PacketComm &packet, size_t size, uint8_t start) {
+  packet.header.type = PacketComm::TypeId::DataObcBeacon;
+  packet.data.resize(size);
+  for (size_t i = 0; i < size; i++) {
+    packet.data[i] = start + i;
+  }
+}
+
+/**
+ * @brief A receive waiting for a packet holds the SPI mutex only while it
+ * polls the radio, so packets sent from another thread in the meantime go
+ * out one frame airtime apart instead of waiting for the receive to end.
+ */
+void test_tx_while_rx_waits(void) {
+  std::atomic<bool>     stop{false};
+  std::atomic<uint32_t> receives{0};
+  std::thread           receiver([&] {
+    PacketComm packet;
+    while (!stop) {
+      radio.recv(packet, RX_WAIT);
+      receives++;
+    }
+  });
+
+  PacketComm packet;
+  fill(packet, TX_DATA_SIZE, 0);
+  uint32_t latency_max = 0;
+  uint32_t start       = micros();
+  for (uint8_t i = 0; i < TX_PACKETS; i++) {
+    uint32_t queued = micros();
+    TEST_ASSERT_TRUE(radio.send(packet));
+    uint32_t latency = micros() - queued;
+    if (latency > latency_max) {
+      latency_max = latency;
+    }
+  }
+  TEST_ASSERT_TRUE(radio.wait_sent(1000));
+  uint32_t elapsed = micros() - start;
+  stop             = true;
+  receiver.join();
+
+  RFM23::link_stats stats   = radio.stats();
+  uint32_t          airtime = stats.airtime / stats.tx_frames;
+  char              message[160];
+  snprintf(message, sizeof(message),
+           "%u frames of %u us airtime in %u us; TX latency max %u us; SPI "
+           "lock wait max %u us",
+           stats.tx_frames, airtime, elapsed, latency_max,
+           stats.lock_wait_max);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL(TX_PACKETS, stats.tx_frames);
+  TEST_ASSERT_LESS_THAN(RX_WAIT * 1000 / 10, latency_max);
+  TEST_ASSERT_LESS_THAN(airtime * 11 / 10, latency_max);
+  TEST_ASSERT_LESS_THAN(RX_WAIT * 1000, elapsed);
+  TEST_ASSERT_LESS_THAN(1000, stats.lock_wait_max);
+}
+
+/**
+ * @brief The configured gap separates frames, measured from the end of the
+ * previous frame even when it finished before the next one was sent, and a
+ * frame sent after a long idle, past the wrap of a signed micros() span, does
+ * not wait.
+ */
+void test_tx_gap(void) {
+  RFM23::rfm23_config gapped = config;
+  gapped.tx_gap              = TX_GAP;
+  TEST_ASSERT_TRUE(radio.init(gapped, &spi_mtx));
+  advance_millis(TX_GAP);
+
+  PacketComm packet;
+  fill(packet, TX_DATA_SIZE, 0);
+  TEST_ASSERT_TRUE(radio.send(packet));
+  TEST_ASSERT_TRUE(radio.send(packet));
+  advance_millis(1000);
+  TEST_ASSERT_TRUE(radio.send(packet));
+  RFM23::frame_record frames[4];
+  radio.frames(frames, 1);
+  advance_millis(frames[0].airtime / 1000 + TX_GAP / 2);
+  TEST_ASSERT_TRUE(radio.send(packet));
+
+  TEST_ASSERT_EQUAL(4, radio.frames(frames, 4));
+  uint32_t done[4];
+  for (size_t i = 0; i < 4; i++) {
+    done[i] = frames[i].time + frames[i].airtime / 1000;
+  }
+  for (size_t i = 1; i < 4; i++) {
+    TEST_ASSERT_GREATER_OR_EQUAL(done[i - 1] + TX_GAP, frames[i].time);
+  }
+  TEST_ASSERT_LESS_THAN(done[2] + TX_GAP + 2, frames[3].time);
+
+  advance_micros(0x80000000UL);
+  uint32_t idle = micros();
+  TEST_ASSERT_TRUE(radio.send(packet));
+  TEST_ASSERT_LESS_THAN(1000, micros() - idle);
+}
+
+/**
+ * @brief Send a burst of beacons and return the time, in microseconds, it
+ * takes to drain.
+ *
+ * @param sleep The time, in milliseconds, to sleep after each send and wait
+ * for the frame to finish, as the channel did before the pipeline. Pass 0
+ * to send each frame as soon as the last one has gone.
+ */
+static uint32_t drain_burst(uint32_t sleep) {
+  PacketComm packet;
+  uint32_t   start = micros();
+  for (uint8_t i = 0; i < BURST_SIZE; i++) {
+    fill(packet, TX_DATA_SIZE, i);
+    TEST_ASSERT_TRUE(radio.send(packet));
+    if (sleep > 0) {
+      TEST_ASSERT_TRUE(radio.wait_sent(1000));
+      delay(sleep);
+    }
+  }
+  TEST_ASSERT_TRUE(radio.wait_sent(1000));
+  return micros() - start;
+}
+
+/**
+ * @brief Pipelined sends drain a beacon burst in its airtime, at the slowest
+ * and fastest rungs, where sleeping after each send capped the radio at
+ * about two frames a second.
+ */
+void test_burst_throughput(void) {
+  const uint8_t rungs[] = {0, RFM23_MODEM_RUNGS - 1};
+  for (uint8_t rung : rungs) {
+    TEST_ASSERT_TRUE(radio.set_modem(rung));
+    uint32_t slept     = drain_burst(BURST_SLEEP);
+    uint32_t pipelined = drain_burst(0);
+    uint32_t airtime   = radio.stats().airtime / (2 * BURST_SIZE);
+
+    char message[160];
+    snprintf(message, sizeof(message),
+             "rung %u: sleeping %.1f frames/s, %u ms; pipelined %.1f "
+             "frames/s, %u ms",
+             rung, BURST_SIZE * 1e6 / slept, slept / 1000,
+             BURST_SIZE * 1e6 / pipelined, pipelined / 1000);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(BURST_SIZE * airtime * 11 / 10, pipelined);
+    TEST_ASSERT_GREATER_THAN(BURST_SIZE * BURST_SLEEP * 1000, slept);
+  }
+}
+
+/** @brief Whether a packet holds the data fill() numbered from start. */
+static bool filled(const PacketComm &packet, size_t size, uint8_t start) {
+  if (packet.data.size() != size) {
+    return false;
+  }
+  for (size_t i = 0; i < size; i++) {
+    if (packet.data[i] != (uint8_t)(start + i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Frame a fragment of a wrapped packet as RFM23::send() frames it
+ * without FEC.
+ *
+ * @param frame The buffer that will hold the frame.
+ * @param id The packet's message ID.
+ * @param index The index of the fragment.
+ * @param wrapped The wrapped packet.
+ * @return uint8_t The length of the frame.
+ */
+static uint8_t frame_fragment(uint8_t *frame, uint8_t id, uint8_t index,
+                              const vector<uint8_t> &wrapped) {
+  size_t count = (wrapped.size() + RFM23_FRAGMENT_PAYLOAD - 1) /
+                 RFM23_FRAGMENT_PAYLOAD;
+  size_t size  = wrapped.size() - index * RFM23_FRAGMENT_PAYLOAD;
+  if (size > RFM23_FRAGMENT_PAYLOAD) {
+    size = RFM23_FRAGMENT_PAYLOAD;
+  }
+  frame[0] = (uint8_t)RFM23::FecMode::None;
+  frame[1] = id;
+  frame[2] = index;
+  frame[3] = (uint8_t)count;
+  memcpy(&frame[4], &wrapped[index * RFM23_FRAGMENT_PAYLOAD], size);
+  uint8_t  length = RFM23_FEC_TAG + RFM23_FRAGMENT_HEADER + size;
+  uint16_t crc    = RFM23::frame_crc(frame, length);
+  frame[length++] = crc & 0xFF;
+  frame[length++] = crc >> 8;
+  return length;
+}
+
+/**
+ * @brief Put a frame straight onto the medium to a listening ground radio,
+ * and have ground read it at once.
+ *
+ * @param frame The frame.
+ * @param length The length of the frame.
+ * @param packet The packet that will hold what ground received.
+ * @return int32_t What ground's recv() returned.
+ */
+static int32_t deliver(const uint8_t *frame, uint8_t length,
+                       PacketComm &packet) {
+  ground.available();
+  sim_medium.transmit(0, frame, length, micros(), 0);
+  advance_micros(sim_medium.model().delay);
+  return ground.recv(packet, 0);
+}
+
+/**
+ * @brief Send a fragment of a wrapped packet from the radio under test to
+ * ground, as RFM23::send() frames it, and have ground read it.
+ *
+ * @param id The packet's message ID.
+ * @param index The index of the fragment.
+ * @param wrapped The wrapped packet.
+ * @param packet The packet that will hold what ground received.
+ * @return int32_t What ground's recv() returned.
+ */
+static int32_t inject(uint8_t id, uint8_t index,
+                      const vector<uint8_t> &wrapped, PacketComm &packet) {
+  uint8_t frame[RH_RF22_MAX_MESSAGE_LEN];
+  uint8_t length = frame_fragment(frame, id, index, wrapped);
+  return deliver(frame, length, packet);
+}
+
+/**
+ * @brief Send packets from the radio under test on another thread, and
+ * receive them at ground until the sender is done.
+ *
+ * @param sizes The size of the data of each packet.
+ * @param count The number of packets.
+ * @param elapsed The time, in microseconds, the packets took to send.
+ * @return uint32_t The number of packets received intact, in order.
+ */
+static uint32_t send_through(const size_t *sizes, size_t count,
+                             uint32_t &elapsed) {
+  std::atomic<bool> done{false};
+  uint32_t          start  = micros();
+  std::thread       sender([&] {
+    PacketComm packet;
+    for (size_t i = 0; i < count; i++) {
+      fill(packet, sizes[i], i);
+      radio.send(packet);
+    }
+    radio.wait_sent(1000);
+    elapsed = micros() - start;
+    done    = true;
+  });
+
+  PacketComm packet;
+  uint32_t   received = 0;
+  size_t     next     = 0;
+  while (true) {
+    if (ground.recv(packet, 1000) >= 0) {
+      for (size_t i = next; i < count; i++) {
+        if (filled(packet, sizes[i], i)) {
+          received++;
+          next = i + 1;
+          break;
+        }
+      }
+    } else if (done && !ground.available()) {
+      break;
+    }
+  }
+  sender.join();
+  return received;
+}
+
+/**
+ * @brief Packets from empty to the largest a frame sequence can hold, and
+ * those either side of a fragment boundary, arrive whole.
+ */
+void test_fragment_round_trip(void) {
+  const size_t wrapping = sizeof(PacketComm::Header) + 2;
+  const size_t largest  = RFM23_MAX_FRAGMENTS * RFM23_FRAGMENT_PAYLOAD -
+                          wrapping;
+  const size_t sizes[]  = {0,
+                           1,
+                           RFM23_FRAGMENT_PAYLOAD - wrapping,
+                           RFM23_FRAGMENT_PAYLOAD - wrapping + 1,
+                           500,
+                           largest};
+  TEST_ASSERT_TRUE(radio.set_modem(RFM23_MODEM_RUNGS - 1));
+  TEST_ASSERT_TRUE(ground.set_modem(RFM23_MODEM_RUNGS - 1));
+  uint32_t elapsed;
+  TEST_ASSERT_EQUAL(6, send_through(sizes, 6, elapsed));
+
+  PacketComm packet;
+  fill(packet, largest + 1, 0);
+  TEST_ASSERT_FALSE(radio.send(packet));
+}
+
+/**
+ * @brief Fragments are reassembled out of order, duplicates are ignored, and
+ * a packet whose fragments stop arriving is abandoned after the timeout.
+ */
+void test_reassembly(void) {
+  PacketComm packet;
+  fill(packet, 100, 7);
+  packet.Wrap();
+  vector<uint8_t> wrapped = packet.wrapped;
+
+  TEST_ASSERT_EQUAL(-1, inject(1, 2, wrapped, packet));
+  TEST_ASSERT_EQUAL(-1, inject(1, 0, wrapped, packet));
+  TEST_ASSERT_EQUAL(-1, inject(1, 0, wrapped, packet));
+  TEST_ASSERT_GREATER_THAN(0, inject(1, 1, wrapped, packet));
+  TEST_ASSERT_TRUE(filled(packet, 100, 7));
+
+  TEST_ASSERT_EQUAL(-1, inject(2, 0, wrapped, packet));
+  TEST_ASSERT_EQUAL(-1, inject(2, 1, wrapped, packet));
+  TEST_ASSERT_EQUAL(-1, ground.recv(packet, 100));
+  advance_millis(RFM23_REASSEMBLY_TIMEOUT + 1);
+  TEST_ASSERT_EQUAL(-1, inject(2, 2, wrapped, packet));
+  TEST_ASSERT_EQUAL(-1, inject(2, 0, wrapped, packet));
+  TEST_ASSERT_GREATER_THAN(0, inject(2, 1, wrapped, packet));
+  TEST_ASSERT_TRUE(filled(packet, 100, 7));
+}
+
+/**
+ * @brief More packets in progress than there are reassembly slots abandon
+ * the one that has waited longest for a fragment.
+ */
+void test_reassembly_slots(void) {
+  static_assert(RFM23_REASSEMBLY_SLOTS == 2, "Test assumes two slots");
+  PacketComm packet;
+  fill(packet, 60, 0);
+  packet.Wrap();
+  vector<uint8_t> wrapped = packet.wrapped;
+
+  TEST_ASSERT_EQUAL(-1, inject(1, 0, wrapped, packet));
+  TEST_ASSERT_EQUAL(-1, inject(2, 0, wrapped, packet));
+  TEST_ASSERT_EQUAL(-1, inject(3, 0, wrapped, packet));
+  TEST_ASSERT_EQUAL(-1, inject(1, 1, wrapped, packet));
+  TEST_ASSERT_GREATER_THAN(0, inject(3, 1, wrapped, packet));
+  TEST_ASSERT_EQUAL(-1, inject(2, 1, wrapped, packet));
+  TEST_ASSERT_GREATER_THAN(0, inject(1, 0, wrapped, packet));
+  TEST_ASSERT_EQUAL(-1, ground.recv(packet, 100));
+}
+
+/**
+ * @brief A frame sent without FEC that picks up a bit error anywhere after
+ * its tag fails its CRC, and counts against the link instead of reaching
+ * reassembly.
+ */
+void test_frame_crc(void) {
+  sim_channel_model instant = sim_medium.model();
+  instant.delay             = 0;
+  sim_medium.set_model(instant);
+  PacketComm packet;
+  fill(packet, TX_DATA_SIZE, 0);
+  packet.Wrap();
+  uint8_t frame[RH_RF22_MAX_MESSAGE_LEN];
+  uint8_t length = frame_fragment(frame, 1, 0, packet.wrapped);
+
+  for (uint16_t bit = 8 * RFM23_FEC_TAG; bit < 8 * length; bit++) {
+    uint8_t corrupted[RH_RF22_MAX_MESSAGE_LEN];
+    memcpy(corrupted, frame, length);
+    corrupted[bit / 8] ^= 1 << (bit % 8);
+    TEST_ASSERT_EQUAL(-1, deliver(corrupted, length, packet));
+  }
+  TEST_ASSERT_EQUAL(8 * (length - RFM23_FEC_TAG), ground.link().bad);
+  TEST_ASSERT_EQUAL(0, ground.link().good);
+
+  TEST_ASSERT_GREATER_THAN(0, deliver(frame, length, packet));
+  TEST_ASSERT_TRUE(filled(packet, TX_DATA_SIZE, 0));
+}
+
+/**
+ * @brief Send single-frame packets through a channel flipping bits at a
+ * rate, and count those received.
+ *
+ * @param fec The forward error correction applied to every frame.
+ * @param corrupted The number of packets received with the wrong data.
+ * @return uint32_t The number of packets received intact.
+ */
+static uint32_t send_noisy(float bit_error_rate, RFM23::FecMode fec,
+                           uint32_t &corrupted) {
+  const size_t size = RFM23_FEC_FRAGMENT_PAYLOAD - sizeof(PacketComm::Header) -
+                      2;
+  sim_channel_model noisy;
+  noisy.bit_error_rate = bit_error_rate;
+  noisy.burst_start    = 0;
+  sim_medium.set_model(noisy);
+
+  PacketComm packet;
+  uint32_t   received = 0;
+  for (uint16_t i = 0; i < NOISY_PACKETS; i++) {
+    fill(packet, size, i);
+    ground.available();
+    uint32_t before = radio.airtime();
+    TEST_ASSERT_TRUE(radio.send(packet, fec));
+    advance_micros(radio.airtime() - before + noisy.delay);
+    if (ground.recv(packet, 0) < 0) {
+      continue;
+    }
+    if (filled(packet, size, i)) {
+      received++;
+    } else {
+      corrupted++;
+    }
+  }
+  return received;
+}
+
+/**
+ * @brief Frames with Reed-Solomon FEC survive bit error rates that lose most
+ * frames without it, and no corrupted packet is ever delivered either way.
+ * Reports the frame loss of each against the bit error rate.
+ */
+void test_fec_frame_loss(void) {
+  TEST_ASSERT_TRUE(radio.set_modem(RFM23_MODEM_RUNGS - 1));
+  TEST_ASSERT_TRUE(ground.set_modem(RFM23_MODEM_RUNGS - 1));
+  const float rates[]   = {1e-4f, 1e-3f, 3e-3f, 1e-2f};
+  uint32_t    corrupted = 0;
+  uint32_t    plain[4];
+  uint32_t    coded[4];
+  for (size_t i = 0; i < 4; i++) {
+    plain[i] = send_noisy(rates[i], RFM23::FecMode::None, corrupted);
+    coded[i] = send_noisy(rates[i], RFM23::FecMode::ReedSolomon, corrupted);
+    char message[120];
+    snprintf(message, sizeof(message),
+             "BER %.0e: frame loss %.1f%% without FEC, %.1f%% with FEC",
+             rates[i], 100.0 * (NOISY_PACKETS - plain[i]) / NOISY_PACKETS,
+             100.0 * (NOISY_PACKETS - coded[i]) / NOISY_PACKETS);
+    TEST_MESSAGE(message);
+  }
+  TEST_ASSERT_EQUAL(0, corrupted);
+  TEST_ASSERT_GREATER_THAN(NOISY_PACKETS * 9 / 10, coded[1]);
+  TEST_ASSERT_LESS_THAN(coded[1], plain[1]);
+  TEST_ASSERT_LESS_THAN(coded[2], plain[2]);
+}
+
+/** @brief The outcome of sending packets through a channel model. */
+struct goodput_result {
+  /** @brief The number of packets received intact. */
+  uint32_t received;
+  /** @brief The goodput, in bits per second of airtime. */
+  double   goodput;
+  /** @brief The number of frames the channel lost. */
+  uint32_t lost;
+  /** @brief The number of frames sent. */
+  uint32_t sent;
+};
+
+/**
+ * @brief Send LOSSY_PACKETS multi-kilobyte packets through a channel model.
+ *
+ * Goodput is measured against the airtime of the frames sent, since the
+ * host threads polling the simulated clock make wall-clock spans inexact.
+ */
+static goodput_result send_lossy(const sim_channel_model &model) {
+  size_t sizes[LOSSY_PACKETS];
+  for (auto &size : sizes) {
+    size = LOSSY_SIZE;
+  }
+  sim_medium.set_model(model);
+  sim_medium.reset();
+  radio.stats();
+  uint32_t       elapsed;
+  goodput_result result = {};
+  result.received       = send_through(sizes, LOSSY_PACKETS, elapsed);
+  result.goodput = 8e6 * result.received * LOSSY_SIZE / radio.stats().airtime;
+  result.lost    = sim_medium.stats().lost;
+  result.sent    = sim_medium.stats().sent;
+  return result;
+}
+
+/**
+ * @brief Multi-kilobyte packets cross lossless, lightly lossy and default
+ * channels, and every packet that arrives is intact. Reports the goodput of
+ * each.
+ *
+ * Without retransmission, a packet is lost with any one of its 45 frames, so
+ * the default channel's bursts lose more than half of them. Bulk data goes
+ * through the ARQ transport for this reason.
+ */
+void test_lossy_goodput(void) {
+  TEST_ASSERT_TRUE(radio.set_modem(RFM23_MODEM_RUNGS - 1));
+  TEST_ASSERT_TRUE(ground.set_modem(RFM23_MODEM_RUNGS - 1));
+  sim_channel_model clean;
+  clean.bit_error_rate = 0;
+  clean.burst_start    = 0;
+  sim_channel_model light;
+  light.burst_start = 0.001f;
+  const sim_channel_model models[] = {clean, light, sim_channel_model()};
+  const char             *names[]  = {"lossless", "light", "default"};
+
+  goodput_result results[3];
+  for (size_t i = 0; i < 3; i++) {
+    results[i] = send_lossy(models[i]);
+    char message[160];
+    snprintf(message, sizeof(message),
+             "%s channel: %u/%u %u-byte packets, %.0f bit/s, %u/%u frames lost",
+             names[i], results[i].received, LOSSY_PACKETS, LOSSY_SIZE,
+             results[i].goodput, results[i].lost, results[i].sent);
+    TEST_MESSAGE(message);
+  }
+  TEST_ASSERT_EQUAL(LOSSY_PACKETS, results[0].received);
+  TEST_ASSERT_GREATER_THAN(0, results[1].received);
+  TEST_ASSERT_LESS_THAN(LOSSY_PACKETS, results[1].received);
+  TEST_ASSERT_GREATER_THAN(0, results[2].lost);
+}
+
+/** @brief The outcome of a bulk transfer. */
+struct bulk_result {
+  /** @brief The number of packets ground popped intact, in order. */
+  uint32_t packets;
+  /** @brief The number of data bytes in those packets. */
+  uint32_t bytes;
+  /** @brief The simulated time, in microseconds, the transfer took. */
+  uint32_t elapsed;
+  /** @brief The number of ARQ frames sent again. */
+  uint32_t resent;
+};
+
+/** @brief Fills the next packet of a bulk transfer, or is false at its end. */
+using bulk_source = std::function<bool(PacketComm &)>;
+/** @brief Checks each packet ground pops from a bulk transfer, in order. */
+using bulk_sink   = std::function<void(const PacketComm &)>;
+
+/** @brief The size of the n-th packet of the bulk transfer. */
+static size_t bulk_size(uint16_t n) { return 64 + (n * 37) % 300; }
+
+/**
+ * @brief Send packets from a source to ground through the ARQ transport, as
+ * the RFM23 channel sends bulk data.
+ *
+ * The radio sends every frame the sender hands out, with Reed-Solomon FEC,
+ * while ground reads each as it lands on a thread of its own, since its radio
+ * holds only one frame. Ground then acknowledges what arrived, duplicates
+ * included, and waits for its acknowledgement to land, since neither end can
+ * hear the other while it sends.
+ *
+ * @param window The ARQ window of both ends.
+ * @param next The source of the packets.
+ * @param take The check of each packet ground pops.
+ */
+static bulk_result send_bulk(uint8_t window, const bulk_source &next,
+                             const bulk_sink &take) {
+  ArqSender             sender(window);
+  ArqReceiver           receiver(pool, window);
+  Threads::Mutex        receiver_mtx;
+  PacketComm            frame;
+  PacketComm            ack;
+  PacketComm            received;
+  bulk_result           result = {};
+  bool                  drawn  = false;
+  uint32_t              start  = micros();
+  uint32_t              delay  = sim_medium.model().delay;
+  std::atomic<bool>     stop{false};
+  std::atomic<bool>     heard{false};
+  std::atomic<uint32_t> drained{start};
+  std::thread           listener([&] {
+    PacketComm data;
+    while (!stop) {
+      uint32_t now = micros();
+      while (ground.available()) {
+        if (ground.recv(data, 0) >= 0 && data.header.type == RADIO_BULK_DATA) {
+          Threads::Scope lock(receiver_mtx);
+          receiver.receive(data);
+          heard = true;
+        }
+      }
+      drained = now;
+      threads.yield();
+    }
+  });
+
+  while (!(drawn && sender.in_flight() == 0) &&
+         micros() - start < BULK_LIMIT * 1000000UL) {
+    while (!drawn && sender.ready()) {
+      PacketHandle packet = pool.acquire();
+      TEST_ASSERT_TRUE(packet);
+      if (!next(*packet)) {
+        drawn = true;
+        break;
+      }
+      TEST_ASSERT_TRUE(sender.push(packet));
+    }
+
+    bool sent = false;
+    while (sender.poll(frame)) {
+      frame.header.type = RADIO_BULK_DATA;
+      TEST_ASSERT_TRUE(radio.send(frame, RFM23::FecMode::ReedSolomon));
+      sent = true;
+    }
+    radio.wait_sent(1000);
+    // Let ground read every frame as it lands, until the last one has.
+    uint32_t landed = micros() + delay;
+    while ((int32_t)(drained - landed) < 0) {
+      threads.yield();
+    }
+    while (true) {
+      PacketHandle packet;
+      {
+        Threads::Scope lock(receiver_mtx);
+        if (!receiver.pop(packet)) {
+          break;
+        }
+      }
+      take(*packet);
+      result.bytes += packet->data.size();
+      result.packets++;
+    }
+
+    if (heard.exchange(false)) {
+      {
+        Threads::Scope lock(receiver_mtx);
+        receiver.acknowledgement(ack);
+      }
+      ack.header.type = RADIO_BULK_ACK;
+      radio.available();
+      uint32_t before = ground.airtime();
+      TEST_ASSERT_TRUE(ground.send(ack, RFM23::FecMode::ReedSolomon));
+      advance_micros(ground.airtime() - before + delay);
+      while (radio.available()) {
+        if (radio.recv(received, 0) >= 0 &&
+            received.header.type == RADIO_BULK_ACK) {
+          sender.acknowledge(received);
+        }
+      }
+    } else if (!sent) {
+      advance_millis(ARQ_TIMER_GRANULARITY);
+    }
+  }
+  stop = true;
+  listener.join();
+  result.elapsed = micros() - start;
+  result.resent  = sender.retransmissions();
+  TEST_ASSERT_EQUAL(0, sender.in_flight());
+  return result;
+}
+
+/**
+ * @brief Send BULK_PACKETS packets of mixed sizes through send_bulk(),
+ * checking each arrives whole and in order.
+ *
+ * @param window The ARQ window of both ends.
+ */
+static bulk_result send_numbered(uint8_t window) {
+  uint16_t pushed = 0;
+  uint16_t popped = 0;
+  auto     next   = [&](PacketComm &packet) {
+    if (pushed == BULK_PACKETS) {
+      return false;
+    }
+    fill(packet, bulk_size(pushed), pushed);
+    pushed++;
+    return true;
+  };
+  auto take = [&](const PacketComm &packet) {
+    TEST_ASSERT_TRUE(filled(packet, bulk_size(popped), popped));
+    popped++;
+  };
+  return send_bulk(window, next, take);
+}
+
+/**
+ * @brief Bulk data crosses a lossy channel whole and in order through the ARQ
+ * transport, fragmented into frames and repaired by FEC, although any lost
+ * frame loses its whole packet. The link statistics of both radios account
+ * for every frame on the medium, and every packet goes back to the pool.
+ * Reports the goodput and retransmissions.
+ */
+void test_arq_transfer(void) {
+  TEST_ASSERT_TRUE(radio.set_modem(RFM23_MODEM_RUNGS - 1));
+  TEST_ASSERT_TRUE(ground.set_modem(RFM23_MODEM_RUNGS - 1));
+  sim_channel_model lossy;
+  lossy.burst_start = 0.02f;
+  sim_medium.set_model(lossy);
+  sim_medium.reset();
+  radio.stats();
+  ground.stats();
+  size_t pool_free = pool.available();
+
+  bulk_result            result = send_numbered(BULK_WINDOW);
+  RFM23::link_stats      tx     = radio.stats();
+  RFM23::link_stats      rx     = ground.stats();
+  const sim_medium_stats medium = sim_medium.stats();
+  char                   message[200];
+  snprintf(message, sizeof(message),
+           "%u packets, %u bytes in %.1f s, %.0f bit/s; %u/%u frames lost, "
+           "%u corrupted; %u frames resent",
+           result.packets, result.bytes, result.elapsed / 1e6,
+           8e6 * result.bytes / result.elapsed, medium.lost, medium.sent,
+           medium.corrupted, result.resent);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_EQUAL(BULK_PACKETS, result.packets);
+  TEST_ASSERT_GREATER_THAN(0, medium.lost);
+  TEST_ASSERT_GREATER_THAN(0, result.resent);
+  TEST_ASSERT_EQUAL(0, medium.missed);
+  TEST_ASSERT_EQUAL(medium.sent, tx.tx_frames + rx.tx_frames);
+  TEST_ASSERT_LESS_OR_EQUAL(medium.sent - medium.lost,
+                            rx.rx_frames + tx.rx_frames);
+  TEST_ASSERT_EQUAL(pool_free, pool.available());
+}
+
+/**
+ * @brief The flight window of ARQ_WINDOW frames moves bulk data faster than
+ * stop-and-wait, a window of one, over a clean channel and two lossy ones.
+ * Reports the goodput and retransmissions of both.
+ */
+void test_arq_window(void) {
+  TEST_ASSERT_TRUE(radio.set_modem(RFM23_MODEM_RUNGS - 1));
+  TEST_ASSERT_TRUE(ground.set_modem(RFM23_MODEM_RUNGS - 1));
+  const float   bursts[]  = {0, 0.01f, 0.02f};
+  const uint8_t windows[] = {1, ARQ_WINDOW};
+  for (float burst : bursts) {
+    sim_channel_model model;
+    model.burst_start = burst;
+    double goodput[2];
+    for (size_t i = 0; i < 2; i++) {
+      sim_medium.set_model(model);
+      sim_medium.reset();
+      bulk_result result = send_numbered(windows[i]);
+      TEST_ASSERT_EQUAL(BULK_PACKETS, result.packets);
+      goodput[i] = 8e6 * result.bytes / result.elapsed;
+
+      char message[160];
+      snprintf(message, sizeof(message),
+               "burst start %.2f, window %2u: %.0f bit/s in %.1f s, %u/%u "
+               "frames lost, %u frames resent",
+               burst, windows[i], goodput[i], result.elapsed / 1e6,
+               sim_medium.stats().lost, sim_medium.stats().sent,
+               result.resent);
+      TEST_MESSAGE(message);
+    }
+    TEST_ASSERT_GREATER_THAN(goodput[0], goodput[1]);
+  }
+}
+
+/**
+ * @brief Answer a file downlink's read request from a file, as the RPi does.
+ *
+ * @param file The file's bytes.
+ * @param request The read request.
+ * @param chunk The packet whose data will be set to the answer.
+ */
+static void answer_read(const vector<uint8_t> &file, const PacketComm &request,
+                        PacketComm &chunk) {
+  uint32_t offset = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    offset |= (uint32_t)request.data[2 + i] << (8 * i);
+  }
+  uint16_t length = request.data[6] | (request.data[7] << 8);
+  size_t   end    = std::min<size_t>(file.size(), offset + length);
+  chunk.data.assign(request.data.begin(), request.data.begin() + 6);
+  for (uint8_t i = 0; i < 4; i++) {
+    chunk.data.push_back(file.size() >> (8 * i));
+  }
+  if (offset < end) {
+    chunk.data.insert(chunk.data.end(), file.begin() + offset,
+                      file.begin() + end);
+  }
+}
+
+/**
+ * @brief A file comes down whole and in order from the file downlink through
+ * the ARQ transport and the radio, over the default channel, as the RPi and
+ * RFM23 channels pass its chunks between them. The RPi answers each read at
+ * once. Reports the effective rate.
+ */
+void test_file_downlink(void) {
+  TEST_ASSERT_TRUE(radio.set_modem(RFM23_MODEM_RUNGS - 1));
+  TEST_ASSERT_TRUE(ground.set_modem(RFM23_MODEM_RUNGS - 1));
+  sim_medium.set_model(sim_channel_model());
+  sim_medium.reset();
+  vector<uint8_t> file(DOWNLINK_FILE_SIZE);
+  for (size_t i = 0; i < file.size(); i++) {
+    file[i] = i * 7 + (i >> 8);
+  }
+
+  FileDownlink    downlink(FILE_DOWNLINK_CHUNK);
+  PacketComm      request;
+  PacketComm      answer;
+  vector<uint8_t> copy;
+  uint32_t        chunks = 0;
+  auto            next   = [&](PacketComm &chunk) {
+    while (!downlink.next_chunk(chunk)) {
+      if (!downlink.active()) {
+        return false;
+      }
+      if (downlink.read_request(request)) {
+        answer_read(file, request, answer);
+        TEST_ASSERT_TRUE(downlink.receive(answer));
+      }
+    }
+    chunk.header.type = FILE_CHUNK;
+    return true;
+  };
+  auto take = [&](const PacketComm &chunk) {
+    TEST_ASSERT_TRUE(chunk.header.type == FILE_CHUNK);
+    TEST_ASSERT_GREATER_OR_EQUAL(FILE_CHUNK_HEADER, chunk.data.size());
+    uint32_t offset = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+      offset |= (uint32_t)chunk.data[2 + i] << (8 * i);
+    }
+    TEST_ASSERT_EQUAL(copy.size(), offset);
+    copy.insert(copy.end(), chunk.data.begin() + FILE_CHUNK_HEADER,
+                chunk.data.end());
+    chunks++;
+  };
+  downlink.start(DOWNLINK_FILE_ID, 0);
+  bulk_result result = send_bulk(ARQ_WINDOW, next, take);
+
+  TEST_ASSERT_FALSE(downlink.active());
+  TEST_ASSERT_EQUAL(file.size(), copy.size());
+  TEST_ASSERT_EQUAL_MEMORY(file.data(), copy.data(), file.size());
+  const sim_medium_stats medium = sim_medium.stats();
+  char                   message[200];
+  snprintf(message, sizeof(message),
+           "%u-byte file in %u chunks, %.1f s: %.0f bytes/s; %u/%u frames "
+           "lost, %u frames resent",
+           DOWNLINK_FILE_SIZE, chunks, result.elapsed / 1e6,
+           1e6 * DOWNLINK_FILE_SIZE / result.elapsed, medium.lost,
+           medium.sent, result.resent);
+  TEST_MESSAGE(message);
+}
+
+/** @brief The number of packets the beacon packer under test has sent. */
+static uint32_t beacon_packets;
+
+/** @brief Acquire a beacon packet, as acquire_beacon_packet() does. */
+static PacketHandle acquire_beacon() {
+  PacketHandle packet = pool.acquire();
+  if (packet) {
+    packet->header.type = PacketComm::TypeId::DataObcBeacon;
+  }
+  return packet;
+}
+
+/** @brief Send a beacon packet from the radio under test, as beacons go. */
+static PushResult send_beacon(PacketHandle packet) {
+  beacon_packets++;
+  TEST_ASSERT_TRUE(radio.send(*packet, RFM23::FecMode::None));
+  return PushResult::Accepted;
+}
+
+/** @brief Register the beacons setup_beacon_codec() compresses. */
+static void register_beacons(BeaconEncoder &encoder) {
+  using namespace Artemis::Devices;
+  const int8_t imu[]         = {-3, -3, -3, -4, -4, -4, -2};
+  const int8_t mag[]         = {-2, -2, -2};
+  const int8_t current1[]    = {-3, -3, -2, -2};
+  const int8_t current2[]    = {-3, -3, -3, -2, -2, -2};
+  int8_t       temperature[ARTEMIS_TEMP_SENSOR_COUNT + 1];
+  for (size_t i = 0; i < sizeof(temperature); i++) {
+    temperature[i] = -2;
+  }
+  TEST_ASSERT_TRUE(encoder.add_stream((uint8_t)BeaconType::IMUBeacon, imu,
+                                      sizeof(imu)));
+  TEST_ASSERT_TRUE(encoder.add_stream((uint8_t)BeaconType::MagnetometerBeacon,
+                                      mag, sizeof(mag)));
+  TEST_ASSERT_TRUE(encoder.add_stream((uint8_t)BeaconType::CurrentBeacon1,
+                                      current1, sizeof(current1)));
+  TEST_ASSERT_TRUE(encoder.add_stream((uint8_t)BeaconType::CurrentBeacon2,
+                                      current2, sizeof(current2)));
+  TEST_ASSERT_TRUE(encoder.add_stream((uint8_t)BeaconType::TemperatureBeacon,
+                                      temperature, sizeof(temperature)));
+}
+
+/** @brief The radio's cost of one cycle of beacons. */
+struct beacon_cost {
+  /** @brief The number of packets sent. */
+  uint32_t packets;
+  /** @brief The number of frames sent. */
+  uint16_t frames;
+  /** @brief The airtime, in microseconds, of the frames sent. */
+  uint32_t airtime;
+};
+
+/**
+ * @brief Send one cycle of beacons through a packer, the ones
+ * beacon_artemis_devices() sends, and flush it.
+ *
+ * The readings drift a little from cycle to cycle, as they do in orbit.
+ */
+static beacon_cost send_beacon_cycle(BeaconPacker &packer, uint32_t cycle) {
+  using namespace Artemis::Devices;
+  const uint32_t                        deci  = cycle * BEACON_CYCLE_TIME;
+  const float                           drift = cycle * 0.013f;
+  TemperatureSensors::temperaturebeacon temperature;
+  CurrentSensors::currentbeacon1        current1;
+  CurrentSensors::currentbeacon2        current2;
+  IMU::imubeacon                        imu;
+  Magnetometer::magbeacon               mag;
+  GPS::gpsbeacon                        gps;
+  airtimebeacon                         airtime;
+  temperature.deci = current1.deci = current2.deci = deci;
+  imu.deci = mag.deci = gps.deci = airtime.deci = deci;
+  for (size_t i = 0; i < ARTEMIS_TEMP_SENSOR_COUNT; i++) {
+    temperature.tmp36_tempC[i] = 18.5f + i + drift;
+  }
+  temperature.teensy_tempC = 31.2f + drift;
+  for (size_t i = 0; i < ARTEMIS_CURRENT_BEACON_1_COUNT; i++) {
+    current1.busvoltage[i] = 4.812f + drift;
+    current1.current[i]    = 0.21f - drift / 10;
+  }
+  for (size_t i = 0;
+       i < ARTEMIS_CURRENT_SENSOR_COUNT - ARTEMIS_CURRENT_BEACON_1_COUNT; i++) {
+    current2.busvoltage[i] = 7.406f - drift;
+    current2.current[i]    = 0.35f + drift / 10;
+  }
+  imu.accelx     = 0.012f + drift;
+  imu.accely     = -0.034f;
+  imu.accelz     = 0.008f - drift;
+  imu.gyrox      = 0.0213f + drift / 10;
+  imu.gyroy      = -0.0107f;
+  imu.gyroz      = 0.0051f;
+  imu.imutemp    = 24.5f + drift;
+  mag.magx       = 21.37f + drift;
+  mag.magy       = -4.12f;
+  mag.magz       = 38.91f - drift;
+  gps.latitude   = 29.65f + drift;
+  gps.longitude  = -82.32f - drift;
+  gps.altitude   = 418000 + cycle;
+  gps.speed      = 7660;
+  gps.satellites = 9;
+  airtime.budget    = RFM23_AIRTIME_BUDGET;
+  airtime.window    = RFM23_AIRTIME_WINDOW / SECONDS;
+  airtime.consumed  = cycle * 1200;
+  airtime.remaining = RFM23_AIRTIME_BUDGET - 1200;
+
+  radio.stats();
+  beacon_packets  = 0;
+  uint32_t before = radio.airtime();
+  packer.add(&temperature, sizeof(temperature));
+  packer.add(&current1, sizeof(current1));
+  packer.add(&current2, sizeof(current2));
+  packer.add(&imu, sizeof(imu));
+  packer.add(&mag, sizeof(mag));
+  packer.add(&gps, sizeof(gps));
+  packer.add(&airtime, sizeof(airtime));
+  for (uint8_t queue = 0; queue < 4; queue++) {
+    queuebeacon beacon;
+    beacon.deci     = deci;
+    beacon.queue    = queue;
+    beacon.enqueued = cycle * 40 + queue;
+    beacon.dequeued = cycle * 40 + queue;
+    for (size_t i = 0; i < QUEUE_DWELL_BUCKETS; i++) {
+      beacon.dwell[i] = i < 3 ? cycle * 12 : 0;
+    }
+    packer.add(&beacon, sizeof(beacon));
+  }
+  packer.flush();
+  return {beacon_packets, radio.stats().tx_frames, radio.airtime() - before};
+}
+
+/**
+ * @brief A cycle of beacons, packed by route_beacon_to_rfm23()'s packer and
+ * sent by the radio, takes fewer frames and less airtime aggregated than
+ * with each beacon in a packet of its own. Reports both, for the keyframe
+ * cycle and the delta cycle after it.
+ */
+void test_beacon_cycle(void) {
+  BeaconEncoder aggregated_encoder(BEACON_KEYFRAME_INTERVAL);
+  BeaconEncoder alone_encoder(BEACON_KEYFRAME_INTERVAL);
+  register_beacons(aggregated_encoder);
+  register_beacons(alone_encoder);
+  BeaconPacker aggregated(aggregated_encoder, BEACON_AGGREGATE_SIZE,
+                          BEACON_AGGREGATE_DEADLINE, acquire_beacon,
+                          send_beacon);
+  BeaconPacker alone(alone_encoder, 0, BEACON_AGGREGATE_DEADLINE,
+                     acquire_beacon, send_beacon);
+
+  const char *names[] = {"Keyframe", "Delta"};
+  for (uint32_t cycle = 0; cycle < 2; cycle++) {
+    beacon_cost packed = send_beacon_cycle(aggregated, cycle);
+    beacon_cost single = send_beacon_cycle(alone, cycle);
+    TEST_ASSERT_EQUAL(11, single.packets);
+    TEST_ASSERT_LESS_THAN(single.packets, packed.packets);
+    TEST_ASSERT_LESS_THAN(single.frames, packed.frames);
+    TEST_ASSERT_LESS_THAN(single.airtime, packed.airtime);
+
+    char message[160];
+    snprintf(message, sizeof(message),
+             "%s cycle: aggregated %u packets, %u frames, %.1f ms; alone %u "
+             "packets, %u frames, %.1f ms",
+             names[cycle], packed.packets, packed.frames, packed.airtime / 1e3,
+             single.packets, single.frames, single.airtime / 1e3);
+    TEST_MESSAGE(message);
+  }
+}
+
+/** @brief The link quality of a rung after a run of intact frames. */
+static RFM23::link_quality heard(uint16_t good, uint16_t bad, int16_t rssi) {
+  RFM23::link_quality link = {};
+  link.good                = good;
+  link.bad                 = bad;
+  link.rssi                = rssi;
+  link.since_rx            = 0;
+  return link;
+}
+
+/**
+ * @brief The ladder asks to step up on a strong, clean link and down on a
+ * weak or lossy one, no more often than RFM23_MODEM_REQUEST_INTERVAL, and
+ * only once it has heard RFM23_MODEM_MIN_FRAMES.
+ */
+void test_modem_ladder(void) {
+  ModemLadder       ladder;
+  ModemLadder::step step;
+  const int16_t     up = RFM23::MODEM_MIN_RSSI[2] + RFM23_MODEM_HYSTERESIS;
+
+  step = ladder.update(heard(RFM23_MODEM_MIN_FRAMES - 1, 0, up), 1);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::None, step.action);
+  step = ladder.update(heard(RFM23_MODEM_MIN_FRAMES, 0, up - 1), 1);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::None, step.action);
+  step = ladder.update(heard(9, 1, up), 1);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::Request, step.action);
+  TEST_ASSERT_EQUAL(2, step.rung);
+
+  step = ladder.update(heard(10, 0, RFM23::MODEM_MIN_RSSI[2] - 1), 2);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::None, step.action);
+  advance_millis(RFM23_MODEM_REQUEST_INTERVAL);
+  step = ladder.update(heard(10, 0, RFM23::MODEM_MIN_RSSI[2] - 1), 2);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::Request, step.action);
+  TEST_ASSERT_EQUAL(1, step.rung);
+
+  advance_millis(RFM23_MODEM_REQUEST_INTERVAL);
+  step = ladder.update(heard(4, 5, up), 2);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::Request, step.action);
+  TEST_ASSERT_EQUAL(1, step.rung);
+
+  advance_millis(RFM23_MODEM_REQUEST_INTERVAL);
+  step = ladder.update(heard(10, 0, 0), RFM23_MODEM_RUNGS - 1);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::None, step.action);
+  step = ladder.update(heard(10, 0, -128), 0);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::None, step.action);
+}
+
+/**
+ * @brief A switch with nothing heard from ground reverts to the previous
+ * rung, one confirmed by a frame stays, and a silent link falls back to
+ * rung 0.
+ */
+void test_modem_fallback(void) {
+  ModemLadder         ladder;
+  RFM23::link_quality silent = {};
+  ladder.switched(1);
+  advance_millis(RFM23_MODEM_PROBATION - 1);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::None, ladder.update(silent, 2).action);
+  advance_millis(1);
+  ModemLadder::step step = ladder.update(silent, 2);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::Switch, step.action);
+  TEST_ASSERT_EQUAL(1, step.rung);
+
+  ladder.switched(1);
+  RFM23::link_quality confirmed = heard(1, 0, -80);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::None,
+                    ladder.update(confirmed, 2).action);
+  advance_millis(RFM23_MODEM_PROBATION);
+  confirmed.good = 0;
+  TEST_ASSERT_EQUAL(ModemLadder::Action::None,
+                    ladder.update(confirmed, 2).action);
+
+  advance_millis(RFM23_MODEM_SILENCE - RFM23_MODEM_PROBATION);
+  step = ladder.update(confirmed, 2);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::Switch, step.action);
+  TEST_ASSERT_EQUAL(0, step.rung);
+  TEST_ASSERT_EQUAL(ModemLadder::Action::None,
+                    ladder.update(confirmed, 0).action);
+}
+
+/** @brief The delivery of a simulated pass. */
+struct pass_result {
+  /** @brief The number of data bytes ground received intact. */
+  uint32_t bytes;
+  /** @brief The number of data frames sent. */
+  uint32_t sent;
+  /** @brief The number of data frames ground received intact. */
+  uint32_t received;
+  /** @brief The number of seconds spent at each rung. */
+  uint32_t seconds[RFM23_MODEM_RUNGS];
+};
+
+/**
+ * @brief The RSSI, in dBm, a second into the pass.
+ *
+ * The signal rises from the horizon to overhead and sets again, as a rough
+ * stand-in for the path loss over a pass.
+ */
+static int16_t pass_rssi(uint32_t second) {
+  return PASS_RSSI_LOW + (PASS_RSSI_HIGH - PASS_RSSI_LOW) *
+                             sin(M_PI * second / PASS_LENGTH);
+}
+
+/**
+ * @brief The channel at an RSSI and rung.
+ *
+ * Frames are lossless RFM23_MODEM_HYSTERESIS above the rung's minimum RSSI,
+ * lost more and more in bursts as the margin shrinks, and all lost once the
+ * RSSI is RFM23_MODEM_HYSTERESIS below it.
+ */
+static sim_channel_model pass_model(int16_t rssi, uint8_t rung) {
+  int16_t           margin = rssi - RFM23::MODEM_MIN_RSSI[rung];
+  sim_channel_model model;
+  model.bit_error_rate = 0;
+  model.rssi           = rssi;
+  model.burst_end      = 0.5f;
+  if (margin >= RFM23_MODEM_HYSTERESIS) {
+    model.burst_start = 0;
+  } else if (margin >= 0) {
+    model.burst_start = 0.1f;
+  } else if (margin >= -RFM23_MODEM_HYSTERESIS) {
+    model.burst_start = 0.5f;
+  } else {
+    model.burst_start = 1;
+    model.burst_end   = 0;
+  }
+  return model;
+}
+
+/**
+ * @brief Fly a pass, with the radio sending single-frame packets to ground
+ * as fast as it can and ground sending a frame every PASS_UPLINK.
+ *
+ * Each second, the adaptive radio takes the step its ModemLadder asks for.
+ * Ground grants every request, and both ends switch together, as they would
+ * on a RADIO_MODEM_SWITCH.
+ *
+ * @param adaptive Whether to walk the ladder, or stay at rung 0.
+ */
+static pass_result fly_pass(bool adaptive) {
+  const size_t size = RFM23_FRAGMENT_PAYLOAD - sizeof(PacketComm::Header) - 2;
+  reset_time();
+  sim_medium.reset();
+  TEST_ASSERT_TRUE(radio.init(config, &spi_mtx));
+  TEST_ASSERT_TRUE(ground.init(config, &ground_mtx));
+
+  ModemLadder ladder;
+  PacketComm  data;
+  PacketComm  uplink;
+  PacketComm  received;
+  fill(data, size, 0);
+  fill(uplink, TX_DATA_SIZE, 0);
+  pass_result result      = {};
+  uint32_t    next_uplink = micros();
+  auto        drain       = [&] {
+    while (radio.available()) {
+      radio.recv(received, 0);
+    }
+    while (ground.available()) {
+      if (ground.recv(received, 0) >= 0 && filled(received, size, 0)) {
+        result.bytes += size;
+        result.received++;
+      }
+    }
+  };
+  for (uint32_t second = 0; second < PASS_LENGTH; second++) {
+    uint8_t rung = radio.modem();
+    sim_medium.set_model(pass_model(pass_rssi(second), rung));
+    result.seconds[rung]++;
+
+    uint32_t end = micros() + 1000000;
+    while ((int32_t)(micros() - end) < 0) {
+      // Ground waits for the radio's last frame to land, and the radio for
+      // ground's, since neither can hear the other while it sends.
+      if ((int32_t)(micros() - next_uplink) >= 0) {
+        advance_micros(sim_medium.model().delay);
+        drain();
+        uint32_t before = ground.airtime();
+        TEST_ASSERT_TRUE(ground.send(uplink));
+        advance_micros(ground.airtime() - before + sim_medium.model().delay);
+        next_uplink += PASS_UPLINK * 1000;
+      } else {
+        uint32_t before = radio.airtime();
+        TEST_ASSERT_TRUE(radio.send(data));
+        advance_micros(radio.airtime() - before);
+        result.sent++;
+      }
+      drain();
+    }
+
+    if (!adaptive) {
+      continue;
+    }
+    ModemLadder::step step = ladder.update(radio.link(), rung);
+    if (step.action != ModemLadder::Action::None) {
+      TEST_ASSERT_TRUE(radio.set_modem(step.rung));
+      TEST_ASSERT_TRUE(ground.set_modem(step.rung));
+    }
+    if (step.action == ModemLadder::Action::Request) {
+      ladder.switched(rung);
+    }
+  }
+  advance_micros(sim_medium.model().delay);
+  drain();
+  return result;
+}
+
+/**
+ * @brief Over a simulated pass, walking the modem ladder delivers several
+ * times the data of staying at rung 0, and steps back down as the
+ * satellite sets instead of losing the link. Reports the delivery of each
+ * and the time spent at each rung.
+ *
+ * A step down waits for the RSSI to fall below the rung's minimum, so some
+ * frames are lost at the edge of each rung on the way down.
+ */
+void test_modem_pass(void) {
+  pass_result fixed    = fly_pass(false);
+  pass_result adaptive = fly_pass(true);
+
+  const pass_result *results[] = {&fixed, &adaptive};
+  const char        *names[]   = {"fixed rung 0", "adaptive"};
+  for (size_t i = 0; i < 2; i++) {
+    const pass_result &result = *results[i];
+    char               message[200];
+    snprintf(message, sizeof(message),
+             "%s: %u bytes in %u s, %.0f bit/s, %u/%u frames; seconds at "
+             "rungs %u/%u/%u/%u/%u",
+             names[i], result.bytes, PASS_LENGTH,
+             8.0 * result.bytes / PASS_LENGTH, result.received, result.sent,
+             result.seconds[0], result.seconds[1], result.seconds[2],
+             result.seconds[3], result.seconds[4]);
+    TEST_MESSAGE(message);
+  }
+  TEST_ASSERT_EQUAL(fixed.sent, fixed.received);
+  TEST_ASSERT_GREATER_THAN(5 * fixed.bytes, adaptive.bytes);
+  TEST_ASSERT_GREATER_THAN(adaptive.sent * 3 / 4, adaptive.received);
+  TEST_ASSERT_GREATER_THAN(0, adaptive.seconds[RFM23_MODEM_RUNGS - 1]);
+  TEST_ASSERT_LESS_THAN(2, radio.modem());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_tx_while_rx_waits);
+  RUN_TEST(test_tx_gap);
+  RUN_TEST(test_burst_throughput);
+  RUN_TEST(test_fragment_round_trip);
+  RUN_TEST(test_reassembly);
+  RUN_TEST(test_reassembly_slots);
+  RUN_TEST(test_frame_crc);
+  RUN_TEST(test_fec_frame_loss);
+  RUN_TEST(test_lossy_goodput);
+  RUN_TEST(test_arq_transfer);
+  RUN_TEST(test_arq_window);
+  RUN_TEST(test_file_downlink);
+  RUN_TEST(test_beacon_cycle);
+  RUN_TEST(test_modem_ladder);
+  RUN_TEST(test_modem_fallback);
+  RUN_TEST(test_modem_pass);
+  return UNITY_END();
+}
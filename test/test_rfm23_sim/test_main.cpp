@@ -0,0 +1,393 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests and a throughput benchmark of the simulated RFM23 radio.
+ *
+ * Each test builds its own channel rather than using sim_medium. Time is
+ * simulated, so airtimes and latencies are checked exactly, and the
+ * channel's statistics are checked against its model over thousands of
+ * frames.
+ */
+#include <RHHardwareSPI1.h>
+#include <chrono>
+#include <sim_rf22.h>
+#include <string.h>
+#include <unity.h>
+
+/** @brief The framing the simulated radio adds to each frame, in bytes. */
+#define FRAME_OVERHEAD 11
+/** @brief The size of the frames sent by these tests. */
+#define FRAME_SIZE     50
+/** @brief The number of frames each statistical test sends. */
+#define MODEL_FRAMES   20000
+/** @brief The simulated time, in seconds, each benchmark rate runs for. */
+#define BENCHMARK_TIME 60
+/** @brief The time, in microseconds, between polls of the benchmark. */
+#define BENCHMARK_STEP 50
+
+/** @brief The modem configurations, and their bit rates, under test. */
+static const struct {
+  RH_RF22::ModemConfigChoice config;
+  uint32_t                   bitrate;
+} MODEMS[] = {
+    {RH_RF22::FSK_Rb2Fd5, 2000},        {RH_RF22::FSK_Rb4_8Fd45, 4800},
+    {RH_RF22::FSK_Rb9_6Fd45, 9600},     {RH_RF22::FSK_Rb19_2Fd9_6, 19200},
+    {RH_RF22::FSK_Rb38_4Fd19_6, 38400}, {RH_RF22::FSK_Rb125Fd125, 125000},
+};
+
+void setUp(void) { reset_time(); }
+
+void tearDown(void) {}
+
+/** @brief A channel model with neither bit errors nor bursts. */
+static sim_channel_model lossless() {
+  sim_channel_model model;
+  model.bit_error_rate = 0;
+  model.burst_start    = 0;
+  return model;
+}
+
+/** @brief The airtime, in microseconds, of a frame at a bit rate. */
+static uint32_t airtime(uint8_t length, uint32_t bitrate) {
+  return (uint64_t)(FRAME_OVERHEAD + length) * 8 * 1000000 / bitrate;
+}
+
+/**
+ * @brief At every bit rate, a frame keeps the radio transmitting for its
+ * airtime, and reaches the other radio, intact and with the model's RSSI,
+ * exactly when its airtime and the propagation delay have passed.
+ */
+void test_airtime_and_delay(void) {
+  SimMedium medium;
+  SimRF22   radio(0, 0, hardware_spi1, medium);
+  SimRF22   ground(0, 0, hardware_spi1, medium);
+  TEST_ASSERT_TRUE(radio.init());
+  TEST_ASSERT_TRUE(ground.init());
+  SimRF22 extra(0, 0, hardware_spi1, medium);
+  TEST_ASSERT_FALSE(extra.init());
+
+  sim_channel_model model = lossless();
+  model.delay             = 4000;
+  model.rssi              = -101;
+  medium.set_model(model);
+  uint8_t frame[FRAME_SIZE];
+  for (uint8_t i = 0; i < FRAME_SIZE; i++) {
+    frame[i] = i;
+  }
+
+  for (const auto &modem : MODEMS) {
+    TEST_ASSERT_TRUE(radio.setModemConfig(modem.config));
+    uint32_t expected = airtime(FRAME_SIZE, modem.bitrate);
+    uint32_t start    = micros();
+    TEST_ASSERT_TRUE(radio.send(frame, FRAME_SIZE));
+    advance_micros(expected - 1);
+    TEST_ASSERT_EQUAL(RHGenericDriver::RHModeTx, radio.mode());
+    advance_micros(1);
+    TEST_ASSERT_EQUAL(RHGenericDriver::RHModeIdle, radio.mode());
+
+    advance_micros(model.delay - 1);
+    TEST_ASSERT_FALSE(ground.available());
+    advance_micros(1);
+    TEST_ASSERT_TRUE(ground.available());
+    uint8_t received[SIM_RF22_MAX_FRAME];
+    uint8_t length = sizeof(received);
+    TEST_ASSERT_TRUE(ground.recv(received, &length));
+    TEST_ASSERT_EQUAL(FRAME_SIZE, length);
+    TEST_ASSERT_EQUAL_MEMORY(frame, received, FRAME_SIZE);
+    TEST_ASSERT_EQUAL(-101, ground.lastRssi());
+    TEST_ASSERT_EQUAL(micros() - start, expected + model.delay);
+  }
+  TEST_ASSERT_FALSE(radio.setModemConfig(RH_RF22::OOK_Rb1_2Bw75));
+  sim_medium_stats stats = medium.stats();
+  TEST_ASSERT_EQUAL(6, stats.sent);
+  TEST_ASSERT_EQUAL(6, stats.delivered);
+  TEST_ASSERT_EQUAL(6 * FRAME_SIZE, stats.bytes);
+}
+
+/**
+ * @brief Bits are flipped at the model's bit error rate, and every frame with
+ * a flipped bit is counted as corrupted.
+ */
+void test_bit_error_rate(void) {
+  SimMedium medium;
+  TEST_ASSERT_EQUAL(0, medium.attach());
+  TEST_ASSERT_EQUAL(1, medium.attach());
+  sim_channel_model model = lossless();
+  model.bit_error_rate    = 1e-3f;
+  model.delay             = 0;
+  medium.set_model(model);
+
+  uint8_t  frame[FRAME_SIZE] = {};
+  uint32_t flipped           = 0;
+  uint32_t corrupted         = 0;
+  for (uint32_t n = 0; n < MODEL_FRAMES; n++) {
+    medium.listen(1, micros(), true);
+    medium.transmit(0, frame, FRAME_SIZE, micros(), 1);
+    advance_micros(1);
+    uint8_t received[SIM_RF22_MAX_FRAME];
+    uint8_t length;
+    TEST_ASSERT_TRUE(medium.take(1, micros(), received, &length));
+    uint32_t bits = 0;
+    for (uint8_t i = 0; i < length; i++) {
+      bits += __builtin_popcount(received[i]);
+    }
+    flipped   += bits;
+    corrupted += bits > 0;
+  }
+
+  double rate = (double)flipped / (MODEL_FRAMES * 8.0 * FRAME_SIZE);
+  char   message[80];
+  snprintf(message, sizeof(message), "Bit error rate %.2e, %u/%u corrupted",
+           rate, corrupted, MODEL_FRAMES);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 1e-3, rate);
+  TEST_ASSERT_EQUAL(corrupted, medium.stats().corrupted);
+}
+
+/**
+ * @brief Frames are lost in bursts that follow the Gilbert model: the
+ * fraction lost and the mean length of a burst match the model's stationary
+ * loss and 1 / burst_end.
+ */
+void test_burst_loss(void) {
+  SimMedium medium;
+  medium.attach();
+  medium.attach();
+  sim_channel_model model = lossless();
+  model.burst_start       = 0.05f;
+  model.burst_end         = 0.25f;
+  model.delay             = 0;
+  medium.set_model(model);
+
+  uint8_t  frame[FRAME_SIZE] = {};
+  uint32_t lost              = 0;
+  uint32_t bursts            = 0;
+  bool     in_burst          = false;
+  for (uint32_t n = 0; n < MODEL_FRAMES; n++) {
+    medium.listen(1, micros(), true);
+    medium.transmit(0, frame, FRAME_SIZE, micros(), 1);
+    advance_micros(1);
+    uint8_t received[SIM_RF22_MAX_FRAME];
+    uint8_t length;
+    bool    arrived = medium.take(1, micros(), received, &length);
+    if (!arrived) {
+      lost++;
+      bursts += !in_burst;
+    }
+    in_burst = !arrived;
+  }
+
+  double s        = model.burst_start;
+  double e        = model.burst_end;
+  double expected = s / (s + e - s * e);
+  double loss     = (double)lost / MODEL_FRAMES;
+  double length   = (double)lost / bursts;
+  char   message[80];
+  snprintf(message, sizeof(message),
+           "Loss %.3f (model %.3f), mean burst %.2f frames", loss, expected,
+           length);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_FLOAT_WITHIN(0.1 * expected, expected, loss);
+  TEST_ASSERT_FLOAT_WITHIN(0.1 / e, 1 / e, length);
+  TEST_ASSERT_EQUAL(lost, medium.stats().lost);
+}
+
+/**
+ * @brief A frame arriving while its receiver transmits is lost and counted
+ * against the receiver, and frames sent in turn are not.
+ */
+void test_collision(void) {
+  SimMedium medium;
+  SimRF22   radio(0, 0, hardware_spi1, medium);
+  SimRF22   ground(0, 0, hardware_spi1, medium);
+  TEST_ASSERT_TRUE(radio.init());
+  TEST_ASSERT_TRUE(ground.init());
+  medium.set_model(lossless());
+
+  uint8_t  frame[FRAME_SIZE] = {};
+  uint8_t  received[SIM_RF22_MAX_FRAME];
+  uint8_t  length            = sizeof(received);
+  uint32_t frame_time        = airtime(FRAME_SIZE, 2000);
+  uint32_t delay             = medium.model().delay;
+  TEST_ASSERT_TRUE(radio.send(frame, FRAME_SIZE));
+  advance_micros(2 * delay);
+  TEST_ASSERT_TRUE(ground.send(frame, FRAME_SIZE));
+  advance_micros(frame_time);
+  TEST_ASSERT_FALSE(radio.available());
+  advance_micros(delay);
+  TEST_ASSERT_FALSE(ground.recv(received, &length));
+  TEST_ASSERT_TRUE(radio.recv(received, &length));
+  TEST_ASSERT_EQUAL(1, ground.rxBad());
+  TEST_ASSERT_EQUAL(0, radio.rxBad());
+
+  TEST_ASSERT_TRUE(radio.send(frame, FRAME_SIZE));
+  advance_micros(frame_time + delay);
+  TEST_ASSERT_TRUE(ground.recv(received, &length));
+  TEST_ASSERT_FALSE(radio.available());
+  TEST_ASSERT_TRUE(ground.send(frame, FRAME_SIZE));
+  advance_micros(frame_time + delay);
+  TEST_ASSERT_TRUE(radio.recv(received, &length));
+  TEST_ASSERT_EQUAL(1, ground.rxBad());
+  TEST_ASSERT_EQUAL(0, radio.rxBad());
+  TEST_ASSERT_EQUAL(1, medium.stats().collided);
+}
+
+/**
+ * @brief A radio only receives in receive mode, and holds one frame: frames
+ * arriving while it idles or sleeps, or while it holds an unread frame, are
+ * missed, and once it has read a frame it listens again only when polled.
+ */
+void test_receiver_modes(void) {
+  SimMedium medium;
+  SimRF22   radio(0, 0, hardware_spi1, medium);
+  SimRF22   ground(0, 0, hardware_spi1, medium);
+  TEST_ASSERT_TRUE(radio.init());
+  TEST_ASSERT_TRUE(ground.init());
+  sim_channel_model model = lossless();
+  model.delay             = 0;
+  medium.set_model(model);
+  TEST_ASSERT_TRUE(radio.setModemConfig(RH_RF22::FSK_Rb125Fd125));
+
+  uint8_t  frame[FRAME_SIZE] = {1, 2, 3};
+  uint8_t  received[SIM_RF22_MAX_FRAME];
+  uint8_t  length            = sizeof(received);
+  uint32_t frame_time        = airtime(FRAME_SIZE, 125000);
+  TEST_ASSERT_TRUE(radio.send(frame, FRAME_SIZE));
+  advance_micros(frame_time);
+  TEST_ASSERT_FALSE(ground.recv(received, &length));
+  TEST_ASSERT_TRUE(ground.sleep());
+  TEST_ASSERT_TRUE(radio.send(frame, FRAME_SIZE));
+  advance_micros(frame_time);
+  TEST_ASSERT_FALSE(ground.recv(received, &length));
+  TEST_ASSERT_EQUAL(2, medium.stats().missed);
+
+  TEST_ASSERT_EQUAL(RHGenericDriver::RHModeRx, ground.mode());
+  TEST_ASSERT_TRUE(radio.send(frame, FRAME_SIZE));
+  advance_micros(frame_time);
+  frame[0] = 9;
+  TEST_ASSERT_TRUE(radio.send(frame, FRAME_SIZE));
+  advance_micros(frame_time);
+  TEST_ASSERT_EQUAL(RHGenericDriver::RHModeIdle, ground.mode());
+  TEST_ASSERT_TRUE(ground.available());
+  TEST_ASSERT_TRUE(ground.recv(received, &length));
+  TEST_ASSERT_EQUAL(1, received[0]);
+  TEST_ASSERT_EQUAL(3, medium.stats().missed);
+
+  TEST_ASSERT_TRUE(radio.send(frame, FRAME_SIZE));
+  advance_micros(frame_time);
+  TEST_ASSERT_FALSE(ground.recv(received, &length));
+  TEST_ASSERT_TRUE(radio.send(frame, FRAME_SIZE));
+  advance_micros(frame_time);
+  TEST_ASSERT_TRUE(ground.recv(received, &length));
+  TEST_ASSERT_EQUAL(9, received[0]);
+
+  sim_medium_stats stats = medium.stats();
+  TEST_ASSERT_EQUAL(6, stats.sent);
+  TEST_ASSERT_EQUAL(2, stats.delivered);
+  TEST_ASSERT_EQUAL(4, stats.missed);
+  TEST_ASSERT_EQUAL(0, stats.collided);
+  TEST_ASSERT_EQUAL(0, ground.rxBad());
+}
+
+/**
+ * @brief A channel repeats exactly after a reset, or with the same seed, and
+ * differs with another seed.
+ */
+void test_repeatable(void) {
+  auto run = [](SimMedium &medium) {
+    medium.attach();
+    medium.attach();
+    sim_channel_model model;
+    model.bit_error_rate = 1e-3f;
+    model.delay          = 0;
+    medium.set_model(model);
+    uint32_t hash = 0;
+    for (uint32_t n = 0; n < 1000; n++) {
+      uint8_t frame[FRAME_SIZE] = {};
+      medium.listen(1, n, true);
+      medium.transmit(0, frame, FRAME_SIZE, n, 1);
+      uint8_t length = 0;
+      if (!medium.take(1, n + 1, frame, &length)) {
+        hash = hash * 31 + 1;
+      }
+      for (uint8_t i = 0; i < length; i++) {
+        hash = hash * 31 + frame[i];
+      }
+    }
+    return hash;
+  };
+  SimMedium first(7);
+  SimMedium same(7);
+  SimMedium other(8);
+  uint32_t  hash = run(first);
+  TEST_ASSERT_EQUAL(hash, run(same));
+  TEST_ASSERT_NOT_EQUAL(hash, run(other));
+  first.reset();
+  TEST_ASSERT_EQUAL(hash, run(first));
+}
+
+/**
+ * @brief Measures the frames per second and latency of back-to-back frames
+ * at each bit rate, in simulated time, and how fast the host simulates them.
+ *
+ * The radio sends for all but the last second, and ground polls for frames
+ * every BENCHMARK_STEP, as a receive loop would, so latency is the frame's
+ * airtime and the propagation delay, to within a step.
+ */
+void test_throughput(void) {
+  using clock = std::chrono::steady_clock;
+  for (const auto &modem : MODEMS) {
+    SimMedium medium;
+    SimRF22   radio(0, 0, hardware_spi1, medium);
+    SimRF22   ground(0, 0, hardware_spi1, medium);
+    TEST_ASSERT_TRUE(radio.init());
+    TEST_ASSERT_TRUE(ground.init());
+    TEST_ASSERT_TRUE(radio.setModemConfig(modem.config));
+    sim_channel_model model;
+    model.burst_start = 0;
+    medium.set_model(model);
+
+    uint8_t frame[FRAME_SIZE] = {};
+    uint8_t received[SIM_RF22_MAX_FRAME];
+    uint8_t length;
+    auto    wall = clock::now();
+    for (uint32_t now = 0; now < BENCHMARK_TIME * 1000000UL;
+         now += BENCHMARK_STEP, advance_micros(BENCHMARK_STEP)) {
+      if (radio.mode() != RHGenericDriver::RHModeTx &&
+          now < (BENCHMARK_TIME - 1) * 1000000UL) {
+        TEST_ASSERT_TRUE(radio.send(frame, FRAME_SIZE));
+      }
+      length = sizeof(received);
+      while (ground.recv(received, &length)) {
+        length = sizeof(received);
+      }
+    }
+    double host = std::chrono::duration<double>(clock::now() - wall).count();
+
+    sim_medium_stats stats = medium.stats();
+    double           fps   = (double)stats.delivered / (BENCHMARK_TIME - 1);
+    char             message[120];
+    snprintf(message, sizeof(message),
+             "%6u bit/s: %.1f frames/s, %.1f ms latency, %.0f frames per "
+             "host second",
+             modem.bitrate, fps, stats.latency / 1e3 / stats.delivered,
+             stats.delivered / host);
+    TEST_MESSAGE(message);
+    uint32_t frame_time = airtime(FRAME_SIZE, modem.bitrate);
+    TEST_ASSERT_EQUAL(stats.sent, stats.delivered);
+    TEST_ASSERT_FLOAT_WITHIN(0.02 * fps, 1e6 / frame_time, fps);
+    TEST_ASSERT_LESS_OR_EQUAL(frame_time + model.delay + BENCHMARK_STEP,
+                              stats.latency / stats.delivered);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_airtime_and_delay);
+  RUN_TEST(test_bit_error_rate);
+  RUN_TEST(test_burst_loss);
+  RUN_TEST(test_collision);
+  RUN_TEST(test_receiver_modes);
+  RUN_TEST(test_repeatable);
+  RUN_TEST(test_throughput);
+  return UNITY_END();
+}
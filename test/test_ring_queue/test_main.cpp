@@ -0,0 +1,354 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the lock-free ring buffer queue.
+ *
+ * The contention tests run several producers and consumers on host threads at
+ * once, and check that every element pushed is popped or dropped exactly once,
+ * in the order its producer pushed it. The benchmark runs the same traffic
+ * through the mutex-guarded deque the ring queue replaced.
+ */
+#include <TeensyThreads.h>
+#include <chrono>
+#include <deque>
+#include <packet_queue.h>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+/** @brief The number of producer threads in the contention tests. */
+#define PRODUCERS          4
+/** @brief The number of consumer threads in the contention tests. */
+#define CONSUMERS          2
+/** @brief The number of elements each producer pushes. */
+#define ELEMENTS           20000
+/** @brief The most elements a batch consumer pulls at once. */
+#define BATCH              8
+/** @brief The number of elements pushed and popped by the benchmark. */
+#define BENCHMARK_ELEMENTS 1000000
+
+/**
+ * @brief A move-only element that counts the non-empty tokens destroyed.
+ *
+ * A token's value is its producer in the top byte and its sequence number
+ * below. The value 0 marks an empty token.
+ */
+class Token {
+public:
+  Token(uint32_t value = 0) : value(value) {}
+  Token(Token &&other) : value(other.value) { other.value = 0; }
+  Token &operator=(Token &&other) {
+    discard();
+    value       = other.value;
+    other.value = 0;
+    return *this;
+  }
+  Token(const Token &)            = delete;
+  Token &operator=(const Token &) = delete;
+  ~Token() { discard(); }
+
+  /** @brief Take the value out of the token, leaving it empty. */
+  uint32_t take() {
+    uint32_t taken = value;
+    value          = 0;
+    return taken;
+  }
+
+  /** @brief The number of non-empty tokens destroyed. */
+  static std::atomic<uint32_t> destroyed;
+
+private:
+  void discard() {
+    if (value != 0) {
+      destroyed++;
+    }
+  }
+
+  uint32_t value;
+};
+
+std::atomic<uint32_t> Token::destroyed{0};
+
+/** @brief The value of a producer's nth token. */
+static uint32_t token_value(uint32_t producer, uint32_t n) {
+  return ((producer + 1) << 24) | (n + 1);
+}
+
+/**
+ * @brief The tokens a consumer has popped, checked as they arrive.
+ *
+ * A consumer must see each producer's tokens in the order they were pushed,
+ * though other consumers may take some of them in between.
+ */
+struct consumer_log {
+  uint32_t count           = 0;
+  uint32_t last[PRODUCERS] = {};
+  bool     in_order        = true;
+
+  void record(uint32_t value) {
+    uint32_t producer = (value >> 24) - 1;
+    uint32_t n        = value & 0xFFFFFF;
+    if (producer >= PRODUCERS || n <= last[producer]) {
+      in_order = false;
+    } else {
+      last[producer] = n;
+    }
+    count++;
+  }
+};
+
+/**
+ * @brief The queue the ring queue replaced: a std::deque guarded by a
+ * Threads::Mutex, as PushQueue() and PullQueue() used it. A full queue
+ * refuses a push here, as the ring queue does, so both carry every element.
+ */
+template <typename T, size_t Size> class MutexQueue {
+public:
+  bool push(T &&item) {
+    Threads::Scope lock(mutex);
+    if (queue.size() == Size) {
+      return false;
+    }
+    queue.push_back(std::move(item));
+    return true;
+  }
+
+  bool pop(T &item) {
+    Threads::Scope lock(mutex);
+    if (queue.empty()) {
+      return false;
+    }
+    item = std::move(queue.front());
+    queue.pop_front();
+    return true;
+  }
+
+private:
+  std::deque<T>  queue;
+  Threads::Mutex mutex;
+};
+
+/**
+ * @brief Push and pop elements through a queue, from one thread and then
+ * from PRODUCERS producers and CONSUMERS consumers at once.
+ *
+ * @param uncontended The time taken, in nanoseconds per element, by one
+ * thread pushing and popping in turn.
+ * @param contended The time taken, in nanoseconds per element, by the racing
+ * threads.
+ */
+template <typename Queue>
+static void time_queue(Queue &queue, double &uncontended, double &contended) {
+  using clock = std::chrono::steady_clock;
+  uint32_t value;
+  uint32_t checked = 0;
+  auto     start   = clock::now();
+  for (uint32_t n = 0; n < BENCHMARK_ELEMENTS; n++) {
+    TEST_ASSERT_TRUE(queue.push(std::move(n)));
+    TEST_ASSERT_TRUE(queue.pop(value));
+    checked += value == n;
+  }
+  uncontended = std::chrono::duration<double, std::nano>(clock::now() - start)
+                    .count() /
+                BENCHMARK_ELEMENTS;
+  TEST_ASSERT_EQUAL(BENCHMARK_ELEMENTS, checked);
+
+  std::atomic<uint32_t>    popped{0};
+  std::vector<std::thread> threads;
+  start = clock::now();
+  for (uint32_t p = 0; p < PRODUCERS; p++) {
+    threads.emplace_back([&queue] {
+      for (uint32_t n = 0; n < BENCHMARK_ELEMENTS / PRODUCERS; n++) {
+        uint32_t item = n;
+        while (!queue.push(std::move(item))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (uint32_t c = 0; c < CONSUMERS; c++) {
+    threads.emplace_back([&queue, &popped] {
+      uint32_t item;
+      while (popped.load() < BENCHMARK_ELEMENTS) {
+        if (queue.pop(item)) {
+          popped++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  contended = std::chrono::duration<double, std::nano>(clock::now() - start)
+                  .count() /
+              BENCHMARK_ELEMENTS;
+  TEST_ASSERT_EQUAL(BENCHMARK_ELEMENTS, popped.load());
+}
+
+void setUp(void) { Token::destroyed = 0; }
+
+void tearDown(void) {}
+
+/** @brief Elements come out in the order they went in, up to capacity. */
+void test_push_pop_order(void) {
+  RingQueue<uint32_t, 4> queue;
+  uint32_t               value;
+  TEST_ASSERT_FALSE(queue.pop(value));
+  for (uint32_t i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(queue.push(i));
+  }
+  TEST_ASSERT_FALSE(queue.push(4));
+  TEST_ASSERT_EQUAL(4, queue.size());
+  for (uint32_t i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(queue.pop(value));
+    TEST_ASSERT_EQUAL(i, value);
+  }
+  TEST_ASSERT_TRUE(queue.empty());
+}
+
+/** @brief A batch takes what is there, oldest first, up to its maximum. */
+void test_pop_batch(void) {
+  RingQueue<uint32_t, 8> queue;
+  uint32_t               batch[8];
+  for (uint32_t i = 0; i < 5; i++) {
+    queue.push(i);
+  }
+  TEST_ASSERT_EQUAL(3, queue.pop_batch(batch, 3));
+  TEST_ASSERT_EQUAL(0, batch[0]);
+  TEST_ASSERT_EQUAL(2, batch[2]);
+  TEST_ASSERT_EQUAL(2, queue.pop_batch(batch, 8));
+  TEST_ASSERT_EQUAL(3, batch[0]);
+  TEST_ASSERT_EQUAL(4, batch[1]);
+  TEST_ASSERT_EQUAL(0, queue.pop_batch(batch, 8));
+}
+
+/** @brief Pushing over a full queue evicts and destroys the oldest element. */
+void test_push_overwrite(void) {
+  RingQueue<Token, 2> queue;
+  TEST_ASSERT_FALSE(queue.push_overwrite(Token(1)));
+  TEST_ASSERT_FALSE(queue.push_overwrite(Token(2)));
+  TEST_ASSERT_TRUE(queue.push_overwrite(Token(3)));
+  TEST_ASSERT_EQUAL(1, Token::destroyed.load());
+  Token token;
+  TEST_ASSERT_TRUE(queue.pop(token));
+  TEST_ASSERT_EQUAL(2, token.take());
+  TEST_ASSERT_TRUE(queue.pop(token));
+  TEST_ASSERT_EQUAL(3, token.take());
+}
+
+/**
+ * @brief Producers and consumers racing over a small queue lose nothing.
+ *
+ * One consumer pops elements one at a time and the other pops batches, so
+ * both reservation paths race with the producers and with each other.
+ */
+void test_contention(void) {
+  static RingQueue<Token, 64> queue;
+  std::atomic<uint32_t>       popped{0};
+  consumer_log                logs[CONSUMERS];
+  std::vector<std::thread>    threads;
+
+  for (uint32_t p = 0; p < PRODUCERS; p++) {
+    threads.emplace_back([p] {
+      for (uint32_t n = 0; n < ELEMENTS; n++) {
+        Token token(token_value(p, n));
+        while (!queue.push(std::move(token))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (uint32_t c = 0; c < CONSUMERS; c++) {
+    threads.emplace_back([c, &popped, &logs] {
+      Token batch[BATCH];
+      while (popped.load() < PRODUCERS * ELEMENTS) {
+        size_t count = c == 0 ? queue.pop(batch[0])
+                              : queue.pop_batch(batch, BATCH);
+        for (size_t i = 0; i < count; i++) {
+          logs[c].record(batch[i].take());
+        }
+        popped += count;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  TEST_ASSERT_EQUAL(PRODUCERS * ELEMENTS, logs[0].count + logs[1].count);
+  TEST_ASSERT_TRUE(logs[0].in_order);
+  TEST_ASSERT_TRUE(logs[1].in_order);
+  TEST_ASSERT_GREATER_THAN(0, logs[0].count);
+  TEST_ASSERT_GREATER_THAN(0, logs[1].count);
+  TEST_ASSERT_TRUE(queue.empty());
+  TEST_ASSERT_EQUAL(0, Token::destroyed.load());
+}
+
+/**
+ * @brief Producers overwriting a queue a consumer drains account for every
+ * element: each is popped, evicted, or still queued at the end.
+ */
+void test_overwrite_contention(void) {
+  static RingQueue<Token, 16> queue;
+  std::atomic<uint32_t>       done{0};
+  consumer_log                log;
+  std::vector<std::thread>    threads;
+
+  for (uint32_t p = 0; p < PRODUCERS; p++) {
+    threads.emplace_back([p, &done] {
+      for (uint32_t n = 0; n < ELEMENTS; n++) {
+        queue.push_overwrite(Token(token_value(p, n)));
+      }
+      done++;
+    });
+  }
+  threads.emplace_back([&done, &log] {
+    Token token;
+    while (done.load() < PRODUCERS || !queue.empty()) {
+      if (queue.pop(token)) {
+        log.record(token.take());
+      }
+    }
+  });
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  TEST_ASSERT_TRUE(log.in_order);
+  TEST_ASSERT_EQUAL(PRODUCERS * ELEMENTS,
+                    log.count + Token::destroyed.load() + queue.size());
+}
+
+/**
+ * @brief Measures the time per element through the ring queue and through
+ * the mutex-guarded deque, alone and with producers and consumers racing.
+ */
+void test_throughput(void) {
+  static RingQueue<uint32_t, 64>  ring;
+  static MutexQueue<uint32_t, 64> locked;
+  double                          ring_alone;
+  double                          ring_racing;
+  double                          locked_alone;
+  double                          locked_racing;
+  time_queue(ring, ring_alone, ring_racing);
+  time_queue(locked, locked_alone, locked_racing);
+
+  char message[160];
+  snprintf(message, sizeof(message),
+           "ring: %.1f ns/element alone, %.1f racing; deque and mutex: %.1f "
+           "ns/element alone, %.1f racing",
+           ring_alone, ring_racing, locked_alone, locked_racing);
+  TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_push_pop_order);
+  RUN_TEST(test_pop_batch);
+  RUN_TEST(test_push_overwrite);
+  RUN_TEST(test_contention);
+  RUN_TEST(test_overwrite_contention);
+  RUN_TEST(test_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,386 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests and a dispatch benchmark of the table-driven packet router.
+ *
+ * The router is checked against a linear scan of the same routes for every
+ * node, a spread of types, and every sub-key, then timed over a mixed traffic
+ * trace against the nested switch it replaced.
+ */
+#include "packet_router.h"
+#include <chrono>
+#include <unity.h>
+
+using namespace Artemis;
+
+/** @brief The number of packets in the benchmark trace. */
+#define TRACE_PACKETS 4096
+/** @brief The number of times the benchmark trace is dispatched. */
+#define TRACE_PASSES  200
+
+/** @brief The PDU switch ID of the RPi, as in the main route table. */
+#define SWITCH_RPI    8
+/** @brief A sub-key at the top of the range, once used as the wildcard. */
+#define SWITCH_TOP    0xFF
+
+/** @brief The handler called last, as an index into handlers. */
+static int last_handler = -1;
+
+/** @brief The number of times any handler has been called. */
+static uint32_t dispatched = 0;
+
+template <int I> void handler() {
+  last_handler = I;
+  dispatched++;
+}
+
+/** @brief The handlers of the test table, indexed as last_handler is. */
+static const Router::route_handler handlers[] = {
+    handler<0>, handler<1>, handler<2>, handler<3>, handler<4>,
+    handler<5>, handler<6>, handler<7>, handler<8>,
+};
+
+/** @brief Routes like the main channel's, plus a route on sub-key 0xFF. */
+constexpr auto routes = Router::sort_routes(Router::route_table<11>{{
+    Router::route(NODES::GROUND_NODE_ID, handler<0>),
+    Router::route(NODES::RPI_NODE_ID, handler<1>),
+    Router::route(NODES::TEENSY_NODE_ID, PacketComm::TypeId::CommandObcPing,
+                  handler<2>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsCommunicate, handler<3>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchName, handler<4>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchName, SWITCH_RPI,
+                  handler<5>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchName, SWITCH_TOP,
+                  handler<6>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchStatus, SWITCH_RPI,
+                  handler<7>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandObcSendBeacon, handler<8>),
+    Router::route(NODES::TEENSY_NODE_ID, (PacketComm::TypeId)0xFFFF,
+                  handler<3>),
+    Router::route(NODES::TEENSY_NODE_ID, (PacketComm::TypeId)0x0000,
+                  handler<4>),
+}});
+static_assert(Router::unique_routes(routes), "Duplicate route in route table");
+
+/** @brief The unsorted routes, for the linear scan to search. */
+static const Router::route_entry unsorted[] = {
+    Router::route(NODES::GROUND_NODE_ID, handler<0>),
+    Router::route(NODES::RPI_NODE_ID, handler<1>),
+    Router::route(NODES::TEENSY_NODE_ID, PacketComm::TypeId::CommandObcPing,
+                  handler<2>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsCommunicate, handler<3>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchName, handler<4>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchName, SWITCH_RPI,
+                  handler<5>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchName, SWITCH_TOP,
+                  handler<6>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandEpsSwitchStatus, SWITCH_RPI,
+                  handler<7>),
+    Router::route(NODES::TEENSY_NODE_ID,
+                  PacketComm::TypeId::CommandObcSendBeacon, handler<8>),
+    Router::route(NODES::TEENSY_NODE_ID, (PacketComm::TypeId)0xFFFF,
+                  handler<3>),
+    Router::route(NODES::TEENSY_NODE_ID, (PacketComm::TypeId)0x0000,
+                  handler<4>),
+};
+
+/** @brief The most specific route for a packet, found by a linear scan. */
+static Router::route_handler scan(uint8_t node, uint16_t type,
+                                  int16_t subkey) {
+  const uint64_t keys[] = {
+      subkey >= 0 ? Router::route_key(node, type, (uint8_t)subkey) : 0,
+      Router::route_key(node, type),
+      Router::route_key(node),
+  };
+  for (size_t k = subkey >= 0 ? 0 : 1; k < 3; k++) {
+    for (const auto &entry : unsorted) {
+      if (entry.key == keys[k]) {
+        return entry.handler;
+      }
+    }
+  }
+  return nullptr;
+}
+
+/** @brief Route a packet and return the index of the handler it reached. */
+static int dispatch(NODES node, PacketComm::TypeId type, int16_t subkey) {
+  last_handler                  = -1;
+  Router::route_handler handler =
+      routes.find((uint8_t)node, (uint16_t)type, subkey);
+  if (handler != nullptr) {
+    handler();
+  }
+  return last_handler;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/** @brief The most specific route wins, down to the node's own route. */
+void test_specific_routes(void) {
+  const NODES teensy = NODES::TEENSY_NODE_ID;
+  TEST_ASSERT_EQUAL(
+      5, dispatch(teensy, PacketComm::TypeId::CommandEpsSwitchName,
+                  SWITCH_RPI));
+  TEST_ASSERT_EQUAL(
+      4, dispatch(teensy, PacketComm::TypeId::CommandEpsSwitchName, 3));
+  TEST_ASSERT_EQUAL(
+      4, dispatch(teensy, PacketComm::TypeId::CommandEpsSwitchName, -1));
+  TEST_ASSERT_EQUAL(2,
+                    dispatch(teensy, PacketComm::TypeId::CommandObcPing, 0));
+  TEST_ASSERT_EQUAL(0, dispatch(NODES::GROUND_NODE_ID,
+                                PacketComm::TypeId::CommandObcPing, 1));
+  TEST_ASSERT_EQUAL(1, dispatch(NODES::RPI_NODE_ID,
+                                PacketComm::TypeId::CommandEpsSwitchName,
+                                SWITCH_RPI));
+}
+
+/** @brief Sub-key 0xFF and type 0xFFFF are ordinary values, not wildcards. */
+void test_top_values_are_not_wildcards(void) {
+  const NODES teensy = NODES::TEENSY_NODE_ID;
+  TEST_ASSERT_EQUAL(
+      6, dispatch(teensy, PacketComm::TypeId::CommandEpsSwitchName,
+                  SWITCH_TOP));
+  TEST_ASSERT_EQUAL(
+      4, dispatch(teensy, PacketComm::TypeId::CommandEpsSwitchName, 0xFE));
+  TEST_ASSERT_EQUAL(-1,
+                    dispatch(teensy, PacketComm::TypeId::CommandEpsSwitchStatus,
+                             SWITCH_TOP));
+  TEST_ASSERT_EQUAL(3, dispatch(teensy, (PacketComm::TypeId)0xFFFF, -1));
+  TEST_ASSERT_EQUAL(4, dispatch(teensy, (PacketComm::TypeId)0x0000, 0));
+}
+
+/**
+ * @brief Types that differ only in their top bit have keys of their own, and
+ * reach their own routes.
+ */
+void test_top_type_bit(void) {
+  const NODES    teensy = NODES::TEENSY_NODE_ID;
+  const uint16_t ping   = (uint16_t)PacketComm::TypeId::CommandObcPing;
+  TEST_ASSERT_TRUE(Router::route_key((uint8_t)teensy, ping) !=
+                   Router::route_key((uint8_t)teensy, ping | 0x8000));
+  TEST_ASSERT_TRUE(Router::route_key((uint8_t)teensy, 0x8000) !=
+                   Router::route_key((uint8_t)teensy + 1, 0x0000));
+  TEST_ASSERT_EQUAL(2, dispatch(teensy, (PacketComm::TypeId)ping, -1));
+  TEST_ASSERT_EQUAL(-1,
+                    dispatch(teensy, (PacketComm::TypeId)(ping | 0x8000), -1));
+  TEST_ASSERT_EQUAL(3, dispatch(teensy, (PacketComm::TypeId)0xFFFF, -1));
+  TEST_ASSERT_EQUAL(-1, dispatch(teensy, (PacketComm::TypeId)0x7FFF, -1));
+  TEST_ASSERT_EQUAL(4, dispatch(teensy, (PacketComm::TypeId)0x0000, -1));
+  TEST_ASSERT_EQUAL(-1, dispatch(teensy, (PacketComm::TypeId)0x8000, -1));
+}
+
+/**
+ * @brief A type with only sub-key routes, or no route at all, falls back to
+ * the node's route, or to nothing if the node has none.
+ */
+void test_fallbacks(void) {
+  const NODES teensy = NODES::TEENSY_NODE_ID;
+  TEST_ASSERT_EQUAL(
+      7, dispatch(teensy, PacketComm::TypeId::CommandEpsSwitchStatus,
+                  SWITCH_RPI));
+  TEST_ASSERT_EQUAL(
+      -1, dispatch(teensy, PacketComm::TypeId::CommandEpsSwitchStatus, 0));
+  TEST_ASSERT_EQUAL(
+      -1, dispatch(teensy, PacketComm::TypeId::CommandCameraCapture, -1));
+  TEST_ASSERT_EQUAL(-1, dispatch((NODES)0, PacketComm::TypeId::None, -1));
+  TEST_ASSERT_EQUAL(-1, dispatch((NODES)0xFF, PacketComm::TypeId::None, 0));
+}
+
+/**
+ * @brief The single search finds the same handler as a scan of the routes,
+ * for every node, the types around each route, and every sub-key.
+ */
+void test_matches_linear_scan(void) {
+  uint16_t types[4 * (sizeof(unsorted) / sizeof(unsorted[0]))] = {};
+  size_t   count                                               = 0;
+  for (const auto &entry : unsorted) {
+    uint16_t type  = (entry.key >> 9) & 0xFFFF;
+    types[count++] = type - 1;
+    types[count++] = type;
+    types[count++] = type + 1;
+    types[count++] = type ^ 0x8000;
+  }
+  uint32_t checked = 0;
+  for (uint16_t node = 0; node < 256; node++) {
+    for (size_t t = 0; t < count; t++) {
+      for (int16_t subkey = -1; subkey < 256; subkey++) {
+        Router::route_handler expected = scan(node, types[t], subkey);
+        Router::route_handler found = routes.find(node, types[t], subkey);
+        if (found != expected) {
+          char message[96];
+          snprintf(message, sizeof(message),
+                   "node %u, type 0x%04X, sub-key %d", node, types[t],
+                   subkey);
+          TEST_FAIL_MESSAGE(message);
+        }
+        checked++;
+      }
+    }
+  }
+  TEST_ASSERT_GREATER_THAN(1000000, checked);
+}
+
+/** @brief A packet in the benchmark trace. */
+struct trace_packet {
+  uint8_t  node;
+  uint16_t type;
+  int16_t  subkey;
+};
+
+/**
+ * @brief Dispatch a packet with a nested switch, the way route_packets() did
+ * before the route table.
+ */
+static void switch_dispatch(const trace_packet &packet) {
+  switch ((NODES)packet.node) {
+    case NODES::GROUND_NODE_ID: {
+      handlers[0]();
+      break;
+    }
+    case NODES::RPI_NODE_ID: {
+      handlers[1]();
+      break;
+    }
+    case NODES::TEENSY_NODE_ID: {
+      switch ((PacketComm::TypeId)packet.type) {
+        case PacketComm::TypeId::CommandObcPing: {
+          handlers[2]();
+          break;
+        }
+        case PacketComm::TypeId::CommandEpsCommunicate: {
+          handlers[3]();
+          break;
+        }
+        case PacketComm::TypeId::CommandEpsSwitchName: {
+          switch (packet.subkey) {
+            case SWITCH_RPI: {
+              handlers[5]();
+              break;
+            }
+            case SWITCH_TOP: {
+              handlers[6]();
+              break;
+            }
+            default: {
+              handlers[4]();
+              break;
+            }
+          }
+          break;
+        }
+        case PacketComm::TypeId::CommandEpsSwitchStatus: {
+          if (packet.subkey == SWITCH_RPI) {
+            handlers[7]();
+          }
+          break;
+        }
+        case PacketComm::TypeId::CommandObcSendBeacon: {
+          handlers[8]();
+          break;
+        }
+        default: {
+          if (packet.type == 0xFFFF) {
+            handlers[3]();
+          } else if (packet.type == 0x0000) {
+            handlers[4]();
+          }
+          break;
+        }
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+/**
+ * @brief Report the per-packet dispatch cost of the route table over a mixed
+ * trace: mostly telemetry to ground, then commands to the Teensy, then
+ * packets for the RPi.
+ */
+void test_dispatch_benchmark(void) {
+  static trace_packet trace[TRACE_PACKETS];
+  const uint16_t      commands[] = {
+      (uint16_t)PacketComm::TypeId::CommandObcPing,
+      (uint16_t)PacketComm::TypeId::CommandEpsCommunicate,
+      (uint16_t)PacketComm::TypeId::CommandEpsSwitchName,
+      (uint16_t)PacketComm::TypeId::CommandEpsSwitchStatus,
+      (uint16_t)PacketComm::TypeId::CommandObcSendBeacon,
+  };
+  uint32_t state = 1;
+  for (auto &packet : trace) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    uint32_t share = state % 100;
+    if (share < 60) {
+      packet = {(uint8_t)NODES::GROUND_NODE_ID,
+                (uint16_t)PacketComm::TypeId::DataObcBeacon, -1};
+    } else if (share < 90) {
+      packet = {(uint8_t)NODES::TEENSY_NODE_ID,
+                commands[(state >> 8) % 5], (int16_t)((state >> 16) % 16)};
+    } else {
+      packet = {(uint8_t)NODES::RPI_NODE_ID,
+                (uint16_t)PacketComm::TypeId::CommandCameraCapture, 0};
+    }
+  }
+
+  dispatched = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t pass = 0; pass < TRACE_PASSES; pass++) {
+    for (const auto &packet : trace) {
+      Router::route_handler handler =
+          routes.find(packet.node, packet.type, packet.subkey);
+      if (handler != nullptr) {
+        handler();
+      }
+    }
+  }
+  auto     table_time = std::chrono::steady_clock::now() - start;
+  uint32_t table      = dispatched;
+
+  dispatched = 0;
+  start      = std::chrono::steady_clock::now();
+  for (uint32_t pass = 0; pass < TRACE_PASSES; pass++) {
+    for (const auto &packet : trace) {
+      switch_dispatch(packet);
+    }
+  }
+  auto     switch_time = std::chrono::steady_clock::now() - start;
+  uint32_t switched    = dispatched;
+
+  char message[128];
+  snprintf(message, sizeof(message),
+           "route table: %.1f ns/packet; nested switch: %.1f ns/packet",
+           std::chrono::duration<double, std::nano>(table_time).count() /
+               (TRACE_PACKETS * TRACE_PASSES),
+           std::chrono::duration<double, std::nano>(switch_time).count() /
+               (TRACE_PACKETS * TRACE_PASSES));
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL(switched, table);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_specific_routes);
+  RUN_TEST(test_top_values_are_not_wildcards);
+  RUN_TEST(test_top_type_bit);
+  RUN_TEST(test_fallbacks);
+  RUN_TEST(test_matches_linear_scan);
+  RUN_TEST(test_dispatch_benchmark);
+  return UNITY_END();
+}
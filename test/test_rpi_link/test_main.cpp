@@ -0,0 +1,283 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the Raspberry Pi link's baud negotiation.
+ *
+ * The link is stepped a millisecond at a time against a stand-in Pi that
+ * answers baud requests at its current rate and then switches, answers pings,
+ * and falls back to RPI_BASE_BAUD if no ping arrives within
+ * RPI_BAUD_PROBATION of a switch. Everything sent either way arrives after
+ * RPI_LINK_DELAY, and only if both ends are at the rate it was sent at, and
+ * the wire carries that rate.
+ */
+#include <deque>
+#include <rpi_link.h>
+#include <unity.h>
+
+/** @brief The time, in milliseconds, a message takes to arrive. */
+#define RPI_LINK_DELAY 10
+/** @brief The fastest baud rate on the ladder. */
+#define RPI_TOP_BAUD   921600
+
+/** @brief The messages sent between the Teensy and the stand-in Pi. */
+enum class Message { BaudRequest, BaudReply, Ping, Pong };
+
+/** @brief A message on its way, the rate it was sent at, and its arrival. */
+struct InFlight {
+  uint32_t arrives;
+  uint32_t baud;
+  Message  message;
+  /** @brief The baud rate requested or agreed to. */
+  uint32_t value;
+};
+
+/** @brief A stand-in Raspberry Pi. */
+struct StandIn {
+  /** @brief The baud rate the stand-in runs at. */
+  uint32_t baud      = RPI_BASE_BAUD;
+  /** @brief The fastest baud rate the stand-in agrees to. */
+  uint32_t agree_max = RPI_TOP_BAUD;
+  /** @brief The fastest baud rate the wire carries. */
+  uint32_t wire_max  = RPI_TOP_BAUD;
+  /** @brief Whether the stand-in answers baud requests at all. */
+  bool     answers   = true;
+  /** @brief The time, in milliseconds, the stand-in last switched rate. */
+  uint32_t switched  = 0;
+  /** @brief Whether a ping has arrived since the last switch. */
+  bool     pinged    = true;
+  /** @brief The number of baud requests the Teensy sent. */
+  uint32_t requests  = 0;
+  /** @brief The number of times the Teensy switched its serial port. */
+  uint32_t switches  = 0;
+  /** @brief The number of messages lost to a rate mismatch. */
+  uint32_t garbled   = 0;
+};
+
+/** @brief The Teensy's serial port to the stand-in. */
+static HardwareSerial       port;
+/** @brief The stand-in Pi. */
+static StandIn              pi;
+/** @brief The messages on their way to the stand-in. */
+static std::deque<InFlight> to_pi;
+/** @brief The messages on their way to the Teensy. */
+static std::deque<InFlight> to_teensy;
+
+/** @brief Send the stand-in a baud request, at the port's rate. */
+static bool send_request(uint32_t baud) {
+  pi.requests++;
+  to_pi.push_back(
+      {millis() + RPI_LINK_DELAY, port.baud, Message::BaudRequest, baud});
+  return true;
+}
+
+/** @brief Ping the stand-in, at the port's rate. */
+static bool send_ping() {
+  to_pi.push_back({millis() + RPI_LINK_DELAY, port.baud, Message::Ping, 0});
+  return true;
+}
+
+/** @brief Count a switch of the Teensy's serial port. */
+static void count_switch() { pi.switches++; }
+
+void setUp(void) {
+  reset_time();
+  port.begin(RPI_BASE_BAUD);
+  pi = StandIn();
+  to_pi.clear();
+  to_teensy.clear();
+}
+
+void tearDown(void) {}
+
+/** @brief Whether a message sent at a rate gets through to a receiver. */
+static bool gets_through(const InFlight &sent, uint32_t baud) {
+  if (sent.baud == baud && sent.baud <= pi.wire_max) {
+    return true;
+  }
+  pi.garbled++;
+  return false;
+}
+
+/** @brief Let a millisecond pass on both ends of the link. */
+static void step(RpiLink &link) {
+  advance_millis(1);
+  uint32_t now = millis();
+  while (!to_teensy.empty() && to_teensy.front().arrives <= now) {
+    InFlight sent = to_teensy.front();
+    to_teensy.pop_front();
+    if (!gets_through(sent, port.baud)) {
+      link.error();
+    } else if (sent.message == Message::Pong) {
+      link.pong();
+    } else {
+      link.baud_reply(sent.value);
+    }
+  }
+  link.update();
+
+  while (!to_pi.empty() && to_pi.front().arrives <= now) {
+    InFlight sent = to_pi.front();
+    to_pi.pop_front();
+    if (!gets_through(sent, pi.baud)) {
+      continue;
+    }
+    if (sent.message == Message::Ping) {
+      pi.pinged = true;
+      to_teensy.push_back({now + RPI_LINK_DELAY, pi.baud, Message::Pong, 0});
+    } else if (pi.answers) {
+      uint32_t agreed = sent.value <= pi.agree_max ? sent.value : 0;
+      to_teensy.push_back(
+          {now + RPI_LINK_DELAY, pi.baud, Message::BaudReply, agreed});
+      if (agreed != 0 && agreed != pi.baud) {
+        pi.baud     = agreed;
+        pi.switched = now;
+        pi.pinged   = agreed == RPI_BASE_BAUD;
+      }
+    }
+  }
+  if (!pi.pinged && now - pi.switched >= RPI_BAUD_PROBATION) {
+    pi.baud   = RPI_BASE_BAUD;
+    pi.pinged = true;
+  }
+}
+
+/**
+ * @brief Step until the link is steady, or a time limit passes.
+ *
+ * @return The time, in milliseconds, it took.
+ */
+static uint32_t run_until_steady(RpiLink &link, uint32_t limit) {
+  uint32_t start = millis();
+  while (!link.steady() && millis() - start < limit) {
+    step(link);
+  }
+  TEST_ASSERT_TRUE(link.steady());
+  return millis() - start;
+}
+
+/** @brief Check both ends run at a rung of the ladder. */
+static void check_rung(const RpiLink &link, uint8_t rung) {
+  TEST_ASSERT_EQUAL(rung, link.rung());
+  TEST_ASSERT_EQUAL(RpiLink::BAUD_LADDER[rung], link.baud());
+  TEST_ASSERT_EQUAL(link.baud(), port.baud);
+  TEST_ASSERT_EQUAL(link.baud(), pi.baud);
+}
+
+/**
+ * @brief A Pi that agrees to the top rate is there after one request and
+ * one ping.
+ */
+void test_agree(void) {
+  RpiLink link(port, send_request, send_ping, count_switch);
+  link.negotiate();
+  TEST_ASSERT_TRUE(link.state() == RpiLinkState::AwaitingBaud);
+  uint32_t time = run_until_steady(link, RPI_REPLY_TIMEOUT);
+  check_rung(link, RPI_BAUD_RUNGS - 1);
+  TEST_ASSERT_EQUAL(1, pi.requests);
+  TEST_ASSERT_EQUAL(1, pi.switches);
+  TEST_ASSERT_LESS_OR_EQUAL(4 * RPI_LINK_DELAY + 2, time);
+}
+
+/**
+ * @brief A Pi that refuses the faster rates is asked for each rung down in
+ * turn, straight after each refusal, until it agrees.
+ */
+void test_refuse(void) {
+  pi.agree_max = 230400;
+  RpiLink link(port, send_request, send_ping, count_switch);
+  link.negotiate();
+  uint32_t time = run_until_steady(link, RPI_REPLY_TIMEOUT);
+  check_rung(link, 2);
+  TEST_ASSERT_EQUAL(3, pi.requests);
+  TEST_ASSERT_EQUAL(1, pi.switches);
+  TEST_ASSERT_LESS_OR_EQUAL(8 * RPI_LINK_DELAY + 4, time);
+}
+
+/**
+ * @brief A Pi that never answers a baud request leaves each rung after
+ * RPI_REPLY_TIMEOUT, and the link stays at RPI_BASE_BAUD without switching.
+ */
+void test_timeout(void) {
+  pi.answers = false;
+  RpiLink link(port, send_request, send_ping, count_switch);
+  link.negotiate();
+  uint32_t time = run_until_steady(link, RPI_BAUD_RUNGS * RPI_REPLY_TIMEOUT);
+  check_rung(link, 0);
+  TEST_ASSERT_EQUAL(RPI_BAUD_RUNGS - 1, pi.requests);
+  TEST_ASSERT_EQUAL(0, pi.switches);
+  TEST_ASSERT_EQUAL((RPI_BAUD_RUNGS - 1) * RPI_REPLY_TIMEOUT, time);
+}
+
+/**
+ * @brief A rate the wire cannot carry is agreed to, but its ping goes
+ * unanswered, so both ends fall back to RPI_BASE_BAUD, and the next rung
+ * down is only asked for once the Pi has fallen back too.
+ */
+void test_no_pong(void) {
+  pi.wire_max = 230400;
+  RpiLink link(port, send_request, send_ping, count_switch);
+  link.negotiate();
+  uint32_t time = run_until_steady(
+      link, RPI_BAUD_RUNGS * (RPI_REPLY_TIMEOUT + RPI_BAUD_PROBATION));
+  check_rung(link, 2);
+  TEST_ASSERT_EQUAL(3, pi.requests);
+  // Two failed switches, each followed by a fall back, then the one held.
+  TEST_ASSERT_EQUAL(5, pi.switches);
+  TEST_ASSERT_GREATER_THAN(0, pi.garbled);
+  TEST_ASSERT_GREATER_OR_EQUAL(2 * (RPI_REPLY_TIMEOUT + RPI_BAUD_PROBATION),
+                               time);
+  TEST_ASSERT_LESS_OR_EQUAL(
+      2 * (RPI_REPLY_TIMEOUT + RPI_BAUD_PROBATION) + 8 * RPI_LINK_DELAY,
+      time);
+}
+
+/**
+ * @brief Up to RPI_MAX_ERRORS in an RPI_ERROR_WINDOW are tolerated. More
+ * lower the ceiling for good: both ends fall back, and after
+ * RPI_BAUD_PROBATION the link settles a rung below, where it stays when it
+ * is negotiated again.
+ */
+void test_error_fallback(void) {
+  RpiLink link(port, send_request, send_ping, count_switch);
+  link.negotiate();
+  run_until_steady(link, RPI_REPLY_TIMEOUT);
+  check_rung(link, RPI_BAUD_RUNGS - 1);
+
+  for (uint32_t ms = 0; ms < RPI_ERROR_WINDOW; ms++) {
+    if (ms < RPI_MAX_ERRORS) {
+      link.error();
+    }
+    step(link);
+    TEST_ASSERT_TRUE(link.steady());
+  }
+
+  for (uint32_t n = 0; n <= RPI_MAX_ERRORS; n++) {
+    link.error();
+  }
+  uint32_t start = millis();
+  while (link.steady() && millis() - start <= RPI_ERROR_WINDOW) {
+    step(link);
+  }
+  TEST_ASSERT_TRUE(link.state() == RpiLinkState::Probation);
+  TEST_ASSERT_EQUAL(RPI_BASE_BAUD, port.baud);
+  uint32_t time = run_until_steady(link, 2 * RPI_BAUD_PROBATION);
+  TEST_ASSERT_GREATER_OR_EQUAL(RPI_BAUD_PROBATION, time);
+  check_rung(link, RPI_BAUD_RUNGS - 2);
+
+  // The Pi reboots, and listens at the base rate again.
+  pi.baud = RPI_BASE_BAUD;
+  link.reset();
+  check_rung(link, 0);
+  link.negotiate();
+  run_until_steady(link, RPI_REPLY_TIMEOUT);
+  check_rung(link, RPI_BAUD_RUNGS - 2);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_agree);
+  RUN_TEST(test_refuse);
+  RUN_TEST(test_timeout);
+  RUN_TEST(test_no_pong);
+  RUN_TEST(test_error_fallback);
+  return UNITY_END();
+}
@@ -0,0 +1,292 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the Raspberry Pi power session.
+ *
+ * The session is stepped a millisecond at a time against a stand-in Pi that
+ * takes a while to boot, then sends a heartbeat every second and answers
+ * pings, and on a halt takes a while to shut down before it acknowledges it.
+ * Everything sent either way arrives after RPI_LINK_DELAY.
+ */
+#include <deque>
+#include <rpi_session.h>
+#include <unity.h>
+
+/** @brief The time, in milliseconds, a message takes to arrive. */
+#define RPI_LINK_DELAY      10
+/** @brief The time, in milliseconds, between the stand-in's heartbeats. */
+#define RPI_HEARTBEAT_TIME  (1 * SECONDS)
+/** @brief The number of random boot and halt times tried. */
+#define RPI_SESSION_RUNS    50
+
+/** @brief The messages sent between the Teensy and the stand-in Pi. */
+enum class Message { Ping, Halt, Pong, Heartbeat, HaltAck };
+
+/** @brief A message on its way, and the time it arrives. */
+struct InFlight {
+  uint32_t arrives;
+  Message  message;
+};
+
+/** @brief The state of the xorshift generator making boot and halt times. */
+static uint32_t state;
+
+void setUp(void) {
+  state = 1;
+  reset_time();
+}
+
+void tearDown(void) {}
+
+/** @brief The next number from the xorshift generator. */
+static uint32_t next_random() {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/**
+ * @brief A stand-in Raspberry Pi, and the session and link driving it, the
+ * way the RPi channel does from its loop.
+ */
+struct Bench {
+  RpiSession           session;
+  std::deque<InFlight> to_pi;
+  std::deque<InFlight> to_teensy;
+  /** @brief The time, in milliseconds, the stand-in takes to boot. */
+  uint32_t             boot_time;
+  /** @brief The time, in milliseconds, the stand-in takes to shut down. */
+  uint32_t             halt_time;
+  /** @brief Whether the stand-in has hung, and stays silent. */
+  bool                 hung      = false;
+  bool                 powered   = false;
+  bool                 halting   = false;
+  bool                 acked     = false;
+  uint32_t             booted_at = 0;
+  uint32_t             halt_at   = 0;
+  uint32_t             last_beat = 0;
+  uint32_t             pings     = 0;
+  uint32_t             halts     = 0;
+
+  Bench(uint32_t boot_time, uint32_t halt_time)
+      : boot_time(boot_time), halt_time(halt_time) {}
+
+  /** @brief Whether the stand-in has booted and talks. */
+  bool up() const {
+    return powered && !hung && !acked && millis() >= booted_at;
+  }
+
+  /** @brief Let a millisecond pass on both ends of the link. */
+  void step() {
+    advance_millis(1);
+    uint32_t now = millis();
+    while (!to_teensy.empty() && to_teensy.front().arrives <= now) {
+      Message message = to_teensy.front().message;
+      to_teensy.pop_front();
+      session.heard();
+      if (message == Message::HaltAck) {
+        session.halt_acknowledged();
+      }
+    }
+    session.update();
+    if (session.contact_due()) {
+      bool halt = session.state() == RpiState::ShuttingDown;
+      to_pi.push_back(
+          {now + RPI_LINK_DELAY, halt ? Message::Halt : Message::Ping});
+      halt ? halts++ : pings++;
+    }
+
+    if (session.powered() && !powered) {
+      powered   = true;
+      halting   = false;
+      acked     = false;
+      booted_at = now + boot_time;
+      last_beat = 0;
+    }
+    powered = session.powered();
+    while (!to_pi.empty() && to_pi.front().arrives <= now) {
+      Message message = to_pi.front().message;
+      to_pi.pop_front();
+      if (!up()) {
+        continue;
+      }
+      if (message == Message::Ping) {
+        to_teensy.push_back({now + RPI_LINK_DELAY, Message::Pong});
+      } else if (!halting) {
+        halting = true;
+        halt_at = now;
+      }
+    }
+    if (!up()) {
+      return;
+    }
+    if (halting) {
+      if (now - halt_at >= halt_time) {
+        to_teensy.push_back({now + RPI_LINK_DELAY, Message::HaltAck});
+        acked = true;
+      }
+    } else if (last_beat == 0 || now - last_beat >= RPI_HEARTBEAT_TIME) {
+      last_beat = now;
+      to_teensy.push_back({now + RPI_LINK_DELAY, Message::Heartbeat});
+    }
+  }
+
+  /**
+   * @brief Step until the session reaches a state, or a time limit passes.
+   *
+   * @return The time, in milliseconds, it took.
+   */
+  uint32_t run_until(RpiState wanted, uint32_t limit) {
+    uint32_t start = millis();
+    while (session.state() != wanted && millis() - start < limit) {
+      step();
+    }
+    TEST_ASSERT_TRUE(session.state() == wanted);
+    return millis() - start;
+  }
+
+  /** @brief Step for a number of milliseconds. */
+  void run_for(uint32_t time) {
+    for (uint32_t n = 0; n < time; n++) {
+      step();
+    }
+  }
+
+  /** @brief Step past RPI_MIN_OFF_TIME and power the stand-in. */
+  void start() {
+    run_for(RPI_MIN_OFF_TIME);
+    TEST_ASSERT_TRUE(session.power_on());
+  }
+};
+
+/**
+ * @brief The session is ready within a ping of the Pi finishing its boot,
+ * however long the boot takes, and cuts the power within a couple of link
+ * delays of the Pi acknowledging a halt, rather than after a fixed time.
+ */
+void test_boot_and_halt(void) {
+  uint32_t worst_ready = 0;
+  uint32_t worst_off   = 0;
+  double   total_ready = 0;
+  double   total_off   = 0;
+  for (size_t run = 0; run < RPI_SESSION_RUNS; run++) {
+    Bench bench(10 * SECONDS + next_random() % (30 * SECONDS),
+                1 * SECONDS + next_random() % (8 * SECONDS));
+    bench.start();
+    uint32_t ready = bench.run_until(RpiState::Ready, RPI_BOOT_TIMEOUT);
+    TEST_ASSERT_GREATER_OR_EQUAL(bench.boot_time, ready);
+    worst_ready  = std::max(worst_ready, ready - bench.boot_time);
+    total_ready += ready - bench.boot_time;
+
+    bench.run_for(next_random() % (30 * SECONDS));
+    bench.session.halt();
+    uint32_t off = bench.run_until(RpiState::Off, RPI_HALT_TIMEOUT);
+    TEST_ASSERT_GREATER_OR_EQUAL(bench.halt_time, off);
+    worst_off  = std::max(worst_off, off - bench.halt_time);
+    total_off += off - bench.halt_time;
+    TEST_ASSERT_FALSE(bench.powered);
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(RPI_BOOT_PING_INTERVAL + 2 * RPI_LINK_DELAY + 1,
+                            worst_ready);
+  TEST_ASSERT_LESS_OR_EQUAL(RPI_HALT_INTERVAL + 2 * RPI_LINK_DELAY + 1,
+                            worst_off);
+
+  char message[160];
+  snprintf(message, sizeof(message),
+           "Ready %.0f ms (worst %u ms) after boot; power cut %.0f ms (worst "
+           "%u ms) after shutdown, against a fixed %u ms",
+           total_ready / RPI_SESSION_RUNS, worst_ready,
+           total_off / RPI_SESSION_RUNS, worst_off, RPI_HALT_TIMEOUT);
+  TEST_MESSAGE(message);
+}
+
+/**
+ * @brief A Pi that never boots is pinged every RPI_BOOT_PING_INTERVAL, and
+ * its power is cut after RPI_BOOT_TIMEOUT.
+ */
+void test_boot_timeout(void) {
+  Bench bench(RPI_BOOT_TIMEOUT * 2, 0);
+  bench.start();
+  uint32_t off = bench.run_until(RpiState::Off, RPI_BOOT_TIMEOUT + 10);
+  TEST_ASSERT_EQUAL(RPI_BOOT_TIMEOUT, off);
+  TEST_ASSERT_EQUAL(RPI_BOOT_TIMEOUT / RPI_BOOT_PING_INTERVAL, bench.pings);
+  TEST_ASSERT_FALSE(bench.powered);
+}
+
+/**
+ * @brief A Pi that never acknowledges a halt is sent one every
+ * RPI_HALT_INTERVAL, and its power is cut after RPI_HALT_TIMEOUT.
+ */
+void test_halt_timeout(void) {
+  Bench bench(5 * SECONDS, RPI_HALT_TIMEOUT * 2);
+  bench.start();
+  bench.run_until(RpiState::Ready, RPI_BOOT_TIMEOUT);
+  bench.session.halt();
+  uint32_t off = bench.run_until(RpiState::Off, RPI_HALT_TIMEOUT + 10);
+  TEST_ASSERT_EQUAL(RPI_HALT_TIMEOUT, off);
+  TEST_ASSERT_EQUAL(RPI_HALT_TIMEOUT / RPI_HALT_INTERVAL, bench.halts);
+}
+
+/**
+ * @brief A ready Pi sending heartbeats is left alone, a quiet one is pinged
+ * every RPI_QUIET_TIME, and one silent for RPI_SILENCE_TIMEOUT is taken to
+ * be booting, and is ready again once it answers.
+ */
+void test_silence(void) {
+  Bench bench(5 * SECONDS, 0);
+  bench.start();
+  bench.run_until(RpiState::Ready, RPI_BOOT_TIMEOUT);
+  uint32_t pings = bench.pings;
+  bench.run_for(60 * SECONDS);
+  TEST_ASSERT_EQUAL(pings, bench.pings);
+  TEST_ASSERT_TRUE(bench.session.ready());
+
+  bench.hung = true;
+  uint32_t silent = bench.run_until(RpiState::Booting, RPI_SILENCE_TIMEOUT);
+  TEST_ASSERT_LESS_OR_EQUAL(RPI_SILENCE_TIMEOUT, silent);
+  TEST_ASSERT_GREATER_THAN(RPI_SILENCE_TIMEOUT - RPI_HEARTBEAT_TIME, silent);
+  // One ping per RPI_QUIET_TIME of silence, the last the first boot ping.
+  TEST_ASSERT_EQUAL(RPI_SILENCE_TIMEOUT / RPI_QUIET_TIME, bench.pings - pings);
+
+  bench.hung = false;
+  uint32_t ready = bench.run_until(RpiState::Ready, RPI_BOOT_TIMEOUT);
+  TEST_ASSERT_LESS_OR_EQUAL(RPI_BOOT_PING_INTERVAL + 2 * RPI_LINK_DELAY,
+                            ready);
+}
+
+/**
+ * @brief The Pi is left off for RPI_MIN_OFF_TIME, after the Teensy starts
+ * and after every power cut, and a halt for a Pi that is off is ignored.
+ */
+void test_min_off_time(void) {
+  Bench bench(5 * SECONDS, 1 * SECONDS);
+  TEST_ASSERT_FALSE(bench.session.power_on());
+  bench.session.halt();
+  TEST_ASSERT_TRUE(bench.session.state() == RpiState::Off);
+  bench.run_for(RPI_MIN_OFF_TIME - 1);
+  TEST_ASSERT_FALSE(bench.session.power_on());
+  bench.step();
+  TEST_ASSERT_TRUE(bench.session.power_on());
+  TEST_ASSERT_TRUE(bench.session.power_on());
+
+  bench.run_until(RpiState::Ready, RPI_BOOT_TIMEOUT);
+  bench.session.halt();
+  bench.run_until(RpiState::Off, RPI_HALT_TIMEOUT);
+  uint32_t refused = 0;
+  while (!bench.session.power_on()) {
+    refused++;
+    bench.step();
+  }
+  TEST_ASSERT_EQUAL(RPI_MIN_OFF_TIME, refused);
+  TEST_ASSERT_TRUE(bench.session.state() == RpiState::Booting);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_boot_and_halt);
+  RUN_TEST(test_boot_timeout);
+  RUN_TEST(test_halt_timeout);
+  RUN_TEST(test_silence);
+  RUN_TEST(test_min_off_time);
+  return UNITY_END();
+}
@@ -0,0 +1,211 @@
+/**
+ * @file test_main.cpp
+ * @brief A throughput benchmark of the RPi link at each baud rate.
+ *
+ * A pseudo-terminal stands in for the serial link. One thread writes SLIP
+ * frames into it the way the RPi channel's flush_to_pi() does: the transmit
+ * ring is topped up to RPI_TX_LOW_WATER, and spans of it are written without
+ * blocking, each no longer than the room the serial port would have at the
+ * line rate. The other thread reads it the way the RPi does, sleeping
+ * RPI_READ_SLEEP between reads, and decodes the frames. This runs in real
+ * time, on a host with pseudo-terminals.
+ */
+#include "config/artemis_defs.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <rpi_link.h>
+#include <slip_decoder.h>
+#include <slip_mux.h>
+#include <slip_tx_ring.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+
+/** @brief The time, in milliseconds, the RPi sleeps between reads. */
+#define RPI_READ_SLEEP      100
+/** @brief The time, in milliseconds, the channel sleeps between writes. */
+#define RPI_WRITE_SLEEP     1
+/** @brief The time, in seconds, each baud rate is measured for. */
+#define RPI_MEASURE_TIME    2.0
+/** @brief The time, in seconds, the base baud rate is measured for. */
+#define RPI_MEASURE_BASE    4.0
+/** @brief The least share of the line rate the link must sustain. */
+#define RPI_MIN_LINE_SHARE  0.85
+
+using steady = std::chrono::steady_clock;
+
+/** @brief The state of the xorshift generator making frame contents. */
+static uint32_t state;
+
+void setUp(void) { state = 1; }
+
+void tearDown(void) {}
+
+/** @brief The next number from the xorshift generator. */
+static uint32_t next_random() {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/** @brief The seconds since a time point. */
+static double seconds_since(steady::time_point start) {
+  return std::chrono::duration<double>(steady::now() - start).count();
+}
+
+/** @brief A pseudo-terminal pair, in raw mode and non-blocking. */
+struct Pty {
+  int teensy = -1;
+  int pi     = -1;
+
+  Pty() {
+    teensy = posix_openpt(O_RDWR | O_NOCTTY);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, teensy);
+    TEST_ASSERT_EQUAL(0, grantpt(teensy));
+    TEST_ASSERT_EQUAL(0, unlockpt(teensy));
+    pi = open(ptsname(teensy), O_RDWR | O_NOCTTY);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, pi);
+    for (int fd : {teensy, pi}) {
+      termios settings;
+      tcgetattr(fd, &settings);
+      cfmakeraw(&settings);
+      tcsetattr(fd, TCSANOW, &settings);
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+    }
+  }
+
+  ~Pty() {
+    close(pi);
+    close(teensy);
+  }
+};
+
+/** @brief What the RPi received at one baud rate. */
+struct link_result {
+  /** @brief The frame bytes decoded per second. */
+  double   rate;
+  /** @brief The number of frames decoded. */
+  uint32_t frames;
+  /** @brief The number of frames missing from the sequence. */
+  uint32_t gaps;
+  /** @brief The number of malformed frames. */
+  uint32_t errors;
+};
+
+/**
+ * @brief Send frames over a pseudo-terminal paced to a baud rate, for a
+ * time, and decode them at the other end.
+ *
+ * Each frame starts with its sequence number, so lost frames show up as gaps.
+ */
+static link_result measure(uint32_t baud, double duration) {
+  Pty                       pty;
+  std::atomic<bool>         stop{false};
+  std::thread               teensy([&] {
+    SlipTxRing<RPI_TX_RING> ring;
+    uint8_t                 frame[SLIP_MUX_FRAME];
+    uint32_t                seq     = 0;
+    double                  line    = baud / 10.0;
+    double                  written = 0;
+    steady::time_point      start   = steady::now();
+    while (!stop) {
+      while (ring.size() < RPI_TX_LOW_WATER) {
+        memcpy(frame, &seq, sizeof(seq));
+        for (size_t i = sizeof(seq); i < sizeof(frame); i++) {
+          frame[i] = next_random();
+        }
+        if (!ring.push(frame, sizeof(frame))) {
+          break;
+        }
+        seq++;
+      }
+      // The room the serial port has once it has sent at the line rate.
+      size_t         room = seconds_since(start) * line - written;
+      const uint8_t *data;
+      size_t         length;
+      while (room > 0 && (length = ring.span(data)) > 0) {
+        ssize_t sent = write(pty.teensy, data, std::min(length, room));
+        if (sent <= 0) {
+          break;
+        }
+        ring.consume(sent);
+        room    -= sent;
+        written += sent;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(RPI_WRITE_SLEEP));
+    }
+  });
+
+  SlipDecoder          decoder(SLIP_MUX_FRAME);
+  std::vector<uint8_t> frame;
+  link_result          result   = {};
+  uint32_t             expected = 0;
+  size_t               bytes    = 0;
+  uint8_t              buffer[RPI_RX_CHUNK];
+  steady::time_point   start    = steady::now();
+  while (seconds_since(start) < duration) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(RPI_READ_SLEEP));
+    ssize_t got;
+    while ((got = read(pty.pi, buffer, sizeof(buffer))) > 0) {
+      size_t offset = 0;
+      while (offset < (size_t)got) {
+        size_t     consumed;
+        SlipStatus status  = decoder.decode(&buffer[offset], got - offset,
+                                            consumed, frame);
+        offset            += consumed;
+        if (status != SlipStatus::Frame) {
+          continue;
+        }
+        uint32_t seq;
+        memcpy(&seq, frame.data(), sizeof(seq));
+        if (seq != expected) {
+          result.gaps++;
+        }
+        expected = seq + 1;
+        result.frames++;
+        bytes += frame.size();
+        frame.clear();
+      }
+    }
+  }
+  result.rate   = bytes / seconds_since(start);
+  result.errors = decoder.errors();
+  stop          = true;
+  teensy.join();
+  return result;
+}
+
+/**
+ * @brief At every rung of the baud ladder, the link sustains most of the line
+ * rate with the RPi reading only every RPI_READ_SLEEP, and loses or garbles
+ * no frame. Reports the rate at each.
+ */
+void test_link_throughput(void) {
+  for (uint8_t rung = 0; rung < RPI_BAUD_RUNGS; rung++) {
+    uint32_t    baud   = RpiLink::BAUD_LADDER[rung];
+    link_result result = measure(baud, rung == 0 ? RPI_MEASURE_BASE
+                                                 : RPI_MEASURE_TIME);
+    double      share  = result.rate / (baud / 10.0);
+    TEST_ASSERT_EQUAL(0, result.gaps);
+    TEST_ASSERT_EQUAL(0, result.errors);
+    TEST_ASSERT_GREATER_THAN(0, result.frames);
+    TEST_ASSERT_TRUE(share >= RPI_MIN_LINE_SHARE);
+
+    char message[120];
+    snprintf(message, sizeof(message),
+             "%6u baud: %.1f KB/s sustained, %.0f%% of line rate, %u frames",
+             baud, result.rate / 1e3, 100 * share, result.frames);
+    TEST_MESSAGE(message);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_link_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,271 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests and a throughput benchmark of the streaming SLIP decoder.
+ *
+ * Frames are SLIP-encoded into a stream, then fed to the decoder in pieces
+ * of every size, as they would come off the RPi's serial port.
+ */
+#include <chrono>
+#include <slip_decoder.h>
+#include <unity.h>
+
+/** @brief The byte that ends every frame. */
+#define END     0xC0
+/** @brief The byte that starts an escape sequence. */
+#define ESC     0xDB
+/** @brief The escaped form of END. */
+#define ESC_END 0xDC
+/** @brief The escaped form of ESC. */
+#define ESC_ESC 0xDD
+
+/** @brief The number of frames in the benchmark stream. */
+#define BENCHMARK_FRAMES 2000
+/** @brief The number of times the benchmark stream is decoded. */
+#define BENCHMARK_PASSES 20
+
+using bytes = std::vector<uint8_t>;
+
+/** @brief The state of the xorshift generator making frame contents. */
+static uint32_t state;
+
+void setUp(void) { state = 1; }
+
+void tearDown(void) {}
+
+/** @brief The next number from the xorshift generator. */
+static uint32_t next_random() {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/** @brief Append a SLIP-encoded frame, with an END before and after it. */
+static void encode(const bytes &frame, bytes &stream) {
+  stream.push_back(END);
+  for (uint8_t byte : frame) {
+    if (byte == END) {
+      stream.insert(stream.end(), {ESC, ESC_END});
+    } else if (byte == ESC) {
+      stream.insert(stream.end(), {ESC, ESC_ESC});
+    } else {
+      stream.push_back(byte);
+    }
+  }
+  stream.push_back(END);
+}
+
+/**
+ * @brief A frame of random bytes, with one in escape_every an END or ESC.
+ */
+static bytes make_frame(size_t size, uint32_t escape_every) {
+  bytes frame(size);
+  for (auto &byte : frame) {
+    uint32_t r = next_random();
+    byte       = r % escape_every == 0 ? (r & 0x100 ? END : ESC) : r >> 16;
+  }
+  return frame;
+}
+
+/**
+ * @brief Feed a stream to a decoder in pieces of a given size, collecting
+ * every frame decoded.
+ */
+static std::vector<bytes> feed(SlipDecoder &decoder, const bytes &stream,
+                               size_t piece) {
+  std::vector<bytes> frames;
+  bytes              frame;
+  for (size_t offset = 0; offset < stream.size(); offset += piece) {
+    size_t length = std::min(piece, stream.size() - offset);
+    size_t used   = 0;
+    while (used < length) {
+      size_t     consumed;
+      SlipStatus status =
+          decoder.decode(&stream[offset + used], length - used, consumed,
+                         frame);
+      TEST_ASSERT_LESS_OR_EQUAL(length - used, consumed);
+      used += consumed;
+      if (status == SlipStatus::Frame) {
+        frames.push_back(frame);
+        frame.clear();
+      } else if (status == SlipStatus::Error) {
+        TEST_ASSERT_TRUE(frame.empty());
+      }
+    }
+  }
+  return frames;
+}
+
+/**
+ * @brief Frames full of escapes decode the same however the stream is split,
+ * from a byte at a time up to the whole stream in one read, including splits
+ * between an ESC and the byte it escapes.
+ */
+void test_fragmented_frames(void) {
+  std::vector<bytes> frames;
+  bytes              stream;
+  for (size_t n = 0; n < 20; n++) {
+    frames.push_back(make_frame(1 + n * 13, 4));
+    encode(frames.back(), stream);
+  }
+  frames.push_back({ESC});
+  encode(frames.back(), stream);
+  frames.push_back({END, END, ESC, ESC});
+  encode(frames.back(), stream);
+
+  const size_t pieces[] = {1, 2, 3, 7, 64, 255, stream.size()};
+  for (size_t piece : pieces) {
+    SlipDecoder        decoder;
+    std::vector<bytes> decoded = feed(decoder, stream, piece);
+    TEST_ASSERT_EQUAL(frames.size(), decoded.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+      TEST_ASSERT_EQUAL(frames[i].size(), decoded[i].size());
+      TEST_ASSERT_EQUAL_MEMORY(frames[i].data(), decoded[i].data(),
+                               frames[i].size());
+    }
+    TEST_ASSERT_EQUAL(frames.size(), decoder.frames());
+    TEST_ASSERT_EQUAL(0, decoder.errors());
+  }
+}
+
+/**
+ * @brief Frames sharing a single END between them, or separated by runs of
+ * ENDs, all decode, and the bytes after a completed frame are left for the
+ * next call.
+ */
+void test_back_to_back_frames(void) {
+  const bytes stream = {END, 1, 2, END, 3, END, END, END, 4, ESC, ESC_END,
+                        END};
+  SlipDecoder decoder;
+  bytes       frame;
+  size_t      consumed;
+  TEST_ASSERT_EQUAL(SlipStatus::Frame,
+                    decoder.decode(stream.data(), stream.size(), consumed,
+                                   frame));
+  TEST_ASSERT_EQUAL(4, consumed);
+  TEST_ASSERT_EQUAL(2, frame.size());
+  frame.clear();
+
+  size_t offset = consumed;
+  TEST_ASSERT_EQUAL(SlipStatus::Frame,
+                    decoder.decode(&stream[offset], stream.size() - offset,
+                                   consumed, frame));
+  TEST_ASSERT_EQUAL(2, consumed);
+  TEST_ASSERT_EQUAL(3, frame[0]);
+  frame.clear();
+
+  offset += consumed;
+  TEST_ASSERT_EQUAL(SlipStatus::Frame,
+                    decoder.decode(&stream[offset], stream.size() - offset,
+                                   consumed, frame));
+  TEST_ASSERT_EQUAL(stream.size(), offset + consumed);
+  TEST_ASSERT_EQUAL(2, frame.size());
+  TEST_ASSERT_EQUAL(4, frame[0]);
+  TEST_ASSERT_EQUAL(END, frame[1]);
+  TEST_ASSERT_EQUAL(3, decoder.frames());
+}
+
+/**
+ * @brief Bytes before the first END, and after a reset(), are ignored. A
+ * frame with a bad escape, an END right after an ESC, or too many bytes,
+ * escaped or not, is discarded, and the frame after it still decodes.
+ */
+void test_bad_frames(void) {
+  SlipDecoder decoder(8);
+  bytes       stream = {1, 2, 3};
+  encode({10}, stream);
+  stream.insert(stream.end(), {11, ESC, 0x42, 12, END});
+  encode({13}, stream);
+  stream.insert(stream.end(), {14, ESC, END});
+  encode({15}, stream);
+  encode(bytes(9, 16), stream);
+  encode(bytes(8, 17), stream);
+  encode({18, 19, 20, 21, 22, 23, 24, 25, ESC}, stream);
+  encode({26}, stream);
+
+  for (size_t piece : {(size_t)1, (size_t)5, stream.size()}) {
+    decoder = SlipDecoder(8);
+    std::vector<bytes> decoded = feed(decoder, stream, piece);
+    TEST_ASSERT_EQUAL(5, decoded.size());
+    TEST_ASSERT_EQUAL(10, decoded[0][0]);
+    TEST_ASSERT_EQUAL(13, decoded[1][0]);
+    TEST_ASSERT_EQUAL(15, decoded[2][0]);
+    TEST_ASSERT_EQUAL(8, decoded[3].size());
+    TEST_ASSERT_EQUAL(26, decoded[4][0]);
+    TEST_ASSERT_EQUAL(4, decoder.errors());
+  }
+
+  bytes partial;
+  encode({30, 31}, partial);
+  partial.pop_back();
+  bytes  frame;
+  size_t consumed;
+  TEST_ASSERT_EQUAL(SlipStatus::Incomplete,
+                    decoder.decode(partial.data(), partial.size(), consumed,
+                                   frame));
+  decoder.reset();
+  frame.clear();
+  const bytes rest = {32, END, 33, END};
+  TEST_ASSERT_EQUAL(SlipStatus::Frame,
+                    decoder.decode(rest.data(), rest.size(), consumed, frame));
+  TEST_ASSERT_EQUAL(1, frame.size());
+  TEST_ASSERT_EQUAL(33, frame[0]);
+}
+
+/**
+ * @brief Measures the decoder's throughput on a stream of frames of mixed
+ * sizes, with few escapes as in PacketComm traffic, and with many.
+ */
+void test_throughput(void) {
+  using clock = std::chrono::steady_clock;
+  for (uint32_t escape_every : {256u, 4u}) {
+    bytes  stream;
+    size_t payload = 0;
+    for (size_t n = 0; n < BENCHMARK_FRAMES; n++) {
+      bytes frame = make_frame(16 + next_random() % 1000, escape_every);
+      payload    += frame.size();
+      encode(frame, stream);
+    }
+
+    uint32_t frames = 0;
+    auto     start  = clock::now();
+    for (size_t pass = 0; pass < BENCHMARK_PASSES; pass++) {
+      SlipDecoder decoder;
+      bytes       frame;
+      frame.reserve(SLIP_MAX_FRAME);
+      for (size_t offset = 0; offset < stream.size(); offset += 64) {
+        size_t length = std::min((size_t)64, stream.size() - offset);
+        size_t used   = 0;
+        while (used < length) {
+          size_t consumed;
+          if (decoder.decode(&stream[offset + used], length - used, consumed,
+                             frame) == SlipStatus::Frame) {
+            frames++;
+            frame.clear();
+          }
+          used += consumed;
+        }
+      }
+    }
+    double elapsed =
+        std::chrono::duration<double>(clock::now() - start).count();
+
+    char message[120];
+    snprintf(message, sizeof(message),
+             "One byte in %u escaped: %.0f MB/s of stream, %.2f us per frame",
+             escape_every, BENCHMARK_PASSES * stream.size() / elapsed / 1e6,
+             elapsed * 1e6 / frames);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(BENCHMARK_FRAMES * BENCHMARK_PASSES, frames);
+    TEST_ASSERT_GREATER_THAN(0, payload);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_fragmented_frames);
+  RUN_TEST(test_back_to_back_frames);
+  RUN_TEST(test_bad_frames);
+  RUN_TEST(test_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,312 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the multiplexer of streams over a SLIP link.
+ *
+ * Two multiplexers are connected back to back, frame by frame, with frames
+ * dropped where a test calls for it. The streams are weighted as the RPi link
+ * weights them.
+ */
+#include <slip_mux.h>
+#include <unity.h>
+
+/** @brief The stream of the link's own packets. */
+#define CONTROL        0
+/** @brief The stream of packets for the rest of the satellite. */
+#define PACKETS        1
+/** @brief The stream of file chunks. */
+#define FILES          2
+/** @brief The flag in a frame's header marking the start of a message. */
+#define FIRST          0x20
+/** @brief The flag in a frame's header marking a credit frame. */
+#define CREDIT         0x40
+/**
+ * @brief The number of frames the weights are tested over, the first half
+ * with the control stream saturated.
+ */
+#define SATURATED_RUN  7000
+
+using bytes = std::vector<uint8_t>;
+
+/** @brief The weight of each stream, as the RPi link sets them. */
+static const uint8_t WEIGHTS[SLIP_MUX_STREAMS] = {4, 2, 1};
+
+/** @brief The state of the xorshift generator timing control messages. */
+static uint32_t state;
+
+void setUp(void) { state = 1; }
+
+void tearDown(void) {}
+
+/** @brief The next number from the xorshift generator. */
+static uint32_t next_random() {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/** @brief A message of a given size, its bytes counting up from first. */
+static bytes make_message(size_t size, uint8_t first) {
+  bytes message(size);
+  for (size_t i = 0; i < size; i++) {
+    message[i] = first + i;
+  }
+  return message;
+}
+
+/** @brief Weight a multiplexer's streams as the RPi link does. */
+static void set_weights(SlipMux &mux) {
+  for (uint8_t stream = 0; stream < SLIP_MUX_STREAMS; stream++) {
+    mux.set_weight(stream, WEIGHTS[stream]);
+  }
+}
+
+/**
+ * @brief Move one frame from one multiplexer to the other.
+ *
+ * @param drop Whether the frame is lost on the way.
+ * @return int The first byte of the frame's header, or -1 if there was no
+ * frame to send.
+ */
+static int step(SlipMux &from, SlipMux &to, bool drop = false) {
+  uint8_t frame[SLIP_MUX_FRAME];
+  size_t  size;
+  if (!from.next_frame(frame, size)) {
+    return -1;
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(SLIP_MUX_HEADER, size);
+  TEST_ASSERT_LESS_OR_EQUAL(SLIP_MUX_FRAME, size);
+  if (!drop) {
+    TEST_ASSERT_TRUE(to.receive(frame, size));
+  }
+  return frame[0];
+}
+
+/** @brief Move frames both ways until neither multiplexer has any left. */
+static void settle(SlipMux &a, SlipMux &b) {
+  while (step(a, b) >= 0 || step(b, a) >= 0) {
+  }
+}
+
+/**
+ * @brief Messages of every size up to SLIP_MUX_MAX_MESSAGE arrive whole and
+ * in order on each stream, both ways.
+ */
+void test_round_trip(void) {
+  SlipMux a;
+  SlipMux b;
+  set_weights(a);
+  set_weights(b);
+  const size_t sizes[] = {0,
+                          1,
+                          SLIP_MUX_SEGMENT - 1,
+                          SLIP_MUX_SEGMENT,
+                          SLIP_MUX_SEGMENT + 1,
+                          3 * SLIP_MUX_SEGMENT + 17,
+                          SLIP_MUX_MAX_MESSAGE};
+  for (uint8_t stream = 0; stream < SLIP_MUX_STREAMS; stream++) {
+    for (size_t size : sizes) {
+      bytes message = make_message(size, stream + size);
+      TEST_ASSERT_TRUE(a.send(stream, message.data(), message.size()));
+      TEST_ASSERT_TRUE(b.send(stream, message.data(), message.size()));
+      settle(a, b);
+      for (SlipMux *end : {&a, &b}) {
+        bytes received;
+        TEST_ASSERT_TRUE(end->pop(stream, received));
+        TEST_ASSERT_EQUAL(size, received.size());
+        TEST_ASSERT_EQUAL_MEMORY(message.data(), received.data(), size);
+        TEST_ASSERT_FALSE(end->pop(stream, received));
+      }
+    }
+  }
+  bytes too_long(SLIP_MUX_MAX_MESSAGE + 1);
+  TEST_ASSERT_FALSE(a.send(FILES, too_long.data(), too_long.size()));
+  TEST_ASSERT_FALSE(a.send(SLIP_MUX_STREAMS, too_long.data(), 1));
+  TEST_ASSERT_EQUAL(0, a.errors());
+  TEST_ASSERT_EQUAL(0, b.errors());
+}
+
+/**
+ * @brief With every stream saturated and the receiver keeping up, the
+ * streams share the link 4:2:1, and a control message queued at any moment
+ * waits behind at most one turn of each other stream. Reports the worst
+ * wait, and the multiplexer's static footprint.
+ */
+void test_weights(void) {
+  SlipMux  a;
+  SlipMux  b;
+  set_weights(a);
+  set_weights(b);
+  bytes    full = make_message(4 * SLIP_MUX_SEGMENT, 0);
+  uint32_t frames[SLIP_MUX_STREAMS] = {};
+  uint32_t worst_wait               = 0;
+  uint32_t waits                    = 0;
+  int32_t  waiting_since            = -1;
+  for (int32_t n = 0; n < SATURATED_RUN; n++) {
+    for (uint8_t stream = PACKETS; stream < SLIP_MUX_STREAMS; stream++) {
+      if (a.queued(stream) < 2 * full.size()) {
+        TEST_ASSERT_TRUE(a.send(stream, full.data(), full.size()));
+      }
+    }
+    // The control stream is either saturated too, or gets one short
+    // message at a time.
+    bool saturated = n < SATURATED_RUN / 2;
+    if (saturated && a.queued(CONTROL) < 2 * full.size()) {
+      TEST_ASSERT_TRUE(a.send(CONTROL, full.data(), full.size()));
+    } else if (!saturated && a.queued(CONTROL) == 0 &&
+               next_random() % 4 == 0) {
+      TEST_ASSERT_TRUE(a.send(CONTROL, full.data(), 10));
+      waiting_since = n;
+    }
+
+    int header = step(a, b);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, header);
+    uint8_t stream = header & 0x0F;
+    if (saturated) {
+      frames[stream]++;
+    } else if (stream == CONTROL && waiting_since >= 0) {
+      worst_wait    = std::max<uint32_t>(worst_wait, n - waiting_since);
+      waiting_since = -1;
+      waits++;
+    }
+    bytes message;
+    for (uint8_t s = 0; s < SLIP_MUX_STREAMS; s++) {
+      while (b.pop(s, message)) {
+      }
+    }
+    while (step(b, a) >= 0) {
+    }
+  }
+
+  char text[160];
+  snprintf(text, sizeof(text),
+           "Frames %u:%u:%u, control waits at most %u frames (%u waits), "
+           "%u bytes of static memory",
+           frames[CONTROL], frames[PACKETS], frames[FILES], worst_wait, waits,
+           (unsigned)sizeof(SlipMux));
+  TEST_MESSAGE(text);
+  TEST_ASSERT_UINT32_WITHIN(WEIGHTS[CONTROL], 2 * frames[PACKETS],
+                            frames[CONTROL]);
+  TEST_ASSERT_UINT32_WITHIN(WEIGHTS[CONTROL], 2 * frames[FILES],
+                            frames[PACKETS]);
+  TEST_ASSERT_GREATER_THAN(SATURATED_RUN / 20, waits);
+  TEST_ASSERT_LESS_OR_EQUAL(WEIGHTS[PACKETS] + WEIGHTS[FILES], worst_wait);
+  TEST_ASSERT_LESS_OR_EQUAL(13 * 1024, sizeof(SlipMux));
+  TEST_ASSERT_EQUAL(0, b.errors());
+}
+
+/**
+ * @brief A stream whose receiver stops popping sends a window of segments
+ * and stops, without holding up the other streams. Each message popped
+ * releases its segments, a lost credit frame is made up for by
+ * refresh_credits(), and a stale credit is ignored.
+ */
+void test_credit_window(void) {
+  SlipMux a;
+  SlipMux b;
+  bytes   segment = make_message(SLIP_MUX_SEGMENT, 1);
+  for (uint8_t n = 0; n < SLIP_MUX_WINDOW + 2; n++) {
+    TEST_ASSERT_TRUE(a.send(FILES, segment.data(), segment.size()));
+  }
+  TEST_ASSERT_TRUE(a.send(CONTROL, segment.data(), 10));
+  settle(a, b);
+  TEST_ASSERT_EQUAL(0, a.credits(FILES));
+  TEST_ASSERT_EQUAL(2 * (2 + SLIP_MUX_SEGMENT), a.queued(FILES));
+  TEST_ASSERT_EQUAL(SLIP_MUX_WINDOW - 1, a.credits(CONTROL));
+
+  // Popping a message gives back its segment, and lets one more through.
+  bytes message;
+  TEST_ASSERT_TRUE(b.pop(CONTROL, message));
+  TEST_ASSERT_EQUAL(10, message.size());
+  TEST_ASSERT_TRUE(b.pop(FILES, message));
+  TEST_ASSERT_EQUAL(CREDIT | CONTROL, step(b, a));
+  TEST_ASSERT_EQUAL(CREDIT | FILES, step(b, a));
+  TEST_ASSERT_EQUAL(1, a.credits(FILES));
+  TEST_ASSERT_EQUAL(FIRST | FILES, step(a, b));
+  TEST_ASSERT_EQUAL(-1, step(a, b));
+
+  // The credit for two more pops is lost, and only refreshing it lets the
+  // sender go on.
+  TEST_ASSERT_TRUE(b.pop(FILES, message));
+  TEST_ASSERT_TRUE(b.pop(FILES, message));
+  TEST_ASSERT_EQUAL(CREDIT | FILES, step(b, a, true));
+  TEST_ASSERT_EQUAL(0, a.credits(FILES));
+  b.refresh_credits();
+  while (step(b, a) >= 0) {
+  }
+  TEST_ASSERT_EQUAL(2, a.credits(FILES));
+
+  // A credit for segments never sent is ignored.
+  uint8_t stale[SLIP_MUX_HEADER] = {CREDIT | FILES, 0x80};
+  TEST_ASSERT_TRUE(a.receive(stale, sizeof(stale)));
+  TEST_ASSERT_EQUAL(2, a.credits(FILES));
+
+  settle(a, b);
+  uint8_t popped = 0;
+  while (b.pop(FILES, message)) {
+    TEST_ASSERT_EQUAL_MEMORY(segment.data(), message.data(), segment.size());
+    popped++;
+  }
+  settle(a, b);
+  while (b.pop(FILES, message)) {
+    popped++;
+  }
+  TEST_ASSERT_EQUAL(SLIP_MUX_WINDOW + 2 - 3, popped);
+  TEST_ASSERT_EQUAL(0, a.queued(FILES));
+  TEST_ASSERT_EQUAL(SLIP_MUX_WINDOW, a.credits(FILES));
+}
+
+/**
+ * @brief A lost segment drops the message it belonged to, and the receiver
+ * releases every segment of that message, received or lost, so the
+ * sender's credit comes back although the message is never popped. The
+ * messages after it arrive whole.
+ */
+void test_gap_releases_credit(void) {
+  SlipMux a;
+  SlipMux b;
+  bytes   first  = make_message(5 * SLIP_MUX_SEGMENT, 3);
+  bytes   second = make_message(2 * SLIP_MUX_SEGMENT + 5, 7);
+  bytes   third  = make_message(30, 9);
+  TEST_ASSERT_TRUE(a.send(PACKETS, first.data(), first.size()));
+  TEST_ASSERT_TRUE(a.send(PACKETS, second.data(), second.size()));
+  TEST_ASSERT_TRUE(a.send(PACKETS, third.data(), third.size()));
+
+  // The third segment of the first message, and the last of the second,
+  // are lost.
+  const bool lost[] = {false, false, true,  false, false,
+                       false, false, true,  false};
+  for (bool drop : lost) {
+    TEST_ASSERT_GREATER_OR_EQUAL(0, step(a, b, drop));
+  }
+  TEST_ASSERT_EQUAL(-1, step(a, b));
+  TEST_ASSERT_EQUAL(2, b.errors());
+
+  // Only the third message is waiting, yet every segment but its one is
+  // released.
+  settle(b, a);
+  TEST_ASSERT_EQUAL(SLIP_MUX_WINDOW - 1, a.credits(PACKETS));
+  bytes message;
+  TEST_ASSERT_TRUE(b.pop(PACKETS, message));
+  TEST_ASSERT_EQUAL(third.size(), message.size());
+  TEST_ASSERT_EQUAL_MEMORY(third.data(), message.data(), third.size());
+  TEST_ASSERT_FALSE(b.pop(PACKETS, message));
+  settle(b, a);
+  TEST_ASSERT_EQUAL(SLIP_MUX_WINDOW, a.credits(PACKETS));
+
+  // The stream goes on as before.
+  TEST_ASSERT_TRUE(a.send(PACKETS, first.data(), first.size()));
+  settle(a, b);
+  TEST_ASSERT_TRUE(b.pop(PACKETS, message));
+  TEST_ASSERT_EQUAL_MEMORY(first.data(), message.data(), first.size());
+  TEST_ASSERT_EQUAL(2, b.errors());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_weights);
+  RUN_TEST(test_credit_window);
+  RUN_TEST(test_gap_releases_credit);
+  return UNITY_END();
+}
@@ -0,0 +1,249 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests and a throughput benchmark of the SLIP transmit ring.
+ *
+ * Frames are pushed into small rings so that they wrap around the end of the
+ * buffer, drained in spans the way the RPi channel writes them to its serial
+ * port, and decoded again with the SLIP decoder.
+ */
+#include <chrono>
+#include <slip_decoder.h>
+#include <slip_tx_ring.h>
+#include <unity.h>
+
+/** @brief The byte that ends every frame. */
+#define END     0xC0
+/** @brief The byte that starts an escape sequence. */
+#define ESC     0xDB
+/** @brief The escaped form of END. */
+#define ESC_END 0xDC
+/** @brief The escaped form of ESC. */
+#define ESC_ESC 0xDD
+
+/** @brief The number of frames pushed by the benchmark. */
+#define BENCHMARK_FRAMES 200000
+
+using bytes = std::vector<uint8_t>;
+
+/** @brief The state of the xorshift generator making frame contents. */
+static uint32_t state;
+
+void setUp(void) { state = 1; }
+
+void tearDown(void) {}
+
+/** @brief The next number from the xorshift generator. */
+static uint32_t next_random() {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/**
+ * @brief A frame of random bytes, with one in escape_every an END or ESC.
+ */
+static bytes make_frame(size_t size, uint32_t escape_every) {
+  bytes frame(size);
+  for (auto &byte : frame) {
+    uint32_t r = next_random();
+    byte       = r % escape_every == 0 ? (r & 0x100 ? END : ESC) : r >> 16;
+  }
+  return frame;
+}
+
+/**
+ * @brief Drain a ring through span() and consume(), at most limit bytes per
+ * write, as a serial port that takes only part of a span would.
+ */
+template <size_t Size>
+static bytes drain(SlipTxRing<Size> &ring, size_t limit) {
+  bytes sent;
+  while (!ring.empty()) {
+    const uint8_t *data;
+    size_t         length = ring.span(data);
+    TEST_ASSERT_GREATER_THAN(0, length);
+    length = std::min(length, limit);
+    sent.insert(sent.end(), data, data + length);
+    ring.consume(length);
+  }
+  return sent;
+}
+
+/** @brief Decode every frame in a stream of SLIP-encoded bytes. */
+static std::vector<bytes> decode(const bytes &stream) {
+  SlipDecoder        decoder;
+  std::vector<bytes> frames;
+  bytes              frame;
+  size_t             used = 0;
+  while (used < stream.size()) {
+    size_t consumed;
+    if (decoder.decode(&stream[used], stream.size() - used, consumed,
+                       frame) == SlipStatus::Frame) {
+      frames.push_back(frame);
+      frame.clear();
+    }
+    used += consumed;
+  }
+  TEST_ASSERT_EQUAL(0, decoder.errors());
+  return frames;
+}
+
+/** @brief A frame is escaped between two ENDs, and counted at that size. */
+void test_encoding(void) {
+  SlipTxRing<64> ring;
+  const bytes    frame   = {1, END, 2, ESC, 3};
+  const bytes    encoded = {END, 1, ESC, ESC_END, 2, ESC, ESC_ESC, 3, END};
+  TEST_ASSERT_EQUAL(encoded.size(),
+                    SlipTxRing<64>::encoded_size(frame.data(), frame.size()));
+  TEST_ASSERT_TRUE(ring.push(frame.data(), frame.size()));
+  TEST_ASSERT_EQUAL(encoded.size(), ring.size());
+  TEST_ASSERT_EQUAL(64 - encoded.size(), ring.free());
+
+  const uint8_t *data;
+  TEST_ASSERT_EQUAL(encoded.size(), ring.span(data));
+  TEST_ASSERT_EQUAL_MEMORY(encoded.data(), data, encoded.size());
+  ring.clear();
+  TEST_ASSERT_TRUE(ring.empty());
+  TEST_ASSERT_EQUAL(0, ring.span(data));
+}
+
+/**
+ * @brief A frame that wraps around the end of the ring is drained in two
+ * spans, the first up to the end of the buffer and the second from its start,
+ * and partial writes of either leave the rest for the next span().
+ */
+void test_wraparound(void) {
+  SlipTxRing<32> ring;
+  const bytes    first(20, 7);
+  TEST_ASSERT_TRUE(ring.push(first.data(), first.size()));
+  ring.consume(18);
+  TEST_ASSERT_EQUAL(4, ring.size());
+
+  const bytes second = {8, END, 9, ESC, 10, 11, 12, 13, 14, 15, 16, 17};
+  TEST_ASSERT_TRUE(ring.push(second.data(), second.size()));
+  TEST_ASSERT_EQUAL(4 + 16, ring.size());
+
+  const uint8_t *data;
+  TEST_ASSERT_EQUAL(32 - 18, ring.span(data));
+  TEST_ASSERT_EQUAL(7, data[2]);
+  TEST_ASSERT_EQUAL(END, data[3]);
+  TEST_ASSERT_EQUAL(END, data[4]);
+  TEST_ASSERT_EQUAL(8, data[5]);
+  ring.consume(5);
+  TEST_ASSERT_EQUAL(32 - 18 - 5, ring.span(data));
+  ring.consume(32 - 18 - 5);
+
+  const uint8_t *start;
+  TEST_ASSERT_EQUAL(20 - (32 - 18), ring.span(start));
+  TEST_ASSERT_TRUE(start < data);
+  ring.consume(20 - (32 - 18));
+  TEST_ASSERT_TRUE(ring.empty());
+
+  for (size_t limit : {(size_t)1, (size_t)3, (size_t)13, (size_t)32}) {
+    SlipTxRing<32>     small;
+    std::vector<bytes> frames;
+    bytes              stream;
+    for (size_t n = 0; n < 200; n++) {
+      bytes frame = make_frame(1 + next_random() % 12, 3);
+      while (!small.push(frame.data(), frame.size())) {
+        bytes sent = drain(small, limit);
+        stream.insert(stream.end(), sent.begin(), sent.end());
+      }
+      frames.push_back(frame);
+    }
+    bytes sent = drain(small, limit);
+    stream.insert(stream.end(), sent.begin(), sent.end());
+
+    std::vector<bytes> decoded = decode(stream);
+    TEST_ASSERT_EQUAL(frames.size(), decoded.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+      TEST_ASSERT_EQUAL(frames[i].size(), decoded[i].size());
+      TEST_ASSERT_EQUAL_MEMORY(frames[i].data(), decoded[i].data(),
+                               frames[i].size());
+    }
+  }
+}
+
+/**
+ * @brief When the ring is nearly full, a frame is pushed only if its exact
+ * encoded size fits, however many of its bytes need escaping, and a refused
+ * frame leaves the ring untouched.
+ */
+void test_near_full(void) {
+  SlipTxRing<32> ring;
+  const bytes    filler(20, 1);
+  TEST_ASSERT_TRUE(ring.push(filler.data(), filler.size()));
+  TEST_ASSERT_EQUAL(10, ring.free());
+
+  const bytes escaped = {2, 3, 4, 5, 6, 7, 8, END};
+  TEST_ASSERT_EQUAL(11, SlipTxRing<32>::encoded_size(escaped.data(),
+                                                     escaped.size()));
+  TEST_ASSERT_FALSE(ring.push(escaped.data(), escaped.size()));
+  TEST_ASSERT_EQUAL(10, ring.free());
+
+  const bytes plain = {2, 3, 4, 5, 6, 7, 8, 9};
+  TEST_ASSERT_TRUE(ring.push(plain.data(), plain.size()));
+  TEST_ASSERT_EQUAL(0, ring.free());
+  TEST_ASSERT_FALSE(ring.push(nullptr, 0));
+
+  ring.consume(22);
+  const bytes ends(10, END);
+  TEST_ASSERT_TRUE(ring.push(ends.data(), ends.size()));
+  TEST_ASSERT_EQUAL(0, ring.free());
+
+  std::vector<bytes> decoded = decode(drain(ring, 32));
+  TEST_ASSERT_EQUAL(2, decoded.size());
+  TEST_ASSERT_EQUAL_MEMORY(plain.data(), decoded[0].data(), plain.size());
+  TEST_ASSERT_EQUAL_MEMORY(ends.data(), decoded[1].data(), ends.size());
+}
+
+/**
+ * @brief Measures encode throughput and the time to push and drain one
+ * frame, for frames of mixed sizes with few escapes, as in PacketComm
+ * traffic, and with many.
+ */
+void test_throughput(void) {
+  using clock = std::chrono::steady_clock;
+  static SlipTxRing<4096> ring;
+  for (uint32_t escape_every : {256u, 4u}) {
+    std::vector<bytes> frames;
+    for (size_t n = 0; n < 64; n++) {
+      frames.push_back(make_frame(16 + next_random() % 1000, escape_every));
+    }
+
+    size_t   payload = 0;
+    uint32_t checked = 0;
+    auto     start   = clock::now();
+    for (size_t n = 0; n < BENCHMARK_FRAMES; n++) {
+      const bytes &frame = frames[n % frames.size()];
+      TEST_ASSERT_TRUE(ring.push(frame.data(), frame.size()));
+      payload += frame.size();
+      while (!ring.empty()) {
+        const uint8_t *data;
+        size_t         length = ring.span(data);
+        checked              += data[length - 1];
+        ring.consume(length);
+      }
+    }
+    double elapsed =
+        std::chrono::duration<double>(clock::now() - start).count();
+
+    char message[120];
+    snprintf(message, sizeof(message),
+             "One byte in %u escaped: encode %.0f MB/s, %.2f us per frame",
+             escape_every, payload / elapsed / 1e6,
+             elapsed * 1e6 / BENCHMARK_FRAMES);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_THAN(0, checked);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_encoding);
+  RUN_TEST(test_wraparound);
+  RUN_TEST(test_near_full);
+  RUN_TEST(test_throughput);
+  return UNITY_END();
+}